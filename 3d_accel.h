@@ -52,6 +52,10 @@ THE SOFTWARE.
 
 #define OP_FBHDA_GAMMA_SET    0x1116 /* VXD, DRV, ESCAPE_DRV_NT */
 #define OP_FBHDA_GAMMA_GET    0x1117 /* VXD, DRV, ESCAPE_DRV_NT */
+#define OP_FBHDA_BATCH_FLUSH  0x1118 /* DRV */
+#define OP_FBHDA_PALETTE_SET_RANGE 0x1119 /* VXD, DRV */
+#define OP_FBHDA_PERF_GET     0x111A /* VXD */
+#define OP_FBHDA_FLIP_STATUS  0x111B /* VXD, DRV */
 
 #define OP_SVGA_VALID         0x2000  /* VXD, DRV, ESCAPE_DRV_NT */
 #define OP_SVGA_SETMODE       0x2001  /* DRV */
@@ -72,6 +76,9 @@ THE SOFTWARE.
 #define OP_SVGA_OT_SETUP      0x2010  /* VXD */
 #define OP_SVGA_FLUSHCACHE    0x2011  /* VXD */
 #define OP_SVGA_VXDCMD        0x2012  /* VXD */
+#define OP_SVGA_CAPTURE_SETUP 0x2013  /* VXD */
+#define OP_SVGA_STATS_SETUP   0x2014  /* VXD */
+#define OP_SVGA_TRACE_SNAPSHOT 0x2015 /* VXD */
 
 #define OP_VBE_VALID          0x3000 /* VXD, DRV, ESCAPE_DRV_NT */
 #define OP_VBE_SETMODE        0x3001 /* DRV */
@@ -145,7 +152,7 @@ typedef struct FBHDA
 	         DWORD system_surface;
 	         DWORD palette_update; /* INC by one everytime when the palette is updated */
 	         DWORD gamma_update; /* INC by one everytime when the pallete is updated */
-	         DWORD res4;
+	         DWORD perf_offset; /* FBHDA_perf_t offset from start of FBHDA, 0 = not available */
 	         DWORD res5;
 } FBHDA_t;
 
@@ -161,9 +168,155 @@ typedef struct FBHDA
 #define FB_ACCEL_VMSVGA10_ST  512 /* not used */
 #define FB_BUG_VMWARE_UPDATE 1024
 
+/*
+ * Batched calls from 16-bit driver. Ring is in same shared memory block
+ * as FBHDA (FBHDA_BATCH_OFFSET from start of FBHDA). The driver only
+ * appends records and the VXD process them on next call, on threshold
+ * (OP_FBHDA_BATCH_FLUSH) or from timer when driver is idle.
+ *
+ * Only ACCESS_END and palette changes can wait. ACCESS_BEGIN/RECT are
+ * always direct calls, VXD has to prepare surface (cursor and flip wait,
+ * readback, cursor erase, clear) before the driver draws.
+ */
+#define FBHDA_BATCH_OFFSET  1024
+#define FBHDA_BATCH_RECS    64 /* must be power of 2 */
+#define FBHDA_BATCH_FLUSH   48
+#define FBHDA_BATCH_TIMEOUT 10 /* ms */
+
+#define FBHDA_BATCH_ACCESS_END   1
+#define FBHDA_BATCH_PALETTE_SET  2
+
+typedef struct FBHDA_batch_rec
+{
+	DWORD op;
+	DWORD arg[4];
+} FBHDA_batch_rec_t;
+
+typedef struct FBHDA_batch
+{
+	volatile DWORD head;        /* DRV: next record to write */
+	volatile DWORD tail;        /* VXD: next record to process */
+	volatile DWORD busy;        /* DRV is writing record, don't process from timer */
+	volatile DWORD armed;       /* VXD timer is running, records will be processed */
+	         DWORD flushes;
+	         DWORD records;
+	FBHDA_batch_rec_t rec[FBHDA_BATCH_RECS];
+} FBHDA_batch_t;
+
+/*
+ * Mode validation limits, computed by VXD after device reset (and VRAM
+ * size change). Driver can validate mode without calling VXD.
+ */
+#define FBHDA_MODES_OFFSET 3072
+
+#define FBHDA_BPP_BIT(_bpp) (1UL << ((_bpp) >> 3))
+
+typedef struct FBHDA_modes
+{
+	volatile DWORD serial; /* INC by one everytime when the limits are updated, 0 = not ready */
+	         DWORD bpp_mask;
+	         DWORD max_width;
+	         DWORD max_height;
+	         DWORD max_size;     /* pitch*height have to be lower */
+	         DWORD max_size_low; /* pitch*height limit for bpp < 32 (0 = none) */
+} FBHDA_modes_t;
+
+/* check mode against ready limits (modes->serial != 0), used by VXD and 16-bit driver */
+static inline BOOL FBHDA_mode_limits(const FBHDA_modes_t FBPTR modes, DWORD w, DWORD h, DWORD bpp)
+{
+	DWORD size;
+	
+	if(bpp > 32 || (modes->bpp_mask & FBHDA_BPP_BIT(bpp)) == 0 || (bpp & 7) != 0)
+	{
+		return FALSE;
+	}
+	
+	if(w > modes->max_width || h > modes->max_height)
+	{
+		return FALSE;
+	}
+	
+	size = (((bpp >> 3) * w + (FBHDA_ROW_ALIGN-1)) & (~((DWORD)FBHDA_ROW_ALIGN-1))) * h;
+	if(size >= modes->max_size)
+	{
+		return FALSE;
+	}
+	
+	if(bpp != 32 && modes->max_size_low != 0 && size > modes->max_size_low)
+	{
+		return FALSE;
+	}
+	
+	return TRUE;
+}
+
+/*
+ * Performance counters. Block is in same shared memory as FBHDA
+ * (FBHDA.perf_offset from start of FBHDA), so 16-bit driver can read it
+ * by its FBHDA far pointer and 32-bit applications by FBHDA linear
+ * address (or SVGA_DB.perf). Counters are only incremented by VXD
+ * (without locking, under semaphore of code which is counting) and zeroed
+ * by OP_FBHDA_PERF_GET reset. New counters are always appended, reader
+ * has to check version and cb. 64-bit counters are stored as lo/hi pair,
+ * reader should repeat the read when hi has changed.
+ */
+#define FBHDA_PERF_OFFSET  3584
+#define FBHDA_PERF_VERSION 1
+
+#define FBHDA_PERF_RESET 1
+
+typedef struct FBHDA_perf_u64
+{
+	DWORD lo;
+	DWORD hi;
+} FBHDA_perf_u64_t;
+
+#define FBHDA_PERF_ADD64(_c, _v) \
+	do{ \
+		DWORD _perf_add = (_v); \
+		(_c).lo += _perf_add; \
+		if((_c).lo < _perf_add) (_c).hi++; \
+	}while(0)
+
+typedef struct FBHDA_perf
+{
+	         DWORD cb;      /* sizeof(FBHDA_perf_t) */
+	         DWORD version; /* FBHDA_PERF_VERSION */
+	volatile DWORD resets;  /* INC by one everytime when counters are zeroed */
+	/* command submission */
+	volatile DWORD cmd_submits;    /* SVGA_CMB_submit calls */
+	FBHDA_perf_u64_t cmd_bytes;    /* bytes of submitted commands */
+	volatile DWORD fifo_submits;   /* submitted by FIFO */
+	volatile DWORD cb_submits;     /* submitted by command buffer */
+	volatile DWORD cb_restarts;    /* CB context restarts after error */
+	volatile DWORD fence_waits;    /* SVGA_fence_wait calls */
+	volatile DWORD fence_spins;    /* sync loops in SVGA_fence_wait when fence wasn't passed */
+	/* memory */
+	volatile DWORD cache_hits;     /* region allocation served from spare cache */
+	volatile DWORD cache_misses;
+	/* 2D */
+	FBHDA_perf_u64_t blit16_bytes; /* 16 bpp system surface bytes converted to screen */
+	FBHDA_perf_u64_t blit8_bytes;  /* 8 bpp system surface bytes converted to screen */
+	volatile DWORD cursor_redraws; /* software cursor draws */
+	volatile DWORD mode_sets;
+	volatile DWORD presents;         /* screen updates of damaged area */
+	volatile DWORD presents_deferred; /* access ends collected by present pacing */
+	volatile DWORD flips;            /* asynchronous flips */
+	volatile DWORD flip_waits;       /* flips blocked because all queue entries were pending */
+	volatile DWORD mode_set_last_ms; /* duration of mode sets (mode_sets is count) */
+	volatile DWORD mode_set_max_ms;
+	volatile DWORD mode_set_total_ms;
+} FBHDA_perf_t;
+
+#define FBHDA_SHARED_SIZE (FBHDA_PERF_OFFSET + sizeof(FBHDA_perf_t))
+
 /* for internal use in RING-0 by VXD only */
 BOOL FBHDA_init_hw(); 
 void FBHDA_release_hw();
+void FBHDA_batch_arm();
+void FBHDA_modes_update(DWORD bpp_mask, DWORD max_width, DWORD max_height, DWORD max_size_low);
+extern FBHDA_perf_t *hda_perf;
+DWORD FBHDA_perf_get(void *buf, DWORD size, BOOL reset);
 
 /* for internal use by RING-3 application/driver */
 void FBHDA_load();
@@ -178,14 +331,22 @@ void FBHDA_free();
 #define FBHDA_ACCESS_RAW_BUFFERING 1
 #define FBHDA_ACCESS_MOUSE_MOVE 2
 #define FBHDA_ACCESS_SURFACE_DIRTY 4
+#define FBHDA_ACCESS_SYNC 8 /* present immediately, even when present pacing is enabled */
 
 void FBHDA_access_begin(DWORD flags);
 void FBHDA_access_end(DWORD flags);
 void FBHDA_access_rect(DWORD left, DWORD top, DWORD right, DWORD bottom);
 BOOL FBHDA_swap(DWORD offset);
+/* number of queued flips still reading surface at offset (offset 0 = all queued flips), never blocks */
+DWORD FBHDA_flip_status(DWORD offset);
 void FBHDA_clean();
+void FBHDA_batch_flush();
+/* check mode by limits in shared memory */
+BOOL FBHDA_mode_valid(DWORD w, DWORD h, DWORD bpp);
 void  FBHDA_palette_set(unsigned char index, DWORD rgb);
 DWORD FBHDA_palette_get(unsigned char index);
+/* rgb is array of count entries in 0x00RRGGBB format */
+void  FBHDA_palette_set_range(DWORD start, DWORD count, DWORD FBPTR rgb);
 
 /* return pitch or 0 when failed */
 DWORD FBHDA_overlay_setup(DWORD overlay, DWORD width, DWORD height, DWORD bpp);
@@ -211,6 +372,8 @@ void mouse_hide();
 void mouse_invalidate(); 
 BOOL mouse_blit();
 void mouse_erase();
+BOOL mouse_move_apply();
+void mouse_move_redraw();
 
 #define MOUSE_BUFFER_SIZE 65535
 
@@ -289,10 +452,16 @@ typedef struct SVGA_DB
 	DWORD              *surfaces_map;
 	char                mutexname[64];
 	DWORD               stat_regions_usage;
-	DWORD               pad1;
+	FBHDA_perf_t       *perf; /* same block as FBHDA.perf_offset, read only */
 	DWORD               pad2;
+	/* SVGA3D_DEVCAP_* values (quirks applied), read only, rebuilt after mode set */
+	DWORD              *caps;
+	DWORD               caps_cnt;
+	volatile DWORD      caps_serial; /* INC by one everytime when caps are rebuilt */
 } SVGA_DB_t;
 
+#define SVGA_DB_CAPS_MAX 512
+
 /* internal VXD only */
 BOOL SVGA_init_hw();
 
@@ -306,6 +475,7 @@ BOOL SVGA_valid();
 #define SVGA_CB_DIRTY_SURFACE      0x04000000UL /* need reread GPU SURFACE first, can combine with SVGA_CB_PRESENT */
 #define SVGA_CB_RENDER             0x02000000UL /* this is 'render' cmd, WAIT for 'present', 'update' */
 #define SVGA_CB_UPDATE             0x01000000UL /* this is 'update' cmd, updates screen on HOST, WAIT for 'update', 'present' */
+#define SVGA_CB_2D                 0x00800000UL /* driver 2D/cursor traffic, VXD internal: can be processed by second CB context */
 
 /* SVGA_CB_FLAG_DX_CONTEXT */
 
@@ -338,6 +508,35 @@ void SVGA_region_free(SVGA_region_info_t FBPTR rinfo);
 #define SVGA_QUERY_REGS 1
 #define SVGA_QUERY_FIFO 2
 #define SVGA_QUERY_CAPS 3
+#define SVGA_QUERY_HIST 4 /* latency histograms, see SVGA_HIST_* */
+
+/*
+ * Latency histograms (TSC cycles), bucket n counts durations in
+ * <2^n, 2^(n+1)) cycles (bucket 0 includes 0). SVGA_QUERY_HIST index is
+ * histogram * SVGA_HIST_STRIDE + bucket, or SVGA_HIST_MAX for longest
+ * duration. After histograms follow SVGA_HIST_CLOCK_* values for TSC
+ * frequency calibration.
+ */
+#define SVGA_HIST_FENCE_WAIT    0 /* SVGA_fence_wait */
+#define SVGA_HIST_SUBMIT_QUEUE  1 /* SVGA_CMB_submit: semaphore and waiting for room in CB queue */
+#define SVGA_HIST_SUBMIT_COPY   2 /* SVGA_CMB_submit: CB insert or copy to FIFO (without sync wait) */
+#define SVGA_HIST_ACCESS_END    3 /* FBHDA_access_end (blit + update) */
+#define SVGA_HIST_REGION_CREATE 4
+#define SVGA_HIST_REGION_FREE   5
+#define SVGA_HIST_CNT           6
+
+#define SVGA_HIST_BUCKETS 32
+#define SVGA_HIST_MAX     32 /* saturated to 0xFFFFFFFF */
+#define SVGA_HIST_STRIDE  34
+
+#define SVGA_HIST_CLOCK         (SVGA_HIST_CNT * SVGA_HIST_STRIDE)
+#define SVGA_HIST_CLOCK_TSC0_LO (SVGA_HIST_CLOCK + 0) /* TSC and system time (ms) of reset */
+#define SVGA_HIST_CLOCK_TSC0_HI (SVGA_HIST_CLOCK + 1)
+#define SVGA_HIST_CLOCK_TIME0   (SVGA_HIST_CLOCK + 2)
+#define SVGA_HIST_CLOCK_TSC1_LO (SVGA_HIST_CLOCK + 3) /* TSC and system time now, read TSC1_LO first */
+#define SVGA_HIST_CLOCK_TSC1_HI (SVGA_HIST_CLOCK + 4)
+#define SVGA_HIST_CLOCK_TIME1   (SVGA_HIST_CLOCK + 5)
+#define SVGA_HIST_QUERY_SIZE    (SVGA_HIST_CLOCK + 6)
 
 DWORD SVGA_query(DWORD type, DWORD index);
 void SVGA_query_vector(DWORD type, DWORD index_start, DWORD count, DWORD *out);
@@ -370,6 +569,174 @@ void SVGA_flushcache();
 BOOL SVGA_vxdcmd(DWORD cmd, DWORD arg);
 #define SVGA_CMD_INVALIDATE_FB 1
 #define SVGA_CMD_CLEANUP 2
+#define SVGA_CMD_CAPTURE 3 /* arg: 1 = clear log and start, 0 = stop */
+#define SVGA_CMD_STATS 4 /* arg: 1 = reset and start, 0 = stop */
+#define SVGA_CMD_TRACE 5 /* arg: 1 = clear ring and start, 0 = stop */
+#define SVGA_CMD_HIST 6 /* arg: 1 = reset and start latency histograms, 0 = stop */
+
+/*
+ * Command stream capture. Log is ring of variable size records in locked
+ * memory, every record is SVGA_capture_rec_t followed by payload padded
+ * to DWORD. When rest of ring is too small for record, SVGA_CAPTURE_WRAP
+ * is written (if header fits) and next record starts at offset 0. Oldest
+ * records are overwritten when ring is full.
+ *
+ * Trace file (tools) is SVGA_capture_file_t followed by records in same
+ * format.
+ */
+#define SVGA_CAPTURE_SUBMIT        1 /* arg: flags, DX context, cmb size, SVGA_CAPTURE_SRC_* */
+#define SVGA_CAPTURE_REGION_CREATE 2 /* arg: region id, size, is_mob, mobonly */
+#define SVGA_CAPTURE_REGION_FREE   3 /* arg: region id, size, is_mob, mobonly */
+#define SVGA_CAPTURE_WRAP          4
+#define SVGA_CAPTURE_ACCESS_BEGIN  5 /* arg: flags (only RAW_BUFFERING, other begins are recorded as ACCESS_RECT) */
+#define SVGA_CAPTURE_ACCESS_RECT   6 /* arg: left, top, right, bottom */
+#define SVGA_CAPTURE_ACCESS_END    7 /* arg: flags */
+#define SVGA_CAPTURE_CURSOR_MOVE   8 /* arg: x, y, HW cursor */
+#define SVGA_CAPTURE_MODE          9 /* arg: width, height, bpp, system surface offset (0 on mode set) */
+
+#define SVGA_CAPTURE_SRC_OTHER  0 /* RING-3 buffer or VXD MOB buffer */
+#define SVGA_CAPTURE_SRC_DRIVER 1 /* submit_cmdbuf */
+
+#define SVGA_CAPTURE_MAGIC   0x50414356UL /* 'VCAP' */
+#define SVGA_CAPTURE_VERSION 1
+
+#define SVGA_CAPTURE_ALIGN(_s) (((_s) + 3) & 0xFFFFFFFCUL)
+
+typedef struct SVGA_capture_rec
+{
+	DWORD type;
+	DWORD size;   /* payload size in bytes, can be lower than arg[2] when buffer was too big */
+	DWORD seq;
+	DWORD time;   /* ms, system time */
+	DWORD arg[4];
+} SVGA_capture_rec_t;
+
+typedef struct SVGA_capture
+{
+	volatile DWORD enabled;
+	volatile DWORD head;    /* offset of next record */
+	volatile DWORD tail;    /* offset of oldest record */
+	volatile DWORD used;    /* bytes from tail to head (including wrap padding) */
+	volatile DWORD seq;     /* records written */
+	volatile DWORD lost;    /* records overwritten */
+	         DWORD ring_size;
+	         DWORD pad;
+	/* BYTE ring[ring_size]; */
+} SVGA_capture_t;
+
+typedef struct SVGA_capture_file
+{
+	DWORD magic;
+	DWORD version;
+	DWORD records;
+	DWORD lost;
+} SVGA_capture_file_t;
+
+SVGA_capture_t *SVGA_capture_setup();
+
+/*
+ * Command statistics, counted on submit when enabled. Opcode index is
+ * SVGA_CMD_* for 2D commands or SVGA_STATS_3D_CNT + (id - SVGA_STATS_3D_BASE)
+ * for 3D ones, index 0 (SVGA_CMD_INVALID_CMD) is used for commands which
+ * cannot be parsed (rest of buffer bytes are counted there).
+ *
+ * Fence wait longer than long_wait_limit ms is counted to last command
+ * before the fence which was waited for.
+ *
+ * Counters are updated without locking, reader should take them as
+ * approximate.
+ */
+#define SVGA_STATS_2D_CNT   64
+#define SVGA_STATS_3D_BASE  1040 /* SVGA_3D_CMD_LEGACY_BASE */
+#define SVGA_STATS_3D_CNT   256
+#define SVGA_STATS_OPS      (SVGA_STATS_2D_CNT + SVGA_STATS_3D_CNT)
+#define SVGA_STATS_PROCS    16
+
+#define SVGA_STATS_PID_DRIVER  0     /* VXD internal buffers (2D, cursor, MOBs) */
+#define SVGA_STATS_PID_UNKNOWN 0xFFFFFFFFUL  /* buffer submitted outside of Win32 process */
+
+typedef struct SVGA_stats_op
+{
+	DWORD cnt;
+	DWORD bytes;
+	DWORD long_waits;
+	DWORD long_wait_ms;
+} SVGA_stats_op_t;
+
+typedef struct SVGA_stats_proc
+{
+	DWORD pid; /* Win32 PID (of DX context owner) or VWIN32 process handle */
+	DWORD submits;
+	DWORD cmds;
+	DWORD bytes;
+} SVGA_stats_proc_t;
+
+typedef struct SVGA_stats
+{
+	volatile DWORD    enabled;
+	DWORD             start_time;     /* ms, system time of reset */
+	DWORD             submits;
+	DWORD             submits_fifo;
+	DWORD             bytes;
+	DWORD             fence_waits;
+	DWORD             fence_wait_ms;
+	DWORD             long_waits;
+	DWORD             long_wait_ms;
+	DWORD             long_wait_limit; /* ms, StatsLongWait in registry */
+	DWORD             procs_lost;      /* submits not counted to process, table was full */
+	DWORD             pad;
+	SVGA_stats_proc_t procs[SVGA_STATS_PROCS];
+	SVGA_stats_op_t   ops[SVGA_STATS_OPS];
+} SVGA_stats_t;
+
+SVGA_stats_t *SVGA_stats_setup();
+
+/*
+ * Event trace. Events are fixed size records with TSC timestamp in ring
+ * in VXD memory, slot is reserved by locked XADD so trace points don't
+ * need semaphore. OP_SVGA_TRACE_SNAPSHOT copies SVGA_trace_snapshot_t
+ * followed by events (oldest first) to output buffer.
+ */
+#define SVGA_TRACE_SUBMIT_BEGIN        1  /* arg: size, flags, DX context */
+#define SVGA_TRACE_SUBMIT_END          2  /* arg: fence */
+#define SVGA_TRACE_FENCE_BEGIN         3  /* arg: fence */
+#define SVGA_TRACE_FENCE_END           4  /* arg: fence */
+#define SVGA_TRACE_CB_RETIRE           5  /* arg: CB context, status, CB id */
+#define SVGA_TRACE_REGION_CREATE_BEGIN 6  /* arg: region id, size */
+#define SVGA_TRACE_REGION_CREATE_END   7  /* arg: region id, success */
+#define SVGA_TRACE_REGION_FREE_BEGIN   8  /* arg: region id, size */
+#define SVGA_TRACE_REGION_FREE_END     9  /* arg: region id */
+#define SVGA_TRACE_ACCESS_BEGIN        10 /* arg: flags */
+#define SVGA_TRACE_ACCESS_END          11 /* arg: flags */
+#define SVGA_TRACE_MODESET_BEGIN       12 /* arg: width, height, bpp */
+#define SVGA_TRACE_MODESET_END         13 /* arg: width, height, bpp */
+
+#define SVGA_TRACE_MAGIC   0x43525456UL /* 'VTRC' */
+#define SVGA_TRACE_VERSION 1
+
+typedef struct SVGA_trace_ev
+{
+	DWORD id;
+	DWORD seq;     /* event number + 1, written last; 0 = slot is being written */
+	DWORD tsc_lo;
+	DWORD tsc_hi;
+	DWORD arg[4];
+} SVGA_trace_ev_t;
+
+typedef struct SVGA_trace_snapshot
+{
+	DWORD magic;
+	DWORD version;
+	DWORD count;   /* events in snapshot */
+	DWORD lost;    /* events overwritten before first one */
+	DWORD tsc0_lo; /* TSC and system time (ms) when trace was started */
+	DWORD tsc0_hi;
+	DWORD time0;
+	DWORD tsc1_lo; /* TSC and system time (ms) of snapshot */
+	DWORD tsc1_hi;
+	DWORD time1;
+	DWORD pad[2];
+} SVGA_trace_snapshot_t;
 
 #endif /* SVGA */
 
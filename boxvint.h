@@ -35,6 +35,7 @@ THE SOFTWARE.
 #define VGA_SEQUENCER       0x3C4
 #define VGA_SEQUENCER_DATA  0x3C5
 #define VGA_PIXEL_MASK      0x3C6
+#define VGA_DAC_R_INDEX     0x3C7
 #define VGA_DAC_W_INDEX     0x3C8
 #define VGA_DAC_DATA        0x3C9
 #define VGA_MISC_OUT_R      0x3CC
@@ -413,6 +413,29 @@ static void buildDDHALInfo(VMDAHAL_t __far *hal, int modeidx)
 	}
 } /* buildDDHALInfo */
 
+/*
+ * Drop modes from list which cannot be set (check by mode limits in
+ * shared memory, so no VXD call per mode).
+ */
+static void filterModes(VMDAHAL_t __far *hal)
+{
+	int i, cnt = 0;
+	
+	for(i = 0; i < hal->modes_count; i++)
+	{
+		if(FBHDA_mode_valid(hal->modes[i].dwWidth, hal->modes[i].dwHeight, hal->modes[i].dwBPP))
+		{
+			if(cnt != i)
+			{
+				hal->modes[cnt] = hal->modes[i];
+			}
+			cnt++;
+		}
+	}
+	
+	hal->modes_count = cnt;
+}
+
 BOOL DDCreateDriverObject(int bReset)
 {
 	VMDAHAL_t __far *hal;
@@ -430,6 +453,8 @@ BOOL DDCreateDriverObject(int bReset)
 		return FALSE;
 	}
 
+	filterModes(hal);
+	
 	for(modeidx = 0; modeidx < hal->modes_count; modeidx++)
 	{
 		if((hal->modes[modeidx].dwWidth == hda->width) &&
@@ -58,6 +58,13 @@ void outp_asm(unsigned short port, unsigned char val);
     "out dx, al"            \
     parm [dx] [al];
 
+void outsb_asm(unsigned short port, const void *buf, unsigned long count);
+#pragma aux outsb_asm =     \
+    ".386"                  \
+    "cld"                   \
+    "rep outsb"             \
+    parm [dx] [esi] [ecx] modify [esi ecx];
+
 /*
  * Watcom complaining if have unused static function so, before include
  * this file define one or more folowing defines to specify which function
@@ -68,6 +75,7 @@ void outp_asm(unsigned short port, unsigned char val);
  *   IN_OUT16
  *   IO_IN8
  *   IN_OUT8
+ *   IO_OUTS8
  *
  */
 #ifdef IO_IN32
@@ -111,3 +119,11 @@ static void outp(unsigned short port, unsigned char val)
   outp_asm(port, val);
 }
 #endif
+
+#ifdef IO_OUTS8
+/* write count bytes from buf to one port (string I/O) */
+static void outsb(unsigned short port, const void *buf, unsigned long count)
+{
+  outsb_asm(port, buf, count);
+}
+#endif
@@ -152,19 +152,9 @@ static int IsModeOK( WORD wXRes, WORD wYRes, WORD wBpp )
     if( !FixModeInfo( &mode ) )
         return( 0 );
 
-#ifdef SVGA
-		if(!SVGA_validmode(wXRes, wYRes, wBpp))
-		{
-			return 0;
-		}
-#endif
-
-#ifdef VBE
-		if(!VBE_validmode(wXRes, wYRes, wBpp))
-		{
-			return 0;
-		}
-#endif
+    /* limits are in shared memory, no VXD call */
+    if( !FBHDA_mode_valid( wXRes, wYRes, wBpp ) )
+        return( 0 );
 
     return( 1 );
 }
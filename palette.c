@@ -35,24 +35,32 @@ THE SOFTWARE.
 
 #pragma code_seg( _INIT )
 
-static void __loadds __far SetColor(unsigned index, DWORD rgb)
+static void __loadds __far SetColors(UINT start, UINT count, DWORD __far *rgb)
 {
-	FBHDA_palette_set(index, rgb);
+	FBHDA_palette_set_range(start, count, rgb);
 }
 
 #pragma code_seg( _TEXT )
 
-/* Load the VGA DAC with values from color table. */
+static DWORD palette_buf[256];
+
+/* Load the VGA DAC with values from color table (in one VXD call). */
 static void SetRAMDAC( UINT bStart, UINT bCount, RGBQUAD FAR *lpPal )
 {
-	  BYTE    bIndex = bStart;
-
-    while( bCount-- ) {
-    	 DWORD rgb = ((DWORD)lpPal[bIndex].rgbRed << 16) |
-    	     ((DWORD)lpPal[bIndex].rgbGreen << 8) | (DWORD)lpPal[bIndex].rgbBlue;
-    	     
-       SetColor(bIndex++, rgb);
+    UINT i;
+    
+    if( bStart >= 256 )
+        return;
+    
+    if( bStart + bCount > 256 )
+        bCount = 256 - bStart;
+    
+    for( i = 0; i < bCount; i++ ) {
+    	 palette_buf[i] = ((DWORD)lpPal[bStart + i].rgbRed << 16) |
+    	     ((DWORD)lpPal[bStart + i].rgbGreen << 8) | (DWORD)lpPal[bStart + i].rgbBlue;
     }
+    
+    SetColors( bStart, bCount, palette_buf );
 }
 
 /* Allow calls from the _INIT segment. */
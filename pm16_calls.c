@@ -56,6 +56,8 @@ static DWORD VXD_VM = 0;
 static DWORD vxd_fbhda16 = 0;
 static DWORD vxd_fbhda32 = 0;
 static DWORD vxd_mouse16  = 0;
+static FBHDA_batch_t __far *batch = NULL;
+static FBHDA_modes_t __far *modes = NULL;
 
 #pragma code_seg( _INIT )
 
@@ -116,6 +118,12 @@ BOOL VXD_VM_connect()
   
   dbg_printf("VDD_REGISTER_DISPLAY_DRIVER_INFO: eax=%lX, edx=%lX, ecx=%lX\n", VXD_VM, vxd_fbhda16, vxd_mouse16);
   
+  if(vxd_fbhda16 != 0)
+  {
+  	batch = (FBHDA_batch_t __far *)(vxd_fbhda16 + FBHDA_BATCH_OFFSET);
+  	modes = (FBHDA_modes_t __far *)(vxd_fbhda16 + FBHDA_MODES_OFFSET);
+  }
+  
 	return VXD_VM != 0;
 }
 
@@ -125,9 +133,89 @@ void FBHDA_setup(FBHDA_t __far* __far* FBHDA, DWORD __far* FBHDA_linear)
 	*FBHDA_linear = vxd_fbhda32;
 }
 
+/*
+ * Append record to batch ring, return FALSE when the call has to be
+ * done directly (timer in VXD not running or ring full). Direct call
+ * process the ring first.
+ */
+static BOOL batch_put(DWORD op, DWORD a0, DWORD a1, DWORD a2, DWORD a3)
+{
+	FBHDA_batch_rec_t __far *rec;
+	DWORD head;
+	
+	if(batch == NULL)
+	{
+		return FALSE;
+	}
+	
+	batch->busy = 1;
+	
+	head = batch->head;
+	if(!batch->armed || head - batch->tail >= FBHDA_BATCH_RECS)
+	{
+		batch->busy = 0;
+		return FALSE;
+	}
+	
+	rec = &batch->rec[head & (FBHDA_BATCH_RECS-1)];
+	rec->op = op;
+	rec->arg[0] = a0;
+	rec->arg[1] = a1;
+	rec->arg[2] = a2;
+	rec->arg[3] = a3;
+	
+	batch->head = head + 1;
+	batch->busy = 0;
+	
+	if(head + 1 - batch->tail >= FBHDA_BATCH_FLUSH)
+	{
+		FBHDA_batch_flush();
+	}
+	
+	return TRUE;
+}
+
+void FBHDA_batch_flush()
+{
+	_asm
+	{
+		.386
+		push eax
+		push edx
+		
+	  mov edx, OP_FBHDA_BATCH_FLUSH
+	  call dword ptr [VXD_VM]
+	  
+		pop edx
+		pop eax
+	}
+}
+
+/*
+ * Same check as FBHDA_mode_valid in vxd_fbhda.c (FBHDA_mode_limits), but
+ * from shared memory without calling VXD. When the table isn't ready, ask
+ * the VXD.
+ */
+BOOL FBHDA_mode_valid(DWORD w, DWORD h, DWORD bpp)
+{
+	if(modes == NULL || modes->serial == 0)
+	{
+#if defined(SVGA)
+		return SVGA_validmode(w, h, bpp);
+#elif defined(VBE)
+		return VBE_validmode(w, h, bpp);
+#else
+		return TRUE;
+#endif
+	}
+	
+	return FBHDA_mode_limits(modes, w, h, bpp);
+}
+
 void FBHDA_access_begin(DWORD flags)
 {
 	static DWORD sFlags;
+	
 	sFlags = flags;
 	
 	_asm
@@ -150,6 +238,12 @@ void FBHDA_access_begin(DWORD flags)
 void FBHDA_access_end(DWORD flags)
 {
 	static DWORD sFlags;
+	
+	if(batch_put(FBHDA_BATCH_ACCESS_END, flags, 0, 0, 0))
+	{
+		return;
+	}
+	
 	sFlags = flags;
 	
 	_asm
@@ -234,6 +328,32 @@ BOOL FBHDA_swap(DWORD offset)
 	return status == 0 ? FALSE : TRUE;
 }
 
+DWORD FBHDA_flip_status(DWORD offset)
+{
+	static DWORD sOffset;
+	
+	sOffset = offset;
+	
+	_asm
+	{
+		.386
+		push eax
+		push edx
+		push ecx
+		
+	  mov edx, OP_FBHDA_FLIP_STATUS
+	  mov ecx, [sOffset]
+	  call dword ptr [VXD_VM]
+	  mov [sOffset], ecx
+	  
+	  pop ecx
+		pop edx
+		pop eax
+	}
+	
+	return sOffset;
+}
+
 void FBHDA_clean()
 {
 	_asm
@@ -255,6 +375,11 @@ void FBHDA_palette_set(unsigned char index, DWORD rgb)
 	static unsigned char sIndex;
 	static DWORD sRGB;
 	
+	if(batch_put(FBHDA_BATCH_PALETTE_SET, index, rgb, 0, 0))
+	{
+		return;
+	}
+	
 	sIndex = index;
 	sRGB = rgb;
 	
@@ -278,6 +403,41 @@ void FBHDA_palette_set(unsigned char index, DWORD rgb)
 	}
 }
 
+void FBHDA_palette_set_range(DWORD start, DWORD count, DWORD FBPTR rgb)
+{
+	static DWORD sStart;
+	static DWORD sCount;
+	static DWORD rgb_linear;
+	
+	sStart = start;
+	sCount = count;
+	
+	rgb_linear = DPMI_GetSegBase(((DWORD)rgb) >> 16);
+	rgb_linear += ((DWORD)rgb) & 0xFFFFUL;
+	
+	_asm
+	{
+		.386
+		push eax
+		push edx
+		push ebx
+		push ecx
+		push esi
+		
+	  mov edx, OP_FBHDA_PALETTE_SET_RANGE
+	  mov ebx, [sStart]
+	  mov ecx, [sCount]
+	  mov esi, [rgb_linear]
+	  call dword ptr [VXD_VM]
+	  
+	  pop esi
+	  pop ecx
+	  pop ebx
+		pop edx
+		pop eax
+	}
+}
+
 DWORD FBHDA_palette_get(unsigned char index)
 {
 	static unsigned char sIndex;
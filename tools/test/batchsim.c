@@ -0,0 +1,172 @@
+/*
+ * Simulation of batched calls from 16-bit driver to VXD (FBHDA_batch_t)
+ *
+ * Ring transition (call dword ptr [VXD_VM]) is simulated by real system
+ * call, VXD side by simple lock counter and damage rectangle. Measures
+ * typical GDI sequence (access_rect + access_end per primitive, some
+ * palette updates) with direct calls and with batch ring.
+ *
+ * gcc -O2 -o batchsim batchsim.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+typedef unsigned char  BYTE;
+typedef unsigned short WORD;
+typedef unsigned int   DWORD;
+typedef int            BOOL;
+typedef void           VOID;
+
+#define TRUE  1
+#define FALSE 0
+
+#include "../../3d_accel.h"
+
+#define PRIMITIVES 1000000
+
+/* VXD side */
+static long  fb_lock_cnt = 0;
+static DWORD presents = 0;
+static DWORD palette[256];
+static DWORD vxd_calls = 0;
+
+static void vxd_access_rect(DWORD l, DWORD t, DWORD r, DWORD b)
+{
+	fb_lock_cnt++;
+}
+
+static void vxd_access_end(DWORD flags)
+{
+	if(--fb_lock_cnt <= 0)
+	{
+		fb_lock_cnt = 0;
+		presents++;
+	}
+}
+
+static FBHDA_batch_t ring;
+
+/* same as FBHDA_batch_flush in vxd_fbhda.c */
+static void vxd_batch_flush()
+{
+	DWORD head = ring.head, tail = ring.tail, i;
+	FBHDA_batch_rec_t *rec;
+
+	for(i = tail; i != head; i++)
+	{
+		rec = &ring.rec[i & (FBHDA_BATCH_RECS-1)];
+		switch(rec->op)
+		{
+			case FBHDA_BATCH_ACCESS_END:  vxd_access_end(rec->arg[0]); break;
+			case FBHDA_BATCH_PALETTE_SET: palette[rec->arg[0] & 0xFF] = rec->arg[1]; break;
+		}
+	}
+
+	ring.records += head - tail;
+	ring.flushes++;
+	ring.tail = head;
+}
+
+/* ring transition */
+static void vxd_call()
+{
+	syscall(SYS_getppid);
+	vxd_calls++;
+	vxd_batch_flush();
+}
+
+/* 16-bit driver side, direct calls */
+static void direct_rect(DWORD l, DWORD t, DWORD r, DWORD b) { vxd_call(); vxd_access_rect(l, t, r, b); }
+static void direct_end(DWORD flags) { vxd_call(); vxd_access_end(flags); if(!ring.armed) ring.armed = 1; }
+static void direct_palette(DWORD i, DWORD rgb) { vxd_call(); palette[i & 0xFF] = rgb; }
+
+/* same as batch_put in pm16_calls.c */
+static BOOL batch_put(DWORD op, DWORD a0, DWORD a1, DWORD a2, DWORD a3)
+{
+	FBHDA_batch_rec_t *rec;
+	DWORD head = ring.head;
+
+	if(!ring.armed || head - ring.tail >= FBHDA_BATCH_RECS)
+		return FALSE;
+
+	rec = &ring.rec[head & (FBHDA_BATCH_RECS-1)];
+	rec->op = op;
+	rec->arg[0] = a0; rec->arg[1] = a1; rec->arg[2] = a2; rec->arg[3] = a3;
+	ring.head = head + 1;
+
+	if(head + 1 - ring.tail >= FBHDA_BATCH_FLUSH)
+		vxd_call();
+
+	return TRUE;
+}
+
+static double elapsed(clock_t start)
+{
+	return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+static void reset()
+{
+	memset(&ring, 0, sizeof(ring));
+	fb_lock_cnt = 0;
+	presents = 0;
+	vxd_calls = 0;
+}
+
+int main()
+{
+	clock_t start;
+	double t_direct, t_batch;
+	DWORD calls_direct, presents_direct;
+	DWORD i;
+
+	reset();
+	start = clock();
+	for(i = 0; i < PRIMITIVES; i++)
+	{
+		direct_rect(i & 511, i & 255, (i & 511) + 16, (i & 255) + 16);
+		direct_end(0);
+		if((i & 63) == 0)
+			direct_palette(i, i * 3);
+	}
+	t_direct = elapsed(start);
+	calls_direct = vxd_calls;
+	presents_direct = presents;
+
+	reset();
+	start = clock();
+	for(i = 0; i < PRIMITIVES; i++)
+	{
+		/* always direct, VXD prepares surface before drawing */
+		direct_rect(i & 511, i & 255, (i & 511) + 16, (i & 255) + 16);
+
+		if(!batch_put(FBHDA_BATCH_ACCESS_END, 0, 0, 0, 0))
+			direct_end(0);
+
+		if((i & 63) == 0)
+		{
+			if(!batch_put(FBHDA_BATCH_PALETTE_SET, i, i * 3, 0, 0))
+				direct_palette(i, i * 3);
+		}
+	}
+	/* timer */
+	vxd_batch_flush();
+	t_batch = elapsed(start);
+
+	if(fb_lock_cnt != 0)
+	{
+		printf("lock count mismatch: %ld\n", fb_lock_cnt);
+		return EXIT_FAILURE;
+	}
+
+	printf("%d primitives\n", PRIMITIVES);
+	printf("direct: %8.2f ms, %8u calls, %8u presents\n", t_direct, calls_direct, presents_direct);
+	printf("batch:  %8.2f ms, %8u calls, %8u presents, %u records in %u flushes\n",
+		t_batch, vxd_calls, presents, ring.records, ring.flushes);
+
+	return EXIT_SUCCESS;
+}
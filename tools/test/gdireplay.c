@@ -0,0 +1,888 @@
+/*
+ * Replay of GDI access protocol (FBHDA_access_rect/begin/end, cursor moves
+ * and mode sets) recorded by command stream capture (svgacap) on software
+ * SVGA-II model (svgasim.h).
+ *
+ * Damage collection, cursor erase/redraw and present are compiled from
+ * vxd_svga_access.h (same code as in vxd_svga.c), software cursor from
+ * vxd_mouse_conv.h and color conversion from vxd_color.h. Submission
+ * follows FIFO branch of SVGA_CMB_submit. Host is lazy: queued commands
+ * are processed only every N-th submit (-l N) or when driver waits for
+ * fence, so waits for previous screen update are visible as stalls.
+ * Present pacing timer runs on recorded time of events.
+ *
+ * With -F N the replay continues by N asynchronous flips (SVGA_flip) over
+ * 3 back buffers at 32 bpp, every buffer is "rendered" only after
+ * FBHDA_flip_status reports it free (as DirectDraw Lock does). Screen has
+ * to match the last buffer at the end.
+ *
+ * usage:
+ *   gdireplay [-l N] [-c size] [-r Hz] [-a pct] [-F N] file.cap
+ *     -l N     host processes commands every N submits (default 2)
+ *     -c size  software cursor size (default 32, 0 = no cursor)
+ *     -r Hz    present pacing rate (PresentRate, default 0 = disabled)
+ *     -a pct   area presented immediately (PresentArea, default 25)
+ *     -F N     flip test after replay (last mode has to be 32 bpp)
+ *
+ * gcc -O2 -fno-strict-aliasing -o gdireplay gdireplay.c
+ */
+#define SVGASIM_VMM
+#include "svgasim.h"
+
+typedef unsigned char  BYTE;
+typedef unsigned short WORD;
+typedef unsigned int   DWORD;
+typedef int            BOOL;
+typedef void           VOID;
+typedef long           LONG;
+
+#include "../../vmware/svga3d_dx.h"
+
+#define SVGA
+#include "../../3d_accel.h"
+#include "../../cursor.h"
+
+#define CURSOR_MAX 64
+
+typedef struct _replay_stat_t
+{
+	uint32 rects;
+	uint32 begins;
+	uint32 ends;
+	uint32 cursor_moves;
+	uint32 cursor_moves_hw;
+	uint32 modes;
+	uint32 recorded_submits;
+	uint32 submits;
+	uint32 presents;
+	uint32 fence_waits;
+	uint32 fence_stalls;
+	uint32 stall_syncs;
+	uint32 fifo_full;
+	uint32 cursor_draws;
+	uint64_t px_convert;
+	uint64_t px_readback;
+} replay_stat_t;
+
+static svgasim_t *sim;
+static replay_stat_t stat;
+static uint32 host_lag = 2;
+static uint32 host_pending = 0;
+static uint32 fence_next = 1;
+static uint32 fence_update = 0;
+
+/*
+ * Device access (same as svgatest.c)
+ */
+static uint32 reg_read(uint32 index)
+{
+	svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_INDEX_PORT, index);
+	return svgasim_inpd(sim, SVGASIM_IO_BASE + SVGA_VALUE_PORT);
+}
+
+static void reg_write(uint32 index, uint32 value)
+{
+	svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_INDEX_PORT, index);
+	svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_VALUE_PORT, value);
+}
+
+static uint32 *fifo_mem()
+{
+	return svgasim_pa_ptr(sim, reg_read(SVGA_REG_MEM_START));
+}
+
+/*
+ * Driver shims used by vxd_svga_access.h
+ */
+#define dbg_printf(...) do{}while(0)
+#define SVGA_TRACE(_id, _a0, _a1, _a2) do{}while(0)
+#define HIST_BEGIN(_tsc) do{ (void)(_tsc); }while(0)
+#define HIST_END(_id, _tsc) do{ (void)(_tsc); }while(0)
+
+static FBHDA_t fbhda;
+FBHDA_t *hda = &fbhda;
+static FBHDA_perf_t fbhda_perf;
+FBHDA_perf_t *hda_perf = &fbhda_perf;
+ULONG hda_sem = 0;
+LONG fb_lock_cnt = 0;
+BOOL surface_dirty = FALSE;
+BOOL capture_active = FALSE;
+void *cmdbuf = NULL;
+
+static DWORD *cursor_cmdbuf = NULL;
+static DWORD cursor_fence = 0;
+
+/* lazy surface clear is not replayed (surface is clean after mode set) */
+static DWORD surface_clear_cnt = 0;
+
+static void surface_clear_rect(DWORD top, DWORD bottom)
+{
+}
+
+static void surface_clear_cancel()
+{
+}
+
+void SVGA_capture_event(DWORD type, DWORD a0, DWORD a1, DWORD a2, DWORD a3)
+{
+}
+
+DWORD SVGA_pitch(DWORD width, DWORD bpp)
+{
+	DWORD bp = (bpp + 7) / 8;
+	return (bp * width + (FBHDA_ROW_ALIGN-1)) & (~((DWORD)FBHDA_ROW_ALIGN-1));
+}
+
+DWORD *SVGA_CMB_alloc_size(DWORD datasize)
+{
+	return malloc(datasize);
+}
+
+static void SVGA_FillGMRFB(SVGAFifoCmdDefineGMRFB *fbgmr,
+	DWORD offset, DWORD pitch, DWORD bpp)
+{
+	fbgmr->ptr.gmrId = SVGA_GMR_FRAMEBUFFER;
+	fbgmr->ptr.offset = offset;
+	fbgmr->bytesPerLine = pitch;
+	fbgmr->format.bitsPerPixel = (bpp >= 24) ? 32 : 16;
+	fbgmr->format.colorDepth   = (bpp >= 24) ? 24 : 16;
+	fbgmr->format.reserved     = 0;
+}
+
+void *SVGA_cmd_ptr(DWORD *buf, DWORD *pOffset, DWORD cmd, DWORD cmdsize)
+{
+	DWORD pp = (*pOffset)/sizeof(DWORD);
+	buf[pp] = cmd;
+	*pOffset = (*pOffset) + sizeof(DWORD) + cmdsize;
+
+	return (void*)(buf + pp + 1);
+}
+
+static void host_run()
+{
+	svgasim_run(sim);
+	host_pending = 0;
+}
+
+void SVGA_Sync()
+{
+	host_run();
+}
+
+BOOL SVGA_fence_is_passed(DWORD fence_id)
+{
+	return (int32)(fifo_mem()[SVGA_FIFO_FENCE] - fence_id) >= 0;
+}
+
+void SVGA_fence_wait(DWORD fence_id)
+{
+	stat.fence_waits++;
+
+	if(!SVGA_fence_is_passed(fence_id))
+	{
+		stat.fence_stalls++;
+		while(!SVGA_fence_is_passed(fence_id))
+		{
+			host_run();
+			stat.stall_syncs++;
+		}
+	}
+}
+
+/* FIFO is processed in order, submit is complete after copy */
+BOOL SVGA_CMB_busy(DWORD *cmb)
+{
+	return FALSE;
+}
+
+void SVGA_CMB_wait_update()
+{
+	if(fence_update)
+	{
+		SVGA_fence_wait(fence_update);
+		fence_update = 0;
+	}
+}
+
+static void fifo_write(const uint32 *cmd, uint32 dwords)
+{
+	uint32 *fifo = fifo_mem();
+	uint32 max  = fifo[SVGA_FIFO_MAX];
+	uint32 min  = fifo[SVGA_FIFO_MIN];
+	uint32 next = fifo[SVGA_FIFO_NEXT_CMD];
+	uint32 stop;
+	uint32 space;
+
+	for(;;)
+	{
+		stop = fifo[SVGA_FIFO_STOP];
+		space = (next >= stop) ? (max - next) + (stop - min) : stop - next;
+		if(space > dwords*4)
+		{
+			break;
+		}
+		stat.fifo_full++;
+		host_run();
+	}
+
+	while(dwords > 0)
+	{
+		fifo[next/4] = *cmd++;
+		next += 4;
+		if(next >= max)
+		{
+			next = min;
+		}
+		dwords--;
+	}
+
+	fifo[SVGA_FIFO_NEXT_CMD] = next;
+}
+
+/* FIFO branch of SVGA_CMB_submit in vxd_svga_cb.c */
+void SVGA_CMB_submit(DWORD *cmb, DWORD cmb_size, SVGA_CMB_status_t *status, DWORD flags, DWORD DXCtxId)
+{
+	uint32 fence = 0;
+	const DWORD fence_flags = SVGA_CB_SYNC | SVGA_CB_FORCE_FENCE | SVGA_CB_PRESENT | SVGA_CB_RENDER | SVGA_CB_UPDATE;
+
+	if(flags & SVGA_CB_UPDATE)
+	{
+		SVGA_CMB_wait_update();
+		stat.presents++;
+	}
+
+	fifo_write(cmb, cmb_size/sizeof(DWORD));
+
+	if(flags & fence_flags)
+	{
+		uint32 fence_cmd[2];
+		fence = fence_next++;
+		fence_cmd[0] = SVGA_CMD_FENCE;
+		fence_cmd[1] = fence;
+		fifo_write(fence_cmd, 2);
+	}
+
+	if(flags & SVGA_CB_UPDATE)
+	{
+		fence_update = fence;
+	}
+
+	if(status)
+	{
+		status->fifo_fence_used = fence;
+	}
+
+	stat.submits++;
+	if(++host_pending >= host_lag)
+	{
+		host_run();
+	}
+
+	if(flags & SVGA_CB_SYNC)
+	{
+		SVGA_fence_wait(fence);
+	}
+}
+
+void wait_for_cmdbuf()
+{
+}
+
+void submit_cmdbuf(DWORD cmdsize, DWORD flags, DWORD dx)
+{
+	SVGA_CMB_submit(cmdbuf, cmdsize, NULL, flags, dx);
+}
+
+/*
+ * Software cursor, same state and functions as vxd_mouse.c
+ */
+static void *mouse_andmask_data = NULL;
+static void *mouse_xormask_data = NULL;
+static void *mouse_swap_data = NULL;
+static void *mouse_swap_back = NULL;
+static DWORD mouse_mem_size = 0;
+
+static int mouse_w = 0;
+static int mouse_h = 0;
+static int mouse_pointx = 0;
+static int mouse_pointy = 0;
+static int mouse_swap_x = 0;
+static int mouse_swap_y = 0;
+static int mouse_swap_w = 0;
+static int mouse_swap_h = 0;
+static int mouse_swap_ox = 0;
+static int mouse_swap_oy = 0;
+static int mouse_swap_valid = FALSE;
+static int mouse_ps = 0;
+
+static int mouse_x = 0;
+static int mouse_y = 0;
+static int mouse_move_x = 0;
+static int mouse_move_y = 0;
+static BOOL mouse_move_pending = FALSE;
+static BOOL mouse_valid = FALSE;
+static BOOL mouse_visible = TRUE;
+static BOOL mouse_empty = FALSE;
+
+#include "../../vxd_color.h"
+#include "../../vxd_mouse_conv.h"
+
+BOOL mouse_get_rect(DWORD *ptr_left, DWORD *ptr_top,
+	DWORD *ptr_right, DWORD *ptr_bottom)
+{
+	int mx, my, mw, mh;
+
+	if(mouse_valid && !mouse_empty)
+	{
+		mw = mouse_w;
+		mx = mouse_x - mouse_pointx;
+		if(mx < 0)
+		{
+			mw += mx;
+			mx = 0;
+		}
+		if(mx + mw > (int)hda->width)
+		{
+			mw = hda->width - mx;
+		}
+
+		mh = mouse_h;
+		my = mouse_y - mouse_pointy;
+		if(my < 0)
+		{
+			mh += my;
+			my = 0;
+		}
+		if(my + mh > (int)hda->height)
+		{
+			mh = hda->height - my;
+		}
+
+		if(mw > 0 && mh > 0)
+		{
+			*ptr_left   = mx;
+			*ptr_top    = my;
+			*ptr_right  = mx + mw;
+			*ptr_bottom = my + mh;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+BOOL mouse_move_apply()
+{
+	if(mouse_move_pending)
+	{
+		mouse_x = mouse_move_x;
+		mouse_y = mouse_move_y;
+		mouse_move_pending = FALSE;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+BOOL mouse_blit()
+{
+	if(mouse_valid && mouse_visible && !mouse_empty)
+	{
+		draw_blit(mouse_x, mouse_y);
+		stat.cursor_draws++;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+void mouse_erase()
+{
+	if(mouse_valid && mouse_visible && !mouse_empty)
+	{
+		draw_restore();
+	}
+}
+
+void mouse_move_redraw()
+{
+	if(mouse_valid && mouse_visible && !mouse_empty)
+	{
+		mouse_move_apply();
+		draw_move(mouse_x, mouse_y);
+		stat.cursor_draws++;
+	}
+}
+
+/* count converted pixels, the real kernels are still called */
+#define blit16(_s, _sp, _d, _dp, _x, _y, _w, _h) \
+	do{ stat.px_convert += (uint64_t)(_w)*(_h); blit16(_s, _sp, _d, _dp, _x, _y, _w, _h); }while(0)
+
+#define blit8(_s, _sp, _d, _dp, _x, _y, _w, _h) \
+	do{ stat.px_convert += (uint64_t)(_w)*(_h); blit8(_s, _sp, _d, _dp, _x, _y, _w, _h); }while(0)
+
+#define readback16(_s, _sp, _d, _dp, _x, _y, _w, _h) \
+	do{ stat.px_readback += (uint64_t)(_w)*(_h); readback16(_s, _sp, _d, _dp, _x, _y, _w, _h); }while(0)
+
+/* present pacing: vxd_svga.c config and timer on recorded time */
+DWORD present_period = 0;
+DWORD present_area = 25;
+static DWORD replay_time = 0;
+static DWORD present_deadline = 0;
+static BOOL present_timer_set = FALSE;
+
+#define Get_System_Time() replay_time
+
+void SVGA_present_timer(DWORD ms)
+{
+	present_deadline = replay_time + ms;
+	present_timer_set = TRUE;
+}
+
+void SVGA_mouse_sw_move();
+
+#include "../../vxd_svga_access.h"
+
+/* vxd_mouse.c: mouse_move for software cursor */
+void mouse_move(int x, int y)
+{
+	if(mouse_valid && mouse_visible && !mouse_empty)
+	{
+		mouse_move_x = x;
+		mouse_move_y = y;
+		mouse_move_pending = TRUE;
+		SVGA_mouse_sw_move();
+	}
+	else
+	{
+		mouse_x = x;
+		mouse_y = y;
+		mouse_move_pending = FALSE;
+	}
+}
+
+/*
+ * Replay
+ */
+typedef struct _trace_t
+{
+	SVGA_capture_file_t hdr;
+	uint8  *data;
+	uint32  size;
+} trace_t;
+
+static int trace_load(trace_t *t, const char *filename)
+{
+	FILE *fr = fopen(filename, "rb");
+	long fsize;
+
+	if(fr == NULL)
+	{
+		printf("cannot open %s\n", filename);
+		return FALSE;
+	}
+
+	fseek(fr, 0, SEEK_END);
+	fsize = ftell(fr);
+	fseek(fr, 0, SEEK_SET);
+
+	if(fsize < (long)sizeof(SVGA_capture_file_t) ||
+		fread(&t->hdr, sizeof(SVGA_capture_file_t), 1, fr) != 1 ||
+		t->hdr.magic != SVGA_CAPTURE_MAGIC || t->hdr.version != SVGA_CAPTURE_VERSION)
+	{
+		printf("%s: not capture file\n", filename);
+		fclose(fr);
+		return FALSE;
+	}
+
+	t->size = fsize - sizeof(SVGA_capture_file_t);
+	t->data = malloc(t->size);
+	if(fread(t->data, 1, t->size, fr) != t->size)
+	{
+		printf("%s: read error\n", filename);
+		fclose(fr);
+		return FALSE;
+	}
+
+	fclose(fr);
+	return TRUE;
+}
+
+static SVGA_capture_rec_t *trace_next(trace_t *t, uint32 *pos)
+{
+	SVGA_capture_rec_t *rec;
+
+	if(*pos + sizeof(SVGA_capture_rec_t) > t->size)
+	{
+		return NULL;
+	}
+
+	rec = (SVGA_capture_rec_t*)(t->data + *pos);
+	if(*pos + sizeof(SVGA_capture_rec_t) + SVGA_CAPTURE_ALIGN(rec->size) > t->size)
+	{
+		return NULL;
+	}
+
+	*pos += sizeof(SVGA_capture_rec_t) + SVGA_CAPTURE_ALIGN(rec->size);
+
+	return rec;
+}
+
+static int replay_init(int cursor_size)
+{
+	uint32 *fifo;
+
+	sim = svgasim_create(64*1024*1024, 256*1024, 4*1024*1024);
+	svgasim_vmm_dev = sim;
+	hda_sem = Create_Semaphore(1);
+
+	reg_write(SVGA_REG_ID, SVGA_ID_2);
+	if(reg_read(SVGA_REG_ID) != SVGA_ID_2)
+	{
+		return FALSE;
+	}
+
+	fifo = fifo_mem();
+	fifo[SVGA_FIFO_MIN] = SVGA_FIFO_NUM_REGS * sizeof(uint32);
+	fifo[SVGA_FIFO_MAX] = reg_read(SVGA_REG_MEM_SIZE);
+	fifo[SVGA_FIFO_NEXT_CMD] = fifo[SVGA_FIFO_MIN];
+	fifo[SVGA_FIFO_STOP] = fifo[SVGA_FIFO_MIN];
+
+	reg_write(SVGA_REG_ENABLE, TRUE);
+	reg_write(SVGA_REG_CONFIG_DONE, TRUE);
+
+	cmdbuf = malloc(64*1024);
+	cursor_cmdbuf = malloc(256);
+	SVGA_flip_alloc();
+
+	mouse_mem_size = CURSOR_MAX*CURSOR_MAX*4;
+	mouse_andmask_data = malloc(mouse_mem_size);
+	mouse_xormask_data = malloc(mouse_mem_size);
+	mouse_swap_data    = malloc(mouse_mem_size);
+	mouse_swap_back    = malloc(mouse_mem_size);
+
+	/* arrow like cursor: hot spot in corner, transparent and inverted pixels */
+	memset(mouse_andmask_data, 0xFF, mouse_mem_size);
+	memset(mouse_xormask_data, 0x00, mouse_mem_size);
+	mouse_w = cursor_size;
+	mouse_h = cursor_size;
+	mouse_empty = (cursor_size == 0);
+
+	return TRUE;
+}
+
+/* state after SVGA_setmode: screen at 0, system surface behind it */
+static void replay_mode(DWORD w, DWORD h, DWORD bpp)
+{
+	SVGAFifoCmdDefineGMRFB *gmrfb;
+	DWORD cmd_offset = 0;
+	DWORD x, y;
+
+	reg_write(SVGA_REG_WIDTH, w);
+	reg_write(SVGA_REG_HEIGHT, h);
+	reg_write(SVGA_REG_BITS_PER_PIXEL, 32);
+	svgasim_mode_legacy(sim);
+
+	hda->width  = w;
+	hda->height = h;
+	hda->bpp    = bpp;
+	hda->pitch  = SVGA_pitch(w, bpp);
+	hda->stride = hda->pitch * h;
+	hda->vram_pm32 = sim->vram;
+	hda->system_surface = (SVGA_pitch(w, 32) * h + 0xFFFF) & 0xFFFF0000UL;
+	hda->surface = hda->system_surface;
+	memset(sim->vram, 0, hda->surface + hda->stride);
+	SVGA_present_cancel();
+
+	gmrfb = SVGA_cmd_ptr(cmdbuf, &cmd_offset, SVGA_CMD_DEFINE_GMRFB, sizeof(SVGAFifoCmdDefineGMRFB));
+	SVGA_FillGMRFB(gmrfb, hda->surface, hda->pitch, bpp);
+	submit_cmdbuf(cmd_offset, SVGA_CB_SYNC, 0);
+
+	/* cursor in screen format (see convmask in vxd_mouse_conv.h) */
+	mouse_ps = (bpp + 7) / 8;
+	for(y = 0; y < (DWORD)mouse_h; y++)
+	{
+		for(x = 0; x < (DWORD)mouse_w; x++)
+		{
+			BYTE *and_px = (BYTE*)mouse_andmask_data + (y*mouse_w + x)*mouse_ps;
+			BYTE *xor_px = (BYTE*)mouse_xormask_data + (y*mouse_w + x)*mouse_ps;
+			BOOL inside = (x <= y) && (x + y/2 < (DWORD)mouse_w);
+			BOOL edge = inside && (x == 0 || x == y);
+
+			memset(and_px, inside ? 0x00 : 0xFF, mouse_ps);
+			memset(xor_px, (inside && !edge) ? 0xFF : 0x00, mouse_ps);
+		}
+	}
+
+	mouse_pointx = 0;
+	mouse_pointy = 0;
+	mouse_swap_valid = FALSE;
+	mouse_valid = TRUE;
+
+	fb_lock_cnt = 0;
+	surface_dirty = FALSE;
+	fence_update = 0;
+	stat.modes++;
+}
+
+/*
+ * DirectDraw like flipping: buffer is written only when it isn't read
+ * by any queued flip, return FALSE when screen doesn't match last buffer.
+ */
+static int flip_test(uint32 flips, uint32 *lock_waits, uint32 *fallbacks)
+{
+	DWORD back[3];
+	DWORD i, y, size;
+	svgasim_screen_t *screen = &sim->screen[0];
+	DWORD last = 0;
+
+	size = (hda->stride + 0xFFFF) & 0xFFFF0000UL;
+	for(i = 0; i < 3; i++)
+	{
+		back[i] = hda->system_surface + (i+1)*size;
+	}
+
+	if(back[2] + size > sim->vram_size)
+	{
+		printf("flip test: not enough VRAM\n");
+		return FALSE;
+	}
+
+	for(i = 0; i < flips; i++)
+	{
+		DWORD offset = back[i % 3];
+		DWORD *px = (DWORD*)(sim->vram + offset);
+		DWORD n;
+
+		while(FBHDA_flip_status(offset) > 0)
+		{
+			(*lock_waits)++;
+			SVGA_Sync();
+		}
+
+		for(n = 0; n < hda->stride/4; n++)
+		{
+			px[n] = (i << 8) ^ n;
+		}
+
+		if(!SVGA_flip(offset))
+		{
+			(*fallbacks)++;
+		}
+		last = offset;
+	}
+
+	host_run();
+
+	/* cursor is drawn to the buffer, so screen has to be same */
+	for(y = 0; y < hda->height; y++)
+	{
+		if(memcmp(screen->pixels + y*screen->pitch, sim->vram + last + y*hda->pitch, hda->width*4) != 0)
+		{
+			return FALSE;
+		}
+	}
+
+	return FBHDA_flip_status(0) == 0;
+}
+
+static double now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int replay(trace_t *t, int cursor_size, uint32 flips)
+{
+	SVGA_capture_rec_t *rec;
+	uint32 pos = 0;
+	uint32 skipped = 0;
+	uint32 time0 = 0, time1 = 0;
+	int first = TRUE;
+	double start, elapsed;
+	int rc;
+
+	if(!replay_init(cursor_size))
+	{
+		printf("device init failed\n");
+		return EXIT_FAILURE;
+	}
+
+	start = now_ms();
+	while((rec = trace_next(t, &pos)) != NULL)
+	{
+		if(first)
+		{
+			time0 = rec->time;
+			first = FALSE;
+		}
+		time1 = rec->time;
+
+		while(present_timer_set && (int)(rec->time - present_deadline) >= 0)
+		{
+			replay_time = present_deadline;
+			present_timer_set = FALSE;
+			SVGA_present_timeout();
+		}
+		replay_time = rec->time;
+
+		/* everything before first mode record was done on unknown screen */
+		if(stat.modes == 0 && rec->type != SVGA_CAPTURE_MODE)
+		{
+			skipped++;
+			continue;
+		}
+
+		switch(rec->type)
+		{
+			case SVGA_CAPTURE_MODE:
+				replay_mode(rec->arg[0], rec->arg[1], rec->arg[2]);
+				break;
+			case SVGA_CAPTURE_ACCESS_BEGIN:
+				FBHDA_access_begin(rec->arg[0]);
+				stat.begins++;
+				break;
+			case SVGA_CAPTURE_ACCESS_RECT:
+				FBHDA_access_rect(rec->arg[0], rec->arg[1], rec->arg[2], rec->arg[3]);
+				stat.rects++;
+				break;
+			case SVGA_CAPTURE_ACCESS_END:
+				FBHDA_access_end(rec->arg[0]);
+				stat.ends++;
+				break;
+			case SVGA_CAPTURE_CURSOR_MOVE:
+				if(rec->arg[2])
+				{
+					stat.cursor_moves_hw++;
+				}
+				else
+				{
+					mouse_move(rec->arg[0], rec->arg[1]);
+					stat.cursor_moves++;
+				}
+				break;
+			case SVGA_CAPTURE_SUBMIT:
+				if(rec->arg[3] == SVGA_CAPTURE_SRC_DRIVER && (rec->arg[0] & SVGA_CB_2D))
+				{
+					stat.recorded_submits++;
+				}
+				break;
+		}
+	}
+
+	if(present_timer_set)
+	{
+		replay_time = present_deadline;
+		present_timer_set = FALSE;
+		SVGA_present_timeout();
+	}
+
+	host_run();
+	elapsed = now_ms() - start;
+
+	if(stat.modes == 0)
+	{
+		printf("no mode record in capture (recorded by older driver?)\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("replayed %u ms of session in %.2f ms (%u records skipped before first mode)\n",
+		time1 - time0, elapsed, skipped);
+	printf("events:   %u rect, %u begin, %u end, %u cursor moves (%u HW), %u mode sets\n",
+		stat.rects, stat.begins, stat.ends, stat.cursor_moves, stat.cursor_moves_hw, stat.modes);
+	printf("submits:  %u (%u presents), recorded 2D driver submits: %u\n",
+		stat.submits, stat.presents, stat.recorded_submits);
+	printf("host:     %u updates, %u blits (%llu px), %u fences\n",
+		sim->stat.updates, sim->stat.blits, (unsigned long long)sim->stat.blit_pixels, sim->stat.fences);
+	printf("pixels:   %llu converted (8/16 bpp), %llu read back\n",
+		(unsigned long long)stat.px_convert, (unsigned long long)stat.px_readback);
+	printf("stalls:   %u fence waits, %u stalled (%u syncs), %u FIFO full\n",
+		stat.fence_waits, stat.fence_stalls, stat.stall_syncs, stat.fifo_full);
+	printf("cursor:   %u redraws\n", stat.cursor_draws);
+	printf("pacing:   %u presents, %u access ends deferred (period %u ms)\n",
+		hda_perf->presents, hda_perf->presents_deferred, present_period);
+
+	if(flips > 0)
+	{
+		uint32 lock_waits = 0, fallbacks = 0;
+		uint32 fence_waits = stat.fence_waits;
+		int match;
+
+		if(hda->bpp != 32)
+		{
+			printf("flip test: last mode isn't 32 bpp\n");
+			return EXIT_FAILURE;
+		}
+
+		match = flip_test(flips, &lock_waits, &fallbacks);
+		printf("flips:    %u queued, %u blocked on full queue, %u fallbacks, %u buffer lock waits, %u fence waits\n",
+			hda_perf->flips, hda_perf->flip_waits, fallbacks, lock_waits, stat.fence_waits - fence_waits);
+		printf("flips:    screen %s last buffer\n", match ? "matches" : "DOESN'T match");
+		if(!match)
+		{
+			return EXIT_FAILURE;
+		}
+	}
+
+	rc = sim->stat.cb_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+	svgasim_destroy(sim);
+
+	return rc;
+}
+
+int main(int argc, char **argv)
+{
+	trace_t trace;
+	const char *filename = NULL;
+	int cursor_size = 32;
+	uint32 flips = 0;
+	int i;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-l") == 0 && i+1 < argc)
+		{
+			host_lag = atoi(argv[++i]);
+			if(host_lag == 0) host_lag = 1;
+		}
+		else if(strcmp(argv[i], "-r") == 0 && i+1 < argc)
+		{
+			int rate = atoi(argv[++i]);
+			present_period = (rate > 0) ? 1000 / rate : 0;
+			if(rate > 0 && present_period == 0) present_period = 1;
+		}
+		else if(strcmp(argv[i], "-a") == 0 && i+1 < argc)
+		{
+			present_area = atoi(argv[++i]);
+			if(present_area > 100) present_area = 100;
+		}
+		else if(strcmp(argv[i], "-F") == 0 && i+1 < argc)
+		{
+			flips = atoi(argv[++i]);
+		}
+		else if(strcmp(argv[i], "-c") == 0 && i+1 < argc)
+		{
+			cursor_size = atoi(argv[++i]);
+			if(cursor_size < 0) cursor_size = 0;
+			if(cursor_size > CURSOR_MAX) cursor_size = CURSOR_MAX;
+		}
+		else
+		{
+			filename = argv[i];
+		}
+	}
+
+	if(filename == NULL)
+	{
+		printf("usage: %s [-l N] [-c size] [-r Hz] [-a pct] [-F N] file.cap\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if(!trace_load(&trace, filename))
+	{
+		return EXIT_FAILURE;
+	}
+
+	return replay(&trace, cursor_size, flips);
+}
@@ -0,0 +1,555 @@
+/*
+ * Mode switch latency benchmark
+ *
+ * Guest build cycles through display modes with ChangeDisplaySettings
+ * (without registry update) and measures each switch. For before/after
+ * numbers run it with HKLM\Software\VMWSVGA\FastModeSwitch = 0 and 1
+ * (reboot after change).
+ *
+ * Host build (-DSVGASIM) runs same mode cycle on software device model
+ * (svgasim.h). Device side of SVGA_setmode is replayed as in vxd_svga.c:
+ * SVGA_setmode_phy (FastModeSwitch = 0) and SVGA_setmode_fast (= 1),
+ * both followed by GMRFB definition. Both variants are run and besides
+ * the time it prints port I/O (every access traps to hypervisor), legacy
+ * mode resets and FIFO drains per switch, because the model doesn't
+ * know how long they take on real host. IRQ sanity check of SVGA_Enable
+ * isn't replayed (model has no IRQ).
+ *
+ * usage: modebench [rounds] [WxHxBPP ...]
+ *
+ * gcc -O2 -fno-strict-aliasing -DSVGASIM -o modebench_sim modebench.c
+ */
+#ifdef SVGASIM
+#include "svgasim.h"
+typedef uint32 DWORD;
+typedef int    BOOL;
+#define TIME_UNIT  "us"
+#define TIME_SCALE 1000.0
+#else
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define TIME_UNIT  "ms"
+#define TIME_SCALE 1.0
+#endif
+
+#define MODES_MAX 16
+#define DEFAULT_ROUNDS 10
+
+typedef struct _bench_mode_t
+{
+	DWORD w;
+	DWORD h;
+	DWORD bpp;
+	double min;
+	double max;
+	double sum;
+	DWORD cnt;
+	DWORD fail;
+} bench_mode_t;
+
+static bench_mode_t modes[MODES_MAX];
+static int modes_cnt = 0;
+
+static void add_mode(DWORD w, DWORD h, DWORD bpp)
+{
+	if(modes_cnt < MODES_MAX)
+	{
+		memset(&modes[modes_cnt], 0, sizeof(bench_mode_t));
+		modes[modes_cnt].w = w;
+		modes[modes_cnt].h = h;
+		modes[modes_cnt].bpp = bpp;
+		modes[modes_cnt].min = 1e30;
+		modes_cnt++;
+	}
+}
+
+#ifdef SVGASIM
+
+/*
+ * Driver side on svgasim (same sequence of register, FIFO and CB
+ * accesses as vxd_svga.c, vxd_svga_cb.c and vmware/svga.c)
+ */
+static svgasim_t *sim;
+static uint32 *ctlbuf;
+static uint32 *cmdbuf;
+static uint32 fence_next = 1;
+static uint64 cb_id = {0, 0};
+
+static BOOL fast_mode_switch = FALSE;
+static BOOL screen_defined = FALSE;
+
+/* events which model doesn't time */
+static DWORD cnt_legacy = 0;
+static DWORD cnt_cb_restart = 0;
+
+static uint32 reg_read(uint32 index)
+{
+	svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_INDEX_PORT, index);
+	return svgasim_inpd(sim, SVGASIM_IO_BASE + SVGA_VALUE_PORT);
+}
+
+static void reg_write(uint32 index, uint32 value)
+{
+	svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_INDEX_PORT, index);
+	svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_VALUE_PORT, value);
+}
+
+static uint32 *fifo_mem()
+{
+	return svgasim_pa_ptr(sim, SVGASIM_FIFO_PA);
+}
+
+/* SVGA_Sync */
+static void drv_sync()
+{
+	reg_write(SVGA_REG_SYNC, 1);
+}
+
+/* SVGA_Flush */
+static void drv_flush()
+{
+	reg_write(SVGA_REG_SYNC, 1);
+	while(reg_read(SVGA_REG_BUSY) != FALSE);
+}
+
+/* FIFO branch of SVGA_CMB_submit with SVGA_CB_SYNC */
+static void fifo_submit_sync(const uint32 *cmd, uint32 dwords)
+{
+	uint32 *fifo = fifo_mem();
+	uint32 next = fifo[SVGA_FIFO_NEXT_CMD];
+	uint32 fence = fence_next++;
+	uint32 i;
+
+	for(i = 0; i < dwords + 2; i++)
+	{
+		fifo[next/4] = (i < dwords) ? cmd[i] : ((i == dwords) ? SVGA_CMD_FENCE : fence);
+		next += 4;
+		if(next >= fifo[SVGA_FIFO_MAX])
+		{
+			next = fifo[SVGA_FIFO_MIN];
+		}
+	}
+	fifo[SVGA_FIFO_NEXT_CMD] = next;
+
+	while((int32)(fifo[SVGA_FIFO_FENCE] - fence) < 0)
+	{
+		drv_sync();
+	}
+}
+
+static uint32 *cb_alloc(uint32 size)
+{
+	uint32 pa;
+	SVGACBHeader *cb = svgasim_phys_alloc(sim, size + sizeof(SVGACBHeader), &pa);
+
+	cb->status = SVGA_CB_STATUS_COMPLETED;
+	cb->ptr.pa.hi  = 0;
+	cb->ptr.pa.low = pa + sizeof(SVGACBHeader);
+
+	return (uint32*)(cb+1);
+}
+
+/* CB submit and wait (SVGA_CB_SYNC) */
+static uint32 cb_submit_sync(uint32 *cmb, uint32 size, uint32 ctx)
+{
+	SVGACBHeader *cb = ((SVGACBHeader*)cmb)-1;
+
+	cb->status      = SVGA_CB_STATUS_NONE;
+	cb->errorOffset = 0;
+	cb->offset      = 0;
+	cb->flags       = SVGA_CB_FLAG_NO_IRQ;
+	cb->dxContext   = 0;
+	cb->id          = cb_id;
+	cb->length      = size;
+
+	if(++cb_id.low == 0) cb_id.hi++;
+
+	reg_write(SVGA_REG_COMMAND_HIGH, 0);
+	reg_write(SVGA_REG_COMMAND_LOW, (cb->ptr.pa.low - sizeof(SVGACBHeader)) | ctx);
+
+	while(cb->status == SVGA_CB_STATUS_NONE)
+	{
+		drv_sync();
+	}
+
+	return cb->status;
+}
+
+/* SVGA_CB_ctx_enable */
+static uint32 ctx_enable(uint32 ctx, uint32 enable)
+{
+	ctlbuf[0] = SVGA_DC_CMD_START_STOP_CONTEXT;
+	ctlbuf[1] = enable;
+	ctlbuf[2] = ctx;
+	return cb_submit_sync(ctlbuf, 12, SVGA_CB_CONTEXT_DEVICE);
+}
+
+/* SVGA_CB_stop, both contexts are running */
+static void cb_stop()
+{
+	ctx_enable(SVGA_CB_CONTEXT_1, 0);
+	drv_sync();
+	ctx_enable(SVGA_CB_CONTEXT_0, 0);
+	drv_sync();
+}
+
+/* SVGA_CB_start */
+static void cb_start()
+{
+	ctx_enable(SVGA_CB_CONTEXT_0, 1);
+	ctx_enable(SVGA_CB_CONTEXT_1, 1);
+	cnt_cb_restart++;
+}
+
+/* SVGA_Enable without IRQ check */
+static void drv_enable()
+{
+	uint32 *fifo = fifo_mem();
+	uint32 fifo_min = reg_read(SVGA_REG_MEM_REGS) * sizeof(uint32);
+
+	if(fifo_min < SVGASIM_PAGE)
+	{
+		fifo_min = SVGASIM_PAGE;
+	}
+
+	fifo[SVGA_FIFO_MIN] = fifo_min;
+	fifo[SVGA_FIFO_MAX] = reg_read(SVGA_REG_MEM_SIZE);
+	fifo[SVGA_FIFO_NEXT_CMD] = fifo_min;
+	fifo[SVGA_FIFO_STOP] = fifo_min;
+
+	reg_write(SVGA_REG_ENABLE, TRUE);
+	reg_write(SVGA_REG_CONFIG_DONE, TRUE);
+}
+
+/* SVGA_regs_snapshot on SVGA_ID_2 device without CAP2 register */
+static void regs_snapshot()
+{
+	static const uint32 regs[] = {
+		SVGA_REG_MAX_WIDTH, SVGA_REG_MAX_HEIGHT, SVGA_REG_FB_START,
+		SVGA_REG_VRAM_SIZE, SVGA_REG_CAPABILITIES, SVGA_REG_MEM_START,
+		SVGA_REG_MEM_SIZE, SVGA_REG_SCRATCH_SIZE, SVGA_REG_MEM_REGS,
+		SVGA_REG_GMR_MAX_IDS, SVGA_REG_GMR_MAX_DESCRIPTOR_LENGTH,
+		SVGA_REG_GMRS_MAX_PAGES, SVGA_REG_MEMORY_SIZE,
+		SVGA_REG_MAX_PRIMARY_MEM, SVGA_REG_SUGGESTED_GBOBJECT_MEM_SIZE_KB,
+		SVGA_REG_SCREENTARGET_MAX_WIDTH, SVGA_REG_SCREENTARGET_MAX_HEIGHT,
+		SVGA_REG_MOB_MAX_SIZE
+	};
+	uint32 i;
+
+	for(i = 0; i < sizeof(regs)/sizeof(regs[0]); i++)
+	{
+		reg_read(regs[i]);
+	}
+}
+
+/* SVGA_SetModeLegacy */
+static void setmode_legacy(uint32 w, uint32 h, uint32 bpp)
+{
+	reg_write(SVGA_REG_ENABLE, FALSE);
+	reg_write(SVGA_REG_WIDTH, w);
+	reg_write(SVGA_REG_HEIGHT, h);
+	reg_write(SVGA_REG_BITS_PER_PIXEL, bpp);
+	reg_read(SVGA_REG_FB_OFFSET);
+	reg_write(SVGA_REG_TRACES, bpp == 32 ? FALSE : TRUE);
+	reg_write(SVGA_REG_ENABLE, TRUE);
+	reg_read(SVGA_REG_BYTES_PER_LINE);
+	drv_flush();
+
+	cnt_legacy++;
+}
+
+/* SVGA_defineScreen */
+static void define_screen(uint32 w, uint32 h, uint32 bpp)
+{
+	static uint32 cmd[1 + sizeof(SVGAScreenObject)/4];
+	SVGAScreenObject *s = (SVGAScreenObject*)(cmd+1);
+
+	cmd[0] = SVGA_CMD_DEFINE_SCREEN;
+	memset(s, 0, sizeof(SVGAScreenObject));
+	s->structSize = sizeof(SVGAScreenObject);
+	s->id = 0;
+	s->flags = SVGA_SCREEN_MUST_BE_SET | SVGA_SCREEN_IS_PRIMARY;
+	s->size.width  = w;
+	s->size.height = h;
+	s->backingStore.pitch = ((bpp + 7)/8 * w + 3) & ~3;
+	s->backingStore.ptr.gmrId = SVGA_GMR_FRAMEBUFFER;
+
+	fifo_submit_sync(cmd, 1 + sizeof(SVGAScreenObject)/4);
+}
+
+/* SVGA_DefineGMRFB */
+static void define_gmrfb(uint32 w, uint32 bpp)
+{
+	SVGAFifoCmdDefineGMRFB *g = (SVGAFifoCmdDefineGMRFB*)(cmdbuf+1);
+
+	cmdbuf[0] = SVGA_CMD_DEFINE_GMRFB;
+	g->ptr.gmrId  = SVGA_GMR_FRAMEBUFFER;
+	g->ptr.offset = 0;
+	g->bytesPerLine = ((bpp + 7)/8 * w + 3) & ~3;
+	g->format.value = 0;
+	g->format.bitsPerPixel = bpp >= 24 ? 32 : 16;
+	g->format.colorDepth   = bpp >= 24 ? 24 : 16;
+
+	cb_submit_sync(cmdbuf, 4 + sizeof(SVGAFifoCmdDefineGMRFB), SVGA_CB_CONTEXT_0);
+}
+
+/* SVGA_setmode_phy */
+static void setmode_phy(uint32 w, uint32 h, uint32 bpp)
+{
+	drv_sync();
+	drv_flush(); /* SVGA_Flush_CB, CB queue is empty */
+
+	cb_stop();
+
+	setmode_legacy(w, h, 32);
+
+	drv_enable();
+	regs_snapshot();
+	drv_flush();
+
+	define_screen(w, h, bpp);
+	drv_enable();
+	drv_flush();
+	drv_sync();
+
+	cb_start();
+
+	drv_sync();
+	drv_flush();
+
+	screen_defined = TRUE;
+}
+
+static BOOL drv_init()
+{
+	uint32 *fifo;
+
+	reg_write(SVGA_REG_ID, SVGA_ID_2);
+	if(reg_read(SVGA_REG_ID) != SVGA_ID_2)
+	{
+		return FALSE;
+	}
+
+	fifo = fifo_mem();
+	fifo[SVGA_FIFO_MIN] = SVGASIM_PAGE;
+	fifo[SVGA_FIFO_MAX] = reg_read(SVGA_REG_MEM_SIZE);
+	fifo[SVGA_FIFO_NEXT_CMD] = fifo[SVGA_FIFO_MIN];
+	fifo[SVGA_FIFO_STOP] = fifo[SVGA_FIFO_MIN];
+
+	reg_write(SVGA_REG_ENABLE, TRUE);
+	reg_write(SVGA_REG_CONFIG_DONE, TRUE);
+
+	ctlbuf = cb_alloc(64);
+	cmdbuf = cb_alloc(4096);
+
+	ctx_enable(SVGA_CB_CONTEXT_0, 1);
+	ctx_enable(SVGA_CB_CONTEXT_1, 1);
+
+	/* boot mode, always full path */
+	setmode_phy(640, 480, 32);
+	define_gmrfb(640, 32);
+
+	return TRUE;
+}
+
+static double now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static BOOL set_mode(bench_mode_t *m, double *ms)
+{
+	double t1, t2;
+
+	if(((m->bpp + 7)/8 * m->w + 3) / 4 * 4 * m->h > sim->vram_size)
+	{
+		return FALSE;
+	}
+
+	t1 = now_ms();
+	if(fast_mode_switch && screen_defined)
+	{
+		define_screen(m->w, m->h, m->bpp); /* SVGA_setmode_fast */
+	}
+	else
+	{
+		setmode_phy(m->w, m->h, m->bpp);
+	}
+	define_gmrfb(m->w, m->bpp);
+	t2 = now_ms();
+
+	*ms = t2 - t1;
+
+	return TRUE;
+}
+
+#else /* !SVGASIM */
+
+static BOOL set_mode(bench_mode_t *m, double *ms)
+{
+	DEVMODEA dm;
+	LARGE_INTEGER freq, t1, t2;
+	LONG rc;
+
+	memset(&dm, 0, sizeof(dm));
+	dm.dmSize = sizeof(dm);
+	dm.dmPelsWidth  = m->w;
+	dm.dmPelsHeight = m->h;
+	dm.dmBitsPerPel = m->bpp;
+	dm.dmFields = DM_PELSWIDTH | DM_PELSHEIGHT | DM_BITSPERPEL;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&t1);
+	rc = ChangeDisplaySettingsA(&dm, CDS_FULLSCREEN);
+	QueryPerformanceCounter(&t2);
+
+	*ms = (double)(t2.QuadPart - t1.QuadPart) * 1000.0 / (double)freq.QuadPart;
+
+	return rc == DISP_CHANGE_SUCCESSFUL;
+}
+
+#endif /* SVGASIM */
+
+static void bench_run(int rounds)
+{
+	int r, i;
+	double ms;
+
+	for(i = 0; i < modes_cnt; i++)
+	{
+		bench_mode_t *m = &modes[i];
+		m->min = 1e30;
+		m->max = 0;
+		m->sum = 0;
+		m->cnt = 0;
+		m->fail = 0;
+	}
+
+	for(r = 0; r < rounds; r++)
+	{
+		for(i = 0; i < modes_cnt; i++)
+		{
+			bench_mode_t *m = &modes[i];
+			if(set_mode(m, &ms))
+			{
+				ms *= TIME_SCALE;
+				if(ms < m->min) m->min = ms;
+				if(ms > m->max) m->max = ms;
+				m->sum += ms;
+				m->cnt++;
+			}
+			else
+			{
+				m->fail++;
+			}
+		}
+	}
+}
+
+static void bench_print()
+{
+	int i;
+
+	printf("%-16s %10s %10s %10s %6s\n", "mode", "avg " TIME_UNIT, "min " TIME_UNIT, "max " TIME_UNIT, "fail");
+	for(i = 0; i < modes_cnt; i++)
+	{
+		bench_mode_t *m = &modes[i];
+		char name[48];
+
+		sprintf(name, "%lux%lux%lu", (unsigned long)m->w, (unsigned long)m->h, (unsigned long)m->bpp);
+		if(m->cnt > 0)
+		{
+			printf("%-16s %10.2f %10.2f %10.2f %6lu\n", name,
+				m->sum / m->cnt, m->min, m->max, (unsigned long)m->fail);
+		}
+		else
+		{
+			printf("%-16s %10s %10s %10s %6lu\n", name, "-", "-", "-", (unsigned long)m->fail);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int rounds = DEFAULT_ROUNDS;
+	int i;
+
+	if(argc > 1)
+	{
+		rounds = atoi(argv[1]);
+		if(rounds <= 0) rounds = DEFAULT_ROUNDS;
+	}
+
+	for(i = 2; i < argc; i++)
+	{
+		unsigned int w, h, bpp;
+		if(sscanf(argv[i], "%ux%ux%u", &w, &h, &bpp) == 3)
+		{
+			add_mode(w, h, bpp);
+		}
+	}
+
+	if(modes_cnt == 0)
+	{
+		/* resolution changes and bpp changes at same resolution */
+		add_mode(800,  600, 32);
+		add_mode(1024, 768, 32);
+		add_mode(1024, 768, 16);
+		add_mode(640,  480, 32);
+		add_mode(640,  480, 8);
+	}
+
+#ifdef SVGASIM
+	for(fast_mode_switch = 0; fast_mode_switch <= 1; fast_mode_switch++)
+	{
+		svgasim_stat_t st;
+		DWORD legacy, restarts, sets;
+		int j;
+
+		sim = svgasim_create(32*1024*1024, 256*1024, 16*1024*1024);
+		screen_defined = FALSE;
+		if(!drv_init())
+		{
+			printf("device init failed\n");
+			return EXIT_FAILURE;
+		}
+
+		st = sim->stat;
+		legacy = cnt_legacy;
+		restarts = cnt_cb_restart;
+
+		bench_run(rounds);
+
+		for(sets = 0, j = 0; j < modes_cnt; j++)
+		{
+			sets += modes[j].cnt;
+		}
+
+		printf("FastModeSwitch = %d\n", fast_mode_switch);
+		bench_print();
+		if(sets > 0)
+		{
+			printf("per switch: %.1f port I/O, %.1f FIFO syncs, %.2f legacy mode resets, %.2f CB context restarts\n\n",
+				(double)((sim->stat.port_in + sim->stat.port_out) - (st.port_in + st.port_out)) / sets,
+				(double)(sim->stat.syncs - st.syncs) / sets,
+				(double)(cnt_legacy - legacy) / sets,
+				(double)(cnt_cb_restart - restarts) / sets);
+		}
+
+		svgasim_destroy(sim);
+	}
+#else
+	bench_run(rounds);
+
+	/* back to registry mode */
+	ChangeDisplaySettingsA(NULL, 0);
+
+	bench_print();
+#endif
+
+	return EXIT_SUCCESS;
+}
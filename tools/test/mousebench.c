@@ -0,0 +1,294 @@
+/*
+ * Host benchmark of software cursor kernels (vxd_mouse_conv.h)
+ *
+ * Compares span kernels with per-pixel clipped reference (original
+ * implementation) and verify, that both produce same screen.
+ *
+ * gcc -O2 -fno-strict-aliasing -o mousebench mousebench.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef unsigned char  BYTE;
+typedef unsigned short WORD;
+typedef unsigned int   DWORD;
+typedef int            BOOL;
+
+#define TRUE  1
+#define FALSE 0
+
+#include "../../cursor.h"
+
+#define SCREEN_W 1024
+#define SCREEN_H 768
+#define ITERS    20000
+
+typedef struct _fake_hda_t
+{
+	void *vram_pm32;
+	DWORD surface;
+	DWORD pitch;
+	DWORD width;
+	DWORD height;
+	DWORD bpp;
+} fake_hda_t;
+
+static fake_hda_t fake_hda;
+static fake_hda_t *hda = &fake_hda;
+
+/* same statics as vxd_mouse.c */
+static void *mouse_andmask_data = NULL;
+static void *mouse_xormask_data = NULL;
+static void *mouse_swap_data = NULL;
+static void *mouse_swap_back = NULL;
+static DWORD mouse_mem_size = 0;
+
+static int mouse_w = 0;
+static int mouse_h = 0;
+static int mouse_pointx = 0;
+static int mouse_pointy = 0;
+static int mouse_swap_x = 0;
+static int mouse_swap_y = 0;
+static int mouse_swap_w = 0;
+static int mouse_swap_h = 0;
+static int mouse_swap_ox = 0;
+static int mouse_swap_oy = 0;
+static int mouse_swap_valid = FALSE;
+static int mouse_ps = 0;
+
+#include "../../vxd_mouse_conv.h"
+
+/*
+ * Reference: per-pixel clip, separate save and blit pass
+ */
+static BYTE *ref_save = NULL;
+static int ref_x, ref_y, ref_valid = FALSE;
+
+static void ref_blit(int mx, int my)
+{
+	int x, y, b;
+	int real_x = mx - mouse_pointx;
+	int real_y = my - mouse_pointy;
+	BYTE *screen = ((BYTE*)hda->vram_pm32) + hda->surface;
+	BYTE *and_mask = mouse_andmask_data;
+	BYTE *xor_mask = mouse_xormask_data;
+	BYTE *buf = ref_save;
+
+	for(y = 0; y < mouse_h; y++)
+	{
+		for(x = 0; x < mouse_w; x++)
+		{
+			int sx = real_x + x;
+			int sy = real_y + y;
+			if(sx >= 0 && sx < (int)hda->width && sy >= 0 && sy < (int)hda->height)
+			{
+				for(b = 0; b < mouse_ps; b++)
+				{
+					*(buf++) = screen[hda->pitch*sy + sx*mouse_ps + b];
+				}
+			}
+		}
+	}
+
+	for(y = 0; y < mouse_h; y++)
+	{
+		for(x = 0; x < mouse_w; x++)
+		{
+			int sx = real_x + x;
+			int sy = real_y + y;
+			if(sx >= 0 && sx < (int)hda->width && sy >= 0 && sy < (int)hda->height)
+			{
+				for(b = 0; b < mouse_ps; b++)
+				{
+					BYTE *p = &screen[hda->pitch*sy + sx*mouse_ps + b];
+					*p &= and_mask[(y*mouse_w + x)*mouse_ps + b];
+					*p ^= xor_mask[(y*mouse_w + x)*mouse_ps + b];
+				}
+			}
+		}
+	}
+
+	ref_x = mx;
+	ref_y = my;
+	ref_valid = TRUE;
+}
+
+static void ref_restore()
+{
+	int x, y, b;
+	int real_x = ref_x - mouse_pointx;
+	int real_y = ref_y - mouse_pointy;
+	BYTE *screen = ((BYTE*)hda->vram_pm32) + hda->surface;
+	BYTE *buf = ref_save;
+
+	if(!ref_valid) return;
+
+	for(y = 0; y < mouse_h; y++)
+	{
+		for(x = 0; x < mouse_w; x++)
+		{
+			int sx = real_x + x;
+			int sy = real_y + y;
+			if(sx >= 0 && sx < (int)hda->width && sy >= 0 && sy < (int)hda->height)
+			{
+				for(b = 0; b < mouse_ps; b++)
+				{
+					screen[hda->pitch*sy + sx*mouse_ps + b] = *(buf++);
+				}
+			}
+		}
+	}
+
+	ref_valid = FALSE;
+}
+
+static void fill_random(BYTE *ptr, DWORD size)
+{
+	while(size--)
+	{
+		*(ptr++) = rand() & 0xFF;
+	}
+}
+
+/* small moves (overlapping) mixed with jumps and screen edges */
+static void move_pos(int i, int *x, int *y)
+{
+	static const int path[][2] = {
+		{500, 400}, {503, 401}, {507, 404}, {512, 406}, {520, 410},
+		{-10, 300}, {-8, 302}, {5, -20}, {1020, 760}, {1015, 755},
+		{300, 0}, {302, 2}, {700, 700}, {690, 695}, {1023, 10}
+	};
+	*x = path[i % 15][0];
+	*y = path[i % 15][1];
+}
+
+static double elapsed(clock_t start)
+{
+	return (double)(clock() - start) * 1000.0 / CLOCKS_PER_SEC;
+}
+
+static int run(int size, int bpp)
+{
+	BYTE *screen_ref;
+	BYTE *screen_new;
+	DWORD screen_size;
+	clock_t start;
+	double t_ref, t_span, t_move;
+	int i, x, y;
+
+	mouse_ps = (bpp + 7) / 8;
+	mouse_w = size;
+	mouse_h = size;
+	mouse_pointx = size/4;
+	mouse_pointy = size/4;
+	mouse_mem_size = size*size*4;
+	mouse_swap_valid = FALSE;
+	ref_valid = FALSE;
+
+	hda->width  = SCREEN_W;
+	hda->height = SCREEN_H;
+	hda->bpp    = bpp;
+	hda->pitch  = (SCREEN_W * mouse_ps + 3) & ~3;
+	hda->surface = 0;
+
+	screen_size = hda->pitch * SCREEN_H;
+	screen_ref = malloc(screen_size);
+	screen_new = malloc(screen_size);
+
+	fill_random(screen_ref, screen_size);
+	memcpy(screen_new, screen_ref, screen_size);
+	fill_random(mouse_andmask_data, mouse_mem_size);
+	fill_random(mouse_xormask_data, mouse_mem_size);
+
+	/* reference: restore + save + blit */
+	hda->vram_pm32 = screen_ref;
+	start = clock();
+	for(i = 0; i < ITERS; i++)
+	{
+		move_pos(i, &x, &y);
+		ref_restore();
+		ref_blit(x, y);
+	}
+	t_ref = elapsed(start);
+
+	/* span: restore + fused save/blit */
+	hda->vram_pm32 = screen_new;
+	start = clock();
+	for(i = 0; i < ITERS; i++)
+	{
+		move_pos(i, &x, &y);
+		draw_restore();
+		draw_blit(x, y);
+	}
+	t_span = elapsed(start);
+
+	if(memcmp(screen_ref, screen_new, screen_size) != 0)
+	{
+		printf("%2dx%2d %2d bpp: span result mismatch!\n", size, size, bpp);
+		return FALSE;
+	}
+
+	/* fused restore/save/blit (continue from same state) */
+	hda->vram_pm32 = screen_ref;
+	for(i = 0; i < ITERS; i++)
+	{
+		move_pos(i, &x, &y);
+		ref_restore();
+		ref_blit(x, y);
+	}
+
+	hda->vram_pm32 = screen_new;
+	start = clock();
+	for(i = 0; i < ITERS; i++)
+	{
+		move_pos(i, &x, &y);
+		draw_move(x, y);
+	}
+	t_move = elapsed(start);
+
+	if(memcmp(screen_ref, screen_new, screen_size) != 0)
+	{
+		printf("%2dx%2d %2d bpp: move result mismatch!\n", size, size, bpp);
+		return FALSE;
+	}
+
+	printf("%2dx%2d %2d bpp: reference %8.2f ms, span %8.2f ms, fused move %8.2f ms\n",
+		size, size, bpp, t_ref, t_span, t_move);
+
+	free(screen_ref);
+	free(screen_new);
+
+	return TRUE;
+}
+
+int main()
+{
+	static const int sizes[] = {32, 48, 64};
+	static const int bpps[]  = {8, 16, 24, 32};
+	int s, b;
+	int rc = EXIT_SUCCESS;
+	DWORD ms = 64*64*4;
+
+	mouse_andmask_data = malloc(ms);
+	mouse_xormask_data = malloc(ms);
+	mouse_swap_data    = malloc(ms);
+	mouse_swap_back    = malloc(ms);
+	ref_save           = malloc(ms);
+
+	printf("%d iterations per test, screen %dx%d\n", ITERS, SCREEN_W, SCREEN_H);
+
+	for(s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+	{
+		for(b = 0; b < sizeof(bpps)/sizeof(bpps[0]); b++)
+		{
+			if(!run(sizes[s], bpps[b]))
+			{
+				rc = EXIT_FAILURE;
+			}
+		}
+	}
+
+	return rc;
+}
@@ -0,0 +1,800 @@
+/*
+ * Host benchmark of driver kernels with golden output checks
+ *
+ * Kernels are compiled from the driver headers with small shims:
+ *   vxd_color.h       - blit16, blit8, readback16
+ *   vxd_mouse_conv.h  - software cursor (draw_blit, draw_restore, draw_move)
+ *   vxd_svga_mask.h   - HW cursor mask conversion (conv_mask)
+ *   vxd_gamma.h       - gamma ramp handling
+ *   vxd_svga_cache.h  - spare region cache
+ *
+ * Every kernel output is compared with simple per-pixel (per-item)
+ * reference, program exit with failure on first mismatch so it can be used
+ * as regression test before building the driver.
+ *
+ * Throughput is reported in pixels per cycle (RDTSC on x86, otherwise
+ * pixels per ns) and in operations per second.
+ *
+ * usage:
+ *   perfbench [-q]      (-q: quick, less iterations)
+ *
+ * gcc -O2 -fno-strict-aliasing -o perfbench perfbench.c
+ */
+#include "svgasim.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define BENCH_TSC
+#endif
+
+typedef unsigned char  BYTE;
+typedef unsigned short WORD;
+typedef unsigned int   DWORD;
+typedef int            BOOL;
+typedef void           VOID;
+typedef void          *PVOID;
+
+#include "../../vmware/svga3d_dx.h"
+
+#define SVGA
+#include "../../3d_accel.h"
+#include "../../cursor.h"
+
+/*
+ * shims
+ */
+#define P_SIZE 4096
+
+static DWORD pages_alloc = 0;
+static DWORD pages_freed = 0;
+
+static void _PageFree(PVOID mem, DWORD flags)
+{
+	free(mem);
+	pages_freed++;
+}
+
+#define dbg_printf(...) do{}while(0)
+
+typedef struct _fake_hda_t
+{
+	void *vram_pm32;
+	DWORD surface;
+	DWORD pitch;
+	DWORD width;
+	DWORD height;
+	DWORD bpp;
+	DWORD gamma;
+	DWORD gamma_update;
+} fake_hda_t;
+
+static fake_hda_t fake_hda;
+static fake_hda_t *hda = &fake_hda;
+
+/* same statics as vxd_mouse.c */
+static void *mouse_andmask_data = NULL;
+static void *mouse_xormask_data = NULL;
+static void *mouse_swap_data = NULL;
+static void *mouse_swap_back = NULL;
+static DWORD mouse_mem_size = 0;
+
+static int mouse_w = 0;
+static int mouse_h = 0;
+static int mouse_pointx = 0;
+static int mouse_pointy = 0;
+static int mouse_swap_x = 0;
+static int mouse_swap_y = 0;
+static int mouse_swap_w = 0;
+static int mouse_swap_h = 0;
+static int mouse_swap_ox = 0;
+static int mouse_swap_oy = 0;
+static int mouse_swap_valid = FALSE;
+static int mouse_ps = 0;
+
+#include "../../vxd_color.h"
+#include "../../vxd_mouse_conv.h"
+#include "../../vxd_svga_mask.h"
+#include "../../vxd_gamma.h"
+#include "../../vxd_svga_cache.h"
+
+/*
+ * timing
+ */
+typedef struct _bench_t
+{
+	uint64_t ticks;
+	uint64_t ns;
+} bench_t;
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t now_ticks()
+{
+#ifdef BENCH_TSC
+	return __rdtsc();
+#else
+	return now_ns();
+#endif
+}
+
+static void bench_start(bench_t *b)
+{
+	b->ns = now_ns();
+	b->ticks = now_ticks();
+}
+
+static void bench_stop(bench_t *b)
+{
+	b->ticks = now_ticks() - b->ticks;
+	b->ns = now_ns() - b->ns;
+	if(b->ticks == 0) b->ticks = 1;
+	if(b->ns == 0) b->ns = 1;
+}
+
+#ifdef BENCH_TSC
+# define TICK_NAME "cycle"
+#else
+# define TICK_NAME "ns"
+#endif
+
+static void report(const char *name, const char *cfg, bench_t *b, double pixels, double ops)
+{
+	if(pixels > 0)
+	{
+		printf("%-12s %-18s %8.3f px/" TICK_NAME " %12.0f ops/s\n",
+			name, cfg, pixels / (double)b->ticks, ops * 1e9 / (double)b->ns);
+	}
+	else
+	{
+		printf("%-12s %-18s %17s %12.0f ops/s\n",
+			name, cfg, "", ops * 1e9 / (double)b->ns);
+	}
+}
+
+static int failed = 0;
+
+static void fail(const char *name, const char *cfg, const char *what)
+{
+	printf("%-12s %-18s MISMATCH: %s\n", name, cfg, what);
+	failed++;
+}
+
+static DWORD rnd_state = 0x12345678;
+
+static DWORD rnd()
+{
+	rnd_state = rnd_state * 1103515245 + 12345;
+	return rnd_state >> 8;
+}
+
+static void fill_random(void *ptr, DWORD size)
+{
+	BYTE *p = ptr;
+	while(size--)
+	{
+		*(p++) = rnd() & 0xFF;
+	}
+}
+
+static const int resolutions[][2] = {
+	{640, 480}, {800, 600}, {1024, 768}, {1280, 1024}, {1920, 1080}
+};
+
+#define RESOLUTIONS (sizeof(resolutions)/sizeof(resolutions[0]))
+
+static DWORD pixel_budget = 64*1024*1024;
+
+static DWORD iters_for(DWORD pixels)
+{
+	DWORD n = pixel_budget / pixels;
+	return n ? n : 1;
+}
+
+/*
+ * Color conversion (vxd_color.h)
+ */
+static DWORD ref_565to888(DWORD px)
+{
+	DWORD r = (px >> 11) & 0x1F;
+	DWORD g = (px >>  5) & 0x3F;
+	DWORD b =  px        & 0x1F;
+	return (r << 19) | (g << 10) | (b << 3);
+}
+
+static DWORD ref_888to565(DWORD px)
+{
+	DWORD r = (px >> 16) & 0xFF;
+	DWORD g = (px >>  8) & 0xFF;
+	DWORD b =  px        & 0xFF;
+	return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+}
+
+static void bench_color(int w, int h)
+{
+	char cfg[32];
+	DWORD pitch16 = w*2;
+	DWORD pitch32 = w*4;
+	DWORD pixels = w*h;
+	DWORD iters = iters_for(pixels);
+	WORD  *fb16   = malloc(pitch16*h);
+	WORD  *back16 = malloc(pitch16*h);
+	BYTE  *fb8    = malloc(w*h);
+	DWORD *fb32   = malloc(pitch32*h);
+	bench_t b;
+	DWORD i;
+	int x, y;
+
+	fill_random(fb16, pitch16*h);
+	fill_random(fb8, w*h);
+	fill_random(palette_emulation, sizeof(palette_emulation));
+
+	/* blit16 */
+	sprintf(cfg, "%dx%dx16", w, h);
+	bench_start(&b);
+	for(i = 0; i < iters; i++)
+	{
+		blit16(fb16, pitch16, fb32, pitch32, 0, 0, w, h);
+	}
+	bench_stop(&b);
+
+	for(y = 0; y < h; y++)
+	{
+		for(x = 0; x < w; x++)
+		{
+			if(fb32[y*w + x] != ref_565to888(fb16[y*w + x]))
+			{
+				fail("blit16", cfg, "pixel differs from reference");
+				y = h;
+				break;
+			}
+		}
+	}
+	report("blit16", cfg, &b, (double)pixels*iters, iters);
+
+	/* readback16, 565 -> 888 -> 565 have to be lossless */
+	bench_start(&b);
+	for(i = 0; i < iters; i++)
+	{
+		readback16(fb32, pitch32, back16, pitch16, 0, 0, w, h);
+	}
+	bench_stop(&b);
+
+	for(y = 0; y < h; y++)
+	{
+		for(x = 0; x < w; x++)
+		{
+			if(back16[y*w + x] != ref_888to565(fb32[y*w + x]) ||
+				back16[y*w + x] != fb16[y*w + x])
+			{
+				fail("readback16", cfg, "round trip is not lossless");
+				y = h;
+				break;
+			}
+		}
+	}
+	report("readback16", cfg, &b, (double)pixels*iters, iters);
+
+	/* blit8 */
+	sprintf(cfg, "%dx%dx8", w, h);
+	bench_start(&b);
+	for(i = 0; i < iters; i++)
+	{
+		blit8(fb8, w, fb32, pitch32, 0, 0, w, h);
+	}
+	bench_stop(&b);
+
+	for(y = 0; y < h; y++)
+	{
+		for(x = 0; x < w; x++)
+		{
+			if(fb32[y*w + x] != palette_emulation[fb8[y*w + x]])
+			{
+				fail("blit8", cfg, "pixel differs from palette");
+				y = h;
+				break;
+			}
+		}
+	}
+	report("blit8", cfg, &b, (double)pixels*iters, iters);
+
+	/* partial rectangle must not touch pixels outside */
+	memset(fb32, 0xCC, pitch32*h);
+	blit16(fb16, pitch16, fb32, pitch32, 7, 5, w/3, h/4);
+	for(y = 0; y < h; y++)
+	{
+		for(x = 0; x < w; x++)
+		{
+			BOOL in = (x >= 7 && x < 7 + w/3 && y >= 5 && y < 5 + h/4);
+			DWORD expect = in ? ref_565to888(fb16[y*w + x]) : 0xCCCCCCCC;
+			if(fb32[y*w + x] != expect)
+			{
+				sprintf(cfg, "%dx%dx16", w, h);
+				fail("blit16 rect", cfg, "write outside of rectangle");
+				y = h;
+				break;
+			}
+		}
+	}
+
+	free(fb16);
+	free(back16);
+	free(fb8);
+	free(fb32);
+}
+
+/*
+ * Software cursor (vxd_mouse_conv.h)
+ */
+#define CURSOR_SIZE 32
+#define CURSOR_PATH 16
+
+static void cursor_path(int i, int w, int h, int *x, int *y)
+{
+	/* small moves (overlapping) mixed with jumps and screen edges, in 1/1000 of screen */
+	static const int path[CURSOR_PATH][2] = {
+		{500, 500}, {503, 502}, {507, 506}, {512, 509}, {520, 515},
+		{-10, 400}, {-8, 403}, {5, -25}, {999, 990}, {994, 984},
+		{300, 0}, {302, 3}, {700, 900}, {690, 893}, {999, 13}, {250, 250}
+	};
+	*x = path[i % CURSOR_PATH][0] * w / 1000;
+	*y = path[i % CURSOR_PATH][1] * h / 1000;
+}
+
+static void bench_cursor(int w, int h, int bpp)
+{
+	char cfg[32];
+	BYTE *screen_orig;
+	BYTE *screen_ref;
+	BYTE *screen_new;
+	DWORD screen_size;
+	DWORD iters = (iters_for(CURSOR_SIZE*CURSOR_SIZE*2) / 8 / CURSOR_PATH + 1) * CURSOR_PATH;
+	bench_t b;
+	DWORD i;
+	int x, y;
+
+	sprintf(cfg, "%dx%dx%d", w, h, bpp);
+
+	mouse_ps = (bpp + 7) / 8;
+	mouse_w = CURSOR_SIZE;
+	mouse_h = CURSOR_SIZE;
+	mouse_pointx = CURSOR_SIZE/4;
+	mouse_pointy = CURSOR_SIZE/4;
+	mouse_mem_size = CURSOR_SIZE*CURSOR_SIZE*4;
+
+	hda->width   = w;
+	hda->height  = h;
+	hda->bpp     = bpp;
+	hda->pitch   = (w * mouse_ps + 3) & ~3;
+	hda->surface = 0;
+
+	screen_size = hda->pitch * h;
+	screen_orig = malloc(screen_size);
+	screen_ref  = malloc(screen_size);
+	screen_new  = malloc(screen_size);
+
+	fill_random(screen_orig, screen_size);
+	fill_random(mouse_andmask_data, mouse_mem_size);
+	fill_random(mouse_xormask_data, mouse_mem_size);
+	memcpy(screen_ref, screen_orig, screen_size);
+	memcpy(screen_new, screen_orig, screen_size);
+
+	/* reference: separate restore and blit */
+	hda->vram_pm32 = screen_ref;
+	mouse_swap_valid = FALSE;
+	for(i = 0; i < CURSOR_PATH; i++)
+	{
+		cursor_path(i, w, h, &x, &y);
+		draw_restore();
+		draw_blit(x, y);
+	}
+
+	/* fused move */
+	hda->vram_pm32 = screen_new;
+	mouse_swap_valid = FALSE;
+	bench_start(&b);
+	for(i = 0; i < iters; i++)
+	{
+		cursor_path(i, w, h, &x, &y);
+		draw_move(x, y);
+	}
+	bench_stop(&b);
+
+	/* iters is multiple of CURSOR_PATH so both ends at same position */
+	if(memcmp(screen_ref, screen_new, screen_size) != 0)
+	{
+		fail("cursor move", cfg, "differs from restore+blit");
+	}
+
+	draw_restore();
+	hda->vram_pm32 = screen_ref;
+	mouse_swap_valid = TRUE;
+	draw_restore();
+
+	if(memcmp(screen_orig, screen_new, screen_size) != 0 ||
+		memcmp(screen_orig, screen_ref, screen_size) != 0)
+	{
+		fail("cursor move", cfg, "screen not restored");
+	}
+
+	report("cursor move", cfg, &b, (double)iters*CURSOR_SIZE*CURSOR_SIZE, iters);
+
+	free(screen_orig);
+	free(screen_ref);
+	free(screen_new);
+}
+
+/*
+ * HW cursor masks (vxd_svga_mask.h)
+ */
+static BOOL ref_check_mask(BYTE *in, DWORD in_bpp, BYTE *out, DWORD out_bpp, int w, int h, int pitch)
+{
+	int x, y;
+
+	for(y = 0; y < h; y++)
+	{
+		for(x = 0; x < w; x++)
+		{
+			DWORD expect;
+			DWORD real;
+
+			if(out_bpp == 1)
+			{
+				DWORD out_pitch = pitch + (pitch % 4);
+				expect = (in[y*pitch + x/8] >> (7 - (x % 8))) & 1;
+				real = (out[y*out_pitch + x/8] >> (7 - (x % 8))) & 1;
+			}
+			else
+			{
+				real = ((DWORD*)out)[y*w + x];
+				switch(in_bpp)
+				{
+					case 1:
+						expect = ((in[y*pitch + x/8] >> (7 - (x % 8))) & 1) ? 0x00FFFFFF : 0;
+						break;
+					case 16:
+						expect = ref_565to888(((WORD*)in)[y*w + x]);
+						break;
+					default:
+						expect = ((DWORD*)in)[y*w + x];
+						break;
+				}
+			}
+
+			if(expect != real)
+			{
+				return FALSE;
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static void bench_mask(int size, DWORD in_bpp, BOOL force32)
+{
+	char cfg[32];
+	int pitch = (in_bpp == 1) ? size/8 : size*in_bpp/8;
+	DWORD iters = iters_for(size*size) / 16;
+	BYTE *in = malloc(pitch*size);
+	BYTE *out = malloc(size*size*4 + 4*size);
+	DWORD out_bpp = 0;
+	DWORD out_size = 0;
+	bench_t b;
+	DWORD i;
+
+	sprintf(cfg, "%dx%d %ld>%s", size, size, (long)in_bpp, force32 ? "32" : "n");
+
+	fill_random(in, pitch*size);
+
+	bench_start(&b);
+	for(i = 0; i < iters; i++)
+	{
+		out_size = conv_mask(in, in_bpp, out, &out_bpp, size, size, pitch, force32);
+	}
+	bench_stop(&b);
+
+	if(out_size == 0 || !ref_check_mask(in, in_bpp, out, out_bpp, size, size, pitch))
+	{
+		fail("conv_mask", cfg, "differs from reference");
+	}
+
+	report("conv_mask", cfg, &b, (double)iters*size*size, iters);
+
+	free(in);
+	free(out);
+}
+
+/*
+ * Gamma ramp (vxd_gamma.h), same steps as FBHDA_gamma_set
+ */
+static WORD gamma_ramp[3][256];
+
+static BOOL gamma_apply(WORD *new_ramp)
+{
+	DWORD gamma;
+
+	if(gamma_ramp_quirk(new_ramp) == 1)
+	{
+		gamma = gamma_from_ramp(new_ramp, 64);
+		if(gamma >= GAMMA_MIN && gamma < GAMMA_MAX)
+		{
+			hda->gamma = gamma;
+			hda->gamma_update++;
+			gamma_ramp_expand(&gamma_ramp[0][0], new_ramp);
+			return TRUE;
+		}
+	}
+	else
+	{
+		gamma = gamma_from_ramp(new_ramp, 128);
+		if(gamma >= GAMMA_MIN && gamma < GAMMA_MAX)
+		{
+			hda->gamma = gamma;
+			hda->gamma_update++;
+			memcpy(&gamma_ramp[0][0], new_ramp, sizeof(gamma_ramp));
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+static void bench_gamma()
+{
+	static WORD linear[3*256];
+	static WORD id_ramp[3*256];
+	static WORD dark[3*256];
+	DWORD iters = iters_for(256*3) / 16;
+	bench_t b;
+	DWORD i;
+	int c;
+
+	for(c = 0; c < 3; c++)
+	{
+		for(i = 0; i < 256; i++)
+		{
+			DWORD v2 = (i*2 > 255) ? 255 : i*2;
+			linear[c*256 + i]  = (i << 8) | i;
+			id_ramp[c*256 + i] = (v2 << 8) | v2;
+			dark[c*256 + i]    = 0;
+		}
+	}
+
+	/* golden: linear ramp = gamma at 128, ID ramp stretched to same curve */
+	if(gamma_ramp_quirk(linear) != 2 || gamma_ramp_quirk(id_ramp) != 1)
+	{
+		fail("gamma", "quirk", "wrong ramp layout detected");
+	}
+
+	if(!gamma_apply(linear) || hda->gamma != gamma_table[128] ||
+		memcmp(gamma_ramp, linear, sizeof(gamma_ramp)) != 0)
+	{
+		fail("gamma", "linear", "wrong gamma or ramp");
+	}
+
+	if(!gamma_apply(id_ramp) || hda->gamma != gamma_table[128])
+	{
+		fail("gamma", "quirk 1", "wrong gamma");
+	}
+
+	for(c = 0; c < 3; c++)
+	{
+		for(i = 0; i < 256; i++)
+		{
+			if(gamma_ramp[c][i] != id_ramp[c*256 + i/2])
+			{
+				fail("gamma", "quirk 1", "ramp not expanded");
+				c = 3;
+				break;
+			}
+		}
+	}
+
+	if(gamma_apply(dark))
+	{
+		fail("gamma", "dark", "out of range gamma accepted");
+	}
+
+	bench_start(&b);
+	for(i = 0; i < iters; i++)
+	{
+		gamma_apply((i & 1) ? id_ramp : linear);
+	}
+	bench_stop(&b);
+
+	report("gamma_set", "3x256", &b, (double)iters*256*3, iters);
+}
+
+/*
+ * Region cache (vxd_svga_cache.h)
+ */
+#define CACHE_LIVE  64
+#define CACHE_SIZES 24
+
+static void region_new(SVGA_region_info_t *r, DWORD size)
+{
+	memset(r, 0, sizeof(SVGA_region_info_t));
+	r->size = size;
+	r->region_address = malloc(16);
+	r->mob_address = malloc(16);
+	r->address = r->region_address;
+	pages_alloc += 2;
+}
+
+static void region_free(SVGA_region_info_t *r)
+{
+	if(!cache_insert(r))
+	{
+		_PageFree(r->region_address, 0);
+		_PageFree(r->mob_address, 0);
+	}
+}
+
+static void cache_flush()
+{
+	int i;
+	for(i = 0; i < cache_state.free_index_max; i++)
+	{
+		cache_delete(i);
+	}
+	cache_init();
+}
+
+static void bench_cache()
+{
+	static const DWORD sizes[CACHE_SIZES] = {
+		4096, 8192, 12288, 16384, 65536, 65536+4096, 131072, 262144,
+		4096, 4096, 8192, 16384, 524288, 1024*1024, 2*1024*1024, 3*1024*1024,
+		4096, 8192, 32768, 49152, 4*1024*1024, 8*1024*1024, 32*1024*1024, 48*1024*1024
+	};
+	SVGA_region_info_t live[CACHE_LIVE];
+	SVGA_region_info_t r1, r2, r3;
+	DWORD iters = iters_for(1) / 64;
+	DWORD hits = 0;
+	bench_t b;
+	DWORD i;
+	char cfg[32];
+
+	cache_init();
+	cache_enable(TRUE);
+
+	/* golden: exact size is reused, same memory is returned */
+	region_new(&r1, 4096);
+	region_new(&r2, 65536);
+	region_new(&r3, 1024*1024);
+	if(!cache_insert(&r1) || !cache_insert(&r2) || !cache_insert(&r3))
+	{
+		fail("cache", "insert", "region not cached");
+	}
+
+	memset(&r1, 0, sizeof(r1));
+	r1.size = 65536;
+	if(!cache_use(&r1) || r1.region_address != r2.region_address || r1.mob_address != r2.mob_address)
+	{
+		fail("cache", "use", "wrong region returned");
+	}
+
+	r2.size = 65536;
+	if(cache_use(&r2))
+	{
+		fail("cache", "use", "region returned twice");
+	}
+	region_free(&r1);
+
+	/* golden: region missed CACHE_THRESHOLD times is released */
+	pages_freed = 0;
+	for(i = 0; i < CACHE_THRESHOLD; i++)
+	{
+		r2.size = 12345;
+		cache_use(&r2);
+	}
+	if(pages_freed != 3*2)
+	{
+		fail("cache", "threshold", "unused regions not released");
+	}
+
+	r3.size = 1024*1024;
+	if(cache_use(&r3))
+	{
+		fail("cache", "threshold", "released region returned");
+	}
+
+	/* churn: random free/alloc of typical surface sizes */
+	cache_init();
+	pages_alloc = 0;
+	pages_freed = 0;
+	for(i = 0; i < CACHE_LIVE; i++)
+	{
+		region_new(&live[i], sizes[rnd() % CACHE_SIZES]);
+	}
+
+	bench_start(&b);
+	for(i = 0; i < iters; i++)
+	{
+		SVGA_region_info_t *r = &live[rnd() % CACHE_LIVE];
+		DWORD size = sizes[rnd() % CACHE_SIZES];
+
+		region_free(r);
+
+		memset(r, 0, sizeof(SVGA_region_info_t));
+		r->size = size;
+		if(cache_use(r))
+		{
+			hits++;
+		}
+		else
+		{
+			region_new(r, size);
+		}
+	}
+	bench_stop(&b);
+
+	for(i = 0; i < CACHE_LIVE; i++)
+	{
+		region_free(&live[i]);
+	}
+	cache_flush();
+
+	if(pages_alloc != pages_freed)
+	{
+		fail("cache", "churn", "memory leaked or freed twice");
+	}
+
+	sprintf(cfg, "churn %.1f%% hit", hits * 100.0 / iters);
+	report("region cache", cfg, &b, 0, iters);
+
+	cache_enable(FALSE);
+}
+
+int main(int argc, char **argv)
+{
+	static const int bpps[] = {8, 16, 32};
+	int r, i;
+
+	if(argc > 1 && strcmp(argv[1], "-q") == 0)
+	{
+		pixel_budget /= 16;
+	}
+
+	mouse_andmask_data = malloc(CURSOR_SIZE*CURSOR_SIZE*4);
+	mouse_xormask_data = malloc(CURSOR_SIZE*CURSOR_SIZE*4);
+	mouse_swap_data    = malloc(CURSOR_SIZE*CURSOR_SIZE*4);
+	mouse_swap_back    = malloc(CURSOR_SIZE*CURSOR_SIZE*4);
+
+	for(r = 0; r < RESOLUTIONS; r++)
+	{
+		bench_color(resolutions[r][0], resolutions[r][1]);
+	}
+
+	for(r = 0; r < RESOLUTIONS; r++)
+	{
+		for(i = 0; i < sizeof(bpps)/sizeof(bpps[0]); i++)
+		{
+			bench_cursor(resolutions[r][0], resolutions[r][1], bpps[i]);
+		}
+	}
+
+	bench_mask(32, 1, FALSE);
+	bench_mask(32, 1, TRUE);
+	bench_mask(32, 16, TRUE);
+	bench_mask(32, 32, TRUE);
+	bench_mask(64, 1, TRUE);
+	bench_mask(64, 32, TRUE);
+
+	bench_gamma();
+	bench_cache();
+
+	if(failed)
+	{
+		printf("%d check(s) failed\n", failed);
+		return EXIT_FAILURE;
+	}
+
+	printf("all checks passed\n");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,144 @@
+/*
+ * Command stream capture control (vmwsmini.vxd)
+ *
+ * usage:
+ *   svgacap start          - clear log and start capture
+ *   svgacap stop           - stop capture
+ *   svgacap dump file.cap  - stop capture and save log to trace file
+ *
+ * Capture must be enabled by CaptureSize (kB) in HKLM\Software\VMWSVGA.
+ * Trace file can be decoded or replayed by svgareplay, GDI access
+ * protocol and cursor moves are replayed by gdireplay.
+ */
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SVGA
+#include "../../3d_accel.h"
+
+#define DRIVER "vmwsmini.vxd"
+
+static BOOL capture_cmd(HANDLE vxd, DWORD enable)
+{
+	DWORD in[2] = {SVGA_CMD_CAPTURE, enable};
+	DWORD out = 0;
+
+	DeviceIoControl(vxd, OP_SVGA_VXDCMD,
+		&in[0], sizeof(in),
+		&out, sizeof(out),
+		NULL, NULL);
+
+	return out != 0;
+}
+
+static int capture_dump(SVGA_capture_t *cap, const char *filename)
+{
+	SVGA_capture_file_t hdr;
+	BYTE *ring = (BYTE*)(cap+1);
+	DWORD pos = cap->tail;
+	DWORD remain = cap->used;
+	FILE *fw;
+
+	fw = fopen(filename, "wb");
+	if(fw == NULL)
+	{
+		printf("cannot open %s\n", filename);
+		return EXIT_FAILURE;
+	}
+
+	hdr.magic   = SVGA_CAPTURE_MAGIC;
+	hdr.version = SVGA_CAPTURE_VERSION;
+	hdr.records = 0;
+	hdr.lost    = cap->lost;
+	fwrite(&hdr, sizeof(hdr), 1, fw);
+
+	while(remain > 0)
+	{
+		SVGA_capture_rec_t *rec = (SVGA_capture_rec_t*)(ring + pos);
+		DWORD len;
+
+		if(cap->ring_size - pos < sizeof(SVGA_capture_rec_t) || rec->type == SVGA_CAPTURE_WRAP)
+		{
+			remain -= cap->ring_size - pos;
+			pos = 0;
+			continue;
+		}
+
+		len = sizeof(SVGA_capture_rec_t) + SVGA_CAPTURE_ALIGN(rec->size);
+		fwrite(rec, len, 1, fw);
+		hdr.records++;
+
+		pos += len;
+		if(pos == cap->ring_size)
+		{
+			pos = 0;
+		}
+		remain -= len;
+	}
+
+	/* rewrite header with record count */
+	fseek(fw, 0, SEEK_SET);
+	fwrite(&hdr, sizeof(hdr), 1, fw);
+	fclose(fw);
+
+	printf("%lu records saved, %lu lost\n", hdr.records, hdr.lost);
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	SVGA_capture_t *cap = NULL;
+	int rc = EXIT_SUCCESS;
+	HANDLE vxd;
+
+	if(argc < 2)
+	{
+		printf("usage: %s start|stop|dump <file>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	vxd = CreateFileA("\\\\.\\" DRIVER, 0, 0, 0, CREATE_NEW, FILE_FLAG_DELETE_ON_CLOSE, 0);
+	if(vxd == INVALID_HANDLE_VALUE)
+	{
+		printf("cannot load VXD driver\n");
+		return EXIT_FAILURE;
+	}
+
+	DeviceIoControl(vxd, OP_SVGA_CAPTURE_SETUP,
+		NULL, 0,
+		&cap, sizeof(cap),
+		NULL, NULL);
+
+	if(cap == NULL)
+	{
+		printf("capture is not enabled (CaptureSize)\n");
+		CloseHandle(vxd);
+		return EXIT_FAILURE;
+	}
+
+	if(strcmp(argv[1], "start") == 0)
+	{
+		capture_cmd(vxd, 1);
+	}
+	else if(strcmp(argv[1], "stop") == 0)
+	{
+		capture_cmd(vxd, 0);
+	}
+	else if(strcmp(argv[1], "dump") == 0 && argc >= 3)
+	{
+		capture_cmd(vxd, 0);
+		rc = capture_dump(cap, argv[2]);
+	}
+	else
+	{
+		printf("Unknown command: %s\n", argv[1]);
+		rc = EXIT_FAILURE;
+	}
+
+	CloseHandle(vxd);
+
+	return rc;
+}
@@ -0,0 +1,150 @@
+/*
+ * Print latency histograms (vmwsmini.vxd)
+ *
+ * usage:
+ *   svgahist          - print p50/p99/max for every histogram
+ *   svgahist start    - clear histograms and start measurement
+ *   svgahist stop     - stop measurement
+ *
+ * Measurement can be also enabled from boot by Histograms = 1 in
+ * HKLM\Software\VMWSVGA.
+ */
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SVGA
+#include "../../3d_accel.h"
+
+#define DRIVER "vmwsmini.vxd"
+
+static const char *hist_names[SVGA_HIST_CNT] = {
+	"fence wait",
+	"submit queue",
+	"submit copy",
+	"access end",
+	"region create",
+	"region free"
+};
+
+static BOOL hist_cmd(HANDLE vxd, DWORD enable)
+{
+	DWORD in[2] = {SVGA_CMD_HIST, enable};
+	DWORD out = 0;
+
+	DeviceIoControl(vxd, OP_SVGA_VXDCMD,
+		&in[0], sizeof(in),
+		&out, sizeof(out),
+		NULL, NULL);
+
+	return out != 0;
+}
+
+/* upper bound of bucket where percentile p (0-100) lies */
+static double hist_percentile(const DWORD *h, DWORD total, double p)
+{
+	double limit = total * p / 100.0;
+	double sum = 0;
+	int i;
+
+	for(i = 0; i < SVGA_HIST_BUCKETS; i++)
+	{
+		sum += h[i];
+		if(sum >= limit)
+		{
+			return 2.0 * (double)(1UL << i);
+		}
+	}
+
+	return 4294967296.0;
+}
+
+static void hist_print(HANDLE vxd)
+{
+	static DWORD data[SVGA_HIST_QUERY_SIZE];
+	DWORD in[3] = {SVGA_QUERY_HIST, 0, SVGA_HIST_QUERY_SIZE};
+	double tsc0, tsc1, cycles_per_us = 0;
+	DWORD ms;
+	int i, b;
+
+	DeviceIoControl(vxd, OP_SVGA_QUERY_VECTOR,
+		&in[0], sizeof(in),
+		&data[0], sizeof(data),
+		NULL, NULL);
+
+	tsc0 = data[SVGA_HIST_CLOCK_TSC0_LO] + data[SVGA_HIST_CLOCK_TSC0_HI] * 4294967296.0;
+	tsc1 = data[SVGA_HIST_CLOCK_TSC1_LO] + data[SVGA_HIST_CLOCK_TSC1_HI] * 4294967296.0;
+	ms = data[SVGA_HIST_CLOCK_TIME1] - data[SVGA_HIST_CLOCK_TIME0];
+	if(tsc0 > 0 && ms > 0 && tsc1 > tsc0)
+	{
+		cycles_per_us = (tsc1 - tsc0) / (ms * 1000.0);
+	}
+
+	if(cycles_per_us <= 0)
+	{
+		printf("histograms were not started\n");
+		return;
+	}
+
+	printf("TSC: %.1f MHz, measured %lu ms\n", cycles_per_us, ms);
+	printf("%-14s %10s %12s %12s %12s\n", "", "samples", "p50 [us]", "p99 [us]", "max [us]");
+
+	for(i = 0; i < SVGA_HIST_CNT; i++)
+	{
+		const DWORD *h = &data[i * SVGA_HIST_STRIDE];
+		DWORD total = 0;
+
+		for(b = 0; b < SVGA_HIST_BUCKETS; b++)
+		{
+			total += h[b];
+		}
+
+		if(total == 0)
+		{
+			printf("%-14s %10d %12s %12s %12s\n", hist_names[i], 0, "-", "-", "-");
+			continue;
+		}
+
+		printf("%-14s %10lu %12.1f %12.1f %12.1f\n", hist_names[i], total,
+			hist_percentile(h, total, 50) / cycles_per_us,
+			hist_percentile(h, total, 99) / cycles_per_us,
+			h[SVGA_HIST_MAX] / cycles_per_us);
+	}
+	printf("(percentiles are upper bounds of log2 buckets)\n");
+}
+
+int main(int argc, char **argv)
+{
+	int rc = EXIT_SUCCESS;
+	HANDLE vxd;
+
+	vxd = CreateFileA("\\\\.\\" DRIVER, 0, 0, 0, CREATE_NEW, FILE_FLAG_DELETE_ON_CLOSE, 0);
+	if(vxd == INVALID_HANDLE_VALUE)
+	{
+		printf("cannot load VXD driver\n");
+		return EXIT_FAILURE;
+	}
+
+	if(argc < 2)
+	{
+		hist_print(vxd);
+	}
+	else if(strcmp(argv[1], "start") == 0)
+	{
+		hist_cmd(vxd, 1);
+	}
+	else if(strcmp(argv[1], "stop") == 0)
+	{
+		hist_cmd(vxd, 0);
+	}
+	else
+	{
+		printf("Unknown command: %s\n", argv[1]);
+		rc = EXIT_FAILURE;
+	}
+
+	CloseHandle(vxd);
+
+	return rc;
+}
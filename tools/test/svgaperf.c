@@ -0,0 +1,137 @@
+/*
+ * Print performance counters (vmwsmini.vxd)
+ *
+ * usage:
+ *   svgaperf          - print counters
+ *   svgaperf reset    - print counters and zero them
+ *   svgaperf watch N  - print counter deltas every N seconds
+ *
+ * Counters are always enabled, the same block is readable without VXD
+ * call at FBHDA + FBHDA.perf_offset (or SVGA_DB.perf).
+ */
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SVGA
+#include "../../3d_accel.h"
+
+#define DRIVER "vmwsmini.vxd"
+
+static BOOL perf_get(HANDLE vxd, FBHDA_perf_t *perf, BOOL reset)
+{
+	DWORD in[1] = {reset ? FBHDA_PERF_RESET : 0};
+	DWORD written = 0;
+
+	memset(perf, 0, sizeof(FBHDA_perf_t));
+	DeviceIoControl(vxd, OP_FBHDA_PERF_GET,
+		&in[0], sizeof(in),
+		perf, sizeof(FBHDA_perf_t),
+		&written, NULL);
+
+	return written >= 2*sizeof(DWORD) && perf->version == FBHDA_PERF_VERSION;
+}
+
+static double u64(FBHDA_perf_u64_t v)
+{
+	return v.lo + v.hi * 4294967296.0;
+}
+
+#define D(_n)   (double)(cur->_n - (prev ? prev->_n : 0))
+#define D64(_n) (u64(cur->_n) - (prev ? u64(prev->_n) : 0.0))
+
+static void perf_print(const FBHDA_perf_t *cur, const FBHDA_perf_t *prev)
+{
+	printf("submits:  %10.0f (FIFO %.0f, CB %.0f), %.0f kB\n",
+		D(cmd_submits), D(fifo_submits), D(cb_submits), D64(cmd_bytes) / 1024.0);
+	printf("fences:   %10.0f waits, %.0f spins\n",
+		D(fence_waits), D(fence_spins));
+	printf("CB:       %10.0f restarts\n", D(cb_restarts));
+	printf("cache:    %10.0f hits, %.0f misses\n",
+		D(cache_hits), D(cache_misses));
+	printf("blit:     %10.0f kB 16 bpp, %.0f kB 8 bpp\n",
+		D64(blit16_bytes) / 1024.0, D64(blit8_bytes) / 1024.0);
+	printf("present:  %10.0f updates, %.0f deferred by pacing\n",
+		D(presents), D(presents_deferred));
+	printf("flips:    %10.0f queued, %.0f blocked on full queue\n",
+		D(flips), D(flip_waits));
+	printf("cursor:   %10.0f redraws\n", D(cursor_redraws));
+	printf("modes:    %10.0f sets, %.0f ms total\n",
+		D(mode_sets), D(mode_set_total_ms));
+}
+
+#undef D
+#undef D64
+
+int main(int argc, char **argv)
+{
+	int rc = EXIT_SUCCESS;
+	HANDLE vxd;
+	FBHDA_perf_t cur, prev;
+
+	vxd = CreateFileA("\\\\.\\" DRIVER, 0, 0, 0, CREATE_NEW, FILE_FLAG_DELETE_ON_CLOSE, 0);
+	if(vxd == INVALID_HANDLE_VALUE)
+	{
+		printf("cannot load VXD driver\n");
+		return EXIT_FAILURE;
+	}
+
+	if(argc < 2 || strcmp(argv[1], "reset") == 0)
+	{
+		if(perf_get(vxd, &cur, argc >= 2))
+		{
+			printf("counters resets: %lu\n", cur.resets);
+			perf_print(&cur, NULL);
+			printf("          last mode set %lu ms, max %lu ms\n",
+				cur.mode_set_last_ms, cur.mode_set_max_ms);
+		}
+		else
+		{
+			printf("performance counters not supported\n");
+			rc = EXIT_FAILURE;
+		}
+	}
+	else if(strcmp(argv[1], "watch") == 0)
+	{
+		DWORD sec = argc >= 3 ? strtoul(argv[2], NULL, 0) : 1;
+		if(sec == 0)
+		{
+			sec = 1;
+		}
+
+		if(perf_get(vxd, &prev, FALSE))
+		{
+			for(;;)
+			{
+				Sleep(sec * 1000);
+				if(!perf_get(vxd, &cur, FALSE))
+				{
+					break;
+				}
+				if(cur.resets != prev.resets)
+				{
+					prev = cur;
+					continue;
+				}
+				printf("--- %lu s ---\n", sec);
+				perf_print(&cur, &prev);
+				prev = cur;
+			}
+		}
+		else
+		{
+			printf("performance counters not supported\n");
+			rc = EXIT_FAILURE;
+		}
+	}
+	else
+	{
+		printf("Unknown command: %s\n", argv[1]);
+		rc = EXIT_FAILURE;
+	}
+
+	CloseHandle(vxd);
+
+	return rc;
+}
@@ -0,0 +1,638 @@
+/*
+ * Decode and replay command stream capture (svgacap) on software SVGA-II
+ * model (svgasim.h)
+ *
+ * usage:
+ *   svgareplay -d file.cap       - print records with command names
+ *   svgareplay [-f] file.cap     - replay (-f: force FIFO for all submits)
+ *
+ * Replay submits buffers in captured order with same flags (fence, sync,
+ * 2D context) like SVGA_CMB_submit. Region contents are not captured, so
+ * regions are backed by empty guest memory and MOB definitions are
+ * relocated to it.
+ *
+ * gcc -O2 -fno-strict-aliasing -o svgareplay svgareplay.c
+ */
+#include "svgasim.h"
+
+typedef unsigned char  BYTE;
+typedef unsigned short WORD;
+typedef unsigned int   DWORD;
+typedef int            BOOL;
+typedef void           VOID;
+
+#include "../../vmware/svga3d_dx.h"
+
+#define SVGA
+#include "../../3d_accel.h"
+
+#define dbg_printf printf
+#include "../../vxd_svga_debug.h"
+
+#define REPLAY_CBS 16
+#define OPCODES_2D 64
+
+static svgasim_t *sim;
+static uint32 fence_next = 1;
+static uint64 cb_id = {0, 0};
+
+static uint32 *cbs[REPLAY_CBS];
+static uint32  cb_act = 0;
+static uint32 *ctlbuf;
+
+static uint32 mob_pa[SVGASIM_MOB_MAX];
+static uint32 mob_size[SVGASIM_MOB_MAX];
+
+static uint32 stat_2d[OPCODES_2D];
+static uint32 stat_3d[CMD3D_MAX - CMD3D_MIN + 1];
+static uint64_t bytes_3d[CMD3D_MAX - CMD3D_MIN + 1];
+
+static const char *cmd_name(uint32 id)
+{
+	static char buf[32];
+
+	if(id >= CMD3D_MIN && id <= CMD3D_MAX)
+	{
+		return svga_cmd_tables[id - CMD3D_MIN];
+	}
+
+	switch(id)
+	{
+		case SVGA_CMD_UPDATE:               return "SVGA_CMD_UPDATE";
+		case SVGA_CMD_RECT_COPY:            return "SVGA_CMD_RECT_COPY";
+		case SVGA_CMD_UPDATE_VERBOSE:       return "SVGA_CMD_UPDATE_VERBOSE";
+		case SVGA_CMD_FRONT_ROP_FILL:       return "SVGA_CMD_FRONT_ROP_FILL";
+		case SVGA_CMD_FENCE:                return "SVGA_CMD_FENCE";
+		case SVGA_CMD_ESCAPE:               return "SVGA_CMD_ESCAPE";
+		case SVGA_CMD_DEFINE_SCREEN:        return "SVGA_CMD_DEFINE_SCREEN";
+		case SVGA_CMD_DESTROY_SCREEN:       return "SVGA_CMD_DESTROY_SCREEN";
+		case SVGA_CMD_DEFINE_GMRFB:         return "SVGA_CMD_DEFINE_GMRFB";
+		case SVGA_CMD_BLIT_GMRFB_TO_SCREEN: return "SVGA_CMD_BLIT_GMRFB_TO_SCREEN";
+		case SVGA_CMD_BLIT_SCREEN_TO_GMRFB: return "SVGA_CMD_BLIT_SCREEN_TO_GMRFB";
+		case SVGA_CMD_DEFINE_CURSOR:        return "SVGA_CMD_DEFINE_CURSOR";
+		case SVGA_CMD_DEFINE_ALPHA_CURSOR:  return "SVGA_CMD_DEFINE_ALPHA_CURSOR";
+		case SVGA_CMD_DEFINE_GMR2:          return "SVGA_CMD_DEFINE_GMR2";
+	}
+
+	sprintf(buf, "SVGA_CMD_%u", id);
+	return buf;
+}
+
+/*
+ * Trace file
+ */
+typedef struct _trace_t
+{
+	SVGA_capture_file_t hdr;
+	uint8 *data;
+	uint32 size;
+} trace_t;
+
+static int trace_load(trace_t *t, const char *filename)
+{
+	FILE *fr = fopen(filename, "rb");
+	long fsize;
+
+	if(fr == NULL)
+	{
+		printf("cannot open %s\n", filename);
+		return FALSE;
+	}
+
+	fseek(fr, 0, SEEK_END);
+	fsize = ftell(fr);
+	fseek(fr, 0, SEEK_SET);
+
+	if(fsize < (long)sizeof(SVGA_capture_file_t) ||
+		fread(&t->hdr, sizeof(SVGA_capture_file_t), 1, fr) != 1 ||
+		t->hdr.magic != SVGA_CAPTURE_MAGIC || t->hdr.version != SVGA_CAPTURE_VERSION)
+	{
+		printf("%s: not capture file\n", filename);
+		fclose(fr);
+		return FALSE;
+	}
+
+	t->size = fsize - sizeof(SVGA_capture_file_t);
+	t->data = malloc(t->size);
+	if(fread(t->data, 1, t->size, fr) != t->size)
+	{
+		printf("%s: read error\n", filename);
+		fclose(fr);
+		return FALSE;
+	}
+
+	fclose(fr);
+	return TRUE;
+}
+
+/* iterate records, return NULL at end */
+static SVGA_capture_rec_t *trace_next(trace_t *t, uint32 *pos)
+{
+	SVGA_capture_rec_t *rec;
+
+	if(*pos + sizeof(SVGA_capture_rec_t) > t->size)
+	{
+		return NULL;
+	}
+
+	rec = (SVGA_capture_rec_t*)(t->data + *pos);
+	if(*pos + sizeof(SVGA_capture_rec_t) + SVGA_CAPTURE_ALIGN(rec->size) > t->size)
+	{
+		return NULL;
+	}
+
+	*pos += sizeof(SVGA_capture_rec_t) + SVGA_CAPTURE_ALIGN(rec->size);
+
+	return rec;
+}
+
+/*
+ * Decode
+ */
+static void decode_flags(uint32 flags)
+{
+	if(flags & SVGA_CB_SYNC)          printf(" SYNC");
+	if(flags & SVGA_CB_FORCE_FIFO)    printf(" FIFO");
+	if(flags & SVGA_CB_FORCE_FENCE)   printf(" FENCE");
+	if(flags & SVGA_CB_PRESENT)       printf(" PRESENT");
+	if(flags & SVGA_CB_DIRTY_SURFACE) printf(" DIRTY");
+	if(flags & SVGA_CB_RENDER)        printf(" RENDER");
+	if(flags & SVGA_CB_UPDATE)        printf(" UPDATE");
+	if(flags & SVGA_CB_2D)            printf(" 2D");
+	if(flags & SVGA_CB_FLAG_DX_CONTEXT) printf(" DX");
+}
+
+static void decode(trace_t *t)
+{
+	SVGA_capture_rec_t *rec;
+	uint32 pos = 0;
+	uint32 time0 = 0;
+	int first = TRUE;
+
+	printf("%u records, %u lost before first\n", t->hdr.records, t->hdr.lost);
+
+	while((rec = trace_next(t, &pos)) != NULL)
+	{
+		if(first)
+		{
+			time0 = rec->time;
+			first = FALSE;
+		}
+
+		printf("%8u %6u ms ", rec->seq, rec->time - time0);
+
+		switch(rec->type)
+		{
+			case SVGA_CAPTURE_SUBMIT:
+			{
+				uint8 *ptr = (uint8*)(rec+1);
+				uint32 off = 0;
+
+				printf("SUBMIT %s size=%u dx=%u", rec->arg[3] == SVGA_CAPTURE_SRC_DRIVER ? "driver" : "other",
+					rec->arg[2], rec->arg[1]);
+				decode_flags(rec->arg[0]);
+				if(rec->size < rec->arg[2])
+				{
+					printf(" (payload not captured)");
+				}
+				printf("\n");
+
+				while(off < rec->size)
+				{
+					uint32 *cmd = (uint32*)(ptr + off);
+					uint32 size = svgasim_cmd_size(cmd, rec->size - off);
+					printf("\t%-48s %u\n", cmd_name(cmd[0]), size);
+					if(size == 0)
+					{
+						break;
+					}
+					off += size;
+				}
+				break;
+			}
+			case SVGA_CAPTURE_REGION_CREATE:
+			case SVGA_CAPTURE_REGION_FREE:
+				printf("REGION_%s id=%u size=%u%s%s\n",
+					rec->type == SVGA_CAPTURE_REGION_CREATE ? "CREATE" : "FREE",
+					rec->arg[0], rec->arg[1], rec->arg[2] ? " mob" : "", rec->arg[3] ? " mobonly" : "");
+				break;
+			case SVGA_CAPTURE_ACCESS_BEGIN:
+				printf("ACCESS_BEGIN flags=0x%X\n", rec->arg[0]);
+				break;
+			case SVGA_CAPTURE_ACCESS_RECT:
+				printf("ACCESS_RECT %u,%u - %u,%u\n", rec->arg[0], rec->arg[1], rec->arg[2], rec->arg[3]);
+				break;
+			case SVGA_CAPTURE_ACCESS_END:
+				printf("ACCESS_END flags=0x%X\n", rec->arg[0]);
+				break;
+			case SVGA_CAPTURE_CURSOR_MOVE:
+				printf("CURSOR_MOVE %d,%d%s\n", (int)rec->arg[0], (int)rec->arg[1], rec->arg[2] ? " hw" : "");
+				break;
+			case SVGA_CAPTURE_MODE:
+				printf("MODE %ux%ux%u\n", rec->arg[0], rec->arg[1], rec->arg[2]);
+				break;
+			default:
+				printf("type %u\n", rec->type);
+				break;
+		}
+	}
+}
+
+/*
+ * Driver side (same as svgatest.c)
+ */
+static uint32 reg_read(uint32 index)
+{
+	svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_INDEX_PORT, index);
+	return svgasim_inpd(sim, SVGASIM_IO_BASE + SVGA_VALUE_PORT);
+}
+
+static void reg_write(uint32 index, uint32 value)
+{
+	svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_INDEX_PORT, index);
+	svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_VALUE_PORT, value);
+}
+
+static void drv_sync()
+{
+	reg_write(SVGA_REG_SYNC, 1);
+}
+
+static uint32 *cb_alloc(uint32 size)
+{
+	uint32 pa;
+	SVGACBHeader *cb = svgasim_phys_alloc(sim, size + sizeof(SVGACBHeader) + 8, &pa);
+
+	cb->status = SVGA_CB_STATUS_COMPLETED;
+	cb->ptr.pa.hi  = 0;
+	cb->ptr.pa.low = pa + sizeof(SVGACBHeader);
+
+	return (uint32*)(cb+1);
+}
+
+static SVGACBHeader *cb_header(uint32 *cmb)
+{
+	return ((SVGACBHeader*)cmb)-1;
+}
+
+static void cb_submit(uint32 *cmb, uint32 size, uint32 ctx, uint32 dx)
+{
+	SVGACBHeader *cb = cb_header(cmb);
+
+	cb->status      = SVGA_CB_STATUS_NONE;
+	cb->errorOffset = 0;
+	cb->offset      = 0;
+	cb->flags       = SVGA_CB_FLAG_NO_IRQ;
+	cb->dxContext   = dx;
+	cb->id          = cb_id;
+	cb->length      = size;
+
+	if(dx != 0) cb->flags |= SVGA_CB_FLAG_DX_CONTEXT;
+	if(++cb_id.low == 0) cb_id.hi++;
+
+	reg_write(SVGA_REG_COMMAND_HIGH, 0);
+	reg_write(SVGA_REG_COMMAND_LOW, (cb->ptr.pa.low - sizeof(SVGACBHeader)) | ctx);
+	drv_sync();
+}
+
+static uint32 cb_wait(uint32 *cmb)
+{
+	SVGACBHeader *cb = cb_header(cmb);
+
+	while(cb->status == SVGA_CB_STATUS_NONE)
+	{
+		drv_sync();
+	}
+
+	return cb->status;
+}
+
+static uint32 cb_ctr(uint32 cmd, uint32 a0, uint32 a1)
+{
+	ctlbuf[0] = cmd;
+	ctlbuf[1] = a0;
+	ctlbuf[2] = a1;
+	cb_submit(ctlbuf, 12, SVGA_CB_CONTEXT_DEVICE, 0);
+	return cb_wait(ctlbuf);
+}
+
+static void fifo_submit(uint32 *cmd, uint32 dwords)
+{
+	uint32 *fifo = sim->fifo;
+	uint32 next = fifo[SVGA_FIFO_NEXT_CMD];
+
+	while(dwords > 0)
+	{
+		/* keep one command space free */
+		while(((next + 4 >= fifo[SVGA_FIFO_MAX]) ? fifo[SVGA_FIFO_MIN] : next + 4) == fifo[SVGA_FIFO_STOP])
+		{
+			drv_sync();
+		}
+
+		fifo[next/4] = *cmd++;
+		next += 4;
+		if(next >= fifo[SVGA_FIFO_MAX])
+		{
+			next = fifo[SVGA_FIFO_MIN];
+		}
+		fifo[SVGA_FIFO_NEXT_CMD] = next;
+		dwords--;
+	}
+}
+
+static void fence_wait(uint32 fence)
+{
+	while((int32)(sim->fifo[SVGA_FIFO_FENCE] - fence) < 0)
+	{
+		drv_sync();
+	}
+}
+
+static int replay_init()
+{
+	uint32 i;
+
+	sim = svgasim_create(16*1024*1024, 1024*1024, 256*1024*1024);
+
+	reg_write(SVGA_REG_ID, SVGA_ID_2);
+	sim->fifo[SVGA_FIFO_MIN] = SVGA_FIFO_NUM_REGS * sizeof(uint32);
+	sim->fifo[SVGA_FIFO_MAX] = reg_read(SVGA_REG_MEM_SIZE);
+	sim->fifo[SVGA_FIFO_NEXT_CMD] = sim->fifo[SVGA_FIFO_MIN];
+	sim->fifo[SVGA_FIFO_STOP] = sim->fifo[SVGA_FIFO_MIN];
+	reg_write(SVGA_REG_ENABLE, TRUE);
+	reg_write(SVGA_REG_CONFIG_DONE, TRUE);
+
+	ctlbuf = cb_alloc(64);
+	for(i = 0; i < REPLAY_CBS; i++)
+	{
+		cbs[i] = cb_alloc(SVGA_CB_MAX_SIZE);
+	}
+
+	if(cb_ctr(SVGA_DC_CMD_START_STOP_CONTEXT, 1, SVGA_CB_CONTEXT_0) != SVGA_CB_STATUS_COMPLETED ||
+		cb_ctr(SVGA_DC_CMD_START_STOP_CONTEXT, 1, SVGA_CB_CONTEXT_1) != SVGA_CB_STATUS_COMPLETED)
+	{
+		printf("CB context start failed\n");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* backing memory for region, shared by GMR and MOB with same id */
+static uint32 region_backing(uint32 id, uint32 size)
+{
+	if(id >= SVGASIM_MOB_MAX)
+	{
+		return 0;
+	}
+
+	if(mob_pa[id] == 0 || mob_size[id] < size)
+	{
+		if(svgasim_phys_alloc(sim, size, &mob_pa[id]) == NULL)
+		{
+			printf("out of guest memory\n");
+			exit(EXIT_FAILURE);
+		}
+		mob_size[id] = size;
+	}
+
+	return mob_pa[id];
+}
+
+static void replay_region(SVGA_capture_rec_t *rec)
+{
+	uint32 id = rec->arg[0];
+
+	if(rec->type == SVGA_CAPTURE_REGION_CREATE && !rec->arg[3])
+	{
+		uint32 desc_pa;
+		SVGAGuestMemDescriptor *desc = svgasim_phys_alloc(sim, SVGASIM_PAGE, &desc_pa);
+		uint32 pa = region_backing(id, rec->arg[1]);
+
+		desc[0].ppn = pa / SVGASIM_PAGE;
+		desc[0].numPages = (rec->arg[1] + SVGASIM_PAGE - 1) / SVGASIM_PAGE;
+		desc[1].ppn = 0;
+		desc[1].numPages = 0;
+
+		reg_write(SVGA_REG_GMR_ID, id);
+		reg_write(SVGA_REG_GMR_DESCRIPTOR, desc_pa / SVGASIM_PAGE);
+	}
+	else if(rec->type == SVGA_CAPTURE_REGION_FREE && !rec->arg[3])
+	{
+		reg_write(SVGA_REG_GMR_ID, id);
+		reg_write(SVGA_REG_GMR_DESCRIPTOR, 0);
+	}
+}
+
+/* count commands and move MOBs to replay memory, FALSE if buffer is invalid */
+static int replay_scan(uint32 *buf, uint32 size)
+{
+	uint32 off = 0;
+
+	while(off < size)
+	{
+		uint32 *cmd = buf + off/4;
+		uint32 cmd_size = svgasim_cmd_size(cmd, size - off);
+
+		if(cmd_size == 0)
+		{
+			return FALSE;
+		}
+
+		if(cmd[0] >= CMD3D_MIN && cmd[0] <= CMD3D_MAX)
+		{
+			stat_3d[cmd[0] - CMD3D_MIN]++;
+			bytes_3d[cmd[0] - CMD3D_MIN] += cmd_size;
+
+			if(cmd[0] == SVGA_3D_CMD_DEFINE_GB_MOB)
+			{
+				SVGA3dCmdDefineGBMob *mob = (SVGA3dCmdDefineGBMob*)(cmd+2);
+				if(mob->mobid < SVGASIM_MOB_MAX)
+				{
+					mob->ptDepth = SVGA3D_MOBFMT_PTDEPTH_0;
+					mob->base = region_backing(mob->mobid, mob->sizeInBytes) / SVGASIM_PAGE;
+				}
+			}
+		}
+		else if(cmd[0] < OPCODES_2D)
+		{
+			stat_2d[cmd[0]]++;
+		}
+
+		off += cmd_size;
+	}
+
+	return TRUE;
+}
+
+static int replay_submit(SVGA_capture_rec_t *rec, int force_fifo)
+{
+	uint32 flags = rec->arg[0];
+	uint32 size = rec->size;
+	uint32 *cmb = cbs[cb_act];
+	uint32 fence = 0;
+
+	if(size < rec->arg[2])
+	{
+		return FALSE; /* payload not captured */
+	}
+
+	/* same as mob_cb_get: wait until buffer is free */
+	cb_wait(cmb);
+	cb_act = (cb_act + 1) % REPLAY_CBS;
+
+	memcpy(cmb, rec+1, size);
+	if(!replay_scan(cmb, size))
+	{
+		return FALSE;
+	}
+
+	if(force_fifo || (flags & SVGA_CB_FORCE_FIFO))
+	{
+		if(flags & (SVGA_CB_SYNC | SVGA_CB_FORCE_FENCE | SVGA_CB_PRESENT | SVGA_CB_RENDER | SVGA_CB_UPDATE))
+		{
+			fence = fence_next++;
+			cmb[size/4]   = SVGA_CMD_FENCE;
+			cmb[size/4+1] = fence;
+			size += 8;
+		}
+
+		fifo_submit(cmb, size/4);
+
+		if(flags & SVGA_CB_SYNC)
+		{
+			fence_wait(fence);
+		}
+	}
+	else
+	{
+		if(flags & SVGA_CB_FORCE_FENCE)
+		{
+			cmb[size/4]   = SVGA_CMD_FENCE;
+			cmb[size/4+1] = fence_next++;
+			size += 8;
+		}
+
+		if(size > 0)
+		{
+			cb_submit(cmb, size, (flags & SVGA_CB_2D) ? SVGA_CB_CONTEXT_1 : SVGA_CB_CONTEXT_0,
+				(flags & SVGA_CB_FLAG_DX_CONTEXT) ? rec->arg[1] : 0);
+
+			if(flags & SVGA_CB_SYNC)
+			{
+				cb_wait(cmb);
+			}
+		}
+	}
+
+	return TRUE;
+}
+
+static double now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int replay(trace_t *t, int force_fifo)
+{
+	SVGA_capture_rec_t *rec;
+	uint32 pos = 0;
+	uint32 submits = 0, skipped = 0, regions = 0;
+	uint32 i;
+	double start, elapsed;
+
+	if(!replay_init())
+	{
+		return EXIT_FAILURE;
+	}
+
+	start = now_ms();
+	while((rec = trace_next(t, &pos)) != NULL)
+	{
+		switch(rec->type)
+		{
+			case SVGA_CAPTURE_SUBMIT:
+				if(replay_submit(rec, force_fifo))
+					submits++;
+				else
+					skipped++;
+				break;
+			case SVGA_CAPTURE_REGION_CREATE:
+			case SVGA_CAPTURE_REGION_FREE:
+				replay_region(rec);
+				regions++;
+				break;
+		}
+	}
+
+	/* drain */
+	for(i = 0; i < REPLAY_CBS; i++)
+	{
+		cb_wait(cbs[i]);
+	}
+	svgasim_run(sim);
+	elapsed = now_ms() - start;
+
+	printf("%u submits (%u skipped), %u region events in %.2f ms (%s)\n",
+		submits, skipped, regions, elapsed, force_fifo ? "FIFO" : "CB");
+	printf("port I/O: %u, syncs: %u, CB errors: %u, blits: %u, fences: %u\n",
+		sim->stat.port_in + sim->stat.port_out, sim->stat.syncs, sim->stat.cb_errors,
+		sim->stat.blits, sim->stat.fences);
+
+	for(i = 0; i < OPCODES_2D; i++)
+	{
+		if(stat_2d[i])
+			printf("%-48s %8u\n", cmd_name(i), stat_2d[i]);
+	}
+
+	for(i = 0; i <= CMD3D_MAX - CMD3D_MIN; i++)
+	{
+		if(stat_3d[i])
+			printf("%-48s %8u %12llu B\n", svga_cmd_tables[i], stat_3d[i], (unsigned long long)bytes_3d[i]);
+	}
+
+	i = sim->stat.cb_errors;
+	svgasim_destroy(sim);
+
+	return i ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	trace_t trace;
+	int do_decode = FALSE;
+	int force_fifo = FALSE;
+	const char *filename = NULL;
+	int i;
+
+	for(i = 1; i < argc; i++)
+	{
+		if(strcmp(argv[i], "-d") == 0)
+			do_decode = TRUE;
+		else if(strcmp(argv[i], "-f") == 0)
+			force_fifo = TRUE;
+		else
+			filename = argv[i];
+	}
+
+	if(filename == NULL)
+	{
+		printf("usage: %s [-d] [-f] file.cap\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if(!trace_load(&trace, filename))
+	{
+		return EXIT_FAILURE;
+	}
+
+	if(do_decode)
+	{
+		decode(&trace);
+		return EXIT_SUCCESS;
+	}
+
+	return replay(&trace, force_fifo);
+}
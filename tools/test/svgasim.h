@@ -0,0 +1,1215 @@
+/*
+ * Software model of VMware SVGA-II device for host (Linux) testing
+ *
+ * Implements register file (index/value ports), FIFO (MIN/MAX/NEXT_CMD/STOP,
+ * fences, 3D caps block), command buffers (SVGA_REG_COMMAND_LOW, device
+ * context START_STOP/PREEMPT, SVGACBHeader status and errorOffset), GMR
+ * descriptors, MOB definitions and 2D commands (UPDATE, GMRFB blits, screen
+ * objects). 3D commands are parsed (so sizes and errors are correct) but
+ * not rendered.
+ *
+ * Guest physical memory is one host buffer, guest linear address is the
+ * host pointer. VMM shims (_PageAllocate, _CopyPageTable, semaphores) are
+ * provided when SVGASIM_VMM is defined before include.
+ *
+ * Usage:
+ *   #include "svgasim.h"
+ *   svgasim_t *sim = svgasim_create(16*1024*1024, 256*1024, 64*1024*1024);
+ *   svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_INDEX_PORT, SVGA_REG_ID);
+ *   ...
+ *
+ * The model processes FIFO and queued CBs when SVGA_REG_SYNC is written,
+ * SVGA_REG_BUSY is read or svgasim_run() is called. Set cb_batch to limit
+ * number of CBs completed per sync to simulate busy host.
+ *
+ * As on real device, CB context halts after CB with error, following CBs
+ * stay in queue until context is started again (START_STOP_CONTEXT with
+ * enable = 1) or they're taken back by PREEMPT.
+ */
+#ifndef __SVGASIM_H__INCLUDED__
+#define __SVGASIM_H__INCLUDED__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#ifndef __TYPES16_H_INCLUDED__
+#define __TYPES16_H_INCLUDED__
+typedef int32_t  int32;
+typedef uint32_t uint32;
+typedef int16_t  int16;
+typedef uint16_t uint16;
+typedef int8_t   int8;
+typedef uint8_t  uint8;
+typedef int      Bool;
+#define FARP
+#endif
+
+#ifndef TRUE
+#define TRUE  1
+#endif
+
+#ifndef FALSE
+#define FALSE 0
+#endif
+
+#ifndef INLINE
+#define INLINE inline
+#endif
+
+#pragma pack(push, 1)
+#include "../../vmware/svga_reg.h"
+#include "../../vmware/svga3d_reg.h"
+#include "../../vmware/svga3d_caps.h"
+#pragma pack(pop)
+
+#define SVGASIM_IO_BASE    0x1070
+#define SVGASIM_PAGE       4096
+#define SVGASIM_PHYS_BASE  0x00100000UL /* start of guest RAM */
+#define SVGASIM_FB_PA      0xE0000000UL
+#define SVGASIM_FIFO_PA    0xFE000000UL
+
+#define SVGASIM_SCREENS    4
+#define SVGASIM_GMR_MAX    64
+#define SVGASIM_MOB_MAX    4096
+#define SVGASIM_DEVCAP_MAX 512
+#define SVGASIM_CB_CTX     SVGA_CB_CONTEXT_MAX
+
+typedef struct _svgasim_screen_t
+{
+	int     defined;
+	uint32  width;
+	uint32  height;
+	int32   x;
+	int32   y;
+	uint32  bpp;
+	uint32  pitch;
+	uint8  *pixels;
+} svgasim_screen_t;
+
+typedef struct _svgasim_gmr_t
+{
+	uint32 *ppn;
+	uint32  pages;
+} svgasim_gmr_t;
+
+typedef struct _svgasim_mob_t
+{
+	int     defined;
+	uint32  depth;
+	uint32  base;
+	uint32  size;
+} svgasim_mob_t;
+
+typedef struct _svgasim_stat_t
+{
+	uint32 port_in;
+	uint32 port_out;
+	uint32 syncs;
+	uint32 fifo_cmds;
+	uint32 cb_cmds;
+	uint32 cmds_3d;
+	uint32 cb_submitted;
+	uint32 cb_completed;
+	uint32 cb_errors;
+	uint32 cb_queue_full;
+	uint32 cb_preempted;
+	uint32 fences;
+	uint32 updates;
+	uint32 blits;
+	uint64_t blit_pixels;
+	uint32 mode_sets;
+} svgasim_stat_t;
+
+typedef struct _svgasim_t
+{
+	/* register file */
+	uint32  index;
+	uint32  regs[SVGA_REG_TOP];
+	uint32  caps;
+	uint32  devcap[SVGASIM_DEVCAP_MAX];
+	uint32  devcap_index;
+	uint32  cmd_high;
+
+	/* memory */
+	uint8  *vram;
+	uint32  vram_size;
+	uint32 *fifo;
+	uint32  fifo_size;
+	uint8  *phys;
+	uint32  phys_size;
+	uint32  phys_used;
+
+	/* 2D state */
+	svgasim_screen_t screen[SVGASIM_SCREENS];
+	int     screen_objects;
+	SVGAFifoCmdDefineGMRFB gmrfb;
+	uint32  cursor_w;
+	uint32  cursor_h;
+
+	svgasim_gmr_t gmr[SVGASIM_GMR_MAX];
+	svgasim_mob_t mob[SVGASIM_MOB_MAX];
+
+	/* command buffers */
+	int     cb_enabled[SVGASIM_CB_CTX];
+	int     cb_halted[SVGASIM_CB_CTX]; /* after error until START_STOP */
+	uint32  cb_queue[SVGASIM_CB_CTX][SVGA_CB_MAX_QUEUED_PER_CONTEXT];
+	uint32  cb_queued[SVGASIM_CB_CTX];
+	uint32  cb_batch; /* max CBs completed per sync and context, 0 = all */
+
+	uint8  *scratch;
+	svgasim_stat_t stat;
+} svgasim_t;
+
+/*
+ * Guest memory
+ */
+static inline void *svgasim_pa_ptr(svgasim_t *sim, uint32 pa)
+{
+	if(pa >= SVGASIM_PHYS_BASE && pa - SVGASIM_PHYS_BASE < sim->phys_size)
+	{
+		return sim->phys + (pa - SVGASIM_PHYS_BASE);
+	}
+
+	if(pa >= SVGASIM_FB_PA && pa - SVGASIM_FB_PA < sim->vram_size)
+	{
+		return sim->vram + (pa - SVGASIM_FB_PA);
+	}
+
+	if(pa >= SVGASIM_FIFO_PA && pa - SVGASIM_FIFO_PA < sim->fifo_size)
+	{
+		return ((uint8*)sim->fifo) + (pa - SVGASIM_FIFO_PA);
+	}
+
+	return NULL;
+}
+
+static inline uint32 svgasim_ptr_pa(svgasim_t *sim, void *ptr)
+{
+	uint8 *p = ptr;
+
+	if(p >= sim->phys && p < sim->phys + sim->phys_size)
+	{
+		return SVGASIM_PHYS_BASE + (uint32)(p - sim->phys);
+	}
+
+	if(p >= sim->vram && p < sim->vram + sim->vram_size)
+	{
+		return SVGASIM_FB_PA + (uint32)(p - sim->vram);
+	}
+
+	return 0;
+}
+
+/* page aligned, never freed */
+static inline void *svgasim_phys_alloc(svgasim_t *sim, uint32 size, uint32 *pa)
+{
+	uint32 pages = (size + SVGASIM_PAGE - 1) / SVGASIM_PAGE;
+	uint8 *ptr;
+
+	if(pages == 0) pages = 1;
+	if(pa) *pa = 0;
+
+	if(sim->phys_used + pages*SVGASIM_PAGE > sim->phys_size)
+	{
+		return NULL;
+	}
+
+	ptr = sim->phys + sim->phys_used;
+	sim->phys_used += pages*SVGASIM_PAGE;
+	memset(ptr, 0, pages*SVGASIM_PAGE);
+
+	if(pa) *pa = svgasim_ptr_pa(sim, ptr);
+
+	return ptr;
+}
+
+/*
+ * GMR and MOB access
+ */
+static inline int svgasim_gmr_define(svgasim_t *sim, uint32 id, uint32 ppn)
+{
+	svgasim_gmr_t *gmr;
+	SVGAGuestMemDescriptor *desc;
+	uint32 cap = 0;
+	uint32 i = 0;
+
+	if(id >= SVGASIM_GMR_MAX)
+	{
+		return FALSE;
+	}
+
+	gmr = &sim->gmr[id];
+	free(gmr->ppn);
+	gmr->ppn   = NULL;
+	gmr->pages = 0;
+
+	if(ppn == 0)
+	{
+		return TRUE; /* undefine */
+	}
+
+	desc = svgasim_pa_ptr(sim, ppn * SVGASIM_PAGE);
+	while(desc != NULL)
+	{
+		if(desc[i].ppn == 0 && desc[i].numPages == 0)
+		{
+			break;
+		}
+
+		if(desc[i].numPages == 0)
+		{
+			/* continue on next descriptor page */
+			desc = svgasim_pa_ptr(sim, desc[i].ppn * SVGASIM_PAGE);
+			i = 0;
+			continue;
+		}
+
+		if(gmr->pages + desc[i].numPages > cap)
+		{
+			cap = (gmr->pages + desc[i].numPages) * 2;
+			gmr->ppn = realloc(gmr->ppn, cap * sizeof(uint32));
+		}
+
+		{
+			uint32 p;
+			for(p = 0; p < desc[i].numPages; p++)
+			{
+				gmr->ppn[gmr->pages++] = desc[i].ppn + p;
+			}
+		}
+
+		i++;
+		if(i >= SVGASIM_PAGE/sizeof(SVGAGuestMemDescriptor))
+		{
+			break; /* last entry on page must be link or end */
+		}
+	}
+
+	return TRUE;
+}
+
+static inline uint32 svgasim_mob_ppn(svgasim_t *sim, svgasim_mob_t *mob, uint32 page)
+{
+	uint32 *pt;
+
+	switch(mob->depth)
+	{
+		case SVGA3D_MOBFMT_PTDEPTH_0:
+			return mob->base + page;
+		case SVGA3D_MOBFMT_PTDEPTH_1:
+			pt = svgasim_pa_ptr(sim, mob->base * SVGASIM_PAGE);
+			return pt ? pt[page] : 0;
+		case SVGA3D_MOBFMT_PTDEPTH_2:
+			pt = svgasim_pa_ptr(sim, mob->base * SVGASIM_PAGE);
+			if(pt == NULL) return 0;
+			pt = svgasim_pa_ptr(sim, pt[page / (SVGASIM_PAGE/4)] * SVGASIM_PAGE);
+			return pt ? pt[page % (SVGASIM_PAGE/4)] : 0;
+	}
+
+	return 0;
+}
+
+/*
+ * Copy between buffer and guest memory object (GMR or MOB), page by page.
+ * Return FALSE when range is out of object.
+ */
+static inline int svgasim_obj_copy(svgasim_t *sim, int is_mob, uint32 id, uint32 offset, void *buf, uint32 len, int write)
+{
+	uint8 *b = buf;
+
+	if(!is_mob && id == SVGA_GMR_FRAMEBUFFER)
+	{
+		if(offset > sim->vram_size || len > sim->vram_size - offset)
+		{
+			return FALSE;
+		}
+
+		if(write)
+			memcpy(sim->vram + offset, b, len);
+		else
+			memcpy(b, sim->vram + offset, len);
+
+		return TRUE;
+	}
+
+	while(len > 0)
+	{
+		uint32 page = offset / SVGASIM_PAGE;
+		uint32 poff = offset % SVGASIM_PAGE;
+		uint32 chunk = SVGASIM_PAGE - poff;
+		uint32 ppn;
+		uint8 *ptr;
+
+		if(chunk > len) chunk = len;
+
+		if(is_mob)
+		{
+			if(id >= SVGASIM_MOB_MAX || !sim->mob[id].defined || offset + chunk > sim->mob[id].size)
+				return FALSE;
+			ppn = svgasim_mob_ppn(sim, &sim->mob[id], page);
+		}
+		else
+		{
+			if(id >= SVGASIM_GMR_MAX || page >= sim->gmr[id].pages)
+				return FALSE;
+			ppn = sim->gmr[id].ppn[page];
+		}
+
+		ptr = svgasim_pa_ptr(sim, ppn * SVGASIM_PAGE);
+		if(ptr == NULL)
+		{
+			return FALSE;
+		}
+
+		if(write)
+			memcpy(ptr + poff, b, chunk);
+		else
+			memcpy(b, ptr + poff, chunk);
+
+		b += chunk;
+		offset += chunk;
+		len -= chunk;
+	}
+
+	return TRUE;
+}
+
+#define svgasim_gmr_copy(_sim, _id, _off, _buf, _len, _write) svgasim_obj_copy(_sim, FALSE, _id, _off, _buf, _len, _write)
+#define svgasim_mob_copy(_sim, _id, _off, _buf, _len, _write) svgasim_obj_copy(_sim, TRUE,  _id, _off, _buf, _len, _write)
+
+/*
+ * Screens
+ */
+static inline void svgasim_screen_set(svgasim_t *sim, uint32 id, uint32 w, uint32 h, uint32 bpp, int32 x, int32 y)
+{
+	svgasim_screen_t *s = &sim->screen[id];
+	uint32 pitch = ((w * ((bpp + 7)/8)) + 3) & ~3;
+
+	if(!s->defined || s->pitch * s->height < pitch * h)
+	{
+		free(s->pixels);
+		s->pixels = calloc(pitch, h);
+	}
+
+	s->defined = TRUE;
+	s->width   = w;
+	s->height  = h;
+	s->bpp     = bpp;
+	s->pitch   = pitch;
+	s->x       = x;
+	s->y       = y;
+}
+
+static inline void svgasim_screen_destroy(svgasim_t *sim, uint32 id)
+{
+	svgasim_screen_t *s = &sim->screen[id];
+
+	free(s->pixels);
+	memset(s, 0, sizeof(svgasim_screen_t));
+}
+
+/* legacy mode set: all screens are destroyed, screen 0 follows registers */
+static inline void svgasim_mode_legacy(svgasim_t *sim)
+{
+	uint32 i;
+
+	for(i = 0; i < SVGASIM_SCREENS; i++)
+	{
+		svgasim_screen_destroy(sim, i);
+	}
+
+	sim->screen_objects = FALSE;
+	svgasim_screen_set(sim, 0, sim->regs[SVGA_REG_WIDTH], sim->regs[SVGA_REG_HEIGHT],
+		sim->regs[SVGA_REG_BITS_PER_PIXEL], 0, 0);
+
+	sim->stat.mode_sets++;
+}
+
+static inline uint32 svgasim_bytes_per_line(svgasim_t *sim)
+{
+	if(sim->regs[SVGA_REG_PITCHLOCK])
+	{
+		return sim->regs[SVGA_REG_PITCHLOCK];
+	}
+
+	return ((sim->regs[SVGA_REG_WIDTH] * ((sim->regs[SVGA_REG_BITS_PER_PIXEL] + 7)/8)) + 3) & ~3;
+}
+
+/*
+ * Commands
+ */
+
+/* command size in bytes, 0 if unknown or not complete in avail */
+static inline uint32 svgasim_cmd_size(const uint32 *cmd, uint32 avail)
+{
+	uint32 size = 0;
+
+	if(avail < 4)
+	{
+		return 0;
+	}
+
+	if(cmd[0] >= SVGA_3D_CMD_LEGACY_BASE && cmd[0] < SVGA_3D_CMD_MAX)
+	{
+		if(avail < sizeof(SVGA3dCmdHeader))
+			return 0;
+		return sizeof(SVGA3dCmdHeader) + cmd[1];
+	}
+
+	switch(cmd[0])
+	{
+		case SVGA_CMD_UPDATE:               size = sizeof(SVGAFifoCmdUpdate); break;
+		case SVGA_CMD_RECT_COPY:            size = sizeof(SVGAFifoCmdRectCopy); break;
+		case SVGA_CMD_UPDATE_VERBOSE:       size = sizeof(SVGAFifoCmdUpdateVerbose); break;
+		case SVGA_CMD_FRONT_ROP_FILL:       size = sizeof(SVGAFifoCmdFrontRopFill); break;
+		case SVGA_CMD_FENCE:                size = sizeof(SVGAFifoCmdFence); break;
+		case SVGA_CMD_DESTROY_SCREEN:       size = sizeof(SVGAFifoCmdDestroyScreen); break;
+		case SVGA_CMD_DEFINE_GMRFB:         size = sizeof(SVGAFifoCmdDefineGMRFB); break;
+		case SVGA_CMD_BLIT_GMRFB_TO_SCREEN: size = sizeof(SVGAFifoCmdBlitGMRFBToScreen); break;
+		case SVGA_CMD_BLIT_SCREEN_TO_GMRFB: size = sizeof(SVGAFifoCmdBlitScreenToGMRFB); break;
+		case SVGA_CMD_ANNOTATION_FILL:      size = sizeof(SVGAFifoCmdAnnotationFill); break;
+		case SVGA_CMD_ANNOTATION_COPY:      size = sizeof(SVGAFifoCmdAnnotationCopy); break;
+		case SVGA_CMD_DEFINE_GMR2:          size = sizeof(SVGAFifoCmdDefineGMR2); break;
+		case SVGA_CMD_DEFINE_SCREEN:
+			if(avail < 8) return 0;
+			size = cmd[1]; /* screen.structSize */
+			break;
+		case SVGA_CMD_ESCAPE:
+			if(avail < 12) return 0;
+			size = sizeof(SVGAFifoCmdEscape) + cmd[2];
+			break;
+		case SVGA_CMD_DEFINE_ALPHA_CURSOR:
+			if(avail < 24) return 0;
+			size = sizeof(SVGAFifoCmdDefineAlphaCursor) + cmd[4]*cmd[5]*4;
+			break;
+		case SVGA_CMD_DEFINE_CURSOR:
+		{
+			uint32 and_pitch, xor_pitch;
+			if(avail < 32) return 0;
+			and_pitch = ((cmd[4] * cmd[6] + 31) / 32) * 4;
+			xor_pitch = ((cmd[4] * cmd[7] + 31) / 32) * 4;
+			size = sizeof(SVGAFifoCmdDefineCursor) + (and_pitch + xor_pitch) * cmd[5];
+			break;
+		}
+		default:
+			return 0;
+	}
+
+	return 4 + size;
+}
+
+static inline int svgasim_cmd_known(uint32 id)
+{
+	uint32 probe[8] = {0};
+
+	probe[0] = id;
+	probe[1] = 8; /* nonzero structSize for DEFINE_SCREEN */
+
+	return svgasim_cmd_size(probe, sizeof(probe)) != 0;
+}
+
+static inline int svgasim_blit(svgasim_t *sim, int to_screen, uint32 screen_id,
+	int32 gx, int32 gy, const SVGASignedRect *r)
+{
+	svgasim_screen_t *s;
+	uint32 Bpp = sim->gmrfb.format.bitsPerPixel / 8;
+	int32 y;
+
+	if(screen_id >= SVGASIM_SCREENS || !sim->screen[screen_id].defined)
+	{
+		return FALSE;
+	}
+
+	s = &sim->screen[screen_id];
+	if(Bpp == 0 || Bpp != (s->bpp + 7)/8)
+	{
+		return FALSE;
+	}
+
+	if(r->left < 0 || r->top < 0 || r->right > (int32)s->width || r->bottom > (int32)s->height ||
+		r->left >= r->right || r->top >= r->bottom || gx < 0 || gy < 0)
+	{
+		return r->left == r->right || r->top == r->bottom; /* empty blit is OK */
+	}
+
+	for(y = 0; y < r->bottom - r->top; y++)
+	{
+		uint8 *row = s->pixels + (r->top + y) * s->pitch + r->left * Bpp;
+		uint32 off = sim->gmrfb.ptr.offset + (gy + y) * sim->gmrfb.bytesPerLine + gx * Bpp;
+
+		if(!svgasim_gmr_copy(sim, sim->gmrfb.ptr.gmrId, off, row, (r->right - r->left) * Bpp, !to_screen))
+		{
+			return FALSE;
+		}
+	}
+
+	sim->stat.blits++;
+	sim->stat.blit_pixels += (uint64_t)(r->right - r->left) * (r->bottom - r->top);
+
+	return TRUE;
+}
+
+static inline void svgasim_fence(svgasim_t *sim, uint32 fence)
+{
+	sim->fifo[SVGA_FIFO_FENCE] = fence;
+	sim->regs[SVGA_REG_FENCE]  = fence;
+	sim->stat.fences++;
+}
+
+/* execute one complete command, FALSE on error */
+static inline int svgasim_exec(svgasim_t *sim, const uint32 *cmd, uint32 size)
+{
+	const void *body = cmd + 1;
+
+	if(cmd[0] >= SVGA_3D_CMD_LEGACY_BASE && cmd[0] < SVGA_3D_CMD_MAX)
+	{
+		const void *body3d = cmd + 2;
+
+		sim->stat.cmds_3d++;
+		switch(cmd[0])
+		{
+			case SVGA_3D_CMD_DEFINE_GB_MOB:
+			{
+				const SVGA3dCmdDefineGBMob *m = body3d;
+				if(m->mobid >= SVGASIM_MOB_MAX || m->ptDepth > SVGA3D_MOBFMT_PTDEPTH_2)
+					return FALSE;
+				sim->mob[m->mobid].defined = TRUE;
+				sim->mob[m->mobid].depth   = m->ptDepth;
+				sim->mob[m->mobid].base    = m->base;
+				sim->mob[m->mobid].size    = m->sizeInBytes;
+				return TRUE;
+			}
+			case SVGA_3D_CMD_DESTROY_GB_MOB:
+			{
+				const SVGA3dCmdDestroyGBMob *m = body3d;
+				if(m->mobid >= SVGASIM_MOB_MAX || !sim->mob[m->mobid].defined)
+					return FALSE;
+				sim->mob[m->mobid].defined = FALSE;
+				return TRUE;
+			}
+		}
+		return TRUE;
+	}
+
+	switch(cmd[0])
+	{
+		case SVGA_CMD_UPDATE:
+		{
+			const SVGAFifoCmdUpdate *u = body;
+			svgasim_screen_t *s = &sim->screen[0];
+			uint32 Bpp = (s->bpp + 7)/8;
+			uint32 pitch = svgasim_bytes_per_line(sim);
+			uint32 y;
+
+			sim->stat.updates++;
+
+			/* legacy mode: host reads guest framebuffer */
+			if(!sim->screen_objects && s->defined &&
+				u->x + u->width <= s->width && u->y + u->height <= s->height)
+			{
+				for(y = u->y; y < u->y + u->height; y++)
+				{
+					memcpy(s->pixels + y*s->pitch + u->x*Bpp,
+						sim->vram + sim->regs[SVGA_REG_FB_OFFSET] + y*pitch + u->x*Bpp, u->width*Bpp);
+				}
+			}
+			return TRUE;
+		}
+		case SVGA_CMD_FENCE:
+			svgasim_fence(sim, ((const SVGAFifoCmdFence*)body)->fence);
+			return TRUE;
+		case SVGA_CMD_DEFINE_SCREEN:
+		{
+			const SVGAScreenObject *so = body;
+			if(so->id >= SVGASIM_SCREENS || so->size.width == 0 || so->size.height == 0)
+				return FALSE;
+			svgasim_screen_set(sim, so->id, so->size.width, so->size.height, 32, so->root.x, so->root.y);
+			sim->screen_objects = TRUE;
+			return TRUE;
+		}
+		case SVGA_CMD_DESTROY_SCREEN:
+		{
+			const SVGAFifoCmdDestroyScreen *d = body;
+			if(d->screenId >= SVGASIM_SCREENS || !sim->screen[d->screenId].defined)
+				return FALSE;
+			svgasim_screen_destroy(sim, d->screenId);
+			return TRUE;
+		}
+		case SVGA_CMD_DEFINE_GMRFB:
+			memcpy(&sim->gmrfb, body, sizeof(SVGAFifoCmdDefineGMRFB));
+			return TRUE;
+		case SVGA_CMD_BLIT_GMRFB_TO_SCREEN:
+		{
+			const SVGAFifoCmdBlitGMRFBToScreen *b = body;
+			return svgasim_blit(sim, TRUE, b->destScreenId, b->srcOrigin.x, b->srcOrigin.y, &b->destRect);
+		}
+		case SVGA_CMD_BLIT_SCREEN_TO_GMRFB:
+		{
+			const SVGAFifoCmdBlitScreenToGMRFB *b = body;
+			return svgasim_blit(sim, FALSE, b->srcScreenId, b->destOrigin.x, b->destOrigin.y, &b->srcRect);
+		}
+		case SVGA_CMD_DEFINE_ALPHA_CURSOR:
+		case SVGA_CMD_DEFINE_CURSOR:
+		{
+			const SVGAFifoCmdDefineAlphaCursor *c = body;
+			sim->cursor_w = c->width;
+			sim->cursor_h = c->height;
+			return TRUE;
+		}
+		case SVGA_CMD_RECT_COPY:
+		case SVGA_CMD_UPDATE_VERBOSE:
+		case SVGA_CMD_FRONT_ROP_FILL:
+		case SVGA_CMD_ESCAPE:
+		case SVGA_CMD_ANNOTATION_FILL:
+		case SVGA_CMD_ANNOTATION_COPY:
+		case SVGA_CMD_DEFINE_GMR2:
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * FIFO
+ */
+static inline void svgasim_fifo_process(svgasim_t *sim)
+{
+	uint32 *fifo = sim->fifo;
+
+	if(!sim->regs[SVGA_REG_ENABLE] || !sim->regs[SVGA_REG_CONFIG_DONE])
+	{
+		return;
+	}
+
+	while(fifo[SVGA_FIFO_STOP] != fifo[SVGA_FIFO_NEXT_CMD])
+	{
+		uint32 min = fifo[SVGA_FIFO_MIN];
+		uint32 max = fifo[SVGA_FIFO_MAX];
+		uint32 stop = fifo[SVGA_FIFO_STOP];
+		uint32 next = fifo[SVGA_FIFO_NEXT_CMD];
+		uint32 avail = (next >= stop) ? next - stop : (max - stop) + (next - min);
+		uint32 *lin = (uint32*)sim->scratch;
+		uint32 pos = stop;
+		uint32 i, size, peek;
+
+		/* linearize header (ring can wrap inside command) */
+		peek = avail < 32 ? avail : 32;
+		for(i = 0; i < peek/4; i++)
+		{
+			lin[i] = fifo[pos/4];
+			pos += 4;
+			if(pos >= max) pos = min;
+		}
+
+		size = svgasim_cmd_size(lin, peek);
+		if(size == 0)
+		{
+			if(peek >= 4 && !svgasim_cmd_known(lin[0]))
+			{
+				/* unknown command, skip rest of FIFO */
+				fprintf(stderr, "svgasim: invalid FIFO command %u\n", lin[0]);
+				fifo[SVGA_FIFO_STOP] = next;
+			}
+			return;
+		}
+
+		if(size > avail || size > sim->fifo_size)
+		{
+			return; /* not complete yet */
+		}
+
+		/* copy whole command (peek may be longer than command) */
+		pos = stop;
+		for(i = 0; i < size/4; i++)
+		{
+			lin[i] = fifo[pos/4];
+			pos += 4;
+			if(pos >= max) pos = min;
+		}
+
+		if(!svgasim_exec(sim, lin, size))
+		{
+			fprintf(stderr, "svgasim: FIFO command %u failed\n", lin[0]);
+		}
+
+		sim->stat.fifo_cmds++;
+		fifo[SVGA_FIFO_STOP] = pos;
+	}
+
+	fifo[SVGA_FIFO_BUSY] = 0;
+}
+
+/*
+ * Command buffers
+ */
+static inline void svgasim_cb_exec(svgasim_t *sim, SVGACBHeader *cb)
+{
+	uint8 *data = svgasim_pa_ptr(sim, cb->ptr.pa.low);
+	uint32 off = 0;
+
+	if(data == NULL || cb->length > SVGA_CB_MAX_SIZE)
+	{
+		cb->status = SVGA_CB_STATUS_CB_HEADER_ERROR;
+		sim->stat.cb_errors++;
+		return;
+	}
+
+	while(off < cb->length)
+	{
+		const uint32 *cmd = (const uint32*)(data + off);
+		uint32 size = svgasim_cmd_size(cmd, cb->length - off);
+
+		if(size == 0 || off + size > cb->length || !svgasim_exec(sim, cmd, size))
+		{
+			cb->errorOffset = off;
+			cb->status = SVGA_CB_STATUS_COMMAND_ERROR;
+			sim->stat.cb_errors++;
+			return;
+		}
+
+		sim->stat.cb_cmds++;
+		off += size;
+	}
+
+	cb->status = SVGA_CB_STATUS_COMPLETED;
+	sim->stat.cb_completed++;
+}
+
+static inline void svgasim_cb_dequeue(svgasim_t *sim, uint32 ctx, uint32 n)
+{
+	memmove(&sim->cb_queue[ctx][0], &sim->cb_queue[ctx][n], (sim->cb_queued[ctx] - n) * sizeof(uint32));
+	sim->cb_queued[ctx] -= n;
+}
+
+static inline void svgasim_cb_preempt(svgasim_t *sim, uint32 ctx, int ignore_id_zero)
+{
+	uint32 i, keep = 0;
+
+	for(i = 0; i < sim->cb_queued[ctx]; i++)
+	{
+		SVGACBHeader *cb = svgasim_pa_ptr(sim, sim->cb_queue[ctx][i]);
+
+		if(ignore_id_zero && cb->id.low == 0 && cb->id.hi == 0)
+		{
+			sim->cb_queue[ctx][keep++] = sim->cb_queue[ctx][i];
+		}
+		else
+		{
+			cb->status = SVGA_CB_STATUS_PREEMPTED;
+			sim->stat.cb_preempted++;
+		}
+	}
+
+	sim->cb_queued[ctx] = keep;
+}
+
+static inline void svgasim_cb_device(svgasim_t *sim, SVGACBHeader *cb)
+{
+	uint32 *cmd = svgasim_pa_ptr(sim, cb->ptr.pa.low);
+
+	if(cmd == NULL || cb->length < 4)
+	{
+		cb->status = SVGA_CB_STATUS_CB_HEADER_ERROR;
+		return;
+	}
+
+	switch(cmd[0])
+	{
+		case SVGA_DC_CMD_NOP:
+			break;
+		case SVGA_DC_CMD_START_STOP_CONTEXT:
+		{
+			SVGADCCmdStartStop *ss = (SVGADCCmdStartStop*)(cmd+1);
+			if(ss->context >= SVGASIM_CB_CTX ||
+				(ss->context > 0 && (sim->caps & SVGA_CAP_CMD_BUFFERS_2) == 0))
+			{
+				cb->errorOffset = 0;
+				cb->status = SVGA_CB_STATUS_COMMAND_ERROR;
+				return;
+			}
+			if(!ss->enable)
+			{
+				svgasim_cb_preempt(sim, ss->context, FALSE);
+			}
+			sim->cb_enabled[ss->context] = ss->enable ? TRUE : FALSE;
+			sim->cb_halted[ss->context] = FALSE;
+			break;
+		}
+		case SVGA_DC_CMD_PREEMPT:
+		{
+			SVGADCCmdPreempt *p = (SVGADCCmdPreempt*)(cmd+1);
+			if(p->context >= SVGASIM_CB_CTX)
+			{
+				cb->errorOffset = 0;
+				cb->status = SVGA_CB_STATUS_COMMAND_ERROR;
+				return;
+			}
+			svgasim_cb_preempt(sim, p->context, p->ignoreIDZero);
+			break;
+		}
+		default:
+			cb->errorOffset = 0;
+			cb->status = SVGA_CB_STATUS_COMMAND_ERROR;
+			return;
+	}
+
+	cb->status = SVGA_CB_STATUS_COMPLETED;
+}
+
+static inline void svgasim_cb_submit(svgasim_t *sim, uint32 low)
+{
+	uint32 ctx = low & SVGA_CB_CONTEXT_MASK;
+	uint32 pa  = low & ~SVGA_CB_CONTEXT_MASK;
+	SVGACBHeader *cb = svgasim_pa_ptr(sim, pa);
+
+	if(cb == NULL || sim->cmd_high != 0)
+	{
+		return;
+	}
+
+	sim->stat.cb_submitted++;
+
+	if(ctx == SVGA_CB_CONTEXT_DEVICE)
+	{
+		svgasim_cb_device(sim, cb);
+		return;
+	}
+
+	if(ctx >= SVGASIM_CB_CTX || !sim->cb_enabled[ctx])
+	{
+		cb->status = SVGA_CB_STATUS_CB_HEADER_ERROR;
+		sim->stat.cb_errors++;
+		return;
+	}
+
+	if(sim->cb_queued[ctx] >= SVGA_CB_MAX_QUEUED_PER_CONTEXT)
+	{
+		cb->status = SVGA_CB_STATUS_QUEUE_FULL;
+		sim->stat.cb_queue_full++;
+		return;
+	}
+
+	sim->cb_queue[ctx][sim->cb_queued[ctx]++] = pa;
+}
+
+static inline void svgasim_cb_process(svgasim_t *sim)
+{
+	uint32 ctx;
+
+	for(ctx = 0; ctx < SVGASIM_CB_CTX; ctx++)
+	{
+		uint32 n = sim->cb_queued[ctx];
+		uint32 i;
+
+		if(sim->cb_halted[ctx])
+		{
+			continue;
+		}
+
+		if(sim->cb_batch > 0 && n > sim->cb_batch)
+		{
+			n = sim->cb_batch;
+		}
+
+		for(i = 0; i < n; i++)
+		{
+			SVGACBHeader *cb = svgasim_pa_ptr(sim, sim->cb_queue[ctx][i]);
+
+			svgasim_cb_exec(sim, cb);
+			if(cb->status != SVGA_CB_STATUS_COMPLETED)
+			{
+				sim->cb_halted[ctx] = TRUE;
+				i++;
+				break;
+			}
+		}
+
+		svgasim_cb_dequeue(sim, ctx, i);
+	}
+}
+
+/* let host process everything pending */
+static inline void svgasim_run(svgasim_t *sim)
+{
+	svgasim_fifo_process(sim);
+	svgasim_cb_process(sim);
+}
+
+/*
+ * Registers
+ */
+static inline uint32 svgasim_read_reg(svgasim_t *sim, uint32 index)
+{
+	switch(index)
+	{
+		case SVGA_REG_BUSY:
+			svgasim_run(sim);
+			return 0;
+		case SVGA_REG_CAPABILITIES:
+			return sim->caps;
+		case SVGA_REG_BYTES_PER_LINE:
+			return svgasim_bytes_per_line(sim);
+		case SVGA_REG_DEPTH:
+			switch(sim->regs[SVGA_REG_BITS_PER_PIXEL])
+			{
+				case 32: return 24;
+				case 16: return 16;
+				default: return sim->regs[SVGA_REG_BITS_PER_PIXEL];
+			}
+		case SVGA_REG_DEV_CAP:
+			return sim->devcap_index < SVGASIM_DEVCAP_MAX ? sim->devcap[sim->devcap_index] : 0;
+	}
+
+	if(index < SVGA_REG_TOP)
+	{
+		return sim->regs[index];
+	}
+
+	return 0;
+}
+
+static inline void svgasim_write_reg(svgasim_t *sim, uint32 index, uint32 value)
+{
+	switch(index)
+	{
+		case SVGA_REG_ID:
+			if(value >= SVGA_ID_0 && value <= SVGA_ID_2)
+			{
+				sim->regs[SVGA_REG_ID] = value;
+			}
+			return;
+		case SVGA_REG_WIDTH:
+		case SVGA_REG_HEIGHT:
+		case SVGA_REG_BITS_PER_PIXEL:
+			sim->regs[index] = value;
+			svgasim_mode_legacy(sim);
+			return;
+		case SVGA_REG_SYNC:
+			sim->stat.syncs++;
+			svgasim_run(sim);
+			return;
+		case SVGA_REG_GMR_DESCRIPTOR:
+			svgasim_gmr_define(sim, sim->regs[SVGA_REG_GMR_ID], value);
+			return;
+		case SVGA_REG_DEV_CAP:
+			sim->devcap_index = value;
+			return;
+		case SVGA_REG_COMMAND_HIGH:
+			sim->cmd_high = value;
+			return;
+		case SVGA_REG_COMMAND_LOW:
+			svgasim_cb_submit(sim, value);
+			return;
+		case SVGA_REG_CAPABILITIES:
+		case SVGA_REG_VRAM_SIZE:
+		case SVGA_REG_FB_START:
+		case SVGA_REG_MEM_START:
+		case SVGA_REG_MEM_SIZE:
+		case SVGA_REG_MAX_WIDTH:
+		case SVGA_REG_MAX_HEIGHT:
+			return; /* read only */
+	}
+
+	if(index < SVGA_REG_TOP)
+	{
+		sim->regs[index] = value;
+	}
+}
+
+static inline void svgasim_outpd(svgasim_t *sim, uint32 port, uint32 value)
+{
+	sim->stat.port_out++;
+
+	switch(port - SVGASIM_IO_BASE)
+	{
+		case SVGA_INDEX_PORT:
+			sim->index = value;
+			break;
+		case SVGA_VALUE_PORT:
+			svgasim_write_reg(sim, sim->index, value);
+			break;
+	}
+}
+
+static inline uint32 svgasim_inpd(svgasim_t *sim, uint32 port)
+{
+	sim->stat.port_in++;
+
+	switch(port - SVGASIM_IO_BASE)
+	{
+		case SVGA_INDEX_PORT:
+			return sim->index;
+		case SVGA_VALUE_PORT:
+			return svgasim_read_reg(sim, sim->index);
+	}
+
+	return 0xFFFFFFFFUL;
+}
+
+/*
+ * Device create/destroy
+ */
+static inline svgasim_t *svgasim_create(uint32 vram_size, uint32 fifo_size, uint32 phys_size)
+{
+	svgasim_t *sim = calloc(1, sizeof(svgasim_t));
+	SVGA3dCapsRecord *rec;
+	uint32 i;
+
+	sim->vram_size = vram_size;
+	sim->fifo_size = fifo_size;
+	sim->phys_size = phys_size;
+	sim->vram    = aligned_alloc(SVGASIM_PAGE, vram_size);
+	sim->fifo    = aligned_alloc(SVGASIM_PAGE, fifo_size);
+	sim->phys    = aligned_alloc(SVGASIM_PAGE, phys_size);
+	sim->scratch = malloc(fifo_size);
+	memset(sim->vram, 0, vram_size);
+	memset(sim->fifo, 0, fifo_size);
+
+	sim->caps = SVGA_CAP_RECT_COPY | SVGA_CAP_CURSOR | SVGA_CAP_CURSOR_BYPASS |
+		SVGA_CAP_CURSOR_BYPASS_2 | SVGA_CAP_8BIT_EMULATION | SVGA_CAP_ALPHA_CURSOR |
+		SVGA_CAP_3D | SVGA_CAP_EXTENDED_FIFO | SVGA_CAP_PITCHLOCK | SVGA_CAP_IRQMASK |
+		SVGA_CAP_GMR | SVGA_CAP_GMR2 | SVGA_CAP_SCREEN_OBJECT_2 | SVGA_CAP_COMMAND_BUFFERS |
+		SVGA_CAP_CMD_BUFFERS_2 | SVGA_CAP_GBOBJECTS;
+
+	sim->regs[SVGA_REG_ID]           = SVGA_ID_2;
+	sim->regs[SVGA_REG_MAX_WIDTH]    = 8192;
+	sim->regs[SVGA_REG_MAX_HEIGHT]   = 8192;
+	sim->regs[SVGA_REG_WIDTH]        = 640;
+	sim->regs[SVGA_REG_HEIGHT]       = 480;
+	sim->regs[SVGA_REG_BITS_PER_PIXEL] = 32;
+	sim->regs[SVGA_REG_HOST_BITS_PER_PIXEL] = 32;
+	sim->regs[SVGA_REG_FB_START]     = SVGASIM_FB_PA;
+	sim->regs[SVGA_REG_VRAM_SIZE]    = vram_size;
+	sim->regs[SVGA_REG_FB_SIZE]      = vram_size;
+	sim->regs[SVGA_REG_MEM_START]    = SVGASIM_FIFO_PA;
+	sim->regs[SVGA_REG_MEM_SIZE]     = fifo_size;
+	sim->regs[SVGA_REG_GMR_MAX_IDS]  = SVGASIM_GMR_MAX;
+	sim->regs[SVGA_REG_GMR_MAX_DESCRIPTOR_LENGTH] = SVGASIM_PAGE/sizeof(SVGAGuestMemDescriptor) - 1;
+	sim->regs[SVGA_REG_GMRS_MAX_PAGES] = phys_size / SVGASIM_PAGE;
+	sim->regs[SVGA_REG_MEMORY_SIZE]  = phys_size;
+	sim->regs[SVGA_REG_MOB_MAX_SIZE] = phys_size;
+	sim->regs[SVGA_REG_SCREENTARGET_MAX_WIDTH]  = 8192;
+	sim->regs[SVGA_REG_SCREENTARGET_MAX_HEIGHT] = 8192;
+	sim->regs[SVGA_REG_SUGGESTED_GBOBJECT_MEM_SIZE_KB] = phys_size / 1024;
+	sim->regs[SVGA_REG_MAX_PRIMARY_MEM] = vram_size;
+
+	sim->devcap[SVGA3D_DEVCAP_3D] = 1;
+	sim->devcap[SVGA3D_DEVCAP_DXCONTEXT] = 1;
+
+	sim->fifo[SVGA_FIFO_CAPABILITIES] = SVGA_FIFO_CAP_FENCE | SVGA_FIFO_CAP_ACCELFRONT |
+		SVGA_FIFO_CAP_PITCHLOCK | SVGA_FIFO_CAP_CURSOR_BYPASS_3 | SVGA_FIFO_CAP_RESERVE |
+		SVGA_FIFO_CAP_SCREEN_OBJECT | SVGA_FIFO_CAP_GMR2 | SVGA_FIFO_CAP_SCREEN_OBJECT_2;
+
+	/* gen9 caps block: one DEVCAPS record with all nonzero caps */
+	rec = (SVGA3dCapsRecord*)&sim->fifo[SVGA_FIFO_3D_CAPS];
+	rec->header.type = SVGA3DCAPS_RECORD_DEVCAPS;
+	rec->header.length = 2;
+	for(i = 0; i < SVGASIM_DEVCAP_MAX && rec->header.length + 2 < SVGA_FIFO_3D_CAPS_SIZE; i++)
+	{
+		if(sim->devcap[i])
+		{
+			rec->data[rec->header.length - 2]     = i;
+			rec->data[rec->header.length - 2 + 1] = sim->devcap[i];
+			rec->header.length += 2;
+		}
+	}
+
+	svgasim_mode_legacy(sim);
+	sim->stat.mode_sets = 0;
+
+	return sim;
+}
+
+static inline void svgasim_destroy(svgasim_t *sim)
+{
+	uint32 i;
+
+	for(i = 0; i < SVGASIM_SCREENS; i++)
+	{
+		svgasim_screen_destroy(sim, i);
+	}
+
+	for(i = 0; i < SVGASIM_GMR_MAX; i++)
+	{
+		free(sim->gmr[i].ppn);
+	}
+
+	free(sim->vram);
+	free(sim->fifo);
+	free(sim->phys);
+	free(sim->scratch);
+	free(sim);
+}
+
+#ifdef SVGASIM_VMM
+/*
+ * VMM shims with same prototypes as vxd_lib.h, device in svgasim_vmm_dev
+ */
+typedef unsigned long ULONG;
+typedef void *PVOID;
+
+static svgasim_t *svgasim_vmm_dev = NULL;
+
+ULONG _PageAllocate(ULONG nPages, ULONG pType, ULONG VM, ULONG AlignMask, ULONG minPhys, ULONG maxPhys, ULONG *PhysAddr, ULONG flags)
+{
+	uint32 pa = 0;
+	void *ptr = svgasim_phys_alloc(svgasim_vmm_dev, nPages * SVGASIM_PAGE, &pa);
+
+	if(PhysAddr) *PhysAddr = pa;
+
+	return (ULONG)ptr;
+}
+
+ULONG _PageFree(PVOID hMem, ULONG flags)
+{
+	return 1; /* bump allocator */
+}
+
+ULONG _CopyPageTable(ULONG LinPgNum, ULONG nPages, uint32 *PageBuf, ULONG flags)
+{
+	ULONG i;
+
+	for(i = 0; i < nPages; i++)
+	{
+		uint32 pa = svgasim_ptr_pa(svgasim_vmm_dev, (void*)((LinPgNum + i) * SVGASIM_PAGE));
+		PageBuf[i] = pa ? (pa | 0x7) : 0; /* P_PRES | P_WRITE | P_USER */
+	}
+
+	return 1;
+}
+
+ULONG Create_Semaphore(ULONG TokenCount)
+{
+	long *sem = malloc(sizeof(long));
+	*sem = TokenCount;
+	return (ULONG)sem;
+}
+
+void Wait_Semaphore(ULONG semHandle, ULONG flags)
+{
+	long *sem = (long*)semHandle;
+	if(*sem <= 0)
+	{
+		fprintf(stderr, "svgasim: semaphore deadlock\n");
+		abort();
+	}
+	(*sem)--;
+}
+
+void Signal_Semaphore(ULONG semHandle)
+{
+	(*(long*)semHandle)++;
+}
+
+uint32 Get_System_Time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32)(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+#endif /* SVGASIM_VMM */
+
+#endif /* __SVGASIM_H__INCLUDED__ */
@@ -0,0 +1,242 @@
+/*
+ * Print command statistics (vmwsmini.vxd)
+ *
+ * usage:
+ *   svgastat          - print statistics
+ *   svgastat start    - clear counters and start counting
+ *   svgastat stop     - stop counting
+ *
+ * Counting can be also enabled from boot by Stats = 1 in
+ * HKLM\Software\VMWSVGA, StatsLongWait (ms, default 4) sets which fence
+ * waits are reported as long.
+ */
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SVGA
+#include "../../3d_accel.h"
+
+#define SVGA_CMD_NAMES_ONLY
+#include "../../vxd_svga_debug.h"
+
+#define DRIVER "vmwsmini.vxd"
+
+static const struct
+{
+	DWORD id;
+	const char *name;
+} cmd2d_names[] = {
+	{0,  "(unparsed)"},
+	{1,  "SVGA_CMD_UPDATE"},
+	{3,  "SVGA_CMD_RECT_COPY"},
+	{19, "SVGA_CMD_DEFINE_CURSOR"},
+	{22, "SVGA_CMD_DEFINE_ALPHA_CURSOR"},
+	{25, "SVGA_CMD_UPDATE_VERBOSE"},
+	{29, "SVGA_CMD_FRONT_ROP_FILL"},
+	{30, "SVGA_CMD_FENCE"},
+	{33, "SVGA_CMD_ESCAPE"},
+	{34, "SVGA_CMD_DEFINE_SCREEN"},
+	{35, "SVGA_CMD_DESTROY_SCREEN"},
+	{36, "SVGA_CMD_DEFINE_GMRFB"},
+	{37, "SVGA_CMD_BLIT_GMRFB_TO_SCREEN"},
+	{38, "SVGA_CMD_BLIT_SCREEN_TO_GMRFB"},
+	{39, "SVGA_CMD_ANNOTATION_FILL"},
+	{40, "SVGA_CMD_ANNOTATION_COPY"},
+	{41, "SVGA_CMD_DEFINE_GMR2"},
+	{42, "SVGA_CMD_REMAP_GMR2"}
+};
+
+#define CAT_OTHER    0
+#define CAT_TRANSFER 1
+#define CAT_DRAW     2
+#define CAT_PRESENT  3
+#define CAT_CNT      4
+
+static const char *cat_names[CAT_CNT] = {"other", "transfer", "draw", "present"};
+
+static const char *op_name(DWORD op)
+{
+	static char buf[32];
+	DWORD i;
+
+	if(op >= SVGA_STATS_2D_CNT)
+	{
+		DWORD id = op - SVGA_STATS_2D_CNT + SVGA_STATS_3D_BASE;
+		if(id >= CMD3D_MIN && id <= CMD3D_MAX)
+		{
+			return svga_cmd_tables[id - CMD3D_MIN];
+		}
+
+		sprintf(buf, "SVGA_3D_CMD_%lu", id);
+		return buf;
+	}
+
+	for(i = 0; i < sizeof(cmd2d_names)/sizeof(cmd2d_names[0]); i++)
+	{
+		if(cmd2d_names[i].id == op)
+		{
+			return cmd2d_names[i].name;
+		}
+	}
+
+	sprintf(buf, "SVGA_CMD_%lu", op);
+	return buf;
+}
+
+/* classify by name, so new commands don't need table update */
+static int op_category(DWORD op)
+{
+	const char *name = op_name(op);
+
+	if(strstr(name, "PRESENT") || strstr(name, "SCREEN") || op == 1 /* SVGA_CMD_UPDATE */)
+		return CAT_PRESENT;
+
+	if(strstr(name, "DRAW") || strstr(name, "CLEAR"))
+		return CAT_DRAW;
+
+	if(strstr(name, "DMA") || strstr(name, "UPDATE_GB") || strstr(name, "READBACK") ||
+		strstr(name, "SUBRESOURCE") || strstr(name, "COPY") || strstr(name, "BLIT"))
+		return CAT_TRANSFER;
+
+	return CAT_OTHER;
+}
+
+static BOOL stats_cmd(HANDLE vxd, DWORD enable)
+{
+	DWORD in[2] = {SVGA_CMD_STATS, enable};
+	DWORD out = 0;
+
+	DeviceIoControl(vxd, OP_SVGA_VXDCMD,
+		&in[0], sizeof(in),
+		&out, sizeof(out),
+		NULL, NULL);
+
+	return out != 0;
+}
+
+static int cmp_bytes(const void *a, const void *b)
+{
+	const SVGA_stats_op_t *oa = *(const SVGA_stats_op_t**)a;
+	const SVGA_stats_op_t *ob = *(const SVGA_stats_op_t**)b;
+
+	if(oa->bytes < ob->bytes) return 1;
+	if(oa->bytes > ob->bytes) return -1;
+	return 0;
+}
+
+static void stats_print(SVGA_stats_t *st)
+{
+	SVGA_stats_t snap;
+	SVGA_stats_op_t *sorted[SVGA_STATS_OPS];
+	DWORD cat_cnt[CAT_CNT] = {0};
+	DWORD cat_bytes[CAT_CNT] = {0};
+	DWORD cnt = 0;
+	DWORD elapsed;
+	DWORD i;
+
+	memcpy(&snap, st, sizeof(snap));
+	elapsed = GetTickCount() - snap.start_time;
+
+	printf("%s, %lu ms\n", snap.enabled ? "running" : "stopped", elapsed);
+	printf("submits: %lu (FIFO: %lu), bytes: %lu\n", snap.submits, snap.submits_fifo, snap.bytes);
+	printf("fence waits: %lu (%lu ms), long (>= %lu ms): %lu (%lu ms)\n\n",
+		snap.fence_waits, snap.fence_wait_ms, snap.long_wait_limit, snap.long_waits, snap.long_wait_ms);
+
+	printf("%-10s %10s %10s %12s\n", "pid", "submits", "commands", "bytes");
+	for(i = 0; i < SVGA_STATS_PROCS; i++)
+	{
+		SVGA_stats_proc_t *p = &snap.procs[i];
+		if(p->submits == 0)
+			continue;
+
+		if(p->pid == SVGA_STATS_PID_DRIVER)
+			printf("%-10s ", "driver");
+		else if(p->pid == SVGA_STATS_PID_UNKNOWN)
+			printf("%-10s ", "unknown");
+		else
+			printf("%08lX   ", p->pid);
+
+		printf("%10lu %10lu %12lu\n", p->submits, p->cmds, p->bytes);
+	}
+	if(snap.procs_lost)
+	{
+		printf("(%lu submits from other processes)\n", snap.procs_lost);
+	}
+
+	for(i = 0; i < SVGA_STATS_OPS; i++)
+	{
+		if(snap.ops[i].cnt)
+		{
+			int c = op_category(i);
+			cat_cnt[c] += snap.ops[i].cnt;
+			cat_bytes[c] += snap.ops[i].bytes;
+			sorted[cnt++] = &snap.ops[i];
+		}
+	}
+
+	printf("\n%-10s %10s %12s\n", "category", "commands", "bytes");
+	for(i = 0; i < CAT_CNT; i++)
+	{
+		printf("%-10s %10lu %12lu\n", cat_names[i], cat_cnt[i], cat_bytes[i]);
+	}
+
+	qsort(sorted, cnt, sizeof(sorted[0]), cmp_bytes);
+
+	printf("\n%-44s %10s %12s %10s %10s\n", "command", "count", "bytes", "long wait", "wait ms");
+	for(i = 0; i < cnt; i++)
+	{
+		SVGA_stats_op_t *op = sorted[i];
+		printf("%-44s %10lu %12lu %10lu %10lu\n", op_name(op - &snap.ops[0]),
+			op->cnt, op->bytes, op->long_waits, op->long_wait_ms);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	SVGA_stats_t *st = NULL;
+	int rc = EXIT_SUCCESS;
+	HANDLE vxd;
+
+	vxd = CreateFileA("\\\\.\\" DRIVER, 0, 0, 0, CREATE_NEW, FILE_FLAG_DELETE_ON_CLOSE, 0);
+	if(vxd == INVALID_HANDLE_VALUE)
+	{
+		printf("cannot load VXD driver\n");
+		return EXIT_FAILURE;
+	}
+
+	DeviceIoControl(vxd, OP_SVGA_STATS_SETUP,
+		NULL, 0,
+		&st, sizeof(st),
+		NULL, NULL);
+
+	if(st == NULL)
+	{
+		printf("statistics are not available\n");
+		CloseHandle(vxd);
+		return EXIT_FAILURE;
+	}
+
+	if(argc < 2)
+	{
+		stats_print(st);
+	}
+	else if(strcmp(argv[1], "start") == 0)
+	{
+		stats_cmd(vxd, 1);
+	}
+	else if(strcmp(argv[1], "stop") == 0)
+	{
+		stats_cmd(vxd, 0);
+	}
+	else
+	{
+		printf("Unknown command: %s\n", argv[1]);
+		rc = EXIT_FAILURE;
+	}
+
+	CloseHandle(vxd);
+
+	return rc;
+}
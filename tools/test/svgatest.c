@@ -0,0 +1,731 @@
+/*
+ * Tests and benchmark of driver submission paths on software SVGA-II
+ * model (svgasim.h)
+ *
+ * CB queue, SVGA_CMB_submit (FIFO and CB branch), context start/stop and
+ * recovery after error in CB are compiled from vxd_svga_cb_queue.h (same
+ * code as in vxd_svga_cb.c), rest of the driver is provided as shims.
+ * Register access and FIFO setup follow vmware/svga.c, GMR descriptors
+ * and MOB page tables follow vxd_svga_mem.c.
+ *
+ * Host processes commands when driver syncs, host_hold stops it to keep
+ * CBs queued (busy host). The driver doesn't sync in its own queue waits
+ * (device runs asynchronously on real HW), so waits between contexts
+ * aren't tested here.
+ *
+ * gcc -O2 -fgnu89-inline -fno-strict-aliasing -o svgatest svgatest.c
+ */
+#define SVGASIM_VMM
+#include "svgasim.h"
+
+typedef unsigned char  BYTE;
+typedef unsigned short WORD;
+typedef unsigned int   DWORD;
+typedef int            BOOL;
+typedef void           VOID;
+typedef long           LONG;
+
+#include "../../vmware/svga3d_dx.h"
+
+#define SVGA
+#include "../../3d_accel.h"
+
+#define SCREEN_W 1024
+#define SCREEN_H 768
+#define BENCH_ITERS 100000
+
+static svgasim_t *sim;
+static BOOL host_hold = FALSE;
+
+/*
+ * Driver side
+ */
+static uint32 reg_read(uint32 index)
+{
+	svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_INDEX_PORT, index);
+	return svgasim_inpd(sim, SVGASIM_IO_BASE + SVGA_VALUE_PORT);
+}
+
+static void reg_write(uint32 index, uint32 value)
+{
+	svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_INDEX_PORT, index);
+	svgasim_outpd(sim, SVGASIM_IO_BASE + SVGA_VALUE_PORT, value);
+}
+
+static uint32 *fifo_mem()
+{
+	return svgasim_pa_ptr(sim, reg_read(SVGA_REG_MEM_START));
+}
+
+/* vxd_svga.c state and services used by CB queue */
+#define dbg_printf(...) do{}while(0)
+#define SVGA_TRACE(_id, _a0, _a1, _a2) do{}while(0)
+#define HIST_BEGIN(_tsc) do{ (void)(_tsc); }while(0)
+#define HIST_END(_id, _tsc) do{ (void)(_tsc); }while(0)
+
+static FBHDA_t fbhda;
+FBHDA_t *hda = &fbhda;
+static FBHDA_perf_t fbhda_perf;
+FBHDA_perf_t *hda_perf = &fbhda_perf;
+
+static struct
+{
+	uint32 *fifoMem;
+} gSVGA;
+
+BOOL cb_support = FALSE;
+BOOL cb_context0 = FALSE;
+BOOL cb_context1 = FALSE;
+DWORD cb_2d_context = TRUE;
+BOOL surface_dirty = FALSE;
+BOOL capture_active = FALSE;
+BOOL stats_active = FALSE;
+void *cmdbuf = NULL;
+void *ctlbuf = NULL;
+ULONG cb_sem = 0;
+
+static uint32 fence_next = 1;
+
+void SVGA_capture_cmb(DWORD *cmb, DWORD cmb_size, DWORD flags, DWORD dx)
+{
+}
+
+void SVGA_stats_cmb(DWORD *cmb, DWORD cmb_size, DWORD flags, DWORD dx, DWORD process)
+{
+}
+
+void SVGA_stats_fence(DWORD fence)
+{
+}
+
+DWORD VWIN32_GetCurrentProcessHandle()
+{
+	return 0;
+}
+
+void SVGA_WriteReg(DWORD index, DWORD value)
+{
+	reg_write(index, value);
+}
+
+DWORD SVGA_ReadRegCached(DWORD index)
+{
+	return reg_read(index);
+}
+
+void SVGA_Sync()
+{
+	if(!host_hold)
+	{
+		reg_write(SVGA_REG_SYNC, 1);
+	}
+}
+
+void SVGA_Flush()
+{
+	reg_write(SVGA_REG_SYNC, 1);
+	reg_read(SVGA_REG_BUSY);
+}
+
+DWORD SVGA_fence_get()
+{
+	return fence_next++;
+}
+
+DWORD SVGA_fence_passed()
+{
+	return gSVGA.fifoMem[SVGA_FIFO_FENCE];
+}
+
+void SVGA_fence_wait(DWORD fence_id)
+{
+	hda_perf->fence_waits++;
+	while((int32)(SVGA_fence_passed() - fence_id) < 0)
+	{
+		hda_perf->fence_spins++;
+		SVGA_Sync();
+	}
+}
+
+DWORD *SVGA_CMB_alloc_size(DWORD datasize);
+
+/* vxd_svga_cb.c */
+static uint64 cb_next_id = {0, 0};
+
+static void SVGA_cb_id_inc()
+{
+	if(++cb_next_id.low == 0)
+	{
+		cb_next_id.hi++;
+	}
+}
+
+#include "../../vxd_svga_cb_queue.h"
+
+/* same layout as SVGA_CMB_alloc_size in vxd_svga_cb.c */
+DWORD *SVGA_CMB_alloc_size(DWORD datasize)
+{
+	uint32 phy;
+	SVGACBHeader *cb;
+	cb_queue_t *q;
+
+	q = svgasim_phys_alloc(sim, datasize + sizeof(SVGACBHeader) + sizeof(cb_queue_t), &phy);
+	if(q)
+	{
+		q->next = NULL;
+		q->flags = 0;
+		q->data_size = 0;
+
+		cb = (SVGACBHeader*)(q+1);
+
+		memset(cb, 0, sizeof(SVGACBHeader));
+		cb->status = SVGA_CB_STATUS_COMPLETED;
+		cb->ptr.pa.hi   = 0;
+		cb->ptr.pa.low  = phy + sizeof(cb_queue_t) + sizeof(SVGACBHeader);
+
+		return (DWORD*)(cb+1);
+	}
+
+	return NULL;
+}
+
+DWORD *SVGA_CMB_alloc()
+{
+	return SVGA_CMB_alloc_size(SVGA_CB_MAX_SIZE);
+}
+
+static int drv_init()
+{
+	uint32 *fifo;
+
+	reg_write(SVGA_REG_ID, SVGA_ID_2);
+	if(reg_read(SVGA_REG_ID) != SVGA_ID_2)
+	{
+		return FALSE;
+	}
+
+	fifo = fifo_mem();
+	fifo[SVGA_FIFO_MIN] = SVGA_FIFO_NUM_REGS * sizeof(uint32);
+	fifo[SVGA_FIFO_MAX] = reg_read(SVGA_REG_MEM_SIZE);
+	fifo[SVGA_FIFO_NEXT_CMD] = fifo[SVGA_FIFO_MIN];
+	fifo[SVGA_FIFO_STOP] = fifo[SVGA_FIFO_MIN];
+	gSVGA.fifoMem = fifo;
+
+	reg_write(SVGA_REG_ENABLE, TRUE);
+	reg_write(SVGA_REG_CONFIG_DONE, TRUE);
+
+	reg_write(SVGA_REG_WIDTH, SCREEN_W);
+	reg_write(SVGA_REG_HEIGHT, SCREEN_H);
+	reg_write(SVGA_REG_BITS_PER_PIXEL, 32);
+
+	cb_sem = Create_Semaphore(1);
+	ctlbuf = SVGA_CMB_alloc_size(1024);
+	cmdbuf = SVGA_CMB_alloc();
+	CB_recover_alloc();
+
+	return TRUE;
+}
+
+static SVGACBHeader *cb_header(uint32 *cmb)
+{
+	return ((SVGACBHeader*)cmb)-1;
+}
+
+/* command builders, return dwords */
+static uint32 cmd_gmrfb(uint32 *p, uint32 gmr, uint32 offset, uint32 pitch)
+{
+	SVGAFifoCmdDefineGMRFB *g = (SVGAFifoCmdDefineGMRFB*)(p+1);
+
+	p[0] = SVGA_CMD_DEFINE_GMRFB;
+	g->ptr.gmrId  = gmr;
+	g->ptr.offset = offset;
+	g->bytesPerLine = pitch;
+	g->format.value = 0;
+	g->format.bitsPerPixel = 32;
+	g->format.colorDepth   = 24;
+
+	return 1 + sizeof(SVGAFifoCmdDefineGMRFB)/4;
+}
+
+static uint32 cmd_blit(uint32 *p, int32 x, int32 y, int32 w, int32 h)
+{
+	SVGAFifoCmdBlitGMRFBToScreen *b = (SVGAFifoCmdBlitGMRFBToScreen*)(p+1);
+
+	p[0] = SVGA_CMD_BLIT_GMRFB_TO_SCREEN;
+	b->srcOrigin.x = x;
+	b->srcOrigin.y = y;
+	b->destRect.left   = x;
+	b->destRect.top    = y;
+	b->destRect.right  = x + w;
+	b->destRect.bottom = y + h;
+	b->destScreenId = 0;
+
+	return 1 + sizeof(SVGAFifoCmdBlitGMRFBToScreen)/4;
+}
+
+static uint32 cmd_screen(uint32 *p, uint32 w, uint32 h)
+{
+	SVGAScreenObject *s = (SVGAScreenObject*)(p+1);
+
+	p[0] = SVGA_CMD_DEFINE_SCREEN;
+	memset(s, 0, sizeof(SVGAScreenObject));
+	s->structSize = sizeof(SVGAScreenObject);
+	s->id = 0;
+	s->flags = SVGA_SCREEN_MUST_BE_SET | SVGA_SCREEN_IS_PRIMARY;
+	s->size.width  = w;
+	s->size.height = h;
+
+	return 1 + sizeof(SVGAScreenObject)/4;
+}
+
+/* valid size, but fails on device: screen isn't defined */
+static uint32 cmd_bad_destroy(uint32 *p)
+{
+	p[0] = SVGA_CMD_DESTROY_SCREEN;
+	p[1] = SVGASIM_SCREENS-1;
+
+	return 1 + sizeof(SVGAFifoCmdDestroyScreen)/4;
+}
+
+static uint32 cmd_update(uint32 *p, uint32 x, uint32 y, uint32 w, uint32 h)
+{
+	p[0] = SVGA_CMD_UPDATE;
+	p[1] = x;
+	p[2] = y;
+	p[3] = w;
+	p[4] = h;
+
+	return 5;
+}
+
+/*
+ * Tests
+ */
+static void fill_pattern(uint8 *ptr, uint32 size, uint32 seed)
+{
+	uint32 i;
+	for(i = 0; i < size; i++)
+	{
+		ptr[i] = (uint8)((i * 2654435761U + seed) >> 13);
+	}
+}
+
+static int check_screen(uint8 *src, uint32 src_pitch, const char *name)
+{
+	svgasim_screen_t *s = &sim->screen[0];
+	uint32 y;
+
+	for(y = 0; y < s->height; y++)
+	{
+		if(memcmp(s->pixels + y*s->pitch, src + y*src_pitch, s->width*4) != 0)
+		{
+			printf("%-24s FAIL (line %u)\n", name, y);
+			return FALSE;
+		}
+	}
+
+	printf("%-24s OK\n", name);
+	return TRUE;
+}
+
+static int test_fifo_update(uint32 *cmb)
+{
+	SVGA_CMB_status_t st;
+	uint32 i;
+
+	fill_pattern(sim->vram, SCREEN_W*SCREEN_H*4, 1);
+
+	/* many small commands to wrap FIFO ring */
+	for(i = 0; i < 20000; i++)
+	{
+		SVGA_CMB_submit(cmb, cmd_update(cmb, 0, (i % SCREEN_H), SCREEN_W, 1)*4, &st, SVGA_CB_SYNC, 0);
+		if(st.sStatus != SVGA_PROC_COMPLETED)
+		{
+			printf("%-24s FAIL (status %u)\n", "FIFO update + fence", st.sStatus);
+			return FALSE;
+		}
+	}
+
+	SVGA_CMB_submit(cmb, cmd_update(cmb, 0, 0, SCREEN_W, SCREEN_H)*4, NULL, SVGA_CB_SYNC, 0);
+
+	return check_screen(sim->vram, SCREEN_W*4, "FIFO update + fence");
+}
+
+/* contexts are started by the driver, context 1 only with CMD_BUFFERS_2 */
+static int test_cb_start()
+{
+	cb_support = (reg_read(SVGA_REG_CAPABILITIES) & SVGA_CAP_COMMAND_BUFFERS) != 0;
+
+	SVGA_CB_start();
+
+	if(!cb_context0 || !cb_context1 || !sim->cb_enabled[SVGA_CB_CONTEXT_0] || !sim->cb_enabled[SVGA_CB_CONTEXT_1])
+	{
+		printf("%-24s FAIL (context0 %d, context1 %d)\n", "CB start", cb_context0, cb_context1);
+		return FALSE;
+	}
+
+	printf("%-24s OK\n", "CB start");
+	return TRUE;
+}
+
+static int test_cb_blit(uint32 *cmb)
+{
+	SVGA_CMB_status_t st;
+	uint32 cb_submits = hda_perf->cb_submits;
+	uint32 n = 0;
+
+	fill_pattern(sim->vram, SCREEN_W*SCREEN_H*4, 2);
+
+	n += cmd_screen(cmb + n, SCREEN_W, SCREEN_H);
+	n += cmd_gmrfb(cmb + n, SVGA_GMR_FRAMEBUFFER, 0, SCREEN_W*4);
+	n += cmd_blit(cmb + n, 0, 0, SCREEN_W, SCREEN_H);
+
+	SVGA_CMB_submit(cmb, n*4, &st, SVGA_CB_SYNC, 0);
+	if(st.sStatus != SVGA_PROC_COMPLETED || hda_perf->cb_submits != cb_submits + 1)
+	{
+		printf("%-24s FAIL (status %u)\n", "CB GMRFB blit", st.sStatus);
+		return FALSE;
+	}
+
+	return check_screen(sim->vram, SCREEN_W*4, "CB GMRFB blit");
+}
+
+/*
+ * Error in CB with more CBs queued behind it: driver preempts the queue,
+ * starts halted context, resubmits rest of failed CB and then preempted
+ * CBs in original order. Every queued CB blits whole screen from GMRFB one
+ * line lower, so screen shows the last one only when order was kept.
+ */
+static int test_cb_recover(uint32 *cmb, uint32 **cmbs, uint32 count)
+{
+	SVGA_CMB_status_t st;
+	svgasim_stat_t ss = sim->stat;
+	uint32 restarts = hda_perf->cb_restarts;
+	uint32 n = 0, bad, i;
+
+	fill_pattern(sim->vram, SCREEN_W*(SCREEN_H+count)*4, 3);
+
+	host_hold = TRUE;
+
+	n += cmd_gmrfb(cmb + n, SVGA_GMR_FRAMEBUFFER, 0, SCREEN_W*4);
+	bad = n;
+	n += cmd_bad_destroy(cmb + n);
+	n += cmd_blit(cmb + n, 0, 0, SCREEN_W, SCREEN_H);
+	SVGA_CMB_submit(cmb, n*4, &st, 0, 0);
+
+	for(i = 0; i < count; i++)
+	{
+		n  = cmd_gmrfb(cmbs[i], SVGA_GMR_FRAMEBUFFER, (i+1)*SCREEN_W*4, SCREEN_W*4);
+		n += cmd_blit(cmbs[i] + n, 0, 0, SCREEN_W, SCREEN_H);
+		SVGA_CMB_submit(cmbs[i], n*4, NULL, 0, 0);
+	}
+
+	if(cb_queue_info[0].items != count+1 || sim->cb_queued[SVGA_CB_CONTEXT_0] != count+1)
+	{
+		host_hold = FALSE;
+		printf("%-24s FAIL (%u CBs queued)\n", "CB error recovery", cb_queue_info[0].items);
+		return FALSE;
+	}
+
+	host_hold = FALSE;
+	SVGA_Flush_CB();
+
+	if(cb_header(cmb)->status != SVGA_CB_STATUS_COMMAND_ERROR || cb_header(cmb)->errorOffset != bad*4)
+	{
+		printf("%-24s FAIL (status %u, offset %u)\n", "CB error recovery",
+			cb_header(cmb)->status, cb_header(cmb)->errorOffset);
+		return FALSE;
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		if(cb_header(cmbs[i])->status != SVGA_CB_STATUS_COMPLETED)
+		{
+			printf("%-24s FAIL (CB %u status %u)\n", "CB error recovery", i, cb_header(cmbs[i])->status);
+			return FALSE;
+		}
+	}
+
+	if(hda_perf->cb_restarts != restarts || sim->stat.cb_preempted - ss.cb_preempted != count ||
+		sim->stat.blits - ss.blits != count+1)
+	{
+		printf("%-24s FAIL (%u restarts, %u preempted, %u blits)\n", "CB error recovery",
+			hda_perf->cb_restarts - restarts, sim->stat.cb_preempted - ss.cb_preempted, sim->stat.blits - ss.blits);
+		return FALSE;
+	}
+
+	return check_screen(sim->vram + count*SCREEN_W*4, SCREEN_W*4, "CB error recovery");
+}
+
+/*
+ * SVGA_CB_SYNC submit of failing CB returns error after rest of its
+ * commands (resubmitted from recovery buffer) is done.
+ */
+static int test_cb_recover_sync(uint32 *cmb)
+{
+	SVGA_CMB_status_t st;
+	svgasim_stat_t ss = sim->stat;
+	uint32 restarts = hda_perf->cb_restarts;
+	uint32 n = 0;
+
+	fill_pattern(sim->vram, SCREEN_W*SCREEN_H*4, 4);
+
+	n += cmd_gmrfb(cmb + n, SVGA_GMR_FRAMEBUFFER, 0, SCREEN_W*4);
+	n += cmd_bad_destroy(cmb + n);
+	n += cmd_blit(cmb + n, 0, 0, SCREEN_W, SCREEN_H);
+	SVGA_CMB_submit(cmb, n*4, &st, SVGA_CB_SYNC, 0);
+
+	if(st.sStatus != SVGA_PROC_ERROR || sim->stat.blits - ss.blits != 1 ||
+		hda_perf->cb_restarts != restarts || cb_queue_info[0].items != 0)
+	{
+		printf("%-24s FAIL (status %u, %u blits, %u restarts, %u queued)\n", "CB sync recovery",
+			st.sStatus, sim->stat.blits - ss.blits, hda_perf->cb_restarts - restarts, cb_queue_info[0].items);
+		return FALSE;
+	}
+
+	return check_screen(sim->vram, SCREEN_W*4, "CB sync recovery");
+}
+
+/*
+ * Without recovery buffer driver has to restart context, SVGA_CB_SYNC
+ * submitter does it before it returns.
+ */
+static int test_cb_restart(uint32 *cmb)
+{
+	SVGA_CMB_status_t st;
+	DWORD *recover_buf = cb_recover_buf;
+	uint32 restarts = hda_perf->cb_restarts;
+	uint32 n = 0;
+
+	cb_recover_buf = NULL;
+
+	n += cmd_bad_destroy(cmb + n);
+	SVGA_CMB_submit(cmb, n*4, &st, SVGA_CB_SYNC, 0);
+
+	if(st.sStatus != SVGA_PROC_ERROR)
+	{
+		cb_recover_buf = recover_buf;
+		printf("%-24s FAIL (status %u)\n", "CB context restart", st.sStatus);
+		return FALSE;
+	}
+
+	SVGA_CMB_submit(cmb, cmd_update(cmb, 0, 0, 1, 1)*4, &st, SVGA_CB_SYNC, 0);
+
+	cb_recover_buf = recover_buf;
+
+	if(st.sStatus != SVGA_PROC_COMPLETED || hda_perf->cb_restarts != restarts + 1 || !cb_context0 || !cb_context1)
+	{
+		printf("%-24s FAIL (status %u, %u restarts)\n", "CB context restart",
+			st.sStatus, hda_perf->cb_restarts - restarts);
+		return FALSE;
+	}
+
+	printf("%-24s OK\n", "CB context restart");
+	return TRUE;
+}
+
+/* driver 2D traffic (SVGA_CB_2D) goes to second context */
+static int test_cb_ctx1(uint32 *cmb)
+{
+	host_hold = TRUE;
+
+	SVGA_CMB_submit(cmb, cmd_update(cmb, 0, 0, 1, 1)*4, NULL, SVGA_CB_2D, 0);
+
+	if(cb_queue_info[1].items != 1 || sim->cb_queued[SVGA_CB_CONTEXT_1] != 1)
+	{
+		host_hold = FALSE;
+		printf("%-24s FAIL (%u CBs queued)\n", "CB context 1", cb_queue_info[1].items);
+		return FALSE;
+	}
+
+	host_hold = FALSE;
+	SVGA_Flush_CB();
+
+	if(cb_header(cmb)->status != SVGA_CB_STATUS_COMPLETED || cb_queue_info[1].items != 0)
+	{
+		printf("%-24s FAIL (status %u)\n", "CB context 1", cb_header(cmb)->status);
+		return FALSE;
+	}
+
+	printf("%-24s OK\n", "CB context 1");
+	return TRUE;
+}
+
+/* GMR from scattered pages, same descriptor format as vxd_svga_mem.c */
+static int test_gmr(uint32 *cmb)
+{
+	uint32 pages = (SCREEN_W*SCREEN_H*4) / SVGASIM_PAGE;
+	uint8 **page_ptr = malloc(pages * sizeof(uint8*));
+	uint8 *ref = malloc(SCREEN_W*SCREEN_H*4);
+	SVGAGuestMemDescriptor *desc;
+	uint32 desc_pa, i, d = 0, n = 0;
+
+	desc = svgasim_phys_alloc(sim, SVGASIM_PAGE * 4, &desc_pa);
+
+	for(i = 0; i < pages; i++)
+	{
+		uint32 pa;
+		page_ptr[i] = svgasim_phys_alloc(sim, SVGASIM_PAGE, &pa);
+		if((i % 3) == 0)
+		{
+			svgasim_phys_alloc(sim, SVGASIM_PAGE, NULL); /* hole */
+		}
+
+		if(d > 0 && desc[d-1].ppn + desc[d-1].numPages == pa/SVGASIM_PAGE)
+		{
+			desc[d-1].numPages++;
+		}
+		else
+		{
+			desc[d].ppn = pa/SVGASIM_PAGE;
+			desc[d].numPages = 1;
+			d++;
+		}
+
+		fill_pattern(page_ptr[i], SVGASIM_PAGE, 3 + i);
+		memcpy(ref + i*SVGASIM_PAGE, page_ptr[i], SVGASIM_PAGE);
+	}
+	desc[d].ppn = 0;
+	desc[d].numPages = 0;
+
+	reg_write(SVGA_REG_GMR_ID, 1);
+	reg_write(SVGA_REG_GMR_DESCRIPTOR, desc_pa/SVGASIM_PAGE);
+
+	n += cmd_gmrfb(cmb + n, 1, 0, SCREEN_W*4);
+	n += cmd_blit(cmb + n, 0, 0, SCREEN_W, SCREEN_H);
+	SVGA_CMB_submit(cmb, n*4, NULL, SVGA_CB_SYNC, 0);
+
+	i = check_screen(ref, SCREEN_W*4, "GMR descriptors");
+
+	free(page_ptr);
+	free(ref);
+
+	return i;
+}
+
+/* MOB with PTDEPTH_1 page table, like vxd_svga_mem.c */
+static int test_mob(uint32 *cmb)
+{
+	uint32 size = 64*SVGASIM_PAGE;
+	uint32 pt_pa, i, n = 0;
+	uint32 *pt = svgasim_phys_alloc(sim, SVGASIM_PAGE, &pt_pa);
+	uint8 *ref = malloc(size);
+	uint8 *back = malloc(size);
+	SVGA3dCmdDefineGBMob *mob;
+	SVGA_CMB_status_t st;
+
+	for(i = 0; i < size/SVGASIM_PAGE; i++)
+	{
+		uint32 pa;
+		uint8 *p = svgasim_phys_alloc(sim, SVGASIM_PAGE, &pa);
+		svgasim_phys_alloc(sim, SVGASIM_PAGE, NULL); /* hole */
+		pt[i] = pa / SVGASIM_PAGE;
+		fill_pattern(p, SVGASIM_PAGE, 100 + i);
+		memcpy(ref + i*SVGASIM_PAGE, p, SVGASIM_PAGE);
+	}
+
+	cmb[n++] = SVGA_3D_CMD_DEFINE_GB_MOB;
+	cmb[n++] = sizeof(SVGA3dCmdDefineGBMob);
+	mob = (SVGA3dCmdDefineGBMob*)(cmb + n);
+	mob->mobid = 7;
+	mob->ptDepth = SVGA3D_MOBFMT_PTDEPTH_1;
+	mob->base = pt_pa / SVGASIM_PAGE;
+	mob->sizeInBytes = size;
+	n += sizeof(SVGA3dCmdDefineGBMob)/4;
+
+	SVGA_CMB_submit(cmb, n*4, &st, SVGA_CB_SYNC, 0);
+	if(st.sStatus != SVGA_PROC_COMPLETED ||
+		!svgasim_mob_copy(sim, 7, 0, back, size, FALSE) || memcmp(ref, back, size) != 0)
+	{
+		printf("%-24s FAIL\n", "MOB page table");
+		i = FALSE;
+	}
+	else
+	{
+		printf("%-24s OK\n", "MOB page table");
+		i = TRUE;
+	}
+
+	free(ref);
+	free(back);
+
+	return i;
+}
+
+/*
+ * Benchmark: small present blits (64x64) submitted one by one
+ */
+static double now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void bench_run(uint32 *cmb, DWORD flags, const char *name)
+{
+	svgasim_stat_t st = sim->stat;
+	double t = now_ms();
+	uint32 i;
+
+	for(i = 0; i < BENCH_ITERS; i++)
+	{
+		uint32 n = cmd_gmrfb(cmb, SVGA_GMR_FRAMEBUFFER, 0, SCREEN_W*4);
+		n += cmd_blit(cmb + n, (i*64) % (SCREEN_W-64), (i*16) % (SCREEN_H-64), 64, 64);
+		SVGA_CMB_submit(cmb, n*4, NULL, flags, 0);
+	}
+	t = now_ms() - t;
+	printf("%s %8.2f ms, %6.2f port I/O per blit\n", name, t,
+		(double)((sim->stat.port_in + sim->stat.port_out) - (st.port_in + st.port_out)) / BENCH_ITERS);
+}
+
+static void bench(uint32 *cmb)
+{
+	bench_run(cmb, SVGA_CB_SYNC | SVGA_CB_FORCE_FIFO, "FIFO sync blits:");
+	bench_run(cmb, SVGA_CB_SYNC,                      "CB sync blits:  ");
+}
+
+int main()
+{
+	uint32 *cmb, *cmbs[8];
+	uint32 i;
+	int rc = EXIT_SUCCESS;
+
+	sim = svgasim_create(16*1024*1024, 256*1024, 128*1024*1024);
+	svgasim_vmm_dev = sim;
+
+	if(!drv_init())
+	{
+		printf("device init failed\n");
+		return EXIT_FAILURE;
+	}
+
+	cmb = SVGA_CMB_alloc();
+	for(i = 0; i < 8; i++)
+	{
+		cmbs[i] = SVGA_CMB_alloc_size(256);
+	}
+
+	if(!test_fifo_update(cmb)) rc = EXIT_FAILURE;
+
+	if(!test_cb_start())
+	{
+		return EXIT_FAILURE;
+	}
+
+	if(!test_cb_blit(cmb)) rc = EXIT_FAILURE;
+	if(!test_cb_recover(cmb, cmbs, 8)) rc = EXIT_FAILURE;
+	if(!test_cb_recover_sync(cmb)) rc = EXIT_FAILURE;
+	if(!test_cb_restart(cmb)) rc = EXIT_FAILURE;
+	if(!test_cb_ctx1(cmb)) rc = EXIT_FAILURE;
+	if(!test_gmr(cmb)) rc = EXIT_FAILURE;
+	if(!test_mob(cmb)) rc = EXIT_FAILURE;
+
+	bench(cmb);
+
+	SVGA_CB_stop();
+
+	svgasim_destroy(sim);
+
+	return rc;
+}
@@ -0,0 +1,122 @@
+/*
+ * Event trace control (vmwsmini.vxd)
+ *
+ * usage:
+ *   svgatrace start          - clear ring and start trace
+ *   svgatrace stop           - stop trace
+ *   svgatrace dump file.trc  - save snapshot of ring (trace keeps running)
+ *
+ * Trace must be enabled by TraceSize (kB) in HKLM\Software\VMWSVGA.
+ * Snapshot can be converted to Chrome trace JSON by svgatrace2json.
+ */
+#include <Windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SVGA
+#include "../../3d_accel.h"
+
+#define DRIVER "vmwsmini.vxd"
+
+#define SNAPSHOT_MAX (16*1024*1024)
+
+static BOOL trace_cmd(HANDLE vxd, DWORD enable)
+{
+	DWORD in[2] = {SVGA_CMD_TRACE, enable};
+	DWORD out = 0;
+
+	DeviceIoControl(vxd, OP_SVGA_VXDCMD,
+		&in[0], sizeof(in),
+		&out, sizeof(out),
+		NULL, NULL);
+
+	return out != 0;
+}
+
+static int trace_dump(HANDLE vxd, const char *filename)
+{
+	SVGA_trace_snapshot_t *snap;
+	DWORD written = 0;
+	FILE *fw;
+
+	snap = malloc(SNAPSHOT_MAX);
+	if(snap == NULL)
+	{
+		printf("out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	DeviceIoControl(vxd, OP_SVGA_TRACE_SNAPSHOT,
+		NULL, 0,
+		snap, SNAPSHOT_MAX,
+		&written, NULL);
+
+	if(written < sizeof(SVGA_trace_snapshot_t) || snap->magic != SVGA_TRACE_MAGIC)
+	{
+		printf("snapshot failed\n");
+		free(snap);
+		return EXIT_FAILURE;
+	}
+
+	fw = fopen(filename, "wb");
+	if(fw == NULL)
+	{
+		printf("cannot open %s\n", filename);
+		free(snap);
+		return EXIT_FAILURE;
+	}
+
+	fwrite(snap, written, 1, fw);
+	fclose(fw);
+
+	printf("%lu events saved, %lu lost\n", snap->count, snap->lost);
+	free(snap);
+
+	return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv)
+{
+	int rc = EXIT_SUCCESS;
+	HANDLE vxd;
+
+	if(argc < 2)
+	{
+		printf("usage: %s start|stop|dump <file>\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	vxd = CreateFileA("\\\\.\\" DRIVER, 0, 0, 0, CREATE_NEW, FILE_FLAG_DELETE_ON_CLOSE, 0);
+	if(vxd == INVALID_HANDLE_VALUE)
+	{
+		printf("cannot load VXD driver\n");
+		return EXIT_FAILURE;
+	}
+
+	if(strcmp(argv[1], "start") == 0)
+	{
+		if(!trace_cmd(vxd, 1))
+		{
+			printf("trace is not enabled (TraceSize)\n");
+			rc = EXIT_FAILURE;
+		}
+	}
+	else if(strcmp(argv[1], "stop") == 0)
+	{
+		trace_cmd(vxd, 0);
+	}
+	else if(strcmp(argv[1], "dump") == 0 && argc >= 3)
+	{
+		rc = trace_dump(vxd, argv[2]);
+	}
+	else
+	{
+		printf("Unknown command: %s\n", argv[1]);
+		rc = EXIT_FAILURE;
+	}
+
+	CloseHandle(vxd);
+
+	return rc;
+}
@@ -0,0 +1,180 @@
+/*
+ * Convert event trace snapshot (svgatrace dump) to Chrome trace JSON
+ * (chrome://tracing or ui.perfetto.dev)
+ *
+ * usage:
+ *   svgatrace2json [-mhz N] file.trc > file.json
+ *
+ * TSC frequency is computed from system time in snapshot, -mhz overrides
+ * it (short traces have only ms resolution of system time).
+ *
+ * gcc -O2 -o svgatrace2json svgatrace2json.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+typedef unsigned char  BYTE;
+typedef unsigned short WORD;
+typedef unsigned int   DWORD;
+typedef int            BOOL;
+typedef void           VOID;
+
+#define SVGA
+#include "../../3d_accel.h"
+
+/* thread lanes */
+#define TID_SUBMIT 1
+#define TID_ACCESS 2
+#define TID_REGION 3
+#define TID_MODE   4
+#define TID_CB     5
+
+typedef struct _ev_desc_t
+{
+	DWORD id;
+	const char *name;
+	char phase;
+	int tid;
+	const char *args[3];
+} ev_desc_t;
+
+static const ev_desc_t ev_desc[] = {
+	{SVGA_TRACE_SUBMIT_BEGIN,        "submit",        'B', TID_SUBMIT, {"size", "flags", "dx"}},
+	{SVGA_TRACE_SUBMIT_END,          "submit",        'E', TID_SUBMIT, {"fence", NULL, NULL}},
+	{SVGA_TRACE_FENCE_BEGIN,         "fence wait",    'B', TID_SUBMIT, {"fence", NULL, NULL}},
+	{SVGA_TRACE_FENCE_END,           "fence wait",    'E', TID_SUBMIT, {NULL, NULL, NULL}},
+	{SVGA_TRACE_CB_RETIRE,           "CB retire",     'i', TID_CB,     {"ctx", "status", "id"}},
+	{SVGA_TRACE_REGION_CREATE_BEGIN, "region create", 'B', TID_REGION, {"id", "size", NULL}},
+	{SVGA_TRACE_REGION_CREATE_END,   "region create", 'E', TID_REGION, {"id", "success", NULL}},
+	{SVGA_TRACE_REGION_FREE_BEGIN,   "region free",   'B', TID_REGION, {"id", "size", NULL}},
+	{SVGA_TRACE_REGION_FREE_END,     "region free",   'E', TID_REGION, {NULL, NULL, NULL}},
+	{SVGA_TRACE_ACCESS_BEGIN,        "access",        'B', TID_ACCESS, {"flags", NULL, NULL}},
+	{SVGA_TRACE_ACCESS_END,          "access",        'E', TID_ACCESS, {"flags", NULL, NULL}},
+	{SVGA_TRACE_MODESET_BEGIN,       "mode set",      'B', TID_MODE,   {"width", "height", "bpp"}},
+	{SVGA_TRACE_MODESET_END,         "mode set",      'E', TID_MODE,   {NULL, NULL, NULL}},
+};
+
+static const char *lane_names[] = {NULL, "submit/fence", "FB access", "regions", "mode set", "CB"};
+
+static uint64_t tsc(DWORD lo, DWORD hi)
+{
+	return ((uint64_t)hi << 32) | lo;
+}
+
+static const ev_desc_t *ev_find(DWORD id)
+{
+	size_t i;
+	for(i = 0; i < sizeof(ev_desc)/sizeof(ev_desc[0]); i++)
+	{
+		if(ev_desc[i].id == id)
+			return &ev_desc[i];
+	}
+	return NULL;
+}
+
+int main(int argc, char **argv)
+{
+	SVGA_trace_snapshot_t snap;
+	SVGA_trace_ev_t ev;
+	const char *filename = NULL;
+	double cycles_per_us = 0;
+	uint64_t base;
+	FILE *fr;
+	DWORD i;
+	int first = 1;
+
+	for(i = 1; i < (DWORD)argc; i++)
+	{
+		if(strcmp(argv[i], "-mhz") == 0 && i + 1 < (DWORD)argc)
+			cycles_per_us = atof(argv[++i]);
+		else
+			filename = argv[i];
+	}
+
+	if(filename == NULL)
+	{
+		fprintf(stderr, "usage: %s [-mhz N] file.trc\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fr = fopen(filename, "rb");
+	if(fr == NULL)
+	{
+		fprintf(stderr, "cannot open %s\n", filename);
+		return EXIT_FAILURE;
+	}
+
+	if(fread(&snap, sizeof(snap), 1, fr) != 1 ||
+		snap.magic != SVGA_TRACE_MAGIC || snap.version != SVGA_TRACE_VERSION)
+	{
+		fprintf(stderr, "%s: not trace snapshot\n", filename);
+		fclose(fr);
+		return EXIT_FAILURE;
+	}
+
+	if(cycles_per_us <= 0)
+	{
+		DWORD ms = snap.time1 - snap.time0;
+		if(ms == 0)
+		{
+			fprintf(stderr, "cannot compute TSC frequency, use -mhz\n");
+			fclose(fr);
+			return EXIT_FAILURE;
+		}
+		cycles_per_us = (double)(tsc(snap.tsc1_lo, snap.tsc1_hi) - tsc(snap.tsc0_lo, snap.tsc0_hi)) / (ms * 1000.0);
+	}
+
+	fprintf(stderr, "%u events, %u lost, TSC %.1f MHz\n", snap.count, snap.lost, cycles_per_us);
+
+	base = tsc(snap.tsc0_lo, snap.tsc0_hi);
+
+	printf("{\"traceEvents\":[\n");
+	for(i = 1; i < sizeof(lane_names)/sizeof(lane_names[0]); i++)
+	{
+		printf("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+			first ? "" : ",\n", i, lane_names[i]);
+		first = 0;
+	}
+
+	for(i = 0; i < snap.count; i++)
+	{
+		const ev_desc_t *d;
+		int a;
+
+		if(fread(&ev, sizeof(ev), 1, fr) != 1)
+		{
+			fprintf(stderr, "truncated file\n");
+			break;
+		}
+
+		d = ev_find(ev.id);
+		if(d == NULL)
+		{
+			continue;
+		}
+
+		printf(",\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":1,\"tid\":%d,\"ts\":%.3f",
+			d->name, d->phase, d->tid, (double)(tsc(ev.tsc_lo, ev.tsc_hi) - base) / cycles_per_us);
+		if(d->phase == 'i')
+		{
+			printf(",\"s\":\"t\"");
+		}
+		if(d->args[0])
+		{
+			printf(",\"args\":{");
+			for(a = 0; a < 3 && d->args[a]; a++)
+			{
+				printf("%s\"%s\":%u", a ? "," : "", d->args[a], ev.arg[a]);
+			}
+			printf("}");
+		}
+		printf("}");
+	}
+	printf("\n]}\n");
+
+	fclose(fr);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,239 @@
+/*
+ * Host benchmark of VRAM fill/copy variants (memset_vram in vxd_lib.c,
+ * copy variants are for comparison only, VXD has no bulk VRAM copy)
+ *
+ * Compares plain DWORD loop (original CRT memset/memcpy), rep stosd/movsd
+ * with alignment prologue and SSE2 non-temporal stores at several buffer
+ * sizes and verifies, that all variants produce same result.
+ *
+ * gcc -O2 -msse2 -o vrambench vrambench.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <emmintrin.h>
+
+typedef unsigned char  BYTE;
+typedef unsigned int   DWORD;
+
+#define TOTAL_BYTES (1024UL*1024UL*1024UL)
+
+/* same as memset/memcpy in vxd_lib.c (volatile, so gcc won't replace it by libc call) */
+static void loop_set(void *dst, int c, DWORD size)
+{
+	DWORD par, i;
+	DWORD dw_count = size >> 2;
+	DWORD dw_size = size & 0xFFFFFFFCUL;
+
+	c &= 0xFF;
+	par = (c << 24) | (c << 16) | (c << 8) | c;
+
+	for(i = 0; i < dw_count; i++)
+		((volatile DWORD*)dst)[i] = par;
+
+	for(i = dw_size; i < size; i++)
+		((BYTE*)dst)[i] = c;
+}
+
+static void loop_copy(void *dst, const void *src, DWORD size)
+{
+	DWORD i;
+	DWORD dw_count = size >> 2;
+	DWORD dw_size = size & 0xFFFFFFFCUL;
+
+	for(i = 0; i < dw_count; i++)
+		((volatile DWORD*)dst)[i] = ((const DWORD*)src)[i];
+
+	for(i = dw_size; i < size; i++)
+		((BYTE*)dst)[i] = ((const BYTE*)src)[i];
+}
+
+static void rep_set(void *dst, int c, DWORD size)
+{
+	BYTE *ptr = dst;
+	unsigned long par, cnt;
+
+	c &= 0xFF;
+	par = c * 0x01010101UL;
+
+	while(((unsigned long)ptr & 3) && size)
+	{
+		*(ptr++) = c;
+		size--;
+	}
+
+	cnt = size >> 2;
+	__asm__ volatile("cld; rep stosl" : "+D"(ptr), "+c"(cnt) : "a"(par) : "memory");
+	size &= 3;
+
+	while(size--)
+		*(ptr++) = c;
+}
+
+static void rep_copy(void *dst, const void *src, DWORD size)
+{
+	BYTE *d = dst;
+	const BYTE *s = src;
+	unsigned long cnt;
+
+	while(((unsigned long)d & 3) && size)
+	{
+		*(d++) = *(s++);
+		size--;
+	}
+
+	cnt = size >> 2;
+	__asm__ volatile("cld; rep movsl" : "+D"(d), "+S"(s), "+c"(cnt) : : "memory");
+	size &= 3;
+
+	while(size--)
+		*(d++) = *(s++);
+}
+
+static void nt_set(void *dst, int c, DWORD size)
+{
+	BYTE *ptr = dst;
+	__m128i v;
+
+	c &= 0xFF;
+	v = _mm_set1_epi8((char)c);
+
+	while(((unsigned long)ptr & 15) && size)
+	{
+		*(ptr++) = c;
+		size--;
+	}
+
+	while(size >= 64)
+	{
+		_mm_stream_si128((__m128i*)ptr, v);
+		_mm_stream_si128((__m128i*)(ptr+16), v);
+		_mm_stream_si128((__m128i*)(ptr+32), v);
+		_mm_stream_si128((__m128i*)(ptr+48), v);
+		ptr += 64;
+		size -= 64;
+	}
+	_mm_sfence();
+
+	rep_set(ptr, c, size);
+}
+
+static void nt_copy(void *dst, const void *src, DWORD size)
+{
+	BYTE *d = dst;
+	const BYTE *s = src;
+
+	while(((unsigned long)d & 15) && size)
+	{
+		*(d++) = *(s++);
+		size--;
+	}
+
+	while(size >= 64)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)s);
+		__m128i b = _mm_loadu_si128((const __m128i*)(s+16));
+		__m128i e = _mm_loadu_si128((const __m128i*)(s+32));
+		__m128i f = _mm_loadu_si128((const __m128i*)(s+48));
+		_mm_stream_si128((__m128i*)d, a);
+		_mm_stream_si128((__m128i*)(d+16), b);
+		_mm_stream_si128((__m128i*)(d+32), e);
+		_mm_stream_si128((__m128i*)(d+48), f);
+		d += 64;
+		s += 64;
+		size -= 64;
+	}
+	_mm_sfence();
+
+	rep_copy(d, s, size);
+}
+
+typedef struct _variant_t
+{
+	const char *name;
+	void (*set)(void *dst, int c, DWORD size);
+	void (*copy)(void *dst, const void *src, DWORD size);
+} variant_t;
+
+static const variant_t variants[] = {
+	{"dword loop",    loop_set, loop_copy},
+	{"rep stos/movs", rep_set,  rep_copy},
+	{"sse2 movntdq",  nt_set,   nt_copy},
+};
+
+#define VARIANTS (sizeof(variants)/sizeof(variants[0]))
+
+static double now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+int main()
+{
+	/* 4k = one scanline, 64k, 3M = 1024x768x32, 8M = 1920x1080x32, 32M */
+	static const DWORD sizes[] = {4096, 65536, 1024*768*4, 1920*1080*4, 32*1024*1024};
+	DWORD max = sizes[sizeof(sizes)/sizeof(sizes[0]) - 1];
+	BYTE *dst = malloc(max + 64);
+	BYTE *src = malloc(max + 64);
+	BYTE *ref = malloc(max + 64);
+	int s, v;
+	DWORD i, iters, off;
+
+	for(i = 0; i < max + 64; i++)
+		src[i] = rand() & 0xFF;
+
+	printf("%-14s %10s %12s %12s\n", "variant", "size", "set MB/s", "copy MB/s");
+
+	for(s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++)
+	{
+		iters = TOTAL_BYTES / sizes[s];
+		/* odd offset to exercise prologue/epilogue */
+		off = 3;
+
+		for(v = 0; v < VARIANTS; v++)
+		{
+			double t0, t_set, t_copy;
+
+			/* verify */
+			memset(dst, 0xEE, max + 64);
+			memset(ref, 0xEE, max + 64);
+			variants[v].set(dst + off, 0x5A, sizes[s] - 1);
+			memset(ref + off, 0x5A, sizes[s] - 1);
+			if(memcmp(dst, ref, max + 64) != 0)
+			{
+				printf("%s: fill mismatch at size %u\n", variants[v].name, sizes[s]);
+				return EXIT_FAILURE;
+			}
+			variants[v].copy(dst + off, src + 1, sizes[s] - 1);
+			memcpy(ref + off, src + 1, sizes[s] - 1);
+			if(memcmp(dst, ref, max + 64) != 0)
+			{
+				printf("%s: copy mismatch at size %u\n", variants[v].name, sizes[s]);
+				return EXIT_FAILURE;
+			}
+
+			t0 = now_ms();
+			for(i = 0; i < iters; i++)
+				variants[v].set(dst, i, sizes[s]);
+			t_set = now_ms() - t0;
+
+			t0 = now_ms();
+			for(i = 0; i < iters; i++)
+				variants[v].copy(dst, src, sizes[s]);
+			t_copy = now_ms() - t0;
+
+			printf("%-14s %10u %12.0f %12.0f\n", variants[v].name, sizes[s],
+				(TOTAL_BYTES / 1048576.0) / (t_set / 1000.0),
+				(TOTAL_BYTES / 1048576.0) / (t_copy / 1000.0));
+		}
+	}
+
+	free(dst);
+	free(src);
+	free(ref);
+
+	return EXIT_SUCCESS;
+}
@@ -112,6 +112,7 @@ typedef struct tagVxD_Desc_Block
 #define SCSIFD_DEVICE_ID       0x00024   // SCSI FASTDISK DEVICE
 #define VPEND_DEVICE_ID        0x00025   // PEN DEVICE
 #define APM_DEVICE_ID          0x00026   // POWER MANAGEMENT DEVICE
+#define VWIN32_DEVICE_ID       0x0002A   // WIN32 SERVICES
 
 #define VMM_Init_Order         0x000000000
 #define APM_Init_Order         0x001000000
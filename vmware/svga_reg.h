@@ -415,7 +415,8 @@ struct SVGAGuestPtr {
 typedef enum {
    SVGA_CB_CONTEXT_DEVICE = 0x3f,
    SVGA_CB_CONTEXT_0      = 0x0,
-   SVGA_CB_CONTEXT_MAX    = 0x1,
+   SVGA_CB_CONTEXT_1      = 0x1, /* Supported with SVGA_CAP_CMD_BUFFERS_2 */
+   SVGA_CB_CONTEXT_MAX    = 0x2,
    SVGA_CB_CONTEXT_FORCE_UINT = MAX_UINT32,
 } SVGACBContext;
 
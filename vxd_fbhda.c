@@ -38,14 +38,23 @@ ULONG hda_sem = 0;
 LONG fb_lock_cnt = 0;
 DWORD gamma_quirk = 0;
 
+static FBHDA_batch_t *batch = NULL;
+static ULONG batch_sem = 0;
+
+static FBHDA_modes_t *modes = NULL;
+
+/* counters go here until shared memory is allocated */
+static FBHDA_perf_t hda_perf_early;
+FBHDA_perf_t *hda_perf = &hda_perf_early;
+
 #include "vxd_strings.h"
 
 BOOL FBHDA_init_hw()
 {
-	hda = (FBHDA_t *)_PageAllocate(RoundToPages(sizeof(FBHDA_t)), PG_SYS, 0, 0, 0x0, 0x100000, NULL, PAGEFIXED);
+	hda = (FBHDA_t *)_PageAllocate(RoundToPages(FBHDA_SHARED_SIZE), PG_SYS, 0, 0, 0x0, 0x100000, NULL, PAGEFIXED);
 	if(hda)
 	{
-		memset(hda, 0, sizeof(FBHDA_t));
+		memset(hda, 0, FBHDA_SHARED_SIZE);
 	
 		hda->cb = sizeof(FBHDA_t);
 		hda->version = API_3DACCEL_VER;
@@ -60,6 +69,19 @@ BOOL FBHDA_init_hw()
 			return FALSE;
 		}
 		
+		batch_sem = Create_Semaphore(1);
+		if(batch_sem != 0)
+		{
+			batch = (FBHDA_batch_t *)(((BYTE*)hda) + FBHDA_BATCH_OFFSET);
+		}
+		
+		modes = (FBHDA_modes_t *)(((BYTE*)hda) + FBHDA_MODES_OFFSET);
+		
+		hda_perf = (FBHDA_perf_t *)(((BYTE*)hda) + FBHDA_PERF_OFFSET);
+		hda_perf->cb = sizeof(FBHDA_perf_t);
+		hda_perf->version = FBHDA_PERF_VERSION;
+		hda->perf_offset = FBHDA_PERF_OFFSET;
+		
 		return TRUE;
 	}
 	return FALSE;	
@@ -67,6 +89,8 @@ BOOL FBHDA_init_hw()
 
 void FBHDA_release_hw()
 {
+	hda_perf = &hda_perf_early;
+	
 	if(hda)
 	{
 		_PageFree(hda, 0);
@@ -76,6 +100,169 @@ void FBHDA_release_hw()
 	{
 		Destroy_Semaphore(hda_sem);
 	}
+	
+	if(batch_sem)
+	{
+		Destroy_Semaphore(batch_sem);
+	}
+}
+
+/**
+ * Process records from 16-bit driver (ACCESS_END and palette changes),
+ * called before every direct call, so ACCESS_BEGIN/RECT never overtake
+ * pending ends.
+ **/
+void FBHDA_batch_flush()
+{
+	DWORD head, tail, i;
+	FBHDA_batch_rec_t *rec;
+	
+	if(batch == NULL)
+	{
+		return;
+	}
+	
+	if(batch->head == batch->tail)
+	{
+		return;
+	}
+	
+	/*
+	 * Driver was interrupted when writing record (we're called from
+	 * mouse interrupt or by other process), ring will be processed
+	 * by next call or by timer.
+	 */
+	if(batch->busy)
+	{
+		return;
+	}
+	
+	Wait_Semaphore(batch_sem, 0);
+	
+	head = batch->head;
+	tail = batch->tail;
+	
+	for(i = tail; i != head; i++)
+	{
+		rec = &batch->rec[i & (FBHDA_BATCH_RECS-1)];
+		switch(rec->op)
+		{
+			case FBHDA_BATCH_ACCESS_END:
+				FBHDA_access_end(rec->arg[0]);
+				break;
+			case FBHDA_BATCH_PALETTE_SET:
+				FBHDA_palette_set((unsigned char)rec->arg[0], rec->arg[1]);
+				break;
+		}
+	}
+	
+	batch->records += head - tail;
+	batch->flushes++;
+	batch->tail = head;
+	
+	Signal_Semaphore(batch_sem);
+}
+
+static void FBHDA_batch_timeout_entry();
+
+static void FBHDA_batch_event()
+{
+	if(batch->busy || batch->head != batch->tail)
+	{
+		/* driver is active, process and check again later */
+		FBHDA_batch_flush();
+		Set_Global_Time_Out(FBHDA_BATCH_TIMEOUT, 0, (DWORD)FBHDA_batch_timeout_entry);
+	}
+	else
+	{
+		/* driver is idle, next records will go by direct calls */
+		batch->armed = 0;
+	}
+}
+
+static void __declspec(naked) FBHDA_batch_event_entry()
+{
+	_asm
+	{
+		pushad
+		call FBHDA_batch_event
+		popad
+		ret
+	}
+}
+
+/* time-out is called in async context, so only schedule event */
+static void FBHDA_batch_timeout()
+{
+	Schedule_Global_Event((DWORD)FBHDA_batch_event_entry, 0);
+}
+
+static void __declspec(naked) FBHDA_batch_timeout_entry()
+{
+	_asm
+	{
+		pushad
+		call FBHDA_batch_timeout
+		popad
+		ret
+	}
+}
+
+/**
+ * Called on direct access call from driver: start timer which process
+ * records, when the driver stops calling.
+ **/
+void FBHDA_batch_arm()
+{
+	if(batch == NULL)
+	{
+		return;
+	}
+	
+	if(!batch->armed)
+	{
+		batch->armed = 1;
+		Set_Global_Time_Out(FBHDA_BATCH_TIMEOUT, 0, (DWORD)FBHDA_batch_timeout_entry);
+	}
+}
+
+BOOL FBHDA_mode_valid(DWORD w, DWORD h, DWORD bpp)
+{
+	if(modes == NULL || modes->serial == 0)
+	{
+		return FALSE;
+	}
+	
+	return FBHDA_mode_limits(modes, w, h, bpp);
+}
+
+/**
+ * Set mode limits (max_size is hda->vram_size). Called by HW driver
+ * after device reset.
+ **/
+void FBHDA_modes_update(DWORD bpp_mask, DWORD max_width, DWORD max_height, DWORD max_size_low)
+{
+	DWORD serial;
+	
+	if(modes == NULL)
+	{
+		return;
+	}
+	
+	serial = modes->serial + 1;
+	if(serial == 0)
+	{
+		serial = 1;
+	}
+	
+	modes->bpp_mask     = bpp_mask;
+	modes->max_width    = max_width;
+	modes->max_height   = max_height;
+	modes->max_size     = hda->vram_size;
+	modes->max_size_low = max_size_low;
+	modes->serial       = serial;
+	
+	dbg_printf("FBHDA_modes_update: %ld x %ld\n", max_width, max_height);
 }
 
 FBHDA_t *FBHDA_setup()
@@ -89,7 +276,7 @@ FBHDA_t *FBHDA_setup()
 void FBHDA_clean()
 {
 	FBHDA_access_begin(0);
-	memset(hda->vram_pm32, 0, hda->stride);
+	memset_vram(hda->vram_pm32, 0, hda->stride);
 	FBHDA_access_end(0);
 }
 
@@ -136,42 +323,22 @@ BOOL FBHDA_gamma_set(VOID FBPTR ramp, DWORD buffer_size)
 		DWORD used_quirk = gamma_quirk;
 		if(used_quirk == 0)
 		{
-			if(new_ramp[0*256 + 128] == 0xFFFF)
-			{
-				used_quirk = 1;
-			}
-			else
-			{
-				used_quirk = 2;
-			}
+			used_quirk = gamma_ramp_quirk(new_ramp);
 		}
 		
 		dbg_printf("Gamma quirk: %ld\n", used_quirk);
 
 		if(used_quirk == 1) /* gamma quirk for ID Software games */
 		{
-			gamma = (
-				gamma_table[(new_ramp[0*256 + 64] >> 8)] +
-				gamma_table[(new_ramp[1*256 + 64] >> 8)] +
-				gamma_table[(new_ramp[2*256 + 64] >> 8)]
-			) / 3;
+			gamma = gamma_from_ramp(new_ramp, 64);
 			
-			if(gamma >= 0x3000 && gamma < 0x1000000) /* from ~0.2000 to 256.0000 */
+			if(gamma >= GAMMA_MIN && gamma < GAMMA_MAX)
 			{
-				int i = 0;
 				hda->gamma = gamma;
 				hda->gamma_update++;
 				
 				/* copy new ramp and duplicate odd values */
-				for(i = 0; i < 128; i ++)
-				{
-					gamma_ramp[0][(i*2) + 0] = new_ramp[0*256 + i];
-					gamma_ramp[0][(i*2) + 1] = new_ramp[0*256 + i];
-					gamma_ramp[1][(i*2) + 0] = new_ramp[1*256 + i];
-					gamma_ramp[1][(i*2) + 1] = new_ramp[1*256 + i];
-					gamma_ramp[2][(i*2) + 0] = new_ramp[2*256 + i];
-					gamma_ramp[2][(i*2) + 1] = new_ramp[2*256 + i];
-				}
+				gamma_ramp_expand(&gamma_ramp[0][0], new_ramp);
 				
 				gamma_ramp_init = TRUE;
 				
@@ -182,13 +349,9 @@ BOOL FBHDA_gamma_set(VOID FBPTR ramp, DWORD buffer_size)
 		}
 		else /* normal way by MS specification */
 		{
-			gamma = (
-				gamma_table[(new_ramp[0*256 + 128] >> 8)] +
-				gamma_table[(new_ramp[1*256 + 128] >> 8)] +
-				gamma_table[(new_ramp[2*256 + 128] >> 8)]
-			) / 3;
+			gamma = gamma_from_ramp(new_ramp, 128);
 			
-			if(gamma >= 0x3000 && gamma < 0x1000000) /* from ~0.2000 to 256.0000 */
+			if(gamma >= GAMMA_MIN && gamma < GAMMA_MAX)
 			{
 				hda->gamma = gamma;
 				hda->gamma_update++;
@@ -224,3 +387,36 @@ BOOL FBHDA_gamma_set(VOID FBPTR ramp, DWORD buffer_size)
 	return FALSE;
 }
 
+/**
+ * Copy performance counters to buffer, optionally zero them after copy.
+ * Return number of bytes written.
+ **/
+DWORD FBHDA_perf_get(void *buf, DWORD size, BOOL reset)
+{
+	DWORD resets;
+	
+	if(size > sizeof(FBHDA_perf_t))
+	{
+		size = sizeof(FBHDA_perf_t);
+	}
+	
+	if(buf != NULL && size > 0)
+	{
+		memcpy(buf, hda_perf, size);
+	}
+	else
+	{
+		size = 0;
+	}
+	
+	if(reset)
+	{
+		resets = hda_perf->resets;
+		memset(hda_perf, 0, sizeof(FBHDA_perf_t));
+		hda_perf->cb = sizeof(FBHDA_perf_t);
+		hda_perf->version = FBHDA_PERF_VERSION;
+		hda_perf->resets = resets + 1;
+	}
+	
+	return size;
+}
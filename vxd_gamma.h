@@ -273,4 +273,49 @@ static const DWORD gamma_table[256] = {
 	0x00FFFFFF, // 255 = 255.000000 (INF)
 };
 
+#define GAMMA_MIN 0x3000    /* ~0.2000 */
+#define GAMMA_MAX 0x1000000 /* 256.0000 */
+
+/**
+ * Detect ramp layout, ID Software games are sending ramp with only first
+ * half filled (value at 128 is already saturated)
+ **/
+static DWORD gamma_ramp_quirk(const WORD *ramp)
+{
+	if(ramp[0*256 + 128] == 0xFFFF)
+	{
+		return 1;
+	}
+	
+	return 2;
+}
+
+/**
+ * Average gamma of all 3 channels measured at ramp[index]
+ **/
+static DWORD gamma_from_ramp(const WORD *ramp, DWORD index)
+{
+	return (
+		gamma_table[(ramp[0*256 + index] >> 8)] +
+		gamma_table[(ramp[1*256 + index] >> 8)] +
+		gamma_table[(ramp[2*256 + index] >> 8)]
+	) / 3;
+}
+
+/**
+ * Stretch half ramp (quirk 1) to full 256 entries by duplicating values
+ **/
+static void gamma_ramp_expand(WORD *dst, const WORD *src)
+{
+	int c, i;
+	for(c = 0; c < 3; c++)
+	{
+		for(i = 0; i < 128; i++)
+		{
+			dst[c*256 + (i*2) + 0] = src[c*256 + i];
+			dst[c*256 + (i*2) + 1] = src[c*256 + i];
+		}
+	}
+}
+
 #endif /* __VXD_GAMMA_H__INCLUDED__ */
@@ -85,6 +85,194 @@ void *memcpy(void *dst, const void *src, unsigned int size)
 	return dst;
 }
 
+/**
+ * VRAM fill
+ *
+ * Framebuffer is large and rarely read back, so use string instructions and
+ * (if CPU and OS support it) SSE2 non-temporal stores, which bypass cache.
+ * There is no bulk VRAM copy in VXD (readback and surface copies are done
+ * by host), so only fill is implemented.
+ *
+ * SSE in ring 0: VMM doesn't save FPU/SSE state for VXD code, the state
+ * in XMM registers belongs to some thread (or is not loaded yet, CR0.TS
+ * set). memset_vram_nt makes it safe by disabling interrupts (nobody can
+ * switch thread or touch FPU meanwhile), clearing TS (no #NM), saving
+ * whole state by fxsave to own area and restoring it and CR0 before
+ * interrupts are enabled again. Save/restore of 512 bytes state is paid
+ * on every chunk, so it's used only for fills >= VRAM_NT_MIN; short
+ * per-row code (cursor kernels, color conversion) stays on integer
+ * registers.
+ **/
+#define VRAM_NT_MIN   (256*1024)
+#define VRAM_NT_CHUNK (64*1024)
+
+static BOOL vram_sse2 = FALSE;
+static BYTE vram_fx_area[512+16];
+
+void vram_stosd(void *dst, unsigned long val, unsigned long cnt);
+#pragma aux vram_stosd = \
+	"cld"                \
+	"rep stosd"          \
+	parm [edi] [eax] [ecx] modify [edi ecx];
+
+void vram_ops_init(BOOL allow_sse2)
+{
+	DWORD id_bit = 0;
+	DWORD features = 0;
+	DWORD cr4 = 0;
+	
+	/* CPUID available? (EFLAGS.ID is writable) */
+	_asm {
+		push eax
+		push ecx
+		pushfd
+		pop eax
+		mov ecx, eax
+		xor eax, 200000h
+		push eax
+		popfd
+		pushfd
+		pop eax
+		push ecx
+		popfd
+		xor eax, ecx
+		mov [id_bit], eax
+		pop ecx
+		pop eax
+	}
+	
+	if(id_bit & 0x200000UL)
+	{
+		_asm {
+			push eax
+			push ebx
+			push ecx
+			push edx
+			mov eax, 1
+			cpuid
+			mov [features], edx
+			pop edx
+			pop ecx
+			pop ebx
+			pop eax
+		}
+	}
+	
+	/* EDX.FXSR (24), EDX.SSE2 (26), CR4.OSFXSR (9) */
+	if(allow_sse2 &&
+		(features & (1UL << 24)) && (features & (1UL << 26)))
+	{
+		/* early CPUs with CPUID (486) have no CR4, read it only now */
+		_asm {
+			push eax
+			mov eax, cr4
+			mov [cr4], eax
+			pop eax
+		}
+		
+		if(cr4 & (1UL << 9))
+		{
+			vram_sse2 = TRUE;
+		}
+	}
+	
+	dbg_printf(dbg_vram_ops, vram_sse2);
+}
+
+/*
+ * FPU state may belong to any thread (lazy switching, CR0.TS), so save it
+ * to own area with interrupts disabled and restore it before return.
+ * dst must be 16 byte aligned, size multiple of 64.
+ */
+static void memset_vram_nt(void *dst, DWORD par, DWORD size)
+{
+	BYTE *fx = (BYTE*)(((DWORD)vram_fx_area + 15) & 0xFFFFFFF0UL);
+	
+	_asm {
+		push eax
+		push ecx
+		push edx
+		push edi
+		pushfd
+		cli
+		mov edx, cr0
+		clts
+		mov eax, [fx]
+		fxsave [eax]
+		mov edi, [dst]
+		mov ecx, [size]
+		shr ecx, 6
+		movd xmm0, [par]
+		pshufd xmm0, xmm0, 0
+	nt_fill:
+		movntdq [edi], xmm0
+		movntdq [edi+16], xmm0
+		movntdq [edi+32], xmm0
+		movntdq [edi+48], xmm0
+		add edi, 64
+		dec ecx
+		jnz nt_fill
+		sfence
+		mov eax, [fx]
+		fxrstor [eax]
+		mov cr0, edx
+		popfd
+		pop edi
+		pop edx
+		pop ecx
+		pop eax
+	}
+}
+
+void memset_vram(void *dst, int c, unsigned int size)
+{
+	BYTE *ptr = dst;
+	DWORD par;
+	DWORD chunk;
+	
+	c &= 0xFF;
+	par = (c << 24) | (c << 16) | (c << 8) | c;
+	
+	if(vram_sse2 && size >= VRAM_NT_MIN)
+	{
+		while((DWORD)ptr & 15)
+		{
+			*(ptr++) = c;
+			size--;
+		}
+		
+		while(size >= 64)
+		{
+			chunk = size & 0xFFFFFFC0UL;
+			if(chunk > VRAM_NT_CHUNK) chunk = VRAM_NT_CHUNK;
+			
+			memset_vram_nt(ptr, par, chunk);
+			ptr  += chunk;
+			size -= chunk;
+		}
+	}
+	else
+	{
+		while(((DWORD)ptr & 3) && size)
+		{
+			*(ptr++) = c;
+			size--;
+		}
+	}
+	
+	if(size >= 4)
+	{
+		vram_stosd(ptr, par, size >> 2);
+		ptr += size & 0xFFFFFFFCUL;
+		size &= 3;
+	}
+	
+	while(size--)
+	{
+		*(ptr++) = c;
+	}
+}
+
 unsigned int strlen(const char *s)
 {
 	const char *ptr = s;
@@ -257,6 +445,66 @@ void Release_Time_Slice()
 	VMMCall(Release_Time_Slice);
 }
 
+/* callback is called in async context, with EDX = refdata */
+DWORD __cdecl Set_Global_Time_Out(DWORD ms, DWORD refdata, DWORD callback)
+{
+	DWORD handle = 0;
+	
+	_asm push eax
+	_asm push edx
+	_asm push esi
+	_asm mov eax, [ms]
+	_asm mov edx, [refdata]
+	_asm mov esi, [callback]
+	VMMCall(Set_Global_Time_Out);
+	_asm mov [handle], esi
+	_asm pop esi
+	_asm pop edx
+	_asm pop eax
+	
+	return handle;
+}
+
+void __cdecl Schedule_Global_Event(DWORD callback, DWORD refdata)
+{
+	_asm push edx
+	_asm push esi
+	_asm mov esi, [callback]
+	_asm mov edx, [refdata]
+	VMMCall(Schedule_Global_Event);
+	_asm pop esi
+	_asm pop edx
+}
+
+/* system time in ms */
+DWORD Get_System_Time()
+{
+	DWORD t = 0;
+	
+	_asm push eax
+	VMMCall(Get_System_Time);
+	_asm mov [t], eax
+	_asm pop eax
+	
+	return t;
+}
+
+void rdtsc_asm(DWORD *lo_hi);
+#pragma aux rdtsc_asm = \
+	".586"               \
+	"rdtsc"              \
+	"mov [ecx], eax"     \
+	"mov [ecx+4], edx"   \
+	parm [ecx] modify [eax edx];
+
+/**
+ * Read CPU time stamp counter, lo_hi[0] = low DWORD, lo_hi[1] = high DWORD
+ **/
+void Get_TSC(DWORD *lo_hi)
+{
+	rdtsc_asm(lo_hi);
+}
+
 void __cdecl *Map_Flat(BYTE SegOffset, BYTE OffOffset)
 {
 	void *result = NULL;
@@ -518,3 +766,18 @@ BOOL VPICD_Virtualize_IRQ(struct _VPICD_IRQ_Descriptor *vid)
 	
 	return r;
 }
+
+#define VWIN32__GetCurrentProcessHandle 13
+
+/* ring-0 handle of current Win32 process, 0 outside process context */
+DWORD VWIN32_GetCurrentProcessHandle()
+{
+	DWORD h = 0;
+	
+	_asm push eax
+	VxDCall(VWIN32, GetCurrentProcessHandle);
+	_asm mov [h], eax
+	_asm pop eax
+	
+	return h;
+}
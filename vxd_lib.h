@@ -30,6 +30,9 @@ unsigned int strlen(const char *s);
 char *strcpy(char *dst, const char *src);
 char *strcat(char *dst, const char *src);
 
+void vram_ops_init(BOOL allow_sse2);
+void memset_vram(void *dst, int c, unsigned int size);
+
 BOOL RegReadConf(UINT root, const char *path, const char *name, DWORD *out);
 
 DWORD Get_VMM_Version();
@@ -56,6 +59,10 @@ DWORD __cdecl _GetFreePageCount(DWORD *pLockablePages);
 
 void __cdecl Resume_VM(ULONG VM);
 void Release_Time_Slice();
+DWORD __cdecl Set_Global_Time_Out(DWORD ms, DWORD refdata, DWORD callback);
+void __cdecl Schedule_Global_Event(DWORD callback, DWORD refdata);
+DWORD Get_System_Time();
+void Get_TSC(DWORD *lo_hi);
 
 void __cdecl _BuildDescriptorDWORDs(ULONG DESCBase, ULONG DESCLimit, ULONG DESCType, ULONG DESCSize, ULONG flags, DWORD *outDescHigh, DWORD *outDescLow);
 void __cdecl _Allocate_LDT_Selector(ULONG vm, ULONG DescHigh, ULONG DescLow, ULONG Count, ULONG flags, DWORD *outFirstSelector, DWORD *outSelectorTable);
@@ -96,3 +103,5 @@ void dbg_printf( const char *s, ... );
 struct _VPICD_IRQ_Descriptor;
 
 BOOL VPICD_Virtualize_IRQ(struct _VPICD_IRQ_Descriptor *vid);
+
+DWORD VWIN32_GetCurrentProcessHandle();
@@ -261,6 +261,9 @@ WORD __stdcall VXD_API_Proc(PCRS_32 state)
 	//dbg_printf("VXD_API_Proc, service: %X\n", service);
 	//Begin_Critical_Section(0);
 	
+	/* process batched calls before anything else */
+	FBHDA_batch_flush();
+	
 	switch(service)
 	{
 		case VXD_PM16_VERSION:
@@ -285,12 +288,18 @@ WORD __stdcall VXD_API_Proc(PCRS_32 state)
 			break;
 		case OP_FBHDA_ACCESS_END:
 			FBHDA_access_end(state->Client_ECX);
+			FBHDA_batch_arm();
 			rc = 1;
 			break;
 		case OP_FBHDA_ACCESS_RECT:
 			FBHDA_access_rect(state->Client_EBX, state->Client_ECX, state->Client_ESI, state->Client_EDI);
 			rc = 1;
 			break;
+		case OP_FBHDA_BATCH_FLUSH:
+			/* already done */
+			FBHDA_batch_arm();
+			rc = 1;
+			break;
 		case OP_FBHDA_SWAP:
 			{
 				BOOL rs;
@@ -299,6 +308,10 @@ WORD __stdcall VXD_API_Proc(PCRS_32 state)
 				rc = 1;
 				break;
 			}
+		case OP_FBHDA_FLIP_STATUS:
+			state->Client_ECX = FBHDA_flip_status(state->Client_ECX);
+			rc = 1;
+			break;
 		case OP_FBHDA_CLEAN:
 			FBHDA_clean();
 			rc = 1;
@@ -307,6 +320,10 @@ WORD __stdcall VXD_API_Proc(PCRS_32 state)
 			FBHDA_palette_set(state->Client_ECX & 0xFF, state->Client_EDI);
 			rc = 1;
 			break;
+		case OP_FBHDA_PALETTE_SET_RANGE:
+			FBHDA_palette_set_range(state->Client_EBX, state->Client_ECX, (DWORD*)state->Client_ESI);
+			rc = 1;
+			break;
 		case OP_FBHDA_PALETTE_GET:
 		{
 			DWORD color;
@@ -459,6 +476,7 @@ static void configure_FBHDA()
 	FBHDA_t *fbhda;
 	DWORD force_sw = 0;
 	DWORD force_qemu3dfx = 0;
+	DWORD vram_sse2 = 1;
 	int i;
 	char buf[32];
 	
@@ -471,6 +489,9 @@ static void configure_FBHDA()
 		RegReadConf(HKEY_LOCAL_MACHINE, reg_path, "FORCE_SOFTWARE", &force_sw);
 		RegReadConf(HKEY_LOCAL_MACHINE, reg_path, "FORCE_QEMU3DFX", &force_qemu3dfx);
 		RegReadConf(HKEY_LOCAL_MACHINE, reg_path, "GAMMA_QUIRK",    &gamma_quirk);
+		RegReadConf(HKEY_LOCAL_MACHINE, reg_path, "VRAM_SSE2",      &vram_sse2);
+
+		vram_ops_init(vram_sse2);
 
 		for(i = 1; i < FBHDA_OVERLAYS_MAX; i++)
 		{
@@ -591,6 +612,9 @@ DWORD __stdcall Device_IO_Control_proc(DWORD vmhandle, struct DIOCParams *params
 	
 	//dbg_printf("I%x\n", params->dwIoControlCode);
 	
+	/* 16-bit driver could have some unprocessed calls */
+	FBHDA_batch_flush();
+	
 	switch(params->dwIoControlCode)
 	{
 		/* DX */
@@ -631,6 +655,10 @@ DWORD __stdcall Device_IO_Control_proc(DWORD vmhandle, struct DIOCParams *params
 			outBuf[0] = FBHDA_swap(inBuf[0]);
 			rc = 0;
 			break;
+		case OP_FBHDA_FLIP_STATUS:
+			outBuf[0] = FBHDA_flip_status(inBuf[0]);
+			rc = 0;
+			break;
 		case OP_FBHDA_CLEAN:
 			FBHDA_clean();
 			rc = 0;
@@ -639,10 +667,38 @@ DWORD __stdcall Device_IO_Control_proc(DWORD vmhandle, struct DIOCParams *params
 			FBHDA_palette_set(inBuf[0], inBuf[1]);
 			rc = 0;
 			break;
+		case OP_FBHDA_PALETTE_SET_RANGE:
+		{
+			DWORD count;
+			/* start, count and colors, read only what caller passed */
+			if(params->cbInBuffer < 2*sizeof(DWORD))
+			{
+				rc = 1;
+				break;
+			}
+			count = inBuf[1];
+			if(count > params->cbInBuffer/sizeof(DWORD) - 2)
+			{
+				count = params->cbInBuffer/sizeof(DWORD) - 2;
+			}
+			FBHDA_palette_set_range(inBuf[0], count, &inBuf[2]);
+			rc = 0;
+			break;
+		}
 		case OP_FBHDA_PALETTE_GET:
 			outBuf[0] = FBHDA_palette_get(inBuf[0]);
 			rc = 0;
 			break;
+		case OP_FBHDA_PERF_GET:
+		{
+			DWORD written = FBHDA_perf_get(outBuf, params->cbOutBuffer, (inBuf[0] & FBHDA_PERF_RESET) != 0);
+			if(params->lpcbBytesReturned)
+			{
+				*((DWORD*)params->lpcbBytesReturned) = written;
+			}
+			rc = 0;
+			break;
+		}
 		case OP_FBHDA_OVERLAY_SETUP:
 			outBuf[0] = FBHDA_overlay_setup(inBuf[0], inBuf[1], inBuf[2], inBuf[3]);
 			rc = 0;
@@ -673,7 +729,7 @@ DWORD __stdcall Device_IO_Control_proc(DWORD vmhandle, struct DIOCParams *params
 				SVGA_CMB_submit_io_t *inio  = (SVGA_CMB_submit_io_t*)inBuf;
 				SVGA_CMB_status_t *status = (SVGA_CMB_status_t*)outBuf;
 				
-				SVGA_CMB_submit(inio->cmb, inio->cmb_size, status, inio->flags, inio->DXCtxId);
+				SVGA_CMB_submit(inio->cmb, inio->cmb_size, status, inio->flags & ~SVGA_CB_2D, inio->DXCtxId);
 				rc = 0;
 				break;
 		}
@@ -737,6 +793,24 @@ DWORD __stdcall Device_IO_Control_proc(DWORD vmhandle, struct DIOCParams *params
 			outBuf[0] = (DWORD)SVGA_vxdcmd(inBuf[0], inBuf[1]);
 			rc = 0;
 			break;
+		case OP_SVGA_CAPTURE_SETUP:
+			outBuf[0] = (DWORD)SVGA_capture_setup();
+			rc = 0;
+			break;
+		case OP_SVGA_STATS_SETUP:
+			outBuf[0] = (DWORD)SVGA_stats_setup();
+			rc = 0;
+			break;
+		case OP_SVGA_TRACE_SNAPSHOT:
+		{
+			DWORD written = SVGA_trace_snapshot(outBuf, params->cbOutBuffer);
+			if(params->lpcbBytesReturned)
+			{
+				*((DWORD*)params->lpcbBytesReturned) = written;
+			}
+			rc = 0;
+			break;
+		}
 #ifdef DBGPRINT
 		/* export some mouse function for debuging */
 		case OP_MOUSE_MOVE:
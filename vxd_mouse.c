@@ -43,6 +43,7 @@ static void *mouse_buffer_mem = NULL;
 static void *mouse_andmask_data = NULL;
 static void *mouse_xormask_data = NULL;
 static void *mouse_swap_data = NULL;
+static void *mouse_swap_back = NULL;
 static DWORD mouse_mem_size = 0;
 
 static int mouse_x = 0;
@@ -56,15 +57,40 @@ static int mouse_swap_x = 0;
 static int mouse_swap_y = 0;
 static int mouse_swap_w = 0;
 static int mouse_swap_h = 0;
+static int mouse_swap_ox = 0;
+static int mouse_swap_oy = 0;
 static int mouse_swap_valid = FALSE;
 static int mouse_ps = 0;
 
+static int  mouse_move_x = 0;
+static int  mouse_move_y = 0;
+static BOOL mouse_move_pending = FALSE;
+
 static BOOL  mouse_valid = FALSE;
 static BOOL  mouse_empty = FALSE;
 static BOOL  mouse_visible  = FALSE;
 
 #define CUR_MIN_SIZE (32*32*4)
 
+/* converted cursors, switching between few cursors (animations) costs only pointer swap */
+#define MOUSE_CACHE_SIZE 4
+
+typedef struct _mouse_cache_t
+{
+	DWORD hash;
+	DWORD hash2;
+	DWORD last_use;
+	DWORD mem_size;
+	int   ps;
+	BOOL  empty;
+	BOOL  valid;
+	void *andmask_data;
+	void *xormask_data;
+} mouse_cache_t;
+
+static mouse_cache_t mouse_cache[MOUSE_CACHE_SIZE];
+static DWORD mouse_cache_tick = 0;
+
 #include "vxd_strings.h"
 
 #include "vxd_mouse_conv.h"
@@ -91,6 +117,76 @@ static void mouse_notify_accel()
 	}
 }
 
+/**
+ * Hash of cursor shape (header + masks in same size as copied by
+ * SetCursor_driver), 2 independent 32-bit hashes to make collision
+ * practically impossible.
+ **/
+static DWORD mouse_shape_hash(CURSORSHAPE *cur, DWORD *hash2)
+{
+	DWORD s, i;
+	DWORD h1 = 2166136261UL;
+	DWORD h2 = 0;
+	BYTE *ptr = (BYTE*)cur;
+	DWORD *ptr32;
+	
+	s = ((cur->cx + 7)/8) * cur->cy;
+	if(cur->BitsPixel == 1)
+	{
+		s += ((cur->cx + 7)/8) * cur->cy;
+	}
+	else
+	{
+		s += ((cur->BitsPixel + 7)/8) * cur->cx * cur->cy;
+	}
+	s += sizeof(CURSORSHAPE);
+	
+	ptr32 = (DWORD*)ptr;
+	for(i = 0; i < s/4; i++)
+	{
+		h1 = (h1 ^ ptr32[i]) * 16777619UL;
+		h2 = ((h2 << 5) | (h2 >> 27)) + ptr32[i];
+	}
+	
+	for(i = i*4; i < s; i++)
+	{
+		h1 = (h1 ^ ptr[i]) * 16777619UL;
+		h2 = ((h2 << 5) | (h2 >> 27)) + ptr[i];
+	}
+	
+	*hash2 = h2 ^ s;
+	return h1;
+}
+
+/**
+ * Search converted cursor in cache, if not found, return least recently
+ * used entry (with hash = 0).
+ **/
+static mouse_cache_t *mouse_cache_get(DWORD hash, DWORD hash2)
+{
+	int i;
+	mouse_cache_t *lru = &mouse_cache[0];
+	
+	for(i = 0; i < MOUSE_CACHE_SIZE; i++)
+	{
+		mouse_cache_t *c = &mouse_cache[i];
+		if(c->hash == hash && c->hash2 == hash2 && c->ps == mouse_ps && c->valid)
+		{
+			c->last_use = ++mouse_cache_tick;
+			return c;
+		}
+		
+		if(c->last_use < lru->last_use)
+		{
+			lru = c;
+		}
+	}
+	
+	lru->valid = FALSE;
+	lru->last_use = ++mouse_cache_tick;
+	return lru;
+}
+
 BOOL mouse_load()
 {
 	DWORD ms = 0;
@@ -98,27 +194,31 @@ BOOL mouse_load()
 	void *xormask_ptr;
 	CURSORSHAPE *cur;
 	DWORD cbw;
+	DWORD hash, hash2;
+	mouse_cache_t *c;
 	
 	//dbg_printf(dbg_mouse_load);
 	
 	if(!mouse_buffer_mem) return FALSE;
+	
+	cur = (CURSORSHAPE*)mouse_buffer_mem;
+	hash = mouse_shape_hash(cur, &hash2);
 		
 #ifdef SVGA
 	if(SVGA_mouse_hw())
 	{
-		BOOL r = SVGA_mouse_load();
+		BOOL r = SVGA_mouse_load(hash, hash2);
 		mouse_valid = FALSE;
 		mouse_notify_accel();
 		return r;
 	}
 #endif
-
-	cur = (CURSORSHAPE*)mouse_buffer_mem;
 	
 	/* erase cursor if present */
 	FBHDA_access_begin(0);
 	
 	mouse_valid = FALSE;
+	mouse_ps = (hda->bpp + 7) / 8;
 	
 	/* check and alocate/resize buffer */
 	ms = (cur->cx * cur->cy * 4);
@@ -127,67 +227,97 @@ BOOL mouse_load()
 	
 	if(ms > mouse_mem_size)
 	{
-		if(mouse_andmask_data)
-			_PageFree(mouse_andmask_data, 0);
-		
-		if(mouse_xormask_data)
-			_PageFree(mouse_xormask_data, 0);
-			
 		if(mouse_swap_data)
 			_PageFree(mouse_swap_data, 0);
+		
+		if(mouse_swap_back)
+			_PageFree(mouse_swap_back, 0);
 			
-		mouse_andmask_data = 
+		mouse_swap_data = 
 			(void*)_PageAllocate(RoundToPages(ms), PG_SYS, 0, 0, 0x0, 0x100000, NULL, PAGEFIXED);
 		
-		mouse_xormask_data = 
+		mouse_swap_back = 
 			(void*)_PageAllocate(RoundToPages(ms), PG_SYS, 0, 0, 0x0, 0x100000, NULL, PAGEFIXED);
 		
-		mouse_swap_data = 
-			(void*)_PageAllocate(RoundToPages(ms), PG_SYS, 0, 0, 0x0, 0x100000, NULL, PAGEFIXED);
-			
 		mouse_mem_size = ms;
+		mouse_swap_valid = FALSE;
+	}
+	
+	c = mouse_cache_get(hash, hash2);
+	if(!c->valid && ms > c->mem_size)
+	{
+		if(c->andmask_data)
+			_PageFree(c->andmask_data, 0);
+		
+		if(c->xormask_data)
+			_PageFree(c->xormask_data, 0);
+		
+		c->andmask_data = 
+			(void*)_PageAllocate(RoundToPages(ms), PG_SYS, 0, 0, 0x0, 0x100000, NULL, PAGEFIXED);
+		
+		c->xormask_data = 
+			(void*)_PageAllocate(RoundToPages(ms), PG_SYS, 0, 0, 0x0, 0x100000, NULL, PAGEFIXED);
+		
+		c->mem_size = ms;
 	}
 	
 	/* can't allocate memory */
-	if(mouse_andmask_data == NULL ||
-		mouse_xormask_data == NULL ||
-		mouse_swap_data == NULL)
+	if(c->andmask_data == NULL ||
+		c->xormask_data == NULL ||
+		mouse_swap_data == NULL ||
+		mouse_swap_back == NULL)
 	{
 		dbg_printf(dbg_mouse_no_mem);
+		c->valid = FALSE;
+		c->mem_size = 0;
 		FBHDA_access_end(0);
 		return FALSE;
 	}
 	
+	mouse_andmask_data = c->andmask_data;
+	mouse_xormask_data = c->xormask_data;
+	
+	if(!c->valid)
+	{
+		/* cache miss, convert masks */
+		andmask_ptr = (void*)(cur + 1);
+		xormask_ptr = (void*)(((BYTE*)andmask_ptr) + cur->cbWidth*cur->cy);
+		
+		mouse_w = cur->cx;
+		mouse_h = cur->cy;
+		
+		cbw = (mouse_w+7)/8;
+		
+		/* AND mask (always 1bpp) */
+		convmask(cur, cbw, andmask_ptr, mouse_andmask_data);
+		
+		/* XOR mask (1bpp or screen bpp) */
+		if(cur->BitsPixel == 1)
+		{
+			convmask(cur, cbw, xormask_ptr, mouse_xormask_data);
+		}
+		else
+		{
+			memcpy(mouse_xormask_data, xormask_ptr, 
+				((cur->BitsPixel + 7)/8) * cur->cx * cur->cy
+			);
+		}
+		
+		c->hash   = hash;
+		c->hash2  = hash2;
+		c->ps     = mouse_ps;
+		c->empty  = cursor_is_empty();
+		c->valid  = TRUE;
+	}
+	
 	mouse_w = cur->cx;
 	mouse_h = cur->cy;
 	mouse_pointx = cur->xHotSpot;
 	mouse_pointy = cur->yHotSpot;
 	
-	andmask_ptr = (void*)(cur + 1);
-	xormask_ptr = (void*)(((BYTE*)andmask_ptr) + cur->cbWidth*cur->cy);
-	
-	mouse_ps = (hda->bpp + 7) / 8;
-	
-	cbw = (mouse_w+7)/8;
-	
-	/* AND mask (always 1bpp) */
-	convmask(cur, cbw, andmask_ptr, mouse_andmask_data);
-	
-	/* XOR mask (1bpp or screen bpp) */
-	if(cur->BitsPixel == 1)
-	{
-		convmask(cur, cbw, xormask_ptr, mouse_xormask_data);
-	}
-	else
-	{
-		memcpy(mouse_xormask_data, xormask_ptr, 
-			((cur->BitsPixel + 7)/8) * cur->cx * cur->cy
-		);
-	}
-	
 	mouse_valid = TRUE;
 	mouse_visible = TRUE;
-	mouse_empty = cursor_is_empty();
+	mouse_empty = c->empty;
 	
 	//dbg_printf(dbg_mouse_status, mouse_valid, mouse_visible, mouse_empty);
 	
@@ -206,6 +336,11 @@ void mouse_move(int x, int y)
 	//dbg_printf(dbg_mouse_move, x, y);
 	
 #ifdef SVGA
+	if(capture_active)
+	{
+		SVGA_capture_event(SVGA_CAPTURE_CURSOR_MOVE, x, y, SVGA_mouse_hw(), 0);
+	}
+	
 	if(SVGA_mouse_hw())
 	{
 		SVGA_mouse_move(x, y);
@@ -215,16 +350,42 @@ void mouse_move(int x, int y)
 	
 	if(mouse_valid && mouse_visible && !mouse_empty)
 	{
+#ifdef SVGA
+		/* only record position, redraw is done without waiting to screen update */
+		mouse_move_x = x;
+		mouse_move_y = y;
+		mouse_move_pending = TRUE;
+		SVGA_mouse_sw_move();
+#else
 		FBHDA_access_begin(FBHDA_ACCESS_MOUSE_MOVE);
 		mouse_x = x;
 		mouse_y = y;
 		FBHDA_access_end(FBHDA_ACCESS_MOUSE_MOVE);
+#endif
 	}
 	else
 	{
 		mouse_x = x;
 		mouse_y = y;
+		mouse_move_pending = FALSE;
+	}
+}
+
+/*
+ * Apply position recorded by mouse_move, cursor has to be erased.
+ * Return TRUE if position was changed.
+ */
+BOOL mouse_move_apply()
+{
+	if(mouse_move_pending)
+	{
+		mouse_x = mouse_move_x;
+		mouse_y = mouse_move_y;
+		mouse_move_pending = FALSE;
+		return TRUE;
 	}
+	
+	return FALSE;
 }
 
 void mouse_show()
@@ -286,8 +447,8 @@ BOOL mouse_blit()
 {
 	if(mouse_valid && mouse_visible && !mouse_empty)
 	{
-		draw_save(mouse_x, mouse_y);
 		draw_blit(mouse_x, mouse_y);
+		hda_perf->cursor_redraws++;
 		return TRUE;
 	}
 	
@@ -303,6 +464,24 @@ void mouse_erase()
 	}
 }
 
+/*
+ * Erase cursor, apply position recorded by mouse_move and draw it again
+ * in one pass. Surface has to be in same state as after mouse_blit.
+ */
+void mouse_move_redraw()
+{
+	if(mouse_valid && mouse_visible && !mouse_empty)
+	{
+		mouse_move_apply();
+		draw_move(mouse_x, mouse_y);
+		hda_perf->cursor_redraws++;
+	}
+	else
+	{
+		mouse_move_apply();
+	}
+}
+
 BOOL mouse_get_rect(DWORD *ptr_left, DWORD *ptr_top,
 	DWORD *ptr_right, DWORD *ptr_bottom)
 {
@@ -350,8 +529,6 @@ BOOL mouse_get_rect(DWORD *ptr_left, DWORD *ptr_top,
 			
 			return TRUE;
 		}
-		
-		return TRUE;
 	}
 	
 	return FALSE;
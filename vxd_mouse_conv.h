@@ -1,8 +1,16 @@
+/*
+ * Software cursor kernels. Cursor is clipped only once (calc_save) and
+ * every visible row is processed as one byte span, AND/XOR masks are
+ * stored in screen format so the same span code works for all bpp.
+ */
 
 static BOOL calc_save(int x, int y)
 {
+	int real_x = x - mouse_pointx;
+	int real_y = y - mouse_pointy;
+	
 	mouse_swap_w = mouse_w;
-	mouse_swap_x = x - mouse_pointx;
+	mouse_swap_x = real_x;
 	
 	if(mouse_swap_x < 0)
 	{
@@ -16,7 +24,7 @@ static BOOL calc_save(int x, int y)
 	}
 	
 	mouse_swap_h = mouse_h;
-	mouse_swap_y = y - mouse_pointy;
+	mouse_swap_y = real_y;
 	
 	if(mouse_swap_y < 0)
 	{
@@ -41,152 +49,280 @@ static BOOL calc_save(int x, int y)
 		return FALSE;
 	}
 	
+	/* first visible pixel in cursor masks */
+	mouse_swap_ox = mouse_swap_x - real_x;
+	mouse_swap_oy = mouse_swap_y - real_y;
+	
 	return TRUE;
 }
 
-#define DEF_SAVE(_bpp, _type) \
-static void save ## _bpp(int mx, int my){ \
-	int x, y; \
-	_type *screen; \
-	_type *buf = mouse_swap_data; \
-	BYTE *screen_pos = ((BYTE*)hda->vram_pm32) + hda->surface; \
-	if(!calc_save(mx, my)){ return; } \
-	screen = (_type*)(screen_pos + hda->pitch * mouse_swap_y); \
-	for(y = 0; y < mouse_swap_h; y++) { \
-		for(x = 0; x < mouse_swap_w; x++) { \
-			*buf = screen[mouse_swap_x + x]; \
-			buf++; \
-		} \
-		screen = (_type*)((BYTE*)screen+hda->pitch); \
-	} \
-	mouse_swap_valid = TRUE; }
+/*
+ * Span kernels, 4 bytes (1 to 4 pixels) per step. x86 don't care
+ * about unaligned access, so the 24 bpp is handled same way.
+ */
+static inline void span_copy(BYTE *dst, const BYTE *src, DWORD n)
+{
+	for(; n >= 4; n -= 4)
+	{
+		*((DWORD*)dst) = *((DWORD*)src);
+		dst += 4; src += 4;
+	}
+	
+	while(n--)
+	{
+		*(dst++) = *(src++);
+	}
+}
 
-DEF_SAVE( 8,  BYTE)
-DEF_SAVE(16,  WORD)
-DEF_SAVE(32, DWORD)
+/* save screen to 'save' and draw cursor over it */
+static inline void span_blit_save(BYTE *screen,
+	const BYTE *and_mask, const BYTE *xor_mask, BYTE *save, DWORD n)
+{
+	DWORD s;
+	BYTE b;
+	
+	for(; n >= 4; n -= 4)
+	{
+		s = *((DWORD*)screen);
+		*((DWORD*)save) = s;
+		*((DWORD*)screen) = (s & *((DWORD*)and_mask)) ^ *((DWORD*)xor_mask);
+		screen += 4; save += 4; and_mask += 4; xor_mask += 4;
+	}
+	
+	while(n--)
+	{
+		b = *screen;
+		*(save++) = b;
+		*(screen++) = (b & *(and_mask++)) ^ *(xor_mask++);
+	}
+}
 
-static void save24(int mx, int my)
+/* same as span_blit_save but background is taken from old save buffer */
+static inline void span_blit_restore(BYTE *screen,
+	const BYTE *and_mask, const BYTE *xor_mask,
+	const BYTE *restore, BYTE *save, DWORD n)
 {
-	int x, y;
+	DWORD s;
+	BYTE b;
+	
+	for(; n >= 4; n -= 4)
+	{
+		s = *((DWORD*)restore);
+		*((DWORD*)save) = s;
+		*((DWORD*)screen) = (s & *((DWORD*)and_mask)) ^ *((DWORD*)xor_mask);
+		screen += 4; save += 4; restore += 4; and_mask += 4; xor_mask += 4;
+	}
+	
+	while(n--)
+	{
+		b = *(restore++);
+		*(save++) = b;
+		*(screen++) = (b & *(and_mask++)) ^ *(xor_mask++);
+	}
+}
+
+/**
+ * Save area under cursor and draw cursor in one pass
+ **/
+static void draw_blit(int mx, int my)
+{
+	int y;
+	DWORD n;
 	BYTE *screen;
 	BYTE *buf = mouse_swap_data;
-	BYTE *screen_pos = ((BYTE*)hda->vram_pm32) + hda->surface;
+	DWORD mask_pitch = mouse_w * mouse_ps;
+	DWORD mask_offset;
+	
 	if(!calc_save(mx, my)){ return; }
-	screen = screen_pos + hda->pitch * mouse_swap_y;
+	
+	n = mouse_swap_w * mouse_ps;
+	screen = ((BYTE*)hda->vram_pm32) + hda->surface
+		+ hda->pitch * mouse_swap_y + mouse_swap_x * mouse_ps;
+	mask_offset = mask_pitch * mouse_swap_oy + mouse_swap_ox * mouse_ps;
+	
 	for(y = 0; y < mouse_swap_h; y++)
 	{
-		for(x = 0; x < mouse_swap_w; x++)
-		{
-			*(buf++) = screen[(mouse_swap_x + x)*3    ];
-			*(buf++) = screen[(mouse_swap_x + x)*3 + 1];
-			*(buf++) = screen[(mouse_swap_x + x)*3 + 2];
-		}
-		screen += hda->pitch;
+		span_blit_save(screen,
+			((BYTE*)mouse_andmask_data) + mask_offset,
+			((BYTE*)mouse_xormask_data) + mask_offset,
+			buf, n);
+		
+		screen      += hda->pitch;
+		buf         += n;
+		mask_offset += mask_pitch;
 	}
+	
 	mouse_swap_valid = TRUE;
 }
 
-#define DEF_RESTORE(_bpp, _type) \
-static void restore ## _bpp () { \
-	int x, y; \
-	_type *screen; \
-	_type *buf = mouse_swap_data; \
-	BYTE *screen_pos = ((BYTE*)hda->vram_pm32) + hda->surface; \
-	if(!mouse_swap_valid){ return; } \
-	screen = (_type*)(screen_pos + hda->pitch * mouse_swap_y); \
-	for(y = 0; y < mouse_swap_h; y++) { \
-		for(x = 0; x < mouse_swap_w; x++) { \
-			screen[mouse_swap_x + x] = *buf; buf++; \
-		} \
-		screen = (_type*)((BYTE*)screen+hda->pitch); \
-	} \
-	mouse_swap_valid = FALSE; }
-
-DEF_RESTORE( 8, BYTE)
-DEF_RESTORE(16, WORD)
-DEF_RESTORE(32, DWORD)
-
-void restore24()
+static void draw_restore()
 {
-	int x, y;
+	int y;
+	DWORD n;
 	BYTE *screen;
 	BYTE *buf = mouse_swap_data;
-	BYTE *screen_pos = ((BYTE*)hda->vram_pm32) + hda->surface;
+	
 	if(!mouse_swap_valid){ return; }
-	screen = screen_pos + hda->pitch * mouse_swap_y;
+	
+	n = mouse_swap_w * mouse_ps;
+	screen = ((BYTE*)hda->vram_pm32) + hda->surface
+		+ hda->pitch * mouse_swap_y + mouse_swap_x * mouse_ps;
+	
 	for(y = 0; y < mouse_swap_h; y++)
 	{
-		for(x = 0; x < mouse_swap_w; x++)
-		{
-			screen[(mouse_swap_x + x)*3    ] = *(buf++);
-			screen[(mouse_swap_x + x)*3 + 1] = *(buf++);
-			screen[(mouse_swap_x + x)*3 + 2] = *(buf++);
-		}
+		span_copy(screen, buf, n);
 		screen += hda->pitch;
+		buf    += n;
 	}
+	
 	mouse_swap_valid = FALSE;
 }
 
-#define DEF_BLIT(_bpp, _type) \
-static void blit ## _bpp (int mx, int my) { \
-	int x, y; \
-	_type *screen_line; \
-	_type *and_line; \
-	_type *xor_line; \
-	int real_x = mx - mouse_pointx; \
-	int real_y = my - mouse_pointy; \
-	int real_xx, real_yy; \
-	BYTE *screen_pos = ((BYTE*)hda->vram_pm32) + hda->surface; \
-	for(y = 0; y < mouse_h; y++) { \
-		real_yy = real_y+y; \
-		if(real_yy >= 0 && real_yy < hda->height) { \
-			screen_line = (_type*)(screen_pos + hda->pitch * (real_yy)); \
-			and_line    = ((_type*)mouse_andmask_data + mouse_w * y); \
-			xor_line    = ((_type*)mouse_xormask_data + mouse_w * y); \
-			for(x = 0; x < mouse_w; x++) { \
-				real_xx = real_x+x; \
-				if(real_xx >= 0 && real_xx < hda->width) { \
-					screen_line[real_xx] &= and_line[x]; \
-					screen_line[real_xx] ^= xor_line[x]; \
-} } } } }
-
-DEF_BLIT(8,  BYTE)
-DEF_BLIT(16, WORD)
-DEF_BLIT(32, DWORD)
-
-static void blit24(int mx, int my)
+/**
+ * Move cursor: restore old area, save new one and draw cursor. When
+ * old and new rectangle overlaps (typical for small move), all is done
+ * in one pass over union of them and the pixels in intersection are
+ * touched only once. New area is saved to mouse_swap_back and buffers
+ * are swapped.
+ **/
+static void draw_move(int mx, int my)
 {
-	int x, y;
-	BYTE *screen_line;
+	int old_x, old_y, old_w, old_h;
+	int y, x, xe, next;
+	int top, bottom;
+	BOOL in_old, in_new;
+	BYTE *screen_pos;
+	BYTE *line;
+	BYTE *old_buf;
+	BYTE *new_buf;
 	BYTE *and_line;
 	BYTE *xor_line;
-	int real_x = mx - mouse_pointx;
-	int real_y = my - mouse_pointy;
-	int real_xx, real_yy;
-	int real_xx3, x3;
-	BYTE *screen_pos = ((BYTE*)hda->vram_pm32) + hda->surface;
-	for(y = 0; y < mouse_h; y++)
+	int ps = mouse_ps; /* signed, offsets below could be negative */
+	void *tmp;
+	
+	if(!mouse_swap_valid)
+	{
+		draw_blit(mx, my);
+		return;
+	}
+	
+	old_x = mouse_swap_x;
+	old_y = mouse_swap_y;
+	old_w = mouse_swap_w;
+	old_h = mouse_swap_h;
+	
+	if(!calc_save(mx, my))
+	{
+		/* new position is out of screen */
+		mouse_swap_x = old_x;
+		mouse_swap_y = old_y;
+		mouse_swap_w = old_w;
+		mouse_swap_h = old_h;
+		mouse_swap_valid = TRUE;
+		draw_restore();
+		return;
+	}
+	
+	if(old_x >= mouse_swap_x + mouse_swap_w || mouse_swap_x >= old_x + old_w ||
+		old_y >= mouse_swap_y + mouse_swap_h || mouse_swap_y >= old_y + old_h)
+	{
+		/* no overlap, old area could be simply restored */
+		int new_x = mouse_swap_x;
+		int new_y = mouse_swap_y;
+		int new_w = mouse_swap_w;
+		int new_h = mouse_swap_h;
+		
+		mouse_swap_x = old_x;
+		mouse_swap_y = old_y;
+		mouse_swap_w = old_w;
+		mouse_swap_h = old_h;
+		draw_restore();
+		
+		mouse_swap_x = new_x;
+		mouse_swap_y = new_y;
+		mouse_swap_w = new_w;
+		mouse_swap_h = new_h;
+		draw_blit(mx, my);
+		return;
+	}
+	
+	screen_pos = ((BYTE*)hda->vram_pm32) + hda->surface;
+	
+	top    = (old_y < mouse_swap_y) ? old_y : mouse_swap_y;
+	bottom = (old_y + old_h > mouse_swap_y + mouse_swap_h) ?
+		old_y + old_h : mouse_swap_y + mouse_swap_h;
+	
+	for(y = top; y < bottom; y++)
 	{
-		real_yy = real_y+y;
-		if(real_yy >= 0 && real_yy < hda->height)
+		line = screen_pos + hda->pitch * y;
+		
+		in_old = (y >= old_y && y < old_y + old_h);
+		in_new = (y >= mouse_swap_y && y < mouse_swap_y + mouse_swap_h);
+		
+		/* pointers to the column 0 of screen coordinates */
+		old_buf  = ((BYTE*)mouse_swap_data) + ((y - old_y) * old_w - old_x) * ps;
+		new_buf  = ((BYTE*)mouse_swap_back) +
+			((y - mouse_swap_y) * mouse_swap_w - mouse_swap_x) * ps;
+		and_line = ((BYTE*)mouse_andmask_data) +
+			((mouse_swap_oy + y - mouse_swap_y) * mouse_w + mouse_swap_ox - mouse_swap_x) * ps;
+		xor_line = ((BYTE*)mouse_xormask_data) +
+			((mouse_swap_oy + y - mouse_swap_y) * mouse_w + mouse_swap_ox - mouse_swap_x) * ps;
+		
+		if(!in_new)
+		{
+			span_copy(line + old_x*ps, old_buf + old_x*ps, old_w*ps);
+			continue;
+		}
+		
+		if(!in_old)
+		{
+			x = mouse_swap_x;
+			span_blit_save(line + x*ps, and_line + x*ps, xor_line + x*ps,
+				new_buf + x*ps, mouse_swap_w*ps);
+			continue;
+		}
+		
+		/* both rectangles on this line, split it to segments */
+		x  = (old_x < mouse_swap_x) ? old_x : mouse_swap_x;
+		xe = (old_x + old_w > mouse_swap_x + mouse_swap_w) ?
+			old_x + old_w : mouse_swap_x + mouse_swap_w;
+		
+		while(x < xe)
 		{
-			screen_line = screen_pos + hda->pitch * real_yy;
-			and_line    = ((BYTE*)mouse_andmask_data) + mouse_w * y * 3;
-			xor_line    = ((BYTE*)mouse_xormask_data) + mouse_w * y * 3;
-			for(x = 0; x < mouse_w; x++)
+			next = xe;
+			if(old_x > x && old_x < next) next = old_x;
+			if(old_x + old_w > x && old_x + old_w < next) next = old_x + old_w;
+			if(mouse_swap_x > x && mouse_swap_x < next) next = mouse_swap_x;
+			if(mouse_swap_x + mouse_swap_w > x && mouse_swap_x + mouse_swap_w < next)
+				next = mouse_swap_x + mouse_swap_w;
+			
+			in_old = (x >= old_x && x < old_x + old_w);
+			in_new = (x >= mouse_swap_x && x < mouse_swap_x + mouse_swap_w);
+			
+			if(in_old && in_new)
 			{
-				real_xx = real_x+x;
-				if(real_xx >= 0 && real_xx < hda->width)
-				{
-					real_xx3 = real_xx*3;
-					x3 = x*3;
-					screen_line[real_xx3  ] &= and_line[x3  ]; screen_line[real_xx3  ] ^= xor_line[x3  ];
-					screen_line[real_xx3+1] &= and_line[x3+1]; screen_line[real_xx3+1] ^= xor_line[x3+1];
-					screen_line[real_xx3+2] &= and_line[x3+2]; screen_line[real_xx3+2] ^= xor_line[x3+2];
-				}
+				span_blit_restore(line + x*ps, and_line + x*ps, xor_line + x*ps,
+					old_buf + x*ps, new_buf + x*ps, (next - x)*ps);
 			}
+			else if(in_old)
+			{
+				span_copy(line + x*ps, old_buf + x*ps, (next - x)*ps);
+			}
+			else if(in_new)
+			{
+				span_blit_save(line + x*ps, and_line + x*ps, xor_line + x*ps,
+					new_buf + x*ps, (next - x)*ps);
+			}
+			
+			x = next;
 		}
 	}
+	
+	tmp = mouse_swap_data;
+	mouse_swap_data = mouse_swap_back;
+	mouse_swap_back = tmp;
+	
+	mouse_swap_valid = TRUE;
 }
 
 #define EXPAND_BIT(_dsttype, _bit) (~(((_dsttype)(_bit))-1))
@@ -200,7 +336,7 @@ static void convmask ## _bpp(CURSORSHAPE *lpCursor, DWORD cbWidth, void *src, vo
 		for(x = 0; x < cbWidth; x++) { \
 			pix8 = ((BYTE *)src)[cbWidth*y + x]; \
 			x8 = x*8; \
-			for(xb = 7; xb >= 0 && x8 < lpCursor->cx; xb--,x8++) { \ 
+			for(xb = 7; xb >= 0 && x8 < lpCursor->cx; xb--,x8++) { \
 				*(ptr++) = EXPAND_BIT(_type, ((pix8 >> xb) & 0x1)); \
 } } } }
 
@@ -231,40 +367,7 @@ static void convmask24(CURSORSHAPE *lpCursor, DWORD cbWidth, void *src, void *ds
 	}
 }
 
-static void draw_save(int mx, int my)
-{
-	switch(mouse_ps)
-	{
-		case 1:  save8(mx, my); return;
-		case 2: save16(mx, my); return;
-		case 3: save24(mx, my); return;
-		case 4: save32(mx, my); return;
-	}
-}
-
-static void draw_restore()
-{
-	switch(mouse_ps)
-	{
-		case 1:  restore8(); return;
-		case 2: restore16(); return;
-		case 3: restore24(); return;
-		case 4: restore32(); return;
-	}
-}
-
-static void draw_blit(int mx, int my)
-{
-	switch(mouse_ps)
-	{
-		case 1:  blit8(mx, my); return;
-		case 2: blit16(mx, my); return;
-		case 3: blit24(mx, my); return;
-		case 4: blit32(mx, my); return;
-	}
-}
-
-static void convmask(CURSORSHAPE *lpCursor, DWORD cbWidth, void *src, void *dst)
+static inline void convmask(CURSORSHAPE *lpCursor, DWORD cbWidth, void *src, void *dst)
 {
 	switch(mouse_ps)
 	{
@@ -275,7 +378,7 @@ static void convmask(CURSORSHAPE *lpCursor, DWORD cbWidth, void *src, void *dst)
 	}
 }
 
-static BOOL cursor_is_empty()
+static inline BOOL cursor_is_empty()
 {
 	DWORD s = mouse_w * mouse_h * mouse_ps;
 	BYTE *and_mask = (BYTE *)mouse_andmask_data;
@@ -135,6 +135,7 @@ DSTR(dbg_ctr_start, "CB CTRL: ");
 
 DSTR(dbg_cb_stop_status,  "stop (status %ld)\n");
 DSTR(dbg_cb_start_status, "start (status %ld)\n");
+DSTR(dbg_cb_recover, "CB recover (status %ld, offset %ld, skip %ld)\n");
 
 DSTR(dbg_irq, "IRQ!\n");
 
@@ -180,6 +181,8 @@ DSTR(dbg_mouse_status, " valid=%ld, visible=%ld, empty=%ld\n");
 DSTR(dbg_mouse_hide, "MOUSE = hide\n");
 DSTR(dbg_mouse_show, "MOUSE = show\n");
 
+DSTR(dbg_vram_ops, "VRAM ops: SSE2 non-temporal=%ld\n");
+
 #undef DSTR
 
 #endif
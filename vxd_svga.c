@@ -70,6 +70,10 @@ extern LONG fb_lock_cnt;
        BOOL gb_support = FALSE;
        BOOL cb_support = FALSE;
        BOOL cb_context0 = FALSE;
+       BOOL cb_context1 = FALSE;
+
+/* use second CB context for driver 2D traffic */
+DWORD cb_2d_context = 1;
 
 /* for GPU9 is FIFO more stable (VMWARE) or faster (VBOX) */
 static DWORD prefer_fifo = 1;
@@ -82,16 +86,28 @@ static DWORD fence_next_id = 1;
 void *cmdbuf = NULL;
 void *ctlbuf = NULL;
 
+/* small CB for software cursor updates */
+static DWORD *cursor_cmdbuf = NULL;
+static DWORD cursor_fence = 0;
+
 DWORD async_mobs = 1;
 DWORD hw_cursor  = 0;
 
+/* mode switch without device reset */
+static DWORD fast_mode_switch = 1;
+static BOOL screen_defined = FALSE;
+
 ULONG cb_sem = 0;
 ULONG mem_sem = 0;
 
 /* vxd_mouse.vxd */
 BOOL mouse_get_rect(DWORD *ptr_left, DWORD *ptr_top,
 	DWORD *ptr_right, DWORD *ptr_bottom);
+BOOL mouse_move_apply();
+void mouse_move_redraw();
 
+static void SVGA_modes_update();
+static void SVGA_caps_update();
 
 //DWORD present_fence = 0;
 /*
@@ -110,9 +126,132 @@ static char SVGA_vxd_name[]        = "vmwsmini.vxd";
 static char SVGA_conf_disable_multisample[] = "NoMultisample";
 static char SVGA_conf_reg_multisample[] = "RegMultisample";
 static char SVGA_conf_async_mobs[] = "AsyncMOBs";
+static char SVGA_conf_fast_mode[]  = "FastModeSwitch";
+static char SVGA_conf_cb_2d[]      = "CBContext2D";
+static char SVGA_conf_capture[]    = "CaptureSize";
+static char SVGA_conf_stats[]      = "Stats";
+static char SVGA_conf_stats_wait[] = "StatsLongWait";
+static char SVGA_conf_trace[]      = "TraceSize";
+static char SVGA_conf_hist[]       = "Histograms";
+static char SVGA_conf_present_rate[] = "PresentRate";
+static char SVGA_conf_present_area[] = "PresentArea";
+
+/* present pacing, see vxd_svga_access.h */
+DWORD present_period = 0; /* ms, 0 = present every access immediately */
+DWORD present_area = 25;  /* % of screen, bigger damage is presented immediately */
 
 svga_saved_state_t svga_saved_state = {FALSE};
 
+/*
+ * Register snapshot: every register access is port I/O and trap to the
+ * hypervisor. Registers listed here don't change after init (or only by
+ * device reset), they're read once by SVGA_regs_snapshot and served from
+ * cache. All other registers are always read live, mainly:
+ *   ID, ENABLE, WIDTH, HEIGHT, BITS_PER_PIXEL, BYTES_PER_LINE, FB_OFFSET,
+ *   FB_SIZE, CONFIG_DONE, SYNC, BUSY, FENCE, IRQ*, CURSOR*, DISPLAY_*,
+ *   GMR_ID/DESCRIPTOR, COMMAND_*, DEV_CAP, MSHINT and palette.
+ */
+static const BYTE svga_regs_immutable[] = {
+	SVGA_REG_MAX_WIDTH,
+	SVGA_REG_MAX_HEIGHT,
+	SVGA_REG_FB_START,
+	SVGA_REG_VRAM_SIZE,
+	SVGA_REG_CAPABILITIES,
+	SVGA_REG_MEM_START,
+	SVGA_REG_MEM_SIZE,
+	SVGA_REG_SCRATCH_SIZE,
+	SVGA_REG_MEM_REGS,
+	SVGA_REG_GMR_MAX_IDS,
+	SVGA_REG_GMR_MAX_DESCRIPTOR_LENGTH,
+	SVGA_REG_GMRS_MAX_PAGES,
+	SVGA_REG_MEMORY_SIZE,
+	SVGA_REG_MAX_PRIMARY_MEM,
+	SVGA_REG_SUGGESTED_GBOBJECT_MEM_SIZE_KB,
+	SVGA_REG_SCREENTARGET_MAX_WIDTH,
+	SVGA_REG_SCREENTARGET_MAX_HEIGHT,
+	SVGA_REG_MOB_MAX_SIZE,
+	SVGA_REG_CAP2,
+	SVGA_REG_DEVEL_CAP,
+	SVGA_REG_CURSOR_MAX_BYTE_SIZE,
+	SVGA_REG_CURSOR_MAX_DIMENSION,
+	SVGA_REG_FIFO_CAPS,
+	SVGA_REG_GBOBJECT_MEM_SIZE_KB,
+	SVGA_REG_REGS_START_HIGH32,
+	SVGA_REG_REGS_START_LOW32,
+	SVGA_REG_FB_START_HIGH32,
+	SVGA_REG_FB_START_LOW32
+};
+
+static DWORD svga_regs_cache[SVGA_REG_TOP];
+static DWORD svga_regs_valid[(SVGA_REG_TOP + 31)/32];
+
+/**
+ * Check if register exists on current device. Reading of not implemented
+ * register is not defined (and some hypervisors log every such access).
+ **/
+static BOOL SVGA_reg_present(DWORD r)
+{
+	/* SVGA_ID_0 has only registers up to FB_SIZE */
+	if(gSVGA.deviceVersionId < SVGA_ID_1 && r > SVGA_REG_FB_SIZE)
+	{
+		return FALSE;
+	}
+	
+	/* CURSOR_MAX_*, FIFO_CAPS, GBOBJECT_MEM_SIZE_KB, REGS_START, FB_START_* */
+	if(r >= SVGA_REG_CURSOR_MOBID && gSVGA.deviceVersionId < SVGA_ID_3)
+	{
+		return FALSE;
+	}
+	
+	if(r == SVGA_REG_CAP2 || r == SVGA_REG_DEVEL_CAP)
+	{
+		if((svga_regs_cache[SVGA_REG_CAPABILITIES] & SVGA_CAP_CAP2_REGISTER) == 0)
+		{
+			return FALSE;
+		}
+	}
+	
+	return TRUE;
+}
+
+/**
+ * Fill register cache, call after init and after device reset.
+ * Registers which device doesn't have are cached as 0.
+ **/
+static void SVGA_regs_snapshot()
+{
+	DWORD i, r;
+	
+	for(i = 0; i < sizeof(svga_regs_immutable); i++)
+	{
+		r = svga_regs_immutable[i];
+		
+		if(SVGA_reg_present(r))
+		{
+			svga_regs_cache[r] = SVGA_ReadReg(r);
+		}
+		else
+		{
+			svga_regs_cache[r] = 0;
+		}
+		
+		svga_regs_valid[r >> 5] |= 1UL << (r & 31);
+	}
+}
+
+/**
+ * Read register from snapshot, if isn't there read it from device
+ **/
+DWORD SVGA_ReadRegCached(DWORD index)
+{
+	if(index < SVGA_REG_TOP && (svga_regs_valid[index >> 5] & (1UL << (index & 31))))
+	{
+		return svga_regs_cache[index];
+	}
+	
+	return SVGA_ReadReg(index);
+}
+
 /**
  * Notify virtual HW that is some work to do
  **/
@@ -148,7 +287,8 @@ static void SVGA_DB_alloc()
 	  SVGA3D_MAX_CONTEXT_IDS * sizeof(SVGA_DB_context_t) +
 	  SVGA3D_MAX_SURFACE_IDS * sizeof(SVGA_DB_surface_t) +
 	  sizeof(SVGA_DB_t) +
-	  regions_map_size + contexts_map_size + surfaces_map_size;
+	  regions_map_size + contexts_map_size + surfaces_map_size +
+	  SVGA_DB_CAPS_MAX * sizeof(DWORD);
 	  
 	svga_db = (SVGA_DB_t*)_PageAllocate(RoundToPages(size), PG_VM, ThisVM, 0, 0x0, 0x100000, NULL, PAGEFIXED);
 	if(svga_db)
@@ -177,6 +317,10 @@ static void SVGA_DB_alloc()
 		
 		svga_db->surfaces_map = (DWORD*)mem;
 	  mem += surfaces_map_size;
+	  
+		svga_db->caps = (DWORD*)mem;
+		svga_db->caps_cnt = 0;
+		mem += SVGA_DB_CAPS_MAX * sizeof(DWORD);
 		
 		memcpy(svga_db->mutexname, &(db_mutexname[0]), sizeof(db_mutexname));
 		
@@ -185,6 +329,7 @@ static void SVGA_DB_alloc()
 		memset(svga_db->surfaces_map, 0xFF, surfaces_map_size);
 			
 		svga_db->stat_regions_usage = 0;
+		svga_db->perf = hda_perf;
 	}
 	
 	dbg_printf("SVGA_DB alloc, mem_usage: %ld\n", svga_db->stat_regions_usage);
@@ -275,8 +420,21 @@ void SVGA_fence_wait(DWORD fence_id)
 void SVGA_fence_wait_dbg(DWORD fence_id, int line)
 #endif
 {
+	DWORD wait_start = 0;
+	DWORD hist_tsc[2] = {0, 0};
 //	dbg_printf(dbg_fence_wait, fence_id, line);
 	
+	HIST_BEGIN(hist_tsc);
+	
+	if(stats_active)
+	{
+		wait_start = Get_System_Time();
+	}
+	
+	SVGA_TRACE(SVGA_TRACE_FENCE_BEGIN, fence_id, 0, 0);
+	
+	hda_perf->fence_waits++;
+	
 	for(;;)
 	{
 		if(SVGA_fence_is_passed(fence_id))
@@ -284,6 +442,8 @@ void SVGA_fence_wait_dbg(DWORD fence_id, int line)
 			break;
 		}
 		
+		hda_perf->fence_spins++;
+		
 #if 1
 		if(cb_support && cb_context0)
 		{
@@ -291,12 +451,20 @@ void SVGA_fence_wait_dbg(DWORD fence_id, int line)
 			{
 				/* waiting for fence but command queue is empty */
 				SVGA_Flush();
-				return;
+				break;
 			}
 		}
 #endif
 		SVGA_Sync();
 	}
+	
+	if(stats_active)
+	{
+		SVGA_stats_wait(fence_id, Get_System_Time() - wait_start);
+	}
+	
+	SVGA_TRACE(SVGA_TRACE_FENCE_END, fence_id, 0, 0);
+	HIST_END(SVGA_HIST_FENCE_WAIT, hist_tsc);
 }
 
 void *SVGA_cmd_ptr(DWORD *buf, DWORD *pOffset, DWORD cmd, DWORD cmdsize)
@@ -346,6 +514,14 @@ BOOL SVGA_vxdcmd(DWORD cmd, DWORD arg)
 		case SVGA_CMD_CLEANUP:
 			SVGA_ProcessCleanup(arg);
 			return TRUE;
+		case SVGA_CMD_CAPTURE:
+			return SVGA_capture_enable(arg != 0);
+		case SVGA_CMD_STATS:
+			return SVGA_stats_enable(arg != 0);
+		case SVGA_CMD_TRACE:
+			return SVGA_trace_enable(arg != 0);
+		case SVGA_CMD_HIST:
+			return SVGA_hist_enable(arg != 0);
 	}
 	
 	return FALSE;
@@ -362,7 +538,7 @@ static void SVGA_write_driver_id()
 {
 	if(gSVGA.deviceVersionId >= SVGA_ID_2)
 	{
-		uint32 caps2 = SVGA_ReadReg(SVGA_REG_CAP2);
+		uint32 caps2 = SVGA_ReadRegCached(SVGA_REG_CAP2);
 		
 		if((caps2 & SVGA_CAP2_DX2) != 0)
 		{
@@ -397,6 +573,12 @@ BOOL SVGA_init_hw()
 	DWORD conf_rgb565bug = 1;
 	DWORD conf_cb = 1;
 	DWORD conf_hw_version = SVGA_VERSION_2;
+	DWORD conf_capture = 0; /* kB, 0 = capture disabled */
+	DWORD conf_stats = 0;
+	DWORD conf_stats_wait = 4; /* ms */
+	DWORD conf_trace = 0; /* kB, 0 = trace disabled */
+	DWORD conf_hist = 0;
+	DWORD conf_present_rate = 0; /* Hz, 0 = pacing disabled */
 #if 0
 	uint8 irq = 0;
 #endif
@@ -419,6 +601,25 @@ BOOL SVGA_init_hw()
 
  	RegReadConf(HKEY_LOCAL_MACHINE, SVGA_conf_path, SVGA_conf_async_mobs, &async_mobs);
  	RegReadConf(HKEY_LOCAL_MACHINE, SVGA_conf_path, SVGA_conf_hw_cursor,  &hw_cursor);
+ 	RegReadConf(HKEY_LOCAL_MACHINE, SVGA_conf_path, SVGA_conf_fast_mode,  &fast_mode_switch);
+ 	RegReadConf(HKEY_LOCAL_MACHINE, SVGA_conf_path, SVGA_conf_cb_2d,      &cb_2d_context);
+ 	RegReadConf(HKEY_LOCAL_MACHINE, SVGA_conf_path, SVGA_conf_capture,    &conf_capture);
+ 	RegReadConf(HKEY_LOCAL_MACHINE, SVGA_conf_path, SVGA_conf_stats,      &conf_stats);
+ 	RegReadConf(HKEY_LOCAL_MACHINE, SVGA_conf_path, SVGA_conf_stats_wait, &conf_stats_wait);
+ 	RegReadConf(HKEY_LOCAL_MACHINE, SVGA_conf_path, SVGA_conf_trace,      &conf_trace);
+ 	RegReadConf(HKEY_LOCAL_MACHINE, SVGA_conf_path, SVGA_conf_hist,       &conf_hist);
+ 	RegReadConf(HKEY_LOCAL_MACHINE, SVGA_conf_path, SVGA_conf_present_rate, &conf_present_rate);
+ 	RegReadConf(HKEY_LOCAL_MACHINE, SVGA_conf_path, SVGA_conf_present_area, &present_area);
+ 	
+ 	if(conf_present_rate > 0)
+ 	{
+ 		present_period = 1000 / conf_present_rate;
+ 		if(present_period == 0)
+ 			present_period = 1;
+ 	}
+ 	
+ 	if(present_area > 100)
+ 		present_area = 100;
  	
  	if(async_mobs < 1)
  		async_mobs = 1;
@@ -438,6 +639,8 @@ BOOL SVGA_init_hw()
  	
 	if(rc == 0)
 	{
+		SVGA_regs_snapshot();
+		
 		/* default flags */
 		gSVGA.userFlags = 0;
 		
@@ -518,7 +721,7 @@ BOOL SVGA_init_hw()
 		SVGA_Enable();
 		
 		/* allocate GB tables, if supported */
-		if(SVGA_ReadReg(SVGA_REG_CAPABILITIES) & SVGA_CAP_GBOBJECTS)
+		if(SVGA_ReadRegCached(SVGA_REG_CAPABILITIES) & SVGA_CAP_GBOBJECTS)
 		{
 			SVGA_OTable_alloc(st_surface_mb > 0);
 			gb_support = TRUE;
@@ -526,7 +729,7 @@ BOOL SVGA_init_hw()
 		}
 		
 		/* enable command buffers if supported and enabled */
-		if(SVGA_ReadReg(SVGA_REG_CAPABILITIES) & (SVGA_CAP_COMMAND_BUFFERS | SVGA_CAP_CMD_BUFFERS_2))
+		if(SVGA_ReadRegCached(SVGA_REG_CAPABILITIES) & (SVGA_CAP_COMMAND_BUFFERS | SVGA_CAP_CMD_BUFFERS_2))
 		{
 			if(prefer_fifo && !gb_support)
 			{
@@ -544,14 +747,41 @@ BOOL SVGA_init_hw()
 		
 		SVGA_DB_alloc();
 		
+		/* command stream capture log */
+		SVGA_capture_alloc(conf_capture);
+		
+		/* command statistics */
+		SVGA_stats_alloc(conf_stats_wait);
+		if(conf_stats)
+		{
+			SVGA_stats_enable(TRUE);
+		}
+		
+		/* event trace ring */
+		SVGA_trace_alloc(conf_trace);
+		
+		if(conf_hist)
+		{
+			SVGA_hist_enable(TRUE);
+		}
+		
 		/* allocate buffer for enable and disable CB */
 		ctlbuf = SVGA_CMB_alloc_size(64);
 		
 		/* allocate CB for this driver */
 		cmdbuf = SVGA_CMB_alloc();
 		
+		/* allocate CB for cursor moves */
+		cursor_cmdbuf = SVGA_CMB_alloc_size(256);
+		
+		/* allocate CBs for asynchronous flips */
+		SVGA_flip_alloc();
+		
 		/* special set for faster MOB define */
 		mob_cb_alloc();
+		
+		/* copy of failed CB for resubmission */
+		CB_recover_alloc();
 	
 		/* vGPU10 */
 		if(gb_support)
@@ -572,6 +802,9 @@ BOOL SVGA_init_hw()
 		hda->vram_size = gSVGA.vramSize;
 		hda->vram_pm16 = fb_pm16;
 		
+		SVGA_modes_update();
+		SVGA_caps_update();
+		
  		memcpy(hda->vxdname, SVGA_vxd_name, sizeof(SVGA_vxd_name));
 		
 		hda->flags |= FB_ACCEL_VMSVGA;
@@ -735,7 +968,7 @@ static void SVGA_DefineGMRFB()
 	  	
 	gmrfb = SVGA_cmd_ptr(cmdbuf, &cmd_offset, SVGA_CMD_DEFINE_GMRFB, sizeof(SVGAFifoCmdDefineGMRFB));
 	SVGA_FillGMRFB(gmrfb, hda->surface, hda->pitch, hda->bpp);
-	submit_cmdbuf(cmd_offset, 0, 0);
+	submit_cmdbuf(cmd_offset, SVGA_CB_2D, 0);
 	
 	dbg_printf("SVGA_DefineGMRFB: %ld\n", hda->surface);
 }
@@ -745,34 +978,20 @@ static void SVGA_DefineGMRFB()
  **/
 BOOL SVGA_validmode(DWORD w, DWORD h, DWORD bpp)
 {
-	switch(bpp)
-	{
-		case 8:
-		case 16:
-		case 32:
-			break;
-		default:
-			return FALSE;
-	}
-	
-	if(w <= SVGA_ReadReg(SVGA_REG_MAX_WIDTH))
-	{
-		if(h <= SVGA_ReadReg(SVGA_REG_MAX_HEIGHT))
-		{
-			DWORD size = SVGA_pitch(w, bpp) * h;
-			if(size < hda->vram_size)
-			{
-				if(bpp != 32 && size > SVGA_FB_MAX_TRACEABLE_SIZE)
-				{
-					return FALSE;
-				}
-				
-				return TRUE;
-			}
-		}
-	}
-	
-	return FALSE;
+	return FBHDA_mode_valid(w, h, bpp);
+}
+
+/**
+ * Update mode limits in shared memory, call after device reset
+ **/
+static void SVGA_modes_update()
+{
+	FBHDA_modes_update(
+		FBHDA_BPP_BIT(8) | FBHDA_BPP_BIT(16) | FBHDA_BPP_BIT(32),
+		SVGA_ReadRegCached(SVGA_REG_MAX_WIDTH),
+		SVGA_ReadRegCached(SVGA_REG_MAX_HEIGHT),
+		SVGA_FB_MAX_TRACEABLE_SIZE
+	);
 }
 
 static void SVGA_setmode_phy(DWORD w, DWORD h, DWORD bpp)
@@ -817,6 +1036,7 @@ static void SVGA_setmode_phy(DWORD w, DWORD h, DWORD bpp)
 	
 	/* VMware, vGPU10: OK, when screen has change, whoale GPU is reset including FIFO */
 	SVGA_Enable();
+	SVGA_regs_snapshot();
 	
 	SVGA_Flush(); /* make sure, that is really set */
 
@@ -839,6 +1059,177 @@ static void SVGA_setmode_phy(DWORD w, DWORD h, DWORD bpp)
 	
 	SVGA_Sync();
 	SVGA_Flush_CB();
+	
+	screen_defined = SVGA_hasAccelScreen();
+}
+
+/**
+ * Mode switch on screen object host, when device is already running
+ * in screen object mode: redefine only screen object, legacy registers
+ * aren't touched, so device (and CB context 0) isn't reset.
+ * GMRFB is set by caller.
+ **/
+static BOOL SVGA_setmode_fast(DWORD w, DWORD h, DWORD bpp)
+{
+	if(!fast_mode_switch || !screen_defined)
+	{
+		return FALSE;
+	}
+	
+	SVGA_defineScreen(w, h, bpp, 0);
+	
+	return TRUE;
+}
+
+static void SVGA_setmode_switch(DWORD w, DWORD h, DWORD bpp)
+{
+	if(!SVGA_setmode_fast(w, h, bpp))
+	{
+		SVGA_setmode_phy(w, h, bpp);
+	}
+}
+
+/*
+ * Lazy clear of system surface: surface is divided to horizontal bands,
+ * pending band is cleared by first FBHDA_access_rect/begin which touch it
+ * (or by cursor draw). Both are direct calls from 16-bit driver, never
+ * from batch ring, so band is cleared before driver draws. Windows redraw whole desktop after mode set anyway,
+ * so most of bands are cleared just before they are overwritten.
+ */
+#define SURFACE_CLEAR_BANDS 256
+
+static DWORD surface_clear_map[SURFACE_CLEAR_BANDS/32];
+static DWORD surface_clear_lines = 0;
+static DWORD surface_clear_cnt = 0;
+
+static void surface_clear_init()
+{
+	DWORD i;
+	
+	surface_clear_lines = (hda->height + SURFACE_CLEAR_BANDS - 1) / SURFACE_CLEAR_BANDS;
+	if(surface_clear_lines == 0)
+	{
+		surface_clear_cnt = 0;
+		return;
+	}
+	
+	surface_clear_cnt = (hda->height + surface_clear_lines - 1) / surface_clear_lines;
+	
+	memset(surface_clear_map, 0, sizeof(surface_clear_map));
+	for(i = 0; i < surface_clear_cnt; i++)
+	{
+		surface_clear_map[i >> 5] |= 1UL << (i & 31);
+	}
+}
+
+/* surface content was replaced (readback), nothing to clear */
+static void surface_clear_cancel()
+{
+	surface_clear_cnt = 0;
+}
+
+static void surface_clear_rect(DWORD top, DWORD bottom)
+{
+	DWORD band, last, y, h;
+	
+	if(surface_clear_cnt == 0 || top >= bottom)
+	{
+		return;
+	}
+	
+	if(bottom > hda->height)
+	{
+		bottom = hda->height;
+	}
+	
+	last = (bottom - 1) / surface_clear_lines;
+	for(band = top / surface_clear_lines; band <= last; band++)
+	{
+		if(surface_clear_map[band >> 5] & (1UL << (band & 31)))
+		{
+			y = band * surface_clear_lines;
+			h = surface_clear_lines;
+			if(y + h > hda->height)
+			{
+				h = hda->height - y;
+			}
+			
+			memset_vram((BYTE*)hda->vram_pm32 + hda->system_surface + y*hda->pitch, 0, h*hda->pitch);
+			
+			surface_clear_map[band >> 5] &= ~(1UL << (band & 31));
+			surface_clear_cnt--;
+		}
+	}
+}
+
+/*
+ * Clear screen (framebuffer from offset 0) by HOST: zero small strip at
+ * system surface and blit it over the screen as GMRFB. Command is
+ * synchronous, because the strip will be overwritten by GDI and for
+ * 8/16 bpp is screen written by CPU.
+ */
+#define SVGA_CLEAR_STRIP (256*1024)
+
+static BOOL SVGA_clear_host()
+{
+	SVGAFifoCmdDefineGMRFB *gmrfb;
+	SVGAFifoCmdBlitGMRFBToScreen *gmrblit;
+	DWORD pitch32 = SVGA_pitch(hda->width, 32);
+	DWORD strip_lines;
+	DWORD cmd_offset = 0;
+	DWORD y;
+	
+	if(pitch32 == 0 || hda->height == 0)
+	{
+		return FALSE;
+	}
+	
+	strip_lines = SVGA_CLEAR_STRIP / pitch32;
+	if(strip_lines == 0)
+	{
+		return FALSE;
+	}
+	
+	if(strip_lines > hda->height)
+	{
+		strip_lines = hda->height;
+	}
+	
+	if(strip_lines * pitch32 > hda->stride)
+	{
+		return FALSE;
+	}
+	
+	memset_vram((BYTE*)hda->vram_pm32 + hda->system_surface, 0, strip_lines * pitch32);
+	
+	wait_for_cmdbuf();
+	
+	gmrfb = SVGA_cmd_ptr(cmdbuf, &cmd_offset, SVGA_CMD_DEFINE_GMRFB, sizeof(SVGAFifoCmdDefineGMRFB));
+	SVGA_FillGMRFB(gmrfb, hda->system_surface, pitch32, 32);
+	
+	for(y = 0; y < hda->height; y += strip_lines)
+	{
+		gmrblit = SVGA_cmd_ptr(cmdbuf, &cmd_offset, SVGA_CMD_BLIT_GMRFB_TO_SCREEN, sizeof(SVGAFifoCmdBlitGMRFBToScreen));
+		gmrblit->srcOrigin.x     = 0;
+		gmrblit->srcOrigin.y     = 0;
+		gmrblit->destRect.left   = 0;
+		gmrblit->destRect.top    = y;
+		gmrblit->destRect.right  = hda->width;
+		gmrblit->destRect.bottom = y + strip_lines;
+		if(gmrblit->destRect.bottom > hda->height)
+		{
+			gmrblit->destRect.bottom = hda->height;
+		}
+		gmrblit->destScreenId = 0;
+	}
+	
+	/* restore GMRFB to current surface */
+	gmrfb = SVGA_cmd_ptr(cmdbuf, &cmd_offset, SVGA_CMD_DEFINE_GMRFB, sizeof(SVGAFifoCmdDefineGMRFB));
+	SVGA_FillGMRFB(gmrfb, hda->surface, hda->pitch, hda->bpp);
+	
+	submit_cmdbuf(cmd_offset, SVGA_CB_SYNC | SVGA_CB_2D, 0);
+	
+	return TRUE;
 }
 
 /* clear both physical screen and system surface */
@@ -846,12 +1237,21 @@ void SVGA_clear()
 {
 	if(hda->system_surface)
 	{
-		memset((BYTE*)hda->vram_pm32 + hda->system_surface, 0, hda->height*hda->pitch);
-		memset(hda->vram_pm32, 0, SVGA_pitch(hda->width, 32)*hda->height);
+		if(SVGA_clear_host())
+		{
+			surface_clear_init();
+		}
+		else
+		{
+			surface_clear_cancel();
+			memset_vram((BYTE*)hda->vram_pm32 + hda->system_surface, 0, hda->height*hda->pitch);
+			memset_vram(hda->vram_pm32, 0, SVGA_pitch(hda->width, 32)*hda->height);
+		}
 	}
 	else
 	{
-		memset(hda->vram_pm32, 0, hda->height*hda->pitch);
+		surface_clear_cancel();
+		memset_vram(hda->vram_pm32, 0, hda->height*hda->pitch);
 	}
 }
 
@@ -862,6 +1262,8 @@ void SVGA_clear()
 BOOL SVGA_setmode(DWORD w, DWORD h, DWORD bpp)
 {
 	BOOL has3D;
+	DWORD start_time;
+	DWORD duration;
 	if(!SVGA_validmode(w, h, bpp))
 	{
 		return FALSE;
@@ -886,11 +1288,20 @@ BOOL SVGA_setmode(DWORD w, DWORD h, DWORD bpp)
 				operations are bit unstable)
 	*/
 	
+	start_time = Get_System_Time();
+	SVGA_TRACE(SVGA_TRACE_MODESET_BEGIN, w, h, bpp);
+	
+	if(capture_active)
+	{
+		SVGA_capture_event(SVGA_CAPTURE_MODE, w, h, bpp, 0);
+	}
+	
 	mouse_invalidate();
 	FBHDA_access_begin(0);
 	
-	SVGA_setmode_phy(w, h, bpp);
+	SVGA_setmode_switch(w, h, bpp);
 		
+	SVGA_caps_update();
 	has3D = SVGA3D_Init();
 	
 	hda->flags &= ~((DWORD)FB_SUPPORT_FLIPING);
@@ -900,6 +1311,8 @@ BOOL SVGA_setmode(DWORD w, DWORD h, DWORD bpp)
 	hda->vram_pm32 = (void*)gSVGA.fbLinear;
 	hda->vram_size = gSVGA.vramSize;
 	hda->vram_pm16 = fb_pm16;
+	
+	SVGA_modes_update();
 
 	hda->width   = w;//SVGA_ReadReg(SVGA_REG_WIDTH);
 	hda->height  = h;//SVGA_ReadReg(SVGA_REG_HEIGHT);
@@ -949,10 +1362,23 @@ BOOL SVGA_setmode(DWORD w, DWORD h, DWORD bpp)
 	
 	SVGA_clear();
 	
+	/* damage of FBHDA_access_begin above (and collected one) is old mode */
+	SVGA_present_cancel();
+	
 	mouse_invalidate();
 	FBHDA_access_end(0);
 
 	fb_lock_cnt = 0; // reset lock counters
+	
+	duration = Get_System_Time() - start_time;
+	hda_perf->mode_sets++;
+	hda_perf->mode_set_last_ms = duration;
+	hda_perf->mode_set_total_ms += duration;
+	if(duration > hda_perf->mode_set_max_ms)
+	{
+		hda_perf->mode_set_max_ms = duration;
+	}
+	SVGA_TRACE(SVGA_TRACE_MODESET_END, w, h, bpp);
 
   return TRUE;
 }
@@ -1017,7 +1443,7 @@ DWORD SVGA_FixDevCap(DWORD cap_id, DWORD cap_val)
  *   SVGA_REG_DEV_CAP HW register
  *
  **/
-DWORD SVGA_GetDevCap(DWORD search_id)
+static DWORD SVGA_ReadDevCap(DWORD search_id)
 {
 	if (gSVGA.capabilities & SVGA_CAP_GBOBJECTS)
 	{
@@ -1054,19 +1480,99 @@ DWORD SVGA_GetDevCap(DWORD search_id)
 	return 0;
 }
 
+static BOOL caps_valid = FALSE;
+
+DWORD SVGA_GetDevCap(DWORD search_id)
+{
+	if(caps_valid && search_id < svga_db->caps_cnt)
+	{
+		return svga_db->caps[search_id];
+	}
+	
+	return SVGA_ReadDevCap(search_id);
+}
+
+/**
+ * Build table of all caps in SVGA_DB (shared with user space), call
+ * after init and after mode set.
+ **/
+static void SVGA_caps_update()
+{
+	DWORD i;
+	DWORD *caps;
+	
+	caps_valid = FALSE;
+	
+	if(svga_db == NULL)
+	{
+		return;
+	}
+	
+	caps = svga_db->caps;
+	
+	if(gSVGA.capabilities & SVGA_CAP_GBOBJECTS)
+	{
+		for(i = 0; i < SVGA_DB_CAPS_MAX; i++)
+		{
+			caps[i] = SVGA_ReadDevCap(i);
+		}
+	}
+	else
+	{
+		/* walk FIFO records only once */
+		SVGA3dCapsRecord *pCaps = (SVGA3dCapsRecord *)&(gSVGA.fifoMem[SVGA_FIFO_3D_CAPS]);
+		
+		memset(caps, 0, SVGA_DB_CAPS_MAX * sizeof(DWORD));
+		
+		if(gSVGA.capabilities & SVGA_CAP_EXTENDED_FIFO)
+		{
+			while(pCaps->header.length != 0)
+			{
+				if(pCaps->header.type == SVGA3DCAPS_RECORD_DEVCAPS)
+				{
+					DWORD datalen = (pCaps->header.length - 2)/2;
+					SVGA3dCapPair *pData = (SVGA3dCapPair *)(&pCaps->data);
+					
+					/* first match wins, same as SVGA_ReadDevCap */
+					for(i = datalen; i > 0; i--)
+					{
+						if(pData[i-1][0] < SVGA_DB_CAPS_MAX)
+						{
+							caps[pData[i-1][0]] = pData[i-1][1];
+						}
+					}
+				}
+				pCaps = (SVGA3dCapsRecord *)((DWORD *)pCaps + pCaps->header.length);
+			}
+		}
+		
+		for(i = 0; i < SVGA_DB_CAPS_MAX; i++)
+		{
+			caps[i] = SVGA_FixDevCap(i, caps[i]);
+		}
+	}
+	
+	svga_db->caps_cnt = SVGA_DB_CAPS_MAX;
+	svga_db->caps_serial++;
+	caps_valid = TRUE;
+}
+
 DWORD SVGA_query(DWORD type, DWORD index)
 {
 	switch(type)
 	{
 		case SVGA_QUERY_REGS:
 			if(index >= 256) break;			
-			return SVGA_ReadReg(index);
+			return SVGA_ReadRegCached(index);
 		case SVGA_QUERY_FIFO:
 			if(index >= 1024) break;
 			return gSVGA.fifoMem[index];
 		case SVGA_QUERY_CAPS:
 			if(index >= 512) break;
 			return SVGA_GetDevCap(index);
+		case SVGA_QUERY_HIST:
+			if(index >= SVGA_HIST_QUERY_SIZE) break;
+			return SVGA_hist_query(index);
 	}
 	
 	return ~0x0;
@@ -1075,6 +1581,14 @@ DWORD SVGA_query(DWORD type, DWORD index)
 void SVGA_query_vector(DWORD type, DWORD index_start, DWORD count, DWORD *out)
 {
 	DWORD i;
+	
+	if(type == SVGA_QUERY_CAPS && caps_valid &&
+		index_start < svga_db->caps_cnt && count <= svga_db->caps_cnt - index_start)
+	{
+		memcpy(out, svga_db->caps + index_start, count*sizeof(DWORD));
+		return;
+	}
+	
 	for(i = 0; i < count; i++)
 	{
 		out[i] = SVGA_query(type, index_start+i);
@@ -1102,6 +1616,7 @@ void SVGA_HW_disable()
 	SVGA_CB_stop();
 	
 	SVGA_Disable();
+	screen_defined = FALSE;
 	
 	svga_saved_state.enabled = FALSE;
 }
@@ -1128,6 +1643,11 @@ BOOL FBHDA_swap(DWORD offset)
 	
 	if(offset >= hda->system_surface) /* DON'T touch surface 0 */
 	{
+		if(SVGA_flip(offset))
+		{
+			return TRUE;
+		}
+		
 	 	FBHDA_access_begin(0);
 	 	if(hda->bpp > 8)
 	 	{
@@ -1135,311 +1655,112 @@ BOOL FBHDA_swap(DWORD offset)
 	 		SVGA_DefineGMRFB();
 	  	rc = TRUE;
 		}
-	  FBHDA_access_end(0);
+	  FBHDA_access_end(FBHDA_ACCESS_SYNC);
 	}
 
 	return rc;
 }
 
-static DWORD rect_left;
-static DWORD rect_top;
-static DWORD rect_right;
-static DWORD rect_bottom;
+#include "vxd_svga_access.h"
 
-static inline void update_rect(DWORD left, DWORD top, DWORD right, DWORD bottom)
+/* present timer: time-out is called in async context, so only schedule event */
+static void __declspec(naked) SVGA_present_event_entry()
 {
-	if(left < rect_left)
-		rect_left = left;
-
-	if(top < rect_top)
-		rect_top = top;
-
-	if(right > rect_right)
+	_asm
 	{
-		rect_right = right;
-		if(rect_right > hda->width)
-		{
-			rect_right = hda->width;
-		}
+		pushad
+		call SVGA_present_timeout
+		popad
+		ret
 	}
+}
 
-	if(bottom > rect_bottom)
-	{
-		rect_bottom = bottom;
-		if(rect_bottom > hda->height)
-		{
-			rect_bottom = hda->height;
-		}
-	}
+static void SVGA_present_time_out()
+{
+	Schedule_Global_Event((DWORD)SVGA_present_event_entry, 0);
 }
 
-static inline void check_dirty()
+static void __declspec(naked) SVGA_present_time_out_entry()
 {
-	if(surface_dirty)
+	_asm
 	{
-		switch(hda->bpp)
-		{
-			case 32:
-			{
-			 	SVGAFifoCmdBlitScreenToGMRFB *gmrblit;
-			 	DWORD cmd_offset = 0;
-		
-				wait_for_cmdbuf();
-						
-				gmrblit = SVGA_cmd_ptr(cmdbuf, &cmd_offset, SVGA_CMD_BLIT_SCREEN_TO_GMRFB, sizeof(SVGAFifoCmdBlitScreenToGMRFB));
-	
-				gmrblit->destOrigin.x    = 0;
-				gmrblit->destOrigin.y    = 0;
-				gmrblit->srcRect.left    = 0;
-				gmrblit->srcRect.top     = 0;
-				gmrblit->srcRect.right   = hda->width;
-				gmrblit->srcRect.bottom  = hda->height;
-				gmrblit->srcScreenId = 0;
-				  	
-				submit_cmdbuf(cmd_offset, SVGA_CB_UPDATE, 0);
-				break;
-			}
-			case 16:
-			{
-				readback16(
-					hda->vram_pm32, SVGA_pitch(hda->width, 32),
-					((BYTE*)hda->vram_pm32)+hda->surface, hda->pitch,
-					0, 0, hda->width, hda->height
-				);
-				break;
-			}
-		} // switch
-		
-		surface_dirty = FALSE;
+		pushad
+		call SVGA_present_time_out
+		popad
+		ret
 	}
 }
 
-void FBHDA_access_rect(DWORD left, DWORD top, DWORD right, DWORD bottom)
+void SVGA_present_timer(DWORD ms)
 {
-	if(hda->overlay > 0)
-	{
-		return;
-	}
-	
-	Wait_Semaphore(hda_sem, 0);
-	
-	if(left > hda->width)
-	{
-		Signal_Semaphore(hda_sem);
-		return;
-	}
-	
-	if(top > hda->height)
+	if(ms == 0)
 	{
-		Signal_Semaphore(hda_sem);
-		return;
+		ms = 1;
 	}
 	
-	if(right > hda->width)
-		right = hda->width;
-	
-	if(bottom > hda->height)
-		bottom = hda->height;
-
-	if(fb_lock_cnt++ == 0)
-	{
-		SVGA_CMB_wait_update();
-		check_dirty();
-		
-		rect_left   = left;
-		rect_top    = top;
-		rect_right  = right;
-		rect_bottom = bottom;
-
-		mouse_erase();
-
-		if(mouse_get_rect(&left, &top, &right, &bottom))
-		{
-			update_rect(left, top, right, bottom);
-		}
-	}
-	else
-	{
-		update_rect(left, top, right, bottom);
-	}
-
-	Signal_Semaphore(hda_sem);
+	Set_Global_Time_Out(ms, 0, (DWORD)SVGA_present_time_out_entry);
 }
 
-void FBHDA_access_begin(DWORD flags)
+void FBHDA_palette_set(unsigned char index, DWORD rgb)
 {
-	if(hda->overlay > 0)
-	{
-		return;
-	}
-	
-	if(flags & (FBHDA_ACCESS_RAW_BUFFERING | FBHDA_ACCESS_MOUSE_MOVE))
+	if(hda->system_surface > 0)
 	{
-		Wait_Semaphore(hda_sem, 0);
-		
-//		dbg_printf("FBHDA_access_begin(%ld)\n", flags);
-		
-		if(fb_lock_cnt++ == 0)
-		{
-			SVGA_CMB_wait_update();
-			mouse_erase();
-			check_dirty();
-			
-			if(!mouse_get_rect(&rect_left, &rect_top, &rect_right, &rect_bottom))
-			{
-				rect_left   = 0;
-				rect_top    = 0;
-				rect_right  = 0;
-				rect_bottom = 0;
-			}
-		}
-		else
-		{
-			DWORD l, t, r, b;
-			
-			if(mouse_get_rect(&l, &t, &r, &b))
-			{
-				update_rect(l, t, r, b);
-			}
-		}
-		
-		Signal_Semaphore(hda_sem);
+		palette_emulation[index] = rgb;
 	}
 	else
 	{
-		FBHDA_access_rect(0, 0, hda->width, hda->height);
-	}
+		UINT sIndex = SVGA_PALETTE_BASE + index*3;
+		
+  	SVGA_WriteReg(sIndex+0, (rgb >> 16) & 0xFF);
+  	SVGA_WriteReg(sIndex+1, (rgb >>  8) & 0xFF);
+  	SVGA_WriteReg(sIndex+2,  rgb        & 0xFF);
+  }
+  hda->palette_update++;
 }
 
-void FBHDA_access_end(DWORD flags)
+/**
+ * Set more palette entries at once, palette_update is incremented only
+ * once and emulated 8bpp screen is expanded only once.
+ **/
+void FBHDA_palette_set_range(DWORD start, DWORD count, DWORD *rgb)
 {
-	//dbg_printf("+++ FBHDA_access_end: %ld\n", fb_lock_cnt);
+	DWORD i;
 	
-	if(hda->overlay > 0)
+	if(start >= 256)
 	{
 		return;
 	}
-
-	Wait_Semaphore(hda_sem, 0);
-
-	if(flags & FBHDA_ACCESS_SURFACE_DIRTY)
+	
+	if(start + count > 256)
 	{
-		surface_dirty = TRUE;
+		count = 256 - start;
 	}
-
-	if(flags & FBHDA_ACCESS_MOUSE_MOVE)
+	
+	if(hda->system_surface > 0)
 	{
-		DWORD l, t, r, b;
+		memcpy(&palette_emulation[start], rgb, count*sizeof(DWORD));
+		hda->palette_update++;
 		
-		if(mouse_get_rect(&l, &t, &r, &b))
+		if(hda->bpp == 8)
 		{
-			update_rect(l, t, r, b);
+			/* re-expand whole screen with new palette */
+			FBHDA_access_rect(0, 0, hda->width, hda->height);
+			FBHDA_access_end(0);
 		}
 	}
-
-	if(--fb_lock_cnt <= 0)
+	else
 	{
-		DWORD w, h;
-		BOOL need_refresh = ((hda->bpp == 32) && (hda->system_surface == 0));
+		UINT sIndex = SVGA_PALETTE_BASE + start*3;
 		
-		fb_lock_cnt = 0;
-		
-		w = rect_right - rect_left;
-		h = rect_bottom - rect_top;
-		
-/*		dbg_printf("FBHDA_access_end(%ld %ld %ld %ld)\n", 
-			rect_left, rect_top, rect_right, rect_bottom);*/
-
-		if(w > 0 && h > 0)
+		for(i = 0; i < count; i++)
 		{
-			check_dirty();
-			mouse_blit();
-			if(hda->surface > 0)
-			{
-				switch(hda->bpp)
-				{
-					case 32:
-					{
-				  	SVGAFifoCmdBlitGMRFBToScreen *gmrblit;
-				  	DWORD cmd_offset = 0;
-		
-						wait_for_cmdbuf();
-						
-				  	gmrblit = SVGA_cmd_ptr(cmdbuf, &cmd_offset, SVGA_CMD_BLIT_GMRFB_TO_SCREEN, sizeof(SVGAFifoCmdBlitGMRFBToScreen));
-	
-				  	gmrblit->srcOrigin.x      = rect_left;
-				  	gmrblit->srcOrigin.y      = rect_top;
-				  	gmrblit->destRect.left    = rect_left;
-				  	gmrblit->destRect.top     = rect_top;
-				  	gmrblit->destRect.right   = rect_right;
-				  	gmrblit->destRect.bottom  = rect_bottom;
-	
-				  	gmrblit->destScreenId = 0;
-	
-						submit_cmdbuf(cmd_offset, SVGA_CB_UPDATE, 0);
-						break;
-					}
-					case 16:
-						blit16(
-							((BYTE*)hda->vram_pm32)+hda->surface, hda->pitch,
-							hda->vram_pm32,  SVGA_pitch(hda->width, 32),
-							rect_left, rect_top,
-							rect_right - rect_left, rect_bottom - rect_top
-						);
-						need_refresh = TRUE;
-						break;
-					case 8:
-						blit8(
-							((BYTE*)hda->vram_pm32)+hda->surface, hda->pitch,
-							hda->vram_pm32,  SVGA_pitch(hda->width, 32),
-							rect_left, rect_top,
-							rect_right - rect_left, rect_bottom - rect_top
-						);
-						need_refresh = TRUE;
-						break;
-				} // switch
-			}
-	
-		  if(need_refresh)
-		  {
-		  	SVGAFifoCmdUpdate *cmd_update;
-		  	DWORD cmd_offset = 0;
-	
-		  	wait_for_cmdbuf();
-	
-		  	cmd_update = SVGA_cmd_ptr(cmdbuf, &cmd_offset, SVGA_CMD_UPDATE, sizeof(SVGAFifoCmdUpdate));
-		  	cmd_update->x = rect_left;
-		  	cmd_update->y = rect_top;
-		  	cmd_update->width  = rect_right - rect_left;
-		  	cmd_update->height = rect_bottom - rect_top;
-	
-				submit_cmdbuf(cmd_offset, SVGA_CB_UPDATE, 0);
-		  }
+			SVGA_WriteReg(sIndex+0, (rgb[i] >> 16) & 0xFF);
+			SVGA_WriteReg(sIndex+1, (rgb[i] >>  8) & 0xFF);
+			SVGA_WriteReg(sIndex+2,  rgb[i]        & 0xFF);
+			sIndex += 3;
 		}
-		else
-		{
-			mouse_blit(); /* in this case is mouse unvisible, but we need still switch visibility state */
-		} // w == 0 && h == 0
-	} // fb_lock_cnt == 0
-	
-	Signal_Semaphore(hda_sem);
-}
-
-void FBHDA_palette_set(unsigned char index, DWORD rgb)
-{
-	if(hda->system_surface > 0)
-	{
-		palette_emulation[index] = rgb;
+		hda->palette_update++;
 	}
-	else
-	{
-		UINT sIndex = SVGA_PALETTE_BASE + index*3;
-		
-  	SVGA_WriteReg(sIndex+0, (rgb >> 16) & 0xFF);
-  	SVGA_WriteReg(sIndex+1, (rgb >>  8) & 0xFF);
-  	SVGA_WriteReg(sIndex+2,  rgb        & 0xFF);
-  }
-  hda->palette_update++;
 }
 
 DWORD FBHDA_palette_get(unsigned char index)
@@ -1473,7 +1794,7 @@ DWORD FBHDA_overlay_setup(DWORD overlay, DWORD width, DWORD height, DWORD bpp)
 	if(overlay == 0)
 	{
 		/* restore */
-		SVGA_setmode_phy(svga_saved_state.width, svga_saved_state.height, svga_saved_state.bpp);
+		SVGA_setmode_switch(svga_saved_state.width, svga_saved_state.height, svga_saved_state.bpp);
 		SVGA_DefineGMRFB();
 		
 		hda->overlay = 0;
@@ -1481,6 +1802,7 @@ DWORD FBHDA_overlay_setup(DWORD overlay, DWORD width, DWORD height, DWORD bpp)
 		if(!svga_saved_state.enabled)
 		{
 			SVGA_Disable();
+			screen_defined = FALSE;
 		}
 		else
 		{
@@ -1505,12 +1827,12 @@ DWORD FBHDA_overlay_setup(DWORD overlay, DWORD width, DWORD height, DWORD bpp)
 			if(hda->overlays[overlay].size > stride)
 			{
 				hda->overlay = overlay;
-				SVGA_setmode_phy(width, height, bpp);
+				SVGA_setmode_switch(width, height, bpp);
 
 				wait_for_cmdbuf();
 				gmrfb = SVGA_cmd_ptr(cmdbuf, &cmd_offset, SVGA_CMD_DEFINE_GMRFB, sizeof(SVGAFifoCmdDefineGMRFB));
 				SVGA_FillGMRFB(gmrfb, offset, pitch, bpp);
-				submit_cmdbuf(cmd_offset, SVGA_CB_SYNC, 0);
+				submit_cmdbuf(cmd_offset, SVGA_CB_SYNC | SVGA_CB_2D, 0);
 
 				ov_width  = width;
 				ov_height = height;
@@ -1519,7 +1841,7 @@ DWORD FBHDA_overlay_setup(DWORD overlay, DWORD width, DWORD height, DWORD bpp)
 
 				/* clear screen */
 				FBHDA_overlay_lock(0, 0, width, height);
-				memset(hda->overlays[overlay].ptr, 0, stride);
+				memset_vram(hda->overlays[overlay].ptr, 0, stride);
 				FBHDA_overlay_unlock(0);
 
 				return pitch;
@@ -1587,7 +1909,7 @@ void  FBHDA_overlay_unlock(DWORD flags)
 	
 	  	gmrblit->destScreenId = 0;
 				  	
-			submit_cmdbuf(cmd_offset, SVGA_CB_UPDATE, 0);
+			submit_cmdbuf(cmd_offset, SVGA_CB_UPDATE | SVGA_CB_2D, 0);
 		}
 
 		if(overlay_lock_cnt < 0)
@@ -27,6 +27,7 @@ void SVGA_region_usage_reset();
 BOOL SVGA_fence_is_passed(DWORD fence_id);
 DWORD SVGA_fence_passed();
 DWORD SVGA_GetDevCap(DWORD search_id);
+DWORD SVGA_ReadRegCached(DWORD index);
 
 #ifdef DBGPRINT
 void SVGA_fence_wait_dbg(DWORD fence_id, int line);
@@ -44,10 +45,11 @@ void SVGA_AllProcessCleanup();
 
 /* mouse */
 BOOL SVGA_mouse_hw();
-BOOL SVGA_mouse_load();
+BOOL SVGA_mouse_load(DWORD hash, DWORD hash2);
 void SVGA_mouse_move(int x, int y);
 void SVGA_mouse_show();
 void SVGA_mouse_hide(BOOL invalidate);
+void SVGA_mouse_sw_move();
 
 /* memory */
 void set_fragmantation_limit();
@@ -65,10 +67,74 @@ void SVGA_CB_start();
 void SVGA_CB_stop();
 void SVGA_CB_restart();
 void SVGA_CMB_wait_update();
+BOOL SVGA_CMB_busy(DWORD *cmb);
 
 void mob_cb_alloc();
+void CB_recover_alloc();
 void *mob_cb_get();
 
+/* capture */
+extern BOOL capture_active;
+void SVGA_capture_alloc(DWORD size_kb);
+BOOL SVGA_capture_enable(BOOL enable);
+void SVGA_capture_cmb(DWORD *cmb, DWORD cmb_size, DWORD flags, DWORD dx);
+void SVGA_capture_region(DWORD type, SVGA_region_info_t *rinfo);
+void SVGA_capture_event(DWORD type, DWORD a0, DWORD a1, DWORD a2, DWORD a3);
+
+/* statistics */
+extern BOOL stats_active;
+DWORD CB_cmd_size(DWORD *cmd, DWORD avail);
+void SVGA_stats_alloc(DWORD long_wait_ms);
+BOOL SVGA_stats_enable(BOOL enable);
+void SVGA_stats_cmb(DWORD *cmb, DWORD cmb_size, DWORD flags, DWORD dx, DWORD process);
+void SVGA_stats_fence(DWORD fence);
+void SVGA_stats_wait(DWORD fence, DWORD ms);
+
+/* trace */
+extern BOOL trace_active;
+void SVGA_trace_alloc(DWORD size_kb);
+BOOL SVGA_trace_enable(BOOL enable);
+void SVGA_trace(DWORD id, DWORD a0, DWORD a1, DWORD a2);
+DWORD SVGA_trace_snapshot(void *buf, DWORD size);
+
+#define SVGA_TRACE(_id, _a0, _a1, _a2) \
+	do{ \
+		if(trace_active){ \
+			SVGA_trace(_id, _a0, _a1, _a2); \
+		} \
+	}while(0)
+
+/* present pacing */
+extern DWORD present_period;
+extern DWORD present_area;
+void SVGA_present_timer(DWORD ms);
+void SVGA_present_timeout();
+void SVGA_present_cancel();
+
+/* flip queue */
+void SVGA_flip_alloc();
+BOOL SVGA_flip(DWORD offset);
+
+/* latency histograms */
+extern BOOL hist_active;
+BOOL SVGA_hist_enable(BOOL enable);
+void SVGA_hist_add(DWORD id, DWORD *start);
+DWORD SVGA_hist_query(DWORD index);
+
+#define HIST_BEGIN(_tsc) \
+	do{ \
+		if(hist_active){ \
+			Get_TSC(_tsc); \
+		} \
+	}while(0)
+
+#define HIST_END(_id, _tsc) \
+	do{ \
+		if(hist_active){ \
+			SVGA_hist_add(_id, _tsc); \
+		} \
+	}while(0)
+
 typedef struct _svga_saved_state_t
 {
 	BOOL enabled;
@@ -0,0 +1,870 @@
+#ifndef __VXD_SVGA_ACCESS_H__INCLUDED__
+#define __VXD_SVGA_ACCESS_H__INCLUDED__
+
+/*
+ * FBHDA access protocol: damage rectangle collected between first
+ * FBHDA_access_rect/begin and last FBHDA_access_end, software cursor
+ * erase/redraw, present of damaged area to the screen (optionally paced
+ * by timer) and asynchronous flips.
+ *
+ * Included only by vxd_svga.c, code is shared with GDI replay harness
+ * (tools/test/gdireplay.c) which provides rest of the driver as shims.
+ */
+
+static DWORD rect_left;
+static DWORD rect_top;
+static DWORD rect_right;
+static DWORD rect_bottom;
+
+/*
+ * Present pacing: when present_period is set, damage of finished access
+ * isn't presented immediately, but it's collected in pend_* and presented
+ * by timer at most once per present_period ms. Damage bigger than
+ * present_area % of screen and FBHDA_ACCESS_SYNC are presented immediately.
+ */
+static DWORD pend_left;
+static DWORD pend_top;
+static DWORD pend_right;
+static DWORD pend_bottom;
+static BOOL  pend_armed = FALSE;
+static DWORD present_last = 0;
+
+/* software cursor move which couldn't be drawn, retried by present timer */
+static BOOL  move_pending = FALSE;
+#define MOVE_RETRY_MS 5
+
+#define pend_empty() (pend_left >= pend_right || pend_top >= pend_bottom)
+
+static void present_pending();
+
+/*
+ * Flip queue: on 32 bpp with system surface FBHDA_swap only retargets
+ * GMRFB and queues blit of whole new surface. Every queued flip has own
+ * small CB and fence, so the flip waits only when all entries are still
+ * pending and user space can ask by FBHDA_flip_status, which surfaces are
+ * still read by HOST (DirectDraw GetFlipStatus, Lock of back buffer).
+ */
+#define FLIP_QUEUE_MAX 3
+
+typedef struct _flip_entry_t
+{
+	DWORD *cmdbuf;
+	DWORD  offset;
+	DWORD  fence;
+} flip_entry_t;
+
+static flip_entry_t flip_queue[FLIP_QUEUE_MAX];
+static DWORD flip_next = 0;
+
+static inline void update_rect(DWORD left, DWORD top, DWORD right, DWORD bottom)
+{
+	if(rect_left >= rect_right || rect_top >= rect_bottom)
+	{
+		/* empty rect, don't extend it from 0,0 */
+		rect_left   = left;
+		rect_top    = top;
+		rect_right  = right;
+		rect_bottom = bottom;
+	}
+
+	if(left < rect_left)
+		rect_left = left;
+
+	if(top < rect_top)
+		rect_top = top;
+
+	if(right > rect_right)
+	{
+		rect_right = right;
+		if(rect_right > hda->width)
+		{
+			rect_right = hda->width;
+		}
+	}
+
+	if(bottom > rect_bottom)
+	{
+		rect_bottom = bottom;
+		if(rect_bottom > hda->height)
+		{
+			rect_bottom = hda->height;
+		}
+	}
+}
+
+static inline void check_dirty()
+{
+	if(surface_dirty)
+	{
+		/* collected damage will be overwritten by readback */
+		present_pending();
+		
+		switch(hda->bpp)
+		{
+			case 32:
+			{
+			 	SVGAFifoCmdBlitScreenToGMRFB *gmrblit;
+			 	DWORD cmd_offset = 0;
+		
+				wait_for_cmdbuf();
+						
+				gmrblit = SVGA_cmd_ptr(cmdbuf, &cmd_offset, SVGA_CMD_BLIT_SCREEN_TO_GMRFB, sizeof(SVGAFifoCmdBlitScreenToGMRFB));
+	
+				gmrblit->destOrigin.x    = 0;
+				gmrblit->destOrigin.y    = 0;
+				gmrblit->srcRect.left    = 0;
+				gmrblit->srcRect.top     = 0;
+				gmrblit->srcRect.right   = hda->width;
+				gmrblit->srcRect.bottom  = hda->height;
+				gmrblit->srcScreenId = 0;
+				  	
+				submit_cmdbuf(cmd_offset, SVGA_CB_UPDATE | SVGA_CB_2D, 0);
+				break;
+			}
+			case 16:
+			{
+				readback16(
+					hda->vram_pm32, SVGA_pitch(hda->width, 32),
+					((BYTE*)hda->vram_pm32)+hda->surface, hda->pitch,
+					0, 0, hda->width, hda->height
+				);
+				break;
+			}
+		} // switch
+		
+		surface_clear_cancel();
+		surface_dirty = FALSE;
+	}
+}
+
+static BOOL cursor_update_busy()
+{
+	if(SVGA_CMB_busy(cursor_cmdbuf))
+	{
+		return TRUE;
+	}
+	
+	if(cursor_fence != 0)
+	{
+		if(!SVGA_fence_is_passed(cursor_fence))
+		{
+			return TRUE;
+		}
+		cursor_fence = 0;
+	}
+	
+	return FALSE;
+}
+
+static void cursor_update_wait()
+{
+	if(cursor_cmdbuf == NULL)
+	{
+		return;
+	}
+	
+	if(cursor_fence != 0)
+	{
+		SVGA_fence_wait(cursor_fence);
+		cursor_fence = 0;
+	}
+	
+	while(SVGA_CMB_busy(cursor_cmdbuf))
+	{
+		SVGA_Sync();
+	}
+}
+
+void SVGA_flip_alloc()
+{
+	int i;
+	
+	for(i = 0; i < FLIP_QUEUE_MAX; i++)
+	{
+		flip_queue[i].cmdbuf = SVGA_CMB_alloc_size(256);
+		flip_queue[i].offset = 0;
+		flip_queue[i].fence  = 0;
+	}
+}
+
+/**
+ * Wait until all queued flips reading visible surface are done, GDI
+ * will draw to it.
+ **/
+static void flip_wait_surface()
+{
+	int i;
+	
+	for(i = 0; i < FLIP_QUEUE_MAX; i++)
+	{
+		if(flip_queue[i].fence != 0 && flip_queue[i].offset == hda->surface)
+		{
+			SVGA_fence_wait(flip_queue[i].fence);
+			flip_queue[i].fence = 0;
+		}
+	}
+}
+
+DWORD FBHDA_flip_status(DWORD offset)
+{
+	DWORD pending = 0;
+	int i;
+	
+	for(i = 0; i < FLIP_QUEUE_MAX; i++)
+	{
+		if(flip_queue[i].fence != 0 && (offset == 0 || flip_queue[i].offset == offset))
+		{
+			if(!SVGA_fence_is_passed(flip_queue[i].fence))
+			{
+				pending++;
+			}
+		}
+	}
+	
+	return pending;
+}
+
+/**
+ * Asynchronous flip to surface at offset. Return FALSE when the flip has
+ * to be done by full access (other bpp than 32, surface is locked,
+ * readback or clear is pending).
+ **/
+BOOL SVGA_flip(DWORD offset)
+{
+	flip_entry_t *flip;
+	SVGAFifoCmdDefineGMRFB *gmrfb;
+	SVGAFifoCmdBlitGMRFBToScreen *gmrblit;
+	SVGA_CMB_status_t status;
+	DWORD cmd_offset = 0;
+	
+	if(hda->bpp != 32 || hda->system_surface == 0 || flip_queue[0].cmdbuf == NULL)
+	{
+		return FALSE;
+	}
+	
+	Wait_Semaphore(hda_sem, 0);
+	
+	if(fb_lock_cnt > 0 || surface_dirty || surface_clear_cnt > 0)
+	{
+		Signal_Semaphore(hda_sem);
+		return FALSE;
+	}
+	
+	/* oldest entry, block only when all flips are still pending */
+	flip = &flip_queue[flip_next];
+	if(flip->fence != 0)
+	{
+		if(!SVGA_fence_is_passed(flip->fence))
+		{
+			hda_perf->flip_waits++;
+			SVGA_fence_wait(flip->fence);
+		}
+		flip->fence = 0;
+	}
+	
+	while(SVGA_CMB_busy(flip->cmdbuf))
+	{
+		SVGA_Sync();
+	}
+	
+	/* move software cursor to new surface */
+	cursor_update_wait();
+	mouse_erase();
+	hda->surface = offset;
+	mouse_move_apply();
+	mouse_blit();
+	
+	gmrfb = SVGA_cmd_ptr(flip->cmdbuf, &cmd_offset, SVGA_CMD_DEFINE_GMRFB, sizeof(SVGAFifoCmdDefineGMRFB));
+	SVGA_FillGMRFB(gmrfb, hda->surface, hda->pitch, hda->bpp);
+	
+	gmrblit = SVGA_cmd_ptr(flip->cmdbuf, &cmd_offset, SVGA_CMD_BLIT_GMRFB_TO_SCREEN, sizeof(SVGAFifoCmdBlitGMRFBToScreen));
+	gmrblit->srcOrigin.x      = 0;
+	gmrblit->srcOrigin.y      = 0;
+	gmrblit->destRect.left    = 0;
+	gmrblit->destRect.top     = 0;
+	gmrblit->destRect.right   = hda->width;
+	gmrblit->destRect.bottom  = hda->height;
+	gmrblit->destScreenId     = 0;
+	
+	status.fifo_fence_used = 0;
+	SVGA_CMB_submit(flip->cmdbuf, cmd_offset, &status, SVGA_CB_FORCE_FENCE | SVGA_CB_2D, 0);
+	
+	flip->offset = offset;
+	flip->fence  = status.fifo_fence_used;
+	flip_next = (flip_next + 1) % FLIP_QUEUE_MAX;
+	
+	/* whole screen was replaced */
+	pend_left   = 0;
+	pend_top    = 0;
+	pend_right  = 0;
+	pend_bottom = 0;
+	
+	hda_perf->flips++;
+	
+	Signal_Semaphore(hda_sem);
+	
+	return TRUE;
+}
+
+void FBHDA_access_rect(DWORD left, DWORD top, DWORD right, DWORD bottom)
+{
+	if(hda->overlay > 0)
+	{
+		return;
+	}
+	
+	if(capture_active)
+	{
+		SVGA_capture_event(SVGA_CAPTURE_ACCESS_RECT, left, top, right, bottom);
+	}
+	
+	Wait_Semaphore(hda_sem, 0);
+	
+	if(left > hda->width)
+	{
+		Signal_Semaphore(hda_sem);
+		return;
+	}
+	
+	if(top > hda->height)
+	{
+		Signal_Semaphore(hda_sem);
+		return;
+	}
+	
+	if(right > hda->width)
+		right = hda->width;
+	
+	if(bottom > hda->height)
+		bottom = hda->height;
+
+	if(fb_lock_cnt++ == 0)
+	{
+		SVGA_CMB_wait_update();
+		cursor_update_wait();
+		flip_wait_surface();
+		check_dirty();
+		
+		rect_left   = left;
+		rect_top    = top;
+		rect_right  = right;
+		rect_bottom = bottom;
+
+		mouse_erase();
+		surface_clear_rect(top, bottom);
+
+		if(mouse_get_rect(&left, &top, &right, &bottom))
+		{
+			update_rect(left, top, right, bottom);
+		}
+	}
+	else
+	{
+		surface_clear_rect(top, bottom);
+		update_rect(left, top, right, bottom);
+	}
+
+	Signal_Semaphore(hda_sem);
+}
+
+void FBHDA_access_begin(DWORD flags)
+{
+	if(hda->overlay > 0)
+	{
+		return;
+	}
+	
+	SVGA_TRACE(SVGA_TRACE_ACCESS_BEGIN, flags, 0, 0);
+	
+	if(flags & (FBHDA_ACCESS_RAW_BUFFERING | FBHDA_ACCESS_MOUSE_MOVE))
+	{
+		/* mouse move accesses are replayed from SVGA_CAPTURE_CURSOR_MOVE */
+		if(capture_active && (flags & FBHDA_ACCESS_MOUSE_MOVE) == 0)
+		{
+			SVGA_capture_event(SVGA_CAPTURE_ACCESS_BEGIN, flags, 0, 0, 0);
+		}
+		
+		Wait_Semaphore(hda_sem, 0);
+		
+//		dbg_printf("FBHDA_access_begin(%ld)\n", flags);
+		
+		if(fb_lock_cnt++ == 0)
+		{
+			SVGA_CMB_wait_update();
+			cursor_update_wait();
+			flip_wait_surface();
+			mouse_erase();
+			check_dirty();
+			
+			if(flags & FBHDA_ACCESS_RAW_BUFFERING)
+			{
+				surface_clear_rect(0, hda->height);
+			}
+			
+			if(!mouse_get_rect(&rect_left, &rect_top, &rect_right, &rect_bottom))
+			{
+				rect_left   = 0;
+				rect_top    = 0;
+				rect_right  = 0;
+				rect_bottom = 0;
+			}
+		}
+		else
+		{
+			DWORD l, t, r, b;
+			
+			if(flags & FBHDA_ACCESS_RAW_BUFFERING)
+			{
+				surface_clear_rect(0, hda->height);
+			}
+			
+			if(mouse_get_rect(&l, &t, &r, &b))
+			{
+				update_rect(l, t, r, b);
+			}
+		}
+		
+		Signal_Semaphore(hda_sem);
+	}
+	else
+	{
+		FBHDA_access_rect(0, 0, hda->width, hda->height);
+	}
+}
+
+/**
+ * Append commands copying rect_* area from system surface to the screen
+ * to buf at *pcmd_offset (8/16 bpp area is converted now).
+ **/
+static void present_rect_cmd(DWORD *buf, DWORD *pcmd_offset)
+{
+	DWORD cmd_offset = *pcmd_offset;
+	BOOL need_refresh = ((hda->bpp == 32) && (hda->system_surface == 0));
+	
+	if(hda->surface > 0)
+	{
+		switch(hda->bpp)
+		{
+			case 32:
+			{
+				SVGAFifoCmdBlitGMRFBToScreen *gmrblit;
+				
+				gmrblit = SVGA_cmd_ptr(buf, &cmd_offset, SVGA_CMD_BLIT_GMRFB_TO_SCREEN, sizeof(SVGAFifoCmdBlitGMRFBToScreen));
+				
+				gmrblit->srcOrigin.x      = rect_left;
+				gmrblit->srcOrigin.y      = rect_top;
+				gmrblit->destRect.left    = rect_left;
+				gmrblit->destRect.top     = rect_top;
+				gmrblit->destRect.right   = rect_right;
+				gmrblit->destRect.bottom  = rect_bottom;
+				
+				gmrblit->destScreenId = 0;
+				break;
+			}
+			case 16:
+				blit16(
+					((BYTE*)hda->vram_pm32)+hda->surface, hda->pitch,
+					hda->vram_pm32,  SVGA_pitch(hda->width, 32),
+					rect_left, rect_top,
+					rect_right - rect_left, rect_bottom - rect_top
+				);
+				FBHDA_PERF_ADD64(hda_perf->blit16_bytes, (rect_right - rect_left) * (rect_bottom - rect_top) * 2);
+				need_refresh = TRUE;
+				break;
+			case 8:
+				blit8(
+					((BYTE*)hda->vram_pm32)+hda->surface, hda->pitch,
+					hda->vram_pm32,  SVGA_pitch(hda->width, 32),
+					rect_left, rect_top,
+					rect_right - rect_left, rect_bottom - rect_top
+				);
+				FBHDA_PERF_ADD64(hda_perf->blit8_bytes, (rect_right - rect_left) * (rect_bottom - rect_top));
+				need_refresh = TRUE;
+				break;
+		} // switch
+	}
+	
+	if(need_refresh)
+	{
+		SVGAFifoCmdUpdate *cmd_update;
+		
+		cmd_update = SVGA_cmd_ptr(buf, &cmd_offset, SVGA_CMD_UPDATE, sizeof(SVGAFifoCmdUpdate));
+		cmd_update->x = rect_left;
+		cmd_update->y = rect_top;
+		cmd_update->width  = rect_right - rect_left;
+		cmd_update->height = rect_bottom - rect_top;
+	}
+	
+	*pcmd_offset = cmd_offset;
+}
+
+/**
+ * Submit commands prepared by present_rect_cmd.
+ * Return fence of the command when SVGA_CB_FORCE_FENCE is set.
+ **/
+static DWORD present_submit(DWORD *buf, DWORD cmd_offset, DWORD flags)
+{
+	SVGA_CMB_status_t status;
+	
+	if(cmd_offset == 0)
+	{
+		return 0;
+	}
+	
+	status.fifo_fence_used = 0;
+	SVGA_CMB_submit(buf, cmd_offset, &status, flags | SVGA_CB_2D, 0);
+	hda_perf->presents++;
+	
+	return status.fifo_fence_used;
+}
+
+/**
+ * Copy rect_* area from system surface to the screen.
+ * Caller has to make sure, that buf isn't used by HOST.
+ * Return fence of the command when SVGA_CB_FORCE_FENCE is set.
+ **/
+static DWORD SVGA_present_rect(DWORD *buf, DWORD flags)
+{
+	DWORD cmd_offset = 0;
+	
+	present_rect_cmd(buf, &cmd_offset);
+	
+	return present_submit(buf, cmd_offset, flags);
+}
+
+/**
+ * Present collected damage now. Caller has to hold hda_sem and surface
+ * must be in presentable state (cursor drawn).
+ **/
+static void present_pending()
+{
+	if(pend_empty())
+	{
+		return;
+	}
+	
+	rect_left   = pend_left;
+	rect_top    = pend_top;
+	rect_right  = pend_right;
+	rect_bottom = pend_bottom;
+	
+	pend_left   = 0;
+	pend_top    = 0;
+	pend_right  = 0;
+	pend_bottom = 0;
+	
+	wait_for_cmdbuf();
+	SVGA_present_rect(cmdbuf, SVGA_CB_UPDATE);
+	present_last = Get_System_Time();
+}
+
+/**
+ * Move older collected damage to rect_* (present it together with the
+ * current access).
+ **/
+static inline void present_merge()
+{
+	if(!pend_empty())
+	{
+		update_rect(pend_left, pend_top, pend_right, pend_bottom);
+		pend_left   = 0;
+		pend_top    = 0;
+		pend_right  = 0;
+		pend_bottom = 0;
+	}
+}
+
+/**
+ * Decide if the present of rect_* can be postponed. Return TRUE when
+ * rect_* was collected and the timer will present it.
+ **/
+static BOOL present_defer(DWORD flags)
+{
+	DWORD now, elapsed, area, area_limit;
+	
+	if(present_period == 0)
+	{
+		return FALSE;
+	}
+	
+	now = Get_System_Time();
+	elapsed = now - present_last;
+	
+	/* in pixels, present_area is max 100, so nothing can overflow */
+	area       = (rect_right - rect_left) * (rect_bottom - rect_top);
+	area_limit = (hda->width * hda->height / 100) * present_area;
+	
+	/* cursor moves are presented immediately too */
+	if((flags & (FBHDA_ACCESS_SYNC | FBHDA_ACCESS_MOUSE_MOVE)) == 0 && elapsed < present_period &&
+		area < area_limit)
+	{
+		pend_left   = rect_left;
+		pend_top    = rect_top;
+		pend_right  = rect_right;
+		pend_bottom = rect_bottom;
+		
+		hda_perf->presents_deferred++;
+		
+		if(!pend_armed)
+		{
+			pend_armed = TRUE;
+			SVGA_present_timer(present_period - elapsed);
+		}
+		
+		return TRUE;
+	}
+	
+	present_last = now;
+	
+	return FALSE;
+}
+
+/**
+ * Called by timer (in global event). When the surface is locked, the
+ * collected damage is merged by next FBHDA_access_end, but timer has to
+ * run again in case when that access will be empty.
+ **/
+void SVGA_present_timeout()
+{
+	BOOL move = FALSE;
+	
+	Wait_Semaphore(hda_sem, 0);
+	
+	pend_armed = FALSE;
+	
+	if(hda->overlay > 0)
+	{
+		/*
+		 * Damage is dropped on purpose: overlay covers the screen and
+		 * FBHDA_overlay_setup(0) presents whole framebuffer when overlay
+		 * ends, so nothing collected here can be lost.
+		 */
+		pend_left   = 0;
+		pend_top    = 0;
+		pend_right  = 0;
+		pend_bottom = 0;
+		move_pending = FALSE;
+	}
+	else if(!pend_empty())
+	{
+		if(fb_lock_cnt == 0)
+		{
+			present_pending();
+		}
+		else
+		{
+			pend_armed = TRUE;
+			SVGA_present_timer(present_period);
+		}
+	}
+	
+	if(move_pending)
+	{
+		if(fb_lock_cnt == 0)
+		{
+			move = TRUE;
+		}
+		else if(!pend_armed)
+		{
+			pend_armed = TRUE;
+			SVGA_present_timer(MOVE_RETRY_MS);
+		}
+	}
+	
+	Signal_Semaphore(hda_sem);
+	
+	if(move)
+	{
+		SVGA_mouse_sw_move();
+	}
+}
+
+/**
+ * Drop collected damage and damage of current access. Used by mode set,
+ * screen is already cleared and system surface is cleared or waits for
+ * lazy clear, so the old content must not be presented by next
+ * FBHDA_access_end.
+ **/
+void SVGA_present_cancel()
+{
+	Wait_Semaphore(hda_sem, 0);
+	
+	rect_left   = 0;
+	rect_top    = 0;
+	rect_right  = 0;
+	rect_bottom = 0;
+	
+	pend_left   = 0;
+	pend_top    = 0;
+	pend_right  = 0;
+	pend_bottom = 0;
+	
+	Signal_Semaphore(hda_sem);
+}
+
+void FBHDA_access_end(DWORD flags)
+{
+	DWORD hist_tsc[2] = {0, 0};
+	//dbg_printf("+++ FBHDA_access_end: %ld\n", fb_lock_cnt);
+	
+	if(hda->overlay > 0)
+	{
+		return;
+	}
+	
+	HIST_BEGIN(hist_tsc);
+
+	if(capture_active && (flags & FBHDA_ACCESS_MOUSE_MOVE) == 0)
+	{
+		SVGA_capture_event(SVGA_CAPTURE_ACCESS_END, flags, 0, 0, 0);
+	}
+
+	Wait_Semaphore(hda_sem, 0);
+
+	if(flags & FBHDA_ACCESS_SURFACE_DIRTY)
+	{
+		surface_dirty = TRUE;
+	}
+
+	if(--fb_lock_cnt <= 0)
+	{
+		DWORD w, h;
+		DWORD l, t, r, b;
+		
+		fb_lock_cnt = 0;
+		
+		/* cursor could be moved during lock */
+		mouse_move_apply();
+		move_pending = FALSE;
+		if(mouse_get_rect(&l, &t, &r, &b))
+		{
+			surface_clear_rect(t, b);
+			update_rect(l, t, r, b);
+		}
+		
+		w = rect_right - rect_left;
+		h = rect_bottom - rect_top;
+		
+/*		dbg_printf("FBHDA_access_end(%ld %ld %ld %ld)\n", 
+			rect_left, rect_top, rect_right, rect_bottom);*/
+
+		if(w > 0 && h > 0)
+		{
+			present_merge();
+			check_dirty();
+			mouse_blit();
+			
+			if(!present_defer(flags))
+			{
+				wait_for_cmdbuf();
+				SVGA_present_rect(cmdbuf, SVGA_CB_UPDATE);
+			}
+		}
+		else
+		{
+			mouse_blit(); /* in this case is mouse unvisible, but we need still switch visibility state */
+		} // w == 0 && h == 0
+	} // fb_lock_cnt == 0
+	
+	SVGA_TRACE(SVGA_TRACE_ACCESS_END, flags, 0, 0);
+	HIST_END(SVGA_HIST_ACCESS_END, hist_tsc);
+	
+	Signal_Semaphore(hda_sem);
+}
+
+/**
+ * Append present of one cursor rect to cursor_cmdbuf.
+ **/
+static void mouse_move_rect(DWORD l, DWORD t, DWORD r, DWORD b, DWORD *pcmd_offset)
+{
+	rect_left   = 0;
+	rect_top    = 0;
+	rect_right  = 0;
+	rect_bottom = 0;
+	
+	update_rect(l, t, r, b);
+	
+	if(rect_left < rect_right && rect_top < rect_bottom)
+	{
+		present_rect_cmd(cursor_cmdbuf, pcmd_offset);
+	}
+}
+
+/**
+ * Software cursor move (called from mouse_move).
+ * Redraw only old and new cursor rectangle and don't wait to previous
+ * screen update. When the surface is locked or previous cursor update is
+ * still in progress, move is only recorded and drawn by next
+ * FBHDA_access_end, next move or by present timer when desktop is idle.
+ **/
+void SVGA_mouse_sw_move()
+{
+	DWORD l, t, r, b;
+	DWORD nl, nt, nr, nb;
+	DWORD cmd_offset = 0;
+	BOOL old_valid;
+	
+	if(hda->overlay > 0 || cursor_cmdbuf == NULL)
+	{
+		return;
+	}
+	
+	Wait_Semaphore(hda_sem, 0);
+	
+	if(fb_lock_cnt == 0 && !cursor_update_busy())
+	{
+		move_pending = FALSE;
+		
+		if(surface_dirty || surface_clear_cnt > 0)
+		{
+			/* readback or clear is required, go slow way */
+			Signal_Semaphore(hda_sem);
+			FBHDA_access_begin(FBHDA_ACCESS_MOUSE_MOVE);
+			FBHDA_access_end(FBHDA_ACCESS_MOUSE_MOVE);
+			return;
+		}
+		
+		old_valid = mouse_get_rect(&l, &t, &r, &b);
+		
+		mouse_move_redraw();
+		
+		/*
+		 * Old and new position as two commands, not area between them.
+		 * Overlapping rects (small move) are presented as one.
+		 */
+		if(mouse_get_rect(&nl, &nt, &nr, &nb))
+		{
+			if(old_valid && nl < r && l < nr && nt < b && t < nb)
+			{
+				if(nl < l) l = nl;
+				if(nt < t) t = nt;
+				if(nr > r) r = nr;
+				if(nb > b) b = nb;
+			}
+			else
+			{
+				mouse_move_rect(nl, nt, nr, nb, &cmd_offset);
+			}
+		}
+		
+		if(old_valid)
+		{
+			mouse_move_rect(l, t, r, b, &cmd_offset);
+		}
+		
+		cursor_fence = present_submit(cursor_cmdbuf, cmd_offset, SVGA_CB_FORCE_FENCE);
+	}
+	else
+	{
+		move_pending = TRUE;
+		if(!pend_armed)
+		{
+			pend_armed = TRUE;
+			SVGA_present_timer(MOVE_RETRY_MS);
+		}
+	}
+	
+	Signal_Semaphore(hda_sem);
+}
+
+#endif /* __VXD_SVGA_ACCESS_H__INCLUDED__ */
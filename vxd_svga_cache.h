@@ -0,0 +1,249 @@
+#ifndef __VXD_SVGA_CACHE_H__INCLUDED__
+#define __VXD_SVGA_CACHE_H__INCLUDED__
+
+/*
+ * Spare region cache. Freed regions are kept by size class and reused
+ * when region with the same size is requested again. Included only by
+ * vxd_svga_mem.c (and host benchmark in tools/test), the cache depends
+ * only on _PageFree and dbg_printf.
+ */
+
+#define SPARE_REGIONS_LARGE 2
+#define SPARE_REGION_LARGE_SIZE (32*1024*1024)
+
+#define SPARE_REGIONS_MEDIUM 16
+#define SPARE_REGION_MEDIUM_SIZE (1024*1024)
+
+#define SPARE_REGIONS_SMALL 128
+//#define SPARE_REGION_SMALL_SIZE 4096
+
+#define SPARE_REGIONS_CNT (SPARE_REGIONS_LARGE+SPARE_REGIONS_MEDIUM+SPARE_REGIONS_SMALL)
+
+#define CACHE_THRESHOLD 128
+
+typedef struct spare_region
+{
+	BOOL      used;
+	uint32    missed;
+	SVGA_region_info_t region;
+} spare_region_t;
+
+typedef struct svga_cache_state
+{
+	int free_index_min;
+	int free_index_max;
+	int cnt_large;
+	int cnt_medium;
+	int cnt_small;
+	spare_region_t spare_region[SPARE_REGIONS_CNT];
+} svga_cache_state_t;
+
+static svga_cache_state_t cache_state = {0, 0};
+
+static BOOL cache_enabled = FALSE;
+/**
+ * Delete item from cache
+ **/
+static void cache_delete(int index)
+{
+	if(cache_state.spare_region[index].used != FALSE)
+	{
+		SVGA_region_info_t *rinfo = &cache_state.spare_region[index].region;
+		BYTE *free_ptr = (BYTE*)rinfo->address;
+		uint32 region_size = rinfo->size;;
+		
+		if(rinfo->region_address != NULL)
+		{
+//			dbg_printf(dbg_pagefree, rinfo->region_address);
+			_PageFree((PVOID)rinfo->region_address, 0);
+		}
+		else
+		{
+			free_ptr -= P_SIZE;
+		}
+			
+		if(rinfo->mob_address != NULL)
+		{
+//			dbg_printf(dbg_pagefree, rinfo->mob_address);
+			_PageFree((PVOID)rinfo->mob_address, 0);
+		}
+		else
+		{
+//			dbg_printf(dbg_pagefree, free_ptr);
+			_PageFree((PVOID)free_ptr, 0);
+		}
+			
+		cache_state.spare_region[index].used = FALSE;
+		
+		if((index+1) == cache_state.free_index_max)
+		{
+			cache_state.free_index_max--;
+		}
+		
+		if(index < cache_state.free_index_min)
+		{
+			cache_state.free_index_min = index;
+		}
+		
+		if(region_size >= SPARE_REGION_LARGE_SIZE)
+			cache_state.cnt_large--;
+		else if(region_size >= SPARE_REGION_MEDIUM_SIZE)
+			cache_state.cnt_medium--;
+		else
+			cache_state.cnt_small--;
+	}
+}
+
+/**
+ * Insert region to cache
+ **/
+static BOOL cache_insert(SVGA_region_info_t *region)
+{
+	int i;
+	BOOL rc = FALSE;
+	
+	if(!cache_enabled)
+	{
+		return FALSE;
+	}
+	
+	if(region->size >= SPARE_REGION_LARGE_SIZE)
+	{
+		if(cache_state.cnt_large > SPARE_REGIONS_LARGE) return FALSE;
+	}
+	else if(region->size >= SPARE_REGION_MEDIUM_SIZE)
+	{
+		if(cache_state.cnt_medium > SPARE_REGIONS_MEDIUM) return FALSE;
+	}
+	else
+	{
+		if(cache_state.cnt_small > SPARE_REGIONS_SMALL) return FALSE;
+	}
+	
+	for(i = cache_state.free_index_min; i < SPARE_REGIONS_CNT; i++)
+	{		
+		if(!cache_state.spare_region[i].used)
+		{
+			memcpy(&cache_state.spare_region[i].region, region, sizeof(SVGA_region_info_t));
+			cache_state.spare_region[i].used = TRUE;
+			cache_state.spare_region[i].missed = 0;
+			rc = TRUE;
+			break;
+		}
+	}
+	
+	for(; i < SPARE_REGIONS_CNT; i++)
+	{
+		if(!cache_state.spare_region[i].used)
+		{
+			cache_state.free_index_min = i;
+			break;
+		}
+	}
+	
+	if(i == SPARE_REGIONS_CNT)
+	{
+		cache_state.free_index_min = i;
+		cache_state.free_index_max = SPARE_REGIONS_CNT;
+	}
+	else if(i >= cache_state.free_index_max)
+	{
+		cache_state.free_index_max = i+1;
+	}
+
+	if(rc)
+	{
+		if(region->size >= SPARE_REGION_LARGE_SIZE)
+			cache_state.cnt_large++;
+		else if(region->size >= SPARE_REGION_MEDIUM_SIZE)
+			cache_state.cnt_medium++;
+		else
+			cache_state.cnt_small++;
+
+//		dbg_printf(dbg_cache_insert, region->region_id, region->size);
+	}
+
+	return rc;
+}
+
+/**
+ * Use region from cache
+ **/
+static BOOL cache_use(SVGA_region_info_t *region)
+{
+	int i;
+	BOOL rc = FALSE;
+	
+	if(!cache_enabled)
+	{
+		return FALSE;
+	}
+	
+//	dbg_printf(dbg_cache_search, region->size);
+	
+	for(i = cache_state.free_index_max-1; i >= 0; i--)
+	{
+		if(cache_state.spare_region[i].used != FALSE)
+		{
+			if(cache_state.spare_region[i].region.size == region->size)
+			{
+				SVGA_region_info_t *ptr = &cache_state.spare_region[i].region;
+				
+				region->address        = ptr->address;
+				region->region_address = ptr->region_address;
+				region->region_ppn     = ptr->region_ppn;
+				region->mob_address    = ptr->mob_address;
+				region->mob_ppn        = ptr->mob_ppn;
+				region->mob_pt_depth   = ptr->mob_pt_depth;
+				
+				cache_state.spare_region[i].used = FALSE;
+				rc = TRUE;
+				break;
+			}
+			else
+			{
+				if(++cache_state.spare_region[i].missed >= CACHE_THRESHOLD)
+				{
+//					dbg_printf(dbg_cache_delete, cache_state.spare_region[i].region.size);
+					cache_delete(i);
+				}
+			}
+		}
+	}
+	
+	if(rc)
+	{
+		if((i+1) == cache_state.free_index_max)
+		{
+			cache_state.free_index_max--;
+		}
+		
+		if(i < cache_state.free_index_min)
+		{
+			cache_state.free_index_min = i;
+		}
+		
+		if(region->size >= SPARE_REGION_LARGE_SIZE)
+			cache_state.cnt_large--;
+		else if(region->size >= SPARE_REGION_MEDIUM_SIZE)
+			cache_state.cnt_medium--;
+		else
+			cache_state.cnt_small--;
+	
+		dbg_printf(dbg_cache_used, region->region_id, region->size);
+	}
+		
+	return rc;
+}
+
+void cache_init()
+{
+	memset(&cache_state, 0, sizeof(svga_cache_state_t));
+}
+
+void cache_enable(BOOL enabled)
+{
+	cache_enabled = enabled;
+}
+
+#endif /* __VXD_SVGA_CACHE_H__INCLUDED__ */
@@ -0,0 +1,275 @@
+/*****************************************************************************
+
+Copyright (c) 2024 Jaroslav Hensl <emulator@emulace.cz>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*****************************************************************************/
+
+/* 32 bit RING-0 code for SVGA-II command stream capture */
+#define SVGA
+
+#include "winhack.h"
+#include "vmm.h"
+#include "vxd.h"
+#include "vxd_lib.h"
+
+#include "svga_all.h"
+#include "3d_accel.h"
+#include "code32.h"
+#include "vxd_svga.h"
+#include "vxd_strings.h"
+
+/*
+ * consts
+ */
+#define CAPTURE_MIN_KB 64
+
+/*
+ * globals
+ */
+extern FBHDA_t *hda;
+
+BOOL capture_active = FALSE;
+
+/*
+ * locals
+ */
+static SVGA_capture_t *capture = NULL;
+static BYTE *capture_ring = NULL;
+
+/**
+ * Allocate capture log, size_kb = 0 means capture is not available
+ **/
+void SVGA_capture_alloc(DWORD size_kb)
+{
+	DWORD size;
+
+	if(size_kb == 0)
+	{
+		return;
+	}
+
+	if(size_kb < CAPTURE_MIN_KB)
+	{
+		size_kb = CAPTURE_MIN_KB;
+	}
+
+	size = size_kb * 1024;
+
+	capture = (SVGA_capture_t*)_PageAllocate(RoundToPages(size + sizeof(SVGA_capture_t)), PG_VM, ThisVM, 0, 0x0, 0x100000, NULL, PAGEFIXED);
+	if(capture)
+	{
+		memset(capture, 0, sizeof(SVGA_capture_t));
+		capture->ring_size = size;
+		capture_ring = (BYTE*)(capture+1);
+	}
+
+	dbg_printf("SVGA capture alloc: %ld kB\n", size_kb);
+}
+
+SVGA_capture_t *SVGA_capture_setup()
+{
+	return capture;
+}
+
+/**
+ * Start (log is cleared) or stop capture.
+ * Return FALSE when capture isn't configured.
+ **/
+BOOL SVGA_capture_enable(BOOL enable)
+{
+	if(capture == NULL)
+	{
+		return FALSE;
+	}
+
+	if(enable)
+	{
+		capture_active = FALSE;
+
+		capture->head = 0;
+		capture->tail = 0;
+		capture->used = 0;
+		capture->seq  = 0;
+		capture->lost = 0;
+
+		capture->enabled = 1;
+		capture_active = TRUE;
+		
+		/* initial state for GDI replay */
+		SVGA_capture_event(SVGA_CAPTURE_MODE, hda->width, hda->height, hda->bpp, hda->system_surface);
+	}
+	else
+	{
+		capture_active = FALSE;
+		capture->enabled = 0;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Remove oldest record (or wrap padding) from ring
+ **/
+static void capture_drop_oldest()
+{
+	SVGA_capture_rec_t *rec = (SVGA_capture_rec_t*)(capture_ring + capture->tail);
+	DWORD len;
+
+	if(capture->ring_size - capture->tail < sizeof(SVGA_capture_rec_t) ||
+		rec->type == SVGA_CAPTURE_WRAP)
+	{
+		len = capture->ring_size - capture->tail;
+		capture->tail = 0;
+	}
+	else
+	{
+		len = sizeof(SVGA_capture_rec_t) + SVGA_CAPTURE_ALIGN(rec->size);
+		capture->tail += len;
+		if(capture->tail == capture->ring_size)
+		{
+			capture->tail = 0;
+		}
+		capture->lost++;
+	}
+
+	capture->used -= len;
+}
+
+/**
+ * Reserve space for new record in ring and fill header.
+ *
+ * There is no blocking call between reserve and end of payload copy, so
+ * other RING-0 caller cannot interleave here.
+ **/
+static SVGA_capture_rec_t *capture_rec(DWORD type, DWORD payload)
+{
+	SVGA_capture_rec_t *rec;
+	DWORD len = sizeof(SVGA_capture_rec_t) + SVGA_CAPTURE_ALIGN(payload);
+	DWORD pad = 0;
+
+	if(capture->head + len > capture->ring_size)
+	{
+		pad = capture->ring_size - capture->head;
+	}
+
+	while(capture->used + pad + len > capture->ring_size)
+	{
+		capture_drop_oldest();
+	}
+
+	if(pad)
+	{
+		if(pad >= sizeof(SVGA_capture_rec_t))
+		{
+			rec = (SVGA_capture_rec_t*)(capture_ring + capture->head);
+			rec->type = SVGA_CAPTURE_WRAP;
+			rec->size = 0;
+		}
+		capture->head = 0;
+		capture->used += pad;
+	}
+
+	rec = (SVGA_capture_rec_t*)(capture_ring + capture->head);
+	rec->type = type;
+	rec->size = payload;
+	rec->seq  = capture->seq++;
+	rec->time = Get_System_Time();
+
+	capture->head += len;
+	if(capture->head == capture->ring_size)
+	{
+		capture->head = 0;
+	}
+	capture->used += len;
+
+	return rec;
+}
+
+/**
+ * Record submitted command buffer, called from SVGA_CMB_submit before
+ * fence is appended.
+ **/
+void SVGA_capture_cmb(DWORD *cmb, DWORD cmb_size, DWORD flags, DWORD dx)
+{
+	SVGA_capture_rec_t *rec;
+	DWORD payload = cmb_size;
+
+	if(!capture_active)
+	{
+		return;
+	}
+
+	/* too big buffer, keep only header */
+	if(payload > capture->ring_size/2 - sizeof(SVGA_capture_rec_t))
+	{
+		payload = 0;
+	}
+
+	rec = capture_rec(SVGA_CAPTURE_SUBMIT, payload);
+	rec->arg[0] = flags;
+	rec->arg[1] = dx;
+	rec->arg[2] = cmb_size;
+	rec->arg[3] = (cmb == (DWORD*)cmdbuf) ? SVGA_CAPTURE_SRC_DRIVER : SVGA_CAPTURE_SRC_OTHER;
+
+	if(payload)
+	{
+		memcpy(rec+1, cmb, payload);
+	}
+}
+
+/**
+ * Record region create/free (SVGA_CAPTURE_REGION_*)
+ **/
+void SVGA_capture_region(DWORD type, SVGA_region_info_t *rinfo)
+{
+	SVGA_capture_rec_t *rec;
+
+	if(!capture_active)
+	{
+		return;
+	}
+
+	rec = capture_rec(type, 0);
+	rec->arg[0] = rinfo->region_id;
+	rec->arg[1] = rinfo->size;
+	rec->arg[2] = rinfo->is_mob;
+	rec->arg[3] = rinfo->mobonly;
+}
+
+/**
+ * Record access protocol, cursor or mode event (SVGA_CAPTURE_ACCESS_*,
+ * SVGA_CAPTURE_CURSOR_MOVE, SVGA_CAPTURE_MODE)
+ **/
+void SVGA_capture_event(DWORD type, DWORD a0, DWORD a1, DWORD a2, DWORD a3)
+{
+	SVGA_capture_rec_t *rec;
+
+	if(!capture_active)
+	{
+		return;
+	}
+
+	rec = capture_rec(type, 0);
+	rec->arg[0] = a0;
+	rec->arg[1] = a1;
+	rec->arg[2] = a2;
+	rec->arg[3] = a3;
+}
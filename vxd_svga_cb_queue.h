@@ -0,0 +1,1255 @@
+#ifndef __VXD_SVGA_CB_QUEUE_H__INCLUDED__
+#define __VXD_SVGA_CB_QUEUE_H__INCLUDED__
+
+/*
+ * Command buffer queue: list of CBs submitted to every context, ordering
+ * of present/render/update (across contexts too), FIFO submit fallback and
+ * recovery of context after error in CB.
+ *
+ * Included only by vxd_svga_cb.c (which provides cb_next_id and
+ * SVGA_cb_id_inc), code is shared with submission tests
+ * (tools/test/svgatest.c) which run it on software SVGA-II model.
+ */
+
+/*
+ * types
+ */
+
+#define CBQ_PRESENT 0x01
+#define CBQ_RENDER  0x02
+#define CBQ_UPDATE  0x04
+#define CBQ_DIRTY   0x08
+
+/* context 0: everything, context 1: driver 2D (SVGA_CB_2D) */
+#define CB_CONTEXTS 2
+
+#pragma pack(push)
+#pragma pack(1)
+typedef struct _cb_enable_t
+{
+	uint32             cmd;
+	SVGADCCmdStartStop cbstart;
+} cb_enable_t;
+
+typedef struct _cb_preempt_t
+{
+	uint32             cmd;
+	SVGADCCmdPreempt   preempt;
+} cb_preempt_t;
+
+typedef struct _cb_queue_t
+{
+	struct _cb_queue_t *next;
+	DWORD  flags;
+	DWORD  data_size;
+	DWORD  ctx;
+	DWORD  pad[(64 - sizeof(void*) - 3*sizeof(DWORD))/sizeof(DWORD)]; /* SVGACBHeader after it have to be 64 B aligned */
+} cb_queue_t;
+
+#pragma pack(pop)
+
+typedef struct _cb_queue_info_t
+{
+	cb_queue_t *first;
+	cb_queue_t *last;
+	DWORD items;
+} cb_queue_info_t;
+
+BOOL CB_queue_check(SVGACBHeader *tracked);
+inline BOOL CB_queue_check_inline(SVGACBHeader *tracked);
+
+/*
+ * Locals
+ **/
+static cb_queue_info_t cb_queue_info[CB_CONTEXTS] = {{NULL, NULL, 0}, {NULL, NULL, 0}};
+
+/* copy of unprocessed part of failed CB */
+static DWORD *cb_recover_buf = NULL;
+
+/* failed CB found by CB_queue_tidy, context is recovered under cb_sem */
+static SVGACBHeader *cb_failed[CB_CONTEXTS] = {NULL, NULL};
+
+static BOOL CB_queue_recover(DWORD ctx, SVGACBHeader *failed);
+static BOOL CB_queue_recover_failed();
+static BOOL CB_queue_recover_pending();
+static void CB_queue_failed_check(SVGACBHeader *cb);
+static void CB_queue_wait_sync(SVGACBHeader *cb);
+static void SVGA_CB_ctx_restart(DWORD ctx);
+
+/*
+ * Macros
+ */
+#define WAIT_FOR_CB(_cb, _forcesync) \
+	do{ \
+		if(cb->status == SVGA_CB_STATUS_NONE){ \
+			while(!CB_queue_check_inline(_cb)){ \
+				CB_queue_recover_pending(); \
+				WAIT_FOR_CB_SYNC_ ## _forcesync \
+		} } \
+	}while(0)
+
+/* expansions of WAIT_FOR_CB */
+#define WAIT_FOR_CB_SYNC_0
+#define WAIT_FOR_CB_SYNC_1 SVGA_Sync();
+
+#define WAIT_FOR_CB_FINAL(_cb) \
+	do{ \
+			while(!CB_queue_check_inline(_cb)){ \
+				CB_queue_recover_pending(); \
+				SVGA_Sync(); \
+		} \
+	}while(0)
+
+/* wait for all commands */
+void SVGA_Flush_CB()
+{
+	/* wait for actual CB (and for rest of failed one) */
+	do
+	{
+		while(!CB_queue_check(NULL))
+		{
+			CB_queue_recover_pending();
+			SVGA_Sync();
+		}
+	} while(CB_queue_recover_pending());
+	
+	/* drain FIFO */
+	SVGA_Flush();
+}
+
+/*
+ * Remove completed CBs from context queue, failed CB is only recorded
+ * to cb_failed, context is recovered by CB_queue_recover_failed.
+ *
+ * @return: TRUE if tracked is still in queue
+ */
+static inline BOOL CB_queue_tidy(DWORD ctx, SVGACBHeader *tracked)
+{
+	cb_queue_info_t *qi = &cb_queue_info[ctx];
+	cb_queue_t *last = NULL;
+	cb_queue_t *item = qi->first;
+	BOOL in_queue = FALSE;
+	SVGACBHeader *failed = NULL;
+	
+	while(item != NULL)
+	{
+		SVGACBHeader *cb = (SVGACBHeader*)(item+1);
+		if(cb->status >= SVGA_CB_STATUS_COMPLETED)
+		{
+			SVGA_TRACE(SVGA_TRACE_CB_RETIRE, ctx, cb->status, cb->id.low);
+			
+			if(last == NULL)
+			{
+				qi->first = item->next;
+			}
+			else
+			{
+				last->next = item->next;
+			}
+			
+			if(cb->status > SVGA_CB_STATUS_COMPLETED)
+			{
+				DWORD *cmd_ptr = (DWORD*)(cb+1);
+				dbg_printf("Error (%ld): offset %ld, error command: %ld\n", cb->status, cb->errorOffset, cmd_ptr[cb->errorOffset/4]);
+				if(cmd_ptr[cb->errorOffset/4] == SVGA_CMD_UPDATE)
+				{
+					if(cmd_ptr[0] == SVGA_3D_CMD_SURFACE_DMA)
+					{
+						dbg_printf("VMware update bug detected!\n");
+						hda->flags |= FB_BUG_VMWARE_UPDATE;
+					}
+				}
+				
+				if(failed == NULL)
+				{
+					failed = cb;
+				}
+			}
+			
+			//dbg_printf(dbg_trace_remove, item);
+			
+			item = item->next;
+			qi->items--;
+		}
+		else
+		{
+			if(tracked == cb)
+			{
+				in_queue = TRUE;
+			}
+			last = item;
+			item = item->next;
+		}
+	}
+	
+	if(last)
+	{
+		qi->last = last;
+		last->next = NULL;
+	}
+	else
+	{
+		qi->first = NULL;
+		qi->last  = NULL;
+	}
+	
+	if(failed != NULL && cb_failed[ctx] == NULL)
+	{
+		cb_failed[ctx] = failed;
+	}
+	
+	return in_queue;
+}
+
+/*
+ * @param tracked: check specific CB, or NULL to check full queue
+ *
+ * @return: TRUE if tracked is complete or TRUE id queue is empty
+ 
+ */
+inline BOOL CB_queue_check_inline(SVGACBHeader *tracked)
+{
+	DWORD ctx;
+	BOOL in_queue = FALSE;
+	BOOL empty = TRUE;
+	
+	for(ctx = 0; ctx < CB_CONTEXTS; ctx++)
+	{
+		if(CB_queue_tidy(ctx, tracked))
+		{
+			in_queue = TRUE;
+		}
+		
+		if(cb_queue_info[ctx].first != NULL)
+		{
+			empty = FALSE;
+		}
+	}
+	
+	if(empty)
+	{
+		return TRUE;
+	}
+	
+	if(tracked != NULL && in_queue == FALSE)
+	{
+		return TRUE;
+	}
+	
+	return FALSE;	
+}
+
+BOOL CB_queue_check(SVGACBHeader *tracked)
+{
+//	dbg_printf(dbg_queue_check);
+	return CB_queue_check_inline(tracked);
+}
+
+static BOOL CB_queue_is_queued(SVGACBHeader *check)
+{
+	cb_queue_t *test = (cb_queue_t*)(check-1);
+	cb_queue_t *item;
+	DWORD ctx;
+	
+	for(ctx = 0; ctx < CB_CONTEXTS; ctx++)
+	{
+		for(item = cb_queue_info[ctx].first; item != NULL; item = item->next)
+		{
+			if(item == test)
+			{
+				return TRUE;
+			}
+		}
+	}
+	
+	return FALSE;
+}
+
+static BOOL CB_queue_item_valid(SVGACBHeader *check)
+{
+	return !CB_queue_is_queued(check);
+}
+
+void CB_queue_valid(SVGACBHeader *check, char *msg)
+{
+	if(!CB_queue_item_valid(check))
+	{
+		dbg_printf(dbg_cb_valid_err, msg, check, ((SVGACBHeader *)cmdbuf)-1);
+		dbg_printf(dbg_cb_valid_status, check->status);
+	}
+}
+
+static BOOL CB_queue_is_flags_set(DWORD ctx, DWORD flags)
+{
+	cb_queue_t *item = cb_queue_info[ctx].first;
+	
+	if(flags == 0) return FALSE;
+	
+	while(item != NULL)
+	{
+		if((item->flags & flags) != 0)
+		{
+			return TRUE;
+		}
+		
+		item = item->next;
+	}
+	
+	return FALSE;
+}
+
+void CB_queue_insert(DWORD ctx, SVGACBHeader *cb, DWORD flags)
+{
+	cb_queue_info_t *qi = &cb_queue_info[ctx];
+	cb_queue_t *item = (cb_queue_t*)(cb-1);
+	item->next = NULL;
+	item->flags = flags;
+	item->data_size = cb->length;
+	item->ctx = ctx;
+
+	//dbg_printf(dbg_trace_insert, item);
+
+	if(qi->last != NULL)
+	{
+		qi->last->next = item;
+		qi->last = item;
+		qi->items++;
+	}
+	else
+	{
+		qi->first = item;
+		qi->last  = item;
+		qi->items = 1;
+	}
+}
+
+void CB_queue_erase(DWORD ctx)
+{
+	cb_queue_t *item = cb_queue_info[ctx].first;
+	while(item != NULL)
+	{
+		SVGACBHeader *cb = (SVGACBHeader*)(item+1);
+		
+		cb->status = SVGA_CB_STATUS_QUEUE_FULL;
+		
+		item = item->next;
+	}
+	
+	cb_queue_info[ctx].first = NULL;
+	cb_queue_info[ctx].last  = NULL;
+	cb_queue_info[ctx].items = 0;
+}
+
+static DWORD flags_to_cbq(DWORD cb_flags)
+{
+	DWORD r = 0;
+	
+	if((cb_flags & SVGA_CB_PRESENT) != 0)
+	{
+		r |= CBQ_PRESENT;
+	}
+	
+	if((cb_flags & SVGA_CB_RENDER) != 0)
+	{
+		r |= CBQ_RENDER;
+	}
+	
+	if((cb_flags & SVGA_CB_UPDATE) != 0)
+	{
+		r |= CBQ_UPDATE;
+	}
+	
+	if((cb_flags & SVGA_CB_DIRTY_SURFACE) != 0)
+	{
+		r |= CBQ_DIRTY;
+	}
+	
+	return r;
+}
+
+/**
+ * Cross context ordering: 2D commands have to wait to 3D commands which
+ * presents or modify system surface, 3D present or surface modification
+ * have to wait to all 2D commands.
+ **/
+static BOOL CB_queue_other_busy(DWORD ctx, DWORD cb_flags)
+{
+	if(ctx == 1)
+	{
+		return CB_queue_is_flags_set(0, CBQ_PRESENT | CBQ_DIRTY);
+	}
+	
+	if((cb_flags & (SVGA_CB_PRESENT | SVGA_CB_DIRTY_SURFACE)) != 0)
+	{
+		return cb_queue_info[1].first != NULL;
+	}
+	
+	return FALSE;
+}
+
+static DWORD flags_to_cbq_check(DWORD cb_flags)
+{
+	DWORD r = 0;
+
+	if((cb_flags & SVGA_CB_PRESENT) != 0)
+	{
+		r |= CBQ_PRESENT | CBQ_RENDER;
+	}
+	
+	if((cb_flags & SVGA_CB_RENDER) != 0)
+	{
+		r |= CBQ_RENDER | CBQ_UPDATE;
+	}
+	
+	if((cb_flags & SVGA_CB_UPDATE) != 0)
+	{
+		r |= CBQ_RENDER | CBQ_UPDATE;
+	}
+	
+	return r;
+}
+
+static uint32 fence_present = 0;
+static uint32 fence_render  = 0;
+static uint32 fence_update  = 0;
+
+static void flags_fence_check(DWORD cb_flags)
+{
+	DWORD to_check = flags_to_cbq_check(cb_flags);
+	
+	if((to_check & CBQ_PRESENT) != 0)
+	{
+		if(fence_present)
+		{
+			SVGA_fence_wait(fence_present);
+			fence_present = 0;
+		}
+	}
+	
+	if((to_check & CBQ_RENDER) != 0)
+	{
+		if(fence_render)
+		{
+			SVGA_fence_wait(fence_render);
+			fence_render = 0;
+		}
+	}
+	
+	if((to_check & CBQ_UPDATE) != 0)
+	{
+		if(fence_update)
+		{
+			SVGA_fence_wait(fence_update);
+			fence_update = 0;
+		}
+	}
+}
+
+static void flags_fence_insert(DWORD cb_flags, uint32 fence)
+{
+	if((cb_flags & SVGA_CB_PRESENT) != 0)
+	{
+		fence_present = fence;
+	}
+	
+	if((cb_flags & SVGA_CB_RENDER) != 0)
+	{
+		fence_render = fence;
+	}
+	
+	if((cb_flags & SVGA_CB_UPDATE) != 0)
+	{
+		fence_update = fence;
+	}
+}
+
+/**
+ * Pass CB header to device
+ **/
+static void CB_hw_submit(SVGACBHeader *cb, DWORD cbhwctxid)
+{
+	SVGA_WriteReg(SVGA_REG_COMMAND_HIGH, 0); // high part of 64-bit memory address...
+	SVGA_WriteReg(SVGA_REG_COMMAND_LOW, (cb->ptr.pa.low - sizeof(SVGACBHeader)) | cbhwctxid);
+	SVGA_Sync(); /* notify HV to read registers (VMware needs it) */
+}
+
+#define flags_fifo_fence_need(_flags) (((_flags) & (SVGA_CB_SYNC | SVGA_CB_FORCE_FENCE | SVGA_CB_PRESENT | SVGA_CB_RENDER | SVGA_CB_UPDATE)) != 0)
+#define flags_cb_fence_need(_flags) (((_flags) & (SVGA_CB_FORCE_FENCE)) != 0)
+
+void SVGA_CMB_submit(DWORD FBPTR cmb, DWORD cmb_size, SVGA_CMB_status_t FBPTR status, DWORD flags, DWORD DXCtxId)
+{
+	DWORD fence = 0;
+	SVGACBHeader *cb = ((SVGACBHeader *)cmb)-1;
+	BOOL proc_by_cb = cb_support && cb_context0 && (flags & SVGA_CB_FORCE_FIFO) == 0;
+	DWORD ctx = (cb_context1 && (flags & SVGA_CB_2D) != 0) ? 1 : 0;
+	DWORD hist_tsc[2] = {0, 0};
+	
+	HIST_BEGIN(hist_tsc);
+	
+	Wait_Semaphore(cb_sem, 0);
+	
+	if(capture_active)
+	{
+		SVGA_capture_cmb(cmb, cmb_size, flags, DXCtxId);
+	}
+	
+	if(stats_active)
+	{
+		DWORD process = 0;
+		
+		/* user buffers come only from OP_SVGA_CMB_SUBMIT: with status and without SVGA_CB_2D */
+		if(status != NULL && (flags & SVGA_CB_2D) == 0)
+		{
+			process = VWIN32_GetCurrentProcessHandle();
+			if(process == 0)
+			{
+				process = SVGA_STATS_PID_UNKNOWN;
+			}
+		}
+		
+		SVGA_stats_cmb(cmb, cmb_size, flags, DXCtxId, process);
+	}
+	
+	SVGA_TRACE(SVGA_TRACE_SUBMIT_BEGIN, cmb_size, flags, DXCtxId);
+	
+	hda_perf->cmd_submits++;
+	FBHDA_PERF_ADD64(hda_perf->cmd_bytes, cmb_size);
+	if(proc_by_cb)
+	{
+		hda_perf->cb_submits++;
+	}
+	else
+	{
+		hda_perf->fifo_submits++;
+	}
+	
+	/* wait and tidy CB queue */
+	if(proc_by_cb)
+	{
+		DWORD cbq_check = flags_to_cbq_check(flags);
+		do
+		{
+			CB_queue_check_inline(NULL);
+			CB_queue_recover_failed();
+		} while(CB_queue_is_flags_set(ctx, cbq_check) ||
+			CB_queue_other_busy(ctx, flags) ||
+			cb_queue_info[ctx].items >= (SVGA_CB_MAX_QUEUED_PER_CONTEXT-1));
+	}
+	
+	HIST_END(SVGA_HIST_SUBMIT_QUEUE, hist_tsc);
+	HIST_BEGIN(hist_tsc);
+	
+	if(status)
+	{
+		cb->status = SVGA_CB_STATUS_NONE;
+		status->sStatus = SVGA_PROC_NONE;
+		status->qStatus = (volatile DWORD*)&cb->status;
+	}
+	
+#ifdef DBGPRINT
+//	debug_cmdbuf(cmb, cmb_size);
+//	debug_cmdbuf_trace(cmb, cmb_size, SVGA_3D_CMD_BLIT_SURFACE_TO_SCREEN);
+//		debug_draw(cmb, cmb_size);
+#endif
+	
+	if(flags & SVGA_CB_DIRTY_SURFACE)
+	{
+		surface_dirty = TRUE;
+	}
+
+	if(proc_by_cb)
+	{
+		/***
+		 *
+		 * COMMAND BUFFER procesing
+		 *
+		 ***/
+		DWORD cbhwctxid = (ctx == 1) ? SVGA_CB_CONTEXT_1 : SVGA_CB_CONTEXT_0;
+		
+		if(flags_cb_fence_need(flags))
+		{
+			DWORD dwords = cmb_size/sizeof(DWORD);
+			fence = SVGA_fence_get();
+			cmb[dwords]   = SVGA_CMD_FENCE;
+			cmb[dwords+1] = fence;
+			cmb_size += sizeof(DWORD)*2;
+			SVGA_stats_fence(fence);
+		}
+		
+		if(cmb_size == 0)
+		{
+			cb->status = SVGA_PROC_COMPLETED;
+			if(status)
+			{
+				status->sStatus = SVGA_PROC_COMPLETED;
+				status->qStatus = NULL;
+				status->fifo_fence_used = 0;
+			}
+		}
+		else
+		{
+#ifdef DBGPRINT
+			CB_queue_valid(cb, dbg_err_double_insert);
+#endif
+			
+			cb->status      = SVGA_CB_STATUS_NONE;
+			cb->errorOffset = 0;
+			cb->offset      = 0; /* VMware modified this, needs to be clear */
+			cb->flags       = SVGA_CB_FLAG_NO_IRQ;
+			
+			if(flags & SVGA_CB_FLAG_DX_CONTEXT)
+			{
+				cb->flags |= SVGA_CB_FLAG_DX_CONTEXT;
+				cb->dxContext = DXCtxId;
+			}
+			else
+			{
+				cb->dxContext = 0;
+			}
+			
+			cb->id.low      = cb_next_id.low;
+			cb->id.hi       = cb_next_id.hi;
+			cb->length      = cmb_size;
+			
+			CB_queue_insert(ctx, cb, flags_to_cbq(flags));			
+			
+			CB_hw_submit(cb, cbhwctxid);
+			
+			SVGA_cb_id_inc();	
+			
+			HIST_END(SVGA_HIST_SUBMIT_COPY, hist_tsc);
+
+			if(flags & SVGA_CB_SYNC)
+			{
+				CB_queue_wait_sync(cb);
+
+				if(cb->status != SVGA_CB_STATUS_COMPLETED)
+				{
+					dbg_printf(dbg_cmd_error, cb->status, cmb[0], cb->errorOffset);
+					if(flags & SVGA_CB_FORCE_FENCE)
+					{
+						/* this may cause freeze, when fence is in buffer and isn't complete. So return some passed fence  */
+						fence = SVGA_fence_passed();
+					}
+				}
+				/*else
+				{
+					dbg_printf(dbg_cb_suc);
+				}*/
+				
+				if(status)
+				{
+					status->sStatus = (cb->status == SVGA_CB_STATUS_COMPLETED) ? SVGA_PROC_COMPLETED : SVGA_PROC_ERROR;
+					status->qStatus = NULL;
+					status->fifo_fence_used = fence;
+				}
+			}
+			else
+			{
+				if(status)
+				{
+					status->sStatus = SVGA_PROC_NONE;
+					status->qStatus = (volatile DWORD*)&cb->status;
+					status->fifo_fence_used = fence;
+				}
+			}
+		}
+	}
+	else
+	{
+		/***
+		 *
+		 * FIFO procesing
+		 *
+		 ***/
+		DWORD *ptr = cmb;
+		DWORD dwords = cmb_size/sizeof(DWORD);
+		DWORD nextCmd, max, min;
+		
+		/* insert fence CMD */
+		if(flags_fifo_fence_need(flags))
+		{
+			fence = SVGA_fence_get();
+			ptr[dwords++] = SVGA_CMD_FENCE;
+			ptr[dwords++] = fence;
+			SVGA_stats_fence(fence);
+		}
+		
+		flags_fence_check(flags);
+		
+		if(dwords == 0)
+		{
+			cb->status = SVGA_PROC_COMPLETED;
+			if(status)
+			{
+				status->sStatus = SVGA_PROC_COMPLETED;
+				status->qStatus = NULL;
+				status->fifo_fence_used = 0;
+			}
+		}
+		else
+		{
+			nextCmd = gSVGA.fifoMem[SVGA_FIFO_NEXT_CMD];
+			max     = gSVGA.fifoMem[SVGA_FIFO_MAX];
+			min     = gSVGA.fifoMem[SVGA_FIFO_MIN];
+			
+			/* copy to fifo */
+			while(dwords > 0)
+			{
+				gSVGA.fifoMem[nextCmd/sizeof(DWORD)] = *ptr;
+				ptr++;
+				
+				nextCmd += sizeof(uint32);
+				if (nextCmd >= max)
+				{
+					nextCmd = min;
+				}
+				gSVGA.fifoMem[SVGA_FIFO_NEXT_CMD] = nextCmd;
+				dwords--;
+			}
+			
+			HIST_END(SVGA_HIST_SUBMIT_COPY, hist_tsc);
+			
+			if(flags & SVGA_CB_SYNC)
+			{
+				SVGA_fence_wait(fence);
+				if(status)
+				{
+					status->sStatus = SVGA_PROC_COMPLETED;
+					status->qStatus = NULL;
+					status->fifo_fence_used = 0;
+				}
+			}
+			else
+			{
+				flags_fence_insert(flags, fence);
+				
+				if(status)
+				{
+					status->sStatus = SVGA_PROC_FENCE;
+					status->qStatus = NULL;
+					status->fifo_fence_used = fence;
+				}
+			}
+			
+			cb->status = SVGA_PROC_COMPLETED;
+		} // size > 0
+	} /* FIFO */
+	
+	if(status)
+	{
+		status->fifo_fence_last = SVGA_fence_passed();
+	}
+	
+	SVGA_TRACE(SVGA_TRACE_SUBMIT_END, fence, 0, 0);
+	
+	Signal_Semaphore(cb_sem);
+	//dbg_printf(dbg_cmd_off, cmb[0]);
+}
+
+void wait_for_cmdbuf()
+{
+	SVGACBHeader *cb;
+	
+	cb = ((SVGACBHeader *)cmdbuf)-1;
+	WAIT_FOR_CB(cb, 0);
+	CB_queue_failed_check(cb);
+}
+
+void submit_cmdbuf(DWORD cmdsize, DWORD flags, DWORD dx)
+{
+	SVGA_CMB_submit(cmdbuf, cmdsize, NULL, flags, dx);
+}
+
+static DWORD SVGA_CB_ctr(DWORD data_size)
+{
+	SVGACBHeader *cb = ((SVGACBHeader *)ctlbuf)-1;
+	
+	dbg_printf(dbg_ctr_start);
+
+	cb->status = SVGA_CB_STATUS_NONE;
+	cb->errorOffset = 0;
+	cb->offset = 0; /* VMware modified this, needs to be clear */
+	cb->flags  = SVGA_CB_FLAG_NO_IRQ;
+	cb->mustBeZero[0] = 0;
+	cb->mustBeZero[1] = 0;
+	cb->mustBeZero[2] = 0;
+	cb->mustBeZero[3] = 0;
+	cb->mustBeZero[4] = 0;
+	cb->mustBeZero[5] = 0;
+	cb->dxContext = 0;
+	cb->id.low = cb_next_id.low;
+	cb->id.hi  = cb_next_id.hi;
+	cb->length = data_size;
+
+	SVGA_WriteReg(SVGA_REG_COMMAND_HIGH, 0);
+	SVGA_WriteReg(SVGA_REG_COMMAND_LOW, (cb->ptr.pa.low - sizeof(SVGACBHeader)) | SVGA_CB_CONTEXT_DEVICE);
+	SVGA_Sync();
+	
+	SVGA_cb_id_inc();
+
+	while(cb->status == SVGA_CB_STATUS_NONE)
+	{
+		SVGA_Sync();
+	}
+	
+	return cb->status;
+}
+
+static DWORD SVGA_CB_ctx_enable(DWORD ctx, DWORD enable)
+{
+	cb_enable_t *cbe = ctlbuf;
+	
+	memset(cbe, 0, sizeof(cb_enable_t));
+	cbe->cmd = SVGA_DC_CMD_START_STOP_CONTEXT;
+	cbe->cbstart.enable  = enable;
+	cbe->cbstart.context = (ctx == 1) ? SVGA_CB_CONTEXT_1 : SVGA_CB_CONTEXT_0;
+	
+	return SVGA_CB_ctr(sizeof(cb_enable_t));
+}
+
+/**
+ * GPU10: start context0 (and context1 for 2D)
+ *
+ **/
+void SVGA_CB_start()
+{
+	if(cb_support && cb_context0 == FALSE)
+	{
+		DWORD status = SVGA_CB_ctx_enable(0, 1);
+		
+		dbg_printf(dbg_cb_start_status, status);
+		
+		if(status == SVGA_CB_STATUS_COMPLETED)
+		{
+			cb_context0 = TRUE;
+		}
+		else
+		{
+			cb_support = FALSE;
+		}
+	}
+	
+	if(cb_context0 && cb_context1 == FALSE && cb_2d_context &&
+		(SVGA_ReadRegCached(SVGA_REG_CAPABILITIES) & SVGA_CAP_CMD_BUFFERS_2) != 0)
+	{
+		DWORD status = SVGA_CB_ctx_enable(1, 1);
+		
+		dbg_printf(dbg_cb_start_status, status);
+		
+		if(status == SVGA_CB_STATUS_COMPLETED)
+		{
+			cb_context1 = TRUE;
+		}
+	}
+}
+
+/**
+ * GPU10: stop contexts
+ *
+ **/
+void SVGA_CB_stop()
+{
+	cb_context0 = FALSE;
+	
+	cb_failed[0] = NULL;
+	cb_failed[1] = NULL;
+	
+	if(cb_support)
+	{
+		/* queue is erased even when stop fails, status isn't needed */
+		if(cb_context1)
+		{
+			cb_context1 = FALSE;
+			SVGA_CB_ctx_enable(1, 0);
+			SVGA_Sync();
+			CB_queue_erase(1);
+		}
+		
+		SVGA_CB_ctx_enable(0, 0);
+		
+		SVGA_Sync();
+		
+		CB_queue_erase(0);
+	}
+}
+
+/**
+ * GPU10: preempt all not started CBs on context0
+ *
+ **/
+static DWORD SVGA_CB_preempt(DWORD ctx)
+{
+	cb_preempt_t *cbp = ctlbuf;
+	
+	memset(cbp, 0, sizeof(cb_preempt_t));
+	cbp->cmd = SVGA_DC_CMD_PREEMPT;
+	cbp->preempt.context = (ctx == 1) ? SVGA_CB_CONTEXT_1 : SVGA_CB_CONTEXT_0;
+	cbp->preempt.ignoreIDZero = 0;
+	
+	return SVGA_CB_ctr(sizeof(cb_preempt_t));
+}
+
+/**
+ * Size of command in bytes or 0 if it cannot be determined
+ **/
+DWORD CB_cmd_size(DWORD *cmd, DWORD avail)
+{
+	if(avail < sizeof(DWORD)*2)
+	{
+		return 0;
+	}
+	
+	if(cmd[0] >= SVGA_3D_CMD_LEGACY_BASE && cmd[0] < SVGA_3D_CMD_MAX)
+	{
+		return sizeof(SVGA3dCmdHeader) + cmd[1];
+	}
+	
+	switch(cmd[0])
+	{
+		case SVGA_CMD_UPDATE:
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdUpdate);
+		case SVGA_CMD_RECT_COPY:
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdRectCopy);
+		case SVGA_CMD_UPDATE_VERBOSE:
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdUpdateVerbose);
+		case SVGA_CMD_FRONT_ROP_FILL:
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdFrontRopFill);
+		case SVGA_CMD_FENCE:
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdFence);
+		case SVGA_CMD_ESCAPE:
+			if(avail < sizeof(DWORD) + sizeof(SVGAFifoCmdEscape))
+			{
+				return 0;
+			}
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdEscape) + cmd[2];
+		case SVGA_CMD_DEFINE_SCREEN:
+			return sizeof(DWORD) + cmd[1]; /* screen.structSize */
+		case SVGA_CMD_DESTROY_SCREEN:
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdDestroyScreen);
+		case SVGA_CMD_DEFINE_GMRFB:
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdDefineGMRFB);
+		case SVGA_CMD_BLIT_GMRFB_TO_SCREEN:
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdBlitGMRFBToScreen);
+		case SVGA_CMD_BLIT_SCREEN_TO_GMRFB:
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdBlitScreenToGMRFB);
+		case SVGA_CMD_ANNOTATION_FILL:
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdAnnotationFill);
+		case SVGA_CMD_ANNOTATION_COPY:
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdAnnotationCopy);
+		case SVGA_CMD_DEFINE_GMR2:
+			return sizeof(DWORD) + sizeof(SVGAFifoCmdDefineGMR2);
+	}
+	
+	return 0;
+}
+
+/**
+ * Resubmit CB which was preempted or prepared for recovery.
+ * Return FALSE if device refuse it.
+ **/
+static BOOL CB_resubmit(DWORD ctx, SVGACBHeader *cb, DWORD cbq_flags)
+{
+	cb->status      = SVGA_CB_STATUS_NONE;
+	cb->errorOffset = 0;
+	cb->offset      = 0;
+	
+	CB_queue_insert(ctx, cb, cbq_flags);
+	CB_hw_submit(cb, (ctx == 1) ? SVGA_CB_CONTEXT_1 : SVGA_CB_CONTEXT_0);
+	
+	if(cb->status == SVGA_CB_STATUS_QUEUE_FULL)
+	{
+		return FALSE;
+	}
+	
+	return TRUE;
+}
+
+/**
+ * GPU10: recover context after error in CB without stop/start.
+ *
+ * Failing command is skipped, rest of failed CB is copied to recovery
+ * buffer and resubmitted before all CBs which were preempted. Failed CB
+ * keeps its error status, so owner is informed about fault.
+ *
+ * Return FALSE if full restart is required.
+ **/
+static BOOL CB_queue_recover(DWORD ctx, SVGACBHeader *failed)
+{
+	cb_queue_info_t *qi = &cb_queue_info[ctx];
+	cb_queue_t *item;
+	cb_queue_t *next;
+	SVGACBHeader *cb;
+	SVGACBHeader *rcb;
+	DWORD skip = 0;
+	DWORD cbq_flags = ((cb_queue_t*)(failed-1))->flags;
+	BOOL  refused = FALSE;
+	
+	if(cb_recover_buf == NULL)
+	{
+		return FALSE;
+	}
+	
+	rcb = ((SVGACBHeader *)cb_recover_buf)-1;
+	if(rcb->status == SVGA_CB_STATUS_NONE)
+	{
+		/* recovery buffer is still in queue */
+		return FALSE;
+	}
+	
+	/* take back CBs not started yet */
+	if(SVGA_CB_preempt(ctx) != SVGA_CB_STATUS_COMPLETED)
+	{
+		return FALSE;
+	}
+	
+	/* CB running during preemption will complete */
+	for(item = qi->first; item != NULL; item = item->next)
+	{
+		cb = (SVGACBHeader*)(item+1);
+		while(cb->status == SVGA_CB_STATUS_NONE)
+		{
+			SVGA_Sync();
+		}
+	}
+	
+	/* context is halted after error, start it again before resubmit */
+	if(SVGA_CB_ctx_enable(ctx, 1) != SVGA_CB_STATUS_COMPLETED)
+	{
+		return FALSE;
+	}
+	
+	item = qi->first;
+	qi->first = NULL;
+	qi->last  = NULL;
+	qi->items = 0;
+	
+	/* rest of failed CB */
+	if(failed->status == SVGA_CB_STATUS_COMMAND_ERROR && failed->errorOffset < failed->length)
+	{
+		DWORD *cmd = ((DWORD*)(failed+1)) + failed->errorOffset/4;
+		
+		skip = CB_cmd_size(cmd, failed->length - failed->errorOffset);
+		if(skip > 0 && failed->errorOffset + skip < failed->length)
+		{
+			DWORD len = failed->length - (failed->errorOffset + skip);
+			
+			/* failed can be recovery buffer itself, memcpy copies forward */
+			memcpy(cb_recover_buf, ((BYTE*)(failed+1)) + failed->errorOffset + skip, len);
+			
+			rcb->flags     = failed->flags;
+			rcb->dxContext = failed->dxContext;
+			rcb->id.low    = cb_next_id.low;
+			rcb->id.hi     = cb_next_id.hi;
+			rcb->length    = len;
+			
+			refused = !CB_resubmit(ctx, rcb, cbq_flags);
+			SVGA_cb_id_inc();
+		}
+	}
+	
+	dbg_printf(dbg_cb_recover, failed->status, failed->errorOffset, skip);
+	
+	/* resubmit preempted in original order */
+	for(; item != NULL; item = next)
+	{
+		next = item->next;
+		cb = (SVGACBHeader*)(item+1);
+		
+		if(cb->status == SVGA_CB_STATUS_PREEMPTED)
+		{
+			if(refused)
+			{
+				cb->status = SVGA_CB_STATUS_QUEUE_FULL;
+			}
+			else
+			{
+				refused = !CB_resubmit(ctx, cb, item->flags);
+			}
+		}
+	}
+	
+	return !refused;
+}
+
+/**
+ * Recover all contexts with failed CB, caller holds cb_sem.
+ * Return TRUE if rest of failed CB was resubmitted.
+ **/
+static BOOL CB_queue_recover_failed()
+{
+	SVGACBHeader *rcb;
+	DWORD ctx;
+	BOOL resubmitted = FALSE;
+	
+	for(ctx = 0; ctx < CB_CONTEXTS; ctx++)
+	{
+		SVGACBHeader *failed = cb_failed[ctx];
+		
+		if(failed != NULL)
+		{
+			cb_failed[ctx] = NULL;
+			
+			if(!CB_queue_recover(ctx, failed))
+			{
+				SVGA_CB_ctx_restart(ctx);
+				continue;
+			}
+			
+			rcb = ((SVGACBHeader *)cb_recover_buf)-1;
+			if(CB_queue_is_queued(rcb))
+			{
+				resubmitted = TRUE;
+			}
+		}
+	}
+	
+	return resubmitted;
+}
+
+/**
+ * Same as CB_queue_recover_failed for code which doesn't hold cb_sem,
+ * CBs queued after failed one are processed after recovery.
+ **/
+static BOOL CB_queue_recover_pending()
+{
+	BOOL resubmitted;
+	
+	if(cb_failed[0] == NULL && cb_failed[1] == NULL)
+	{
+		return FALSE;
+	}
+	
+	Wait_Semaphore(cb_sem, 0);
+	resubmitted = CB_queue_recover_failed();
+	Signal_Semaphore(cb_sem);
+	
+	return resubmitted;
+}
+
+/**
+ * Owner is going to reuse CB which failed, rest of it has to be
+ * copied to recovery buffer before it is overwritten.
+ **/
+static void CB_queue_failed_check(SVGACBHeader *cb)
+{
+	if(cb->status > SVGA_CB_STATUS_COMPLETED)
+	{
+		CB_queue_check_inline(NULL);
+		CB_queue_recover_pending();
+	}
+}
+
+/**
+ * SVGA_CB_SYNC wait in SVGA_CMB_submit (cb_sem is held). When CB failed,
+ * wait for rest of it too, so owner gets status after all its commands.
+ **/
+static void CB_queue_wait_sync(SVGACBHeader *cb)
+{
+	SVGACBHeader *rcb;
+	
+	while(!CB_queue_check_inline(cb))
+	{
+		CB_queue_recover_failed();
+	}
+	
+	if(cb->status > SVGA_CB_STATUS_COMPLETED && cb_recover_buf != NULL)
+	{
+		rcb = ((SVGACBHeader *)cb_recover_buf)-1;
+		
+		while(!CB_queue_check_inline(rcb) || CB_queue_recover_failed())
+		{
+			SVGA_Sync();
+		}
+	}
+}
+
+void CB_recover_alloc()
+{
+	cb_recover_buf = SVGA_CMB_alloc();
+}
+
+/**
+ * GPU10: restart all contexts after error
+ *
+ **/
+void SVGA_CB_restart()
+{
+	hda_perf->cb_restarts++;
+	
+	SVGA_CB_stop();
+	
+	SVGA_CB_start();
+}
+
+/**
+ * GPU10: restart only one context, queue of other context is kept
+ *
+ **/
+static void SVGA_CB_ctx_restart(DWORD ctx)
+{
+	DWORD status;
+	
+	if(ctx == 0 || !cb_context1)
+	{
+		SVGA_CB_restart();
+		return;
+	}
+	
+	status = SVGA_CB_ctx_enable(1, 0);
+	SVGA_Sync();
+	CB_queue_erase(1);
+	cb_failed[1] = NULL;
+	dbg_printf(dbg_cb_stop_status, status);
+	
+	status = SVGA_CB_ctx_enable(1, 1);
+	dbg_printf(dbg_cb_start_status, status);
+	
+	if(status != SVGA_CB_STATUS_COMPLETED)
+	{
+		cb_context1 = FALSE;
+	}
+}
+
+void SVGA_CMB_wait_update()
+{
+	if(cb_support && cb_context0)
+	{
+		do
+		{
+			CB_queue_check_inline(NULL);
+			CB_queue_recover_pending();
+		} while(CB_queue_is_flags_set(0, CBQ_UPDATE) || CB_queue_is_flags_set(1, CBQ_UPDATE));
+	}
+	else
+	{
+		flags_fence_check(SVGA_CB_UPDATE);
+	}
+}
+
+/**
+ * Non blocking check if command buffer is still processed by HOST.
+ * FIFO submits are always completed after copy.
+ **/
+BOOL SVGA_CMB_busy(DWORD *cmb)
+{
+	SVGACBHeader *cb = ((SVGACBHeader *)cmb)-1;
+	
+	if(cb->status == SVGA_CB_STATUS_NONE)
+	{
+		if(CB_queue_check_inline(cb))
+		{
+			return FALSE;
+		}
+		
+		/* CB can wait behind failed one */
+		CB_queue_recover_pending();
+		return TRUE;
+	}
+	
+	CB_queue_failed_check(cb);
+	
+	return FALSE;
+}
+
+#endif /* __VXD_SVGA_CB_QUEUE_H__INCLUDED__ */
@@ -257,6 +257,9 @@ static char svga_cmd_tables[][64] = {
 #define CMD3D_MIN 1040
 #define CMD3D_MAX 1291
 
+/* tools: only command names */
+#ifndef SVGA_CMD_NAMES_ONLY
+
 static char dbg_bufinfo[] = "commands size: %d\n";
 static char dbg_cmd3d[] = "cmd3D: %s (%d)\n";
 static char dbg_cmd3d_trace[] = "cmd3D(%02ld): %s (%ld)\n";
@@ -396,3 +399,5 @@ void debug_draw(void *cmdbuf, DWORD cmd_size)
 		}
 	}
 }
+
+#endif /* SVGA_CMD_NAMES_ONLY */
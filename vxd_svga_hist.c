@@ -0,0 +1,132 @@
+/*****************************************************************************
+
+Copyright (c) 2024 Jaroslav Hensl <emulator@emulace.cz>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*****************************************************************************/
+
+
+/* 32 bit RING-0 code for SVGA-II latency histograms */
+#define SVGA
+
+#include "winhack.h"
+#include "vmm.h"
+#include "vxd.h"
+#include "vxd_lib.h"
+
+#include "svga_all.h"
+#include "3d_accel.h"
+#include "code32.h"
+#include "vxd_svga.h"
+#include "vxd_strings.h"
+
+/*
+ * globals
+ */
+BOOL hist_active = FALSE;
+
+/*
+ * locals
+ */
+static DWORD hist[SVGA_HIST_CNT][SVGA_HIST_STRIDE];
+static DWORD hist_tsc0[2];
+static DWORD hist_time0 = 0;
+static DWORD hist_tsc1[2];
+
+/**
+ * Start (histograms are cleared) or stop measurement
+ **/
+BOOL SVGA_hist_enable(BOOL enable)
+{
+	hist_active = FALSE;
+
+	if(enable)
+	{
+		memset(hist, 0, sizeof(hist));
+		Get_TSC(hist_tsc0);
+		hist_time0 = Get_System_Time();
+		hist_active = TRUE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Add duration from start (result of Get_TSC) to now to histogram.
+ * Zero start means that measurement was enabled during the measured
+ * operation, such sample is ignored.
+ **/
+void SVGA_hist_add(DWORD id, DWORD *start)
+{
+	DWORD now[2];
+	DWORD cycles;
+	DWORD bucket = 0;
+
+	if(!hist_active || (start[0] == 0 && start[1] == 0))
+	{
+		return;
+	}
+
+	Get_TSC(now);
+
+	cycles = now[0] - start[0];
+	if(now[1] - start[1] - (now[0] < start[0] ? 1 : 0) != 0)
+	{
+		cycles = 0xFFFFFFFFUL;
+	}
+
+	while((cycles >> bucket) > 1)
+	{
+		bucket++;
+	}
+
+	hist[id][bucket]++;
+	if(cycles > hist[id][SVGA_HIST_MAX])
+	{
+		hist[id][SVGA_HIST_MAX] = cycles;
+	}
+}
+
+DWORD SVGA_hist_query(DWORD index)
+{
+	if(index < SVGA_HIST_CLOCK)
+	{
+		return hist[index / SVGA_HIST_STRIDE][index % SVGA_HIST_STRIDE];
+	}
+
+	switch(index)
+	{
+		case SVGA_HIST_CLOCK_TSC0_LO:
+			return hist_tsc0[0];
+		case SVGA_HIST_CLOCK_TSC0_HI:
+			return hist_tsc0[1];
+		case SVGA_HIST_CLOCK_TIME0:
+			return hist_time0;
+		case SVGA_HIST_CLOCK_TSC1_LO:
+			Get_TSC(hist_tsc1);
+			return hist_tsc1[0];
+		case SVGA_HIST_CLOCK_TSC1_HI:
+			return hist_tsc1[1];
+		case SVGA_HIST_CLOCK_TIME1:
+			return Get_System_Time();
+	}
+
+	return ~0x0;
+}
@@ -0,0 +1,99 @@
+#ifndef __VXD_SVGA_MASK_H__INCLUDED__
+#define __VXD_SVGA_MASK_H__INCLUDED__
+
+/*
+ * Conversion of cursor masks to format accepted by SVGA_CMD_DEFINE_CURSOR
+ * and SVGA_CMD_DEFINE_ALPHA_CURSOR. No driver state is touched here, so
+ * the same code is compiled by host benchmark in tools/test.
+ */
+
+static DWORD conv_mask16to32(void *in, void *out, int w, int h)
+{
+	WORD *in16 = in;
+	DWORD *out32 = out;
+	int x, y;
+	
+	for(y = 0; y < h; y++)
+	{
+		for(x = 0; x < w; x++)
+		{
+			DWORD px16 = *in16;
+			DWORD px32 = ((px16 & 0xF800) << 8) | ((px16 & 0x07E0) << 5) | ((px16 & 0x001F) << 3);
+			*out32 = px32;
+			
+			in16++;
+			out32++;
+		}
+	}
+	
+	return w * h * sizeof(DWORD);
+}
+
+static DWORD conv_mask1to32(void *in, void *out, int w, int h, int pitch)
+{
+	BYTE *in1 = in;
+	DWORD *out32 = out;
+	int x, y;
+	
+	for(y = 0; y < h; y++)
+	{
+		for(x = 0; x < w; x++)
+		{
+			DWORD b = ((in1[x >> 3] << (x & 0x7)) >> 7) & 0x1;
+			out32[x] = b ? 0x00FFFFFF : 0;
+		}
+		
+		out32 += w;
+		in1 += pitch;
+	}
+	
+	return w * h * sizeof(DWORD);
+}
+
+static DWORD copy_mask1(void *in, void *out, int w, int h, int pitch)
+{
+	BYTE *in8 = in;
+	BYTE *out8 = out;
+	DWORD bw = pitch;
+	DWORD pad = bw % 4;
+	int y;
+	
+	for(y = 0; y < h; y++)
+	{
+		memcpy(out8, in8, bw);
+		in8 += bw;
+		out8 += bw + pad;
+	}
+	
+	return (bw + pad) * h;
+}
+
+static DWORD conv_mask(void *in, DWORD in_bpp, void *out, DWORD *out_bpp, int w, int h, int pitch, BOOL force32bpp)
+{
+	switch(in_bpp)
+	{
+		case 1:
+			if(force32bpp)
+			{
+				*out_bpp = 32;
+				return conv_mask1to32(in, out, w, h, pitch);
+			}
+			*out_bpp = 1;
+			return copy_mask1(in, out, w, h, pitch);
+		case 16:
+			*out_bpp = 32;
+			return conv_mask16to32(in, out, w, h);
+		case 32:
+		{
+			DWORD s = w * h * sizeof(DWORD);
+			
+			*out_bpp = 32;
+			memcpy(out, in, s);
+			return s;
+		}
+	}
+	
+	return 0;
+}
+
+#endif /* __VXD_SVGA_MASK_H__INCLUDED__ */
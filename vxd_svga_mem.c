@@ -46,40 +46,7 @@ THE SOFTWARE.
 #define PTONPAGE (P_SIZE/sizeof(DWORD))
 #define MDONPAGE (P_SIZE/sizeof(SVGAGuestMemDescriptor))
 
-#define SPARE_REGIONS_LARGE 2
-#define SPARE_REGION_LARGE_SIZE (32*1024*1024)
-
-#define SPARE_REGIONS_MEDIUM 16
-#define SPARE_REGION_MEDIUM_SIZE (1024*1024)
-
-#define SPARE_REGIONS_SMALL 128
-//#define SPARE_REGION_SMALL_SIZE 4096
-
-#define SPARE_REGIONS_CNT (SPARE_REGIONS_LARGE+SPARE_REGIONS_MEDIUM+SPARE_REGIONS_SMALL)
-
-#define CACHE_THRESHOLD 128
-
-/**
- * types
- */
-
-typedef struct spare_region
-{
-	BOOL      used;
-	uint32    missed;
-	SVGA_region_info_t region;
-} spare_region_t;
-
-typedef struct svga_cache_state
-{
-	int free_index_min;
-	int free_index_max;
-	int cnt_large;
-	int cnt_medium;
-	int cnt_small;
-	spare_region_t spare_region[SPARE_REGIONS_CNT];
-} svga_cache_state_t;
-
+#include "vxd_svga_cache.h"
 
 /* object table for GPU10 */
 static SVGA_OT_info_entry_t otable_setup[SVGA_OTABLE_DX_MAX] = {
@@ -93,10 +60,6 @@ static SVGA_OT_info_entry_t otable_setup[SVGA_OTABLE_DX_MAX] = {
 
 static SVGA_OT_info_entry_t *otable = NULL;
 
-static svga_cache_state_t cache_state = {0, 0};
-
-static BOOL cache_enabled = FALSE;
-
 #define PHY_CACHE_SIZE (8192 + 1024)
 static DWORD phycache[PHY_CACHE_SIZE];
 static DWORD phycache_starta = 0;
@@ -403,217 +366,12 @@ void SVGA_OTable_unload()
 	submit_cmdbuf(cmd_offset, SVGA_CB_SYNC, 0);
 }
 
-/**
- * Delete item from cache
- **/
-static void cache_delete(int index)
-{
-	if(cache_state.spare_region[index].used != FALSE)
-	{
-		SVGA_region_info_t *rinfo = &cache_state.spare_region[index].region;
-		BYTE *free_ptr = (BYTE*)rinfo->address;
-		uint32 region_size = rinfo->size;;
-		
-		if(rinfo->region_address != NULL)
-		{
-//			dbg_printf(dbg_pagefree, rinfo->region_address);
-			_PageFree((PVOID)rinfo->region_address, 0);
-		}
-		else
-		{
-			free_ptr -= P_SIZE;
-		}
-			
-		if(rinfo->mob_address != NULL)
-		{
-//			dbg_printf(dbg_pagefree, rinfo->mob_address);
-			_PageFree((PVOID)rinfo->mob_address, 0);
-		}
-		else
-		{
-//			dbg_printf(dbg_pagefree, free_ptr);
-			_PageFree((PVOID)free_ptr, 0);
-		}
-			
-		cache_state.spare_region[index].used = FALSE;
-		
-		if((index+1) == cache_state.free_index_max)
-		{
-			cache_state.free_index_max--;
-		}
-		
-		if(index < cache_state.free_index_min)
-		{
-			cache_state.free_index_min = index;
-		}
-		
-		if(region_size >= SPARE_REGION_LARGE_SIZE)
-			cache_state.cnt_large--;
-		else if(region_size >= SPARE_REGION_MEDIUM_SIZE)
-			cache_state.cnt_medium--;
-		else
-			cache_state.cnt_small--;
-	}
-}
-
-/**
- * Insert region to cache
- **/
-static BOOL cache_insert(SVGA_region_info_t *region)
-{
-	int i;
-	BOOL rc = FALSE;
-	
-	if(!cache_enabled)
-	{
-		return FALSE;
-	}
-	
-	if(region->size >= SPARE_REGION_LARGE_SIZE)
-	{
-		if(cache_state.cnt_large > SPARE_REGIONS_LARGE) return FALSE;
-	}
-	else if(region->size >= SPARE_REGION_MEDIUM_SIZE)
-	{
-		if(cache_state.cnt_medium > SPARE_REGIONS_MEDIUM) return FALSE;
-	}
-	else
-	{
-		if(cache_state.cnt_small > SPARE_REGIONS_SMALL) return FALSE;
-	}
-	
-	for(i = cache_state.free_index_min; i < SPARE_REGIONS_CNT; i++)
-	{		
-		if(!cache_state.spare_region[i].used)
-		{
-			memcpy(&cache_state.spare_region[i].region, region, sizeof(SVGA_region_info_t));
-			cache_state.spare_region[i].used = TRUE;
-			cache_state.spare_region[i].missed = 0;
-			rc = TRUE;
-			break;
-		}
-	}
-	
-	for(; i < SPARE_REGIONS_CNT; i++)
-	{
-		if(!cache_state.spare_region[i].used)
-		{
-			cache_state.free_index_min = i;
-			break;
-		}
-	}
-	
-	if(i == SPARE_REGIONS_CNT)
-	{
-		cache_state.free_index_min = i;
-		cache_state.free_index_max = SPARE_REGIONS_CNT;
-	}
-	else if(i >= cache_state.free_index_max)
-	{
-		cache_state.free_index_max = i+1;
-	}
-
-	if(rc)
-	{
-		if(region->size >= SPARE_REGION_LARGE_SIZE)
-			cache_state.cnt_large++;
-		else if(region->size >= SPARE_REGION_MEDIUM_SIZE)
-			cache_state.cnt_medium++;
-		else
-			cache_state.cnt_small++;
-
-//		dbg_printf(dbg_cache_insert, region->region_id, region->size);
-	}
-
-	return rc;
-}
-
-/**
- * Use region from cache
- **/
-static BOOL cache_use(SVGA_region_info_t *region)
-{
-	int i;
-	BOOL rc = FALSE;
-	
-	if(!cache_enabled)
-	{
-		return FALSE;
-	}
-	
-//	dbg_printf(dbg_cache_search, region->size);
-	
-	for(i = cache_state.free_index_max-1; i >= 0; i--)
-	{
-		if(cache_state.spare_region[i].used != FALSE)
-		{
-			if(cache_state.spare_region[i].region.size == region->size)
-			{
-				SVGA_region_info_t *ptr = &cache_state.spare_region[i].region;
-				
-				region->address        = ptr->address;
-				region->region_address = ptr->region_address;
-				region->region_ppn     = ptr->region_ppn;
-				region->mob_address    = ptr->mob_address;
-				region->mob_ppn        = ptr->mob_ppn;
-				region->mob_pt_depth   = ptr->mob_pt_depth;
-				
-				cache_state.spare_region[i].used = FALSE;
-				rc = TRUE;
-				break;
-			}
-			else
-			{
-				if(++cache_state.spare_region[i].missed >= CACHE_THRESHOLD)
-				{
-//					dbg_printf(dbg_cache_delete, cache_state.spare_region[i].region.size);
-					cache_delete(i);
-				}
-			}
-		}
-	}
-	
-	if(rc)
-	{
-		if((i+1) == cache_state.free_index_max)
-		{
-			cache_state.free_index_max--;
-		}
-		
-		if(i < cache_state.free_index_min)
-		{
-			cache_state.free_index_min = i;
-		}
-		
-		if(region->size >= SPARE_REGION_LARGE_SIZE)
-			cache_state.cnt_large--;
-		else if(region->size >= SPARE_REGION_MEDIUM_SIZE)
-			cache_state.cnt_medium--;
-		else
-			cache_state.cnt_small--;
-	
-		dbg_printf(dbg_cache_used, region->region_id, region->size);
-	}
-		
-	return rc;
-}
-
-void cache_init()
-{
-	memset(&cache_state, 0, sizeof(svga_cache_state_t));
-}
-
-void cache_enable(BOOL enabled)
-{
-	cache_enabled = enabled;
-}
-
 static DWORD pa_flags = PAGEFIXED;
 static DWORD pa_align = 0x00000000;
 
 void set_fragmantation_limit()
 {
-	DWORD max_len = SVGA_ReadReg(SVGA_REG_GMR_MAX_DESCRIPTOR_LENGTH);
+	DWORD max_len = SVGA_ReadRegCached(SVGA_REG_GMR_MAX_DESCRIPTOR_LENGTH);
 	
 	if(max_len < 1024)
 	{
@@ -689,8 +447,12 @@ BOOL SVGA_region_create(SVGA_region_info_t *rinfo)
 	ULONG size_total = 0;
 	
 	DWORD pt_pages = PT_count(new_size);
+	DWORD hist_tsc[2] = {0, 0};
 
+	HIST_BEGIN(hist_tsc);
 	Wait_Semaphore(mem_sem, 0);
+	
+	SVGA_TRACE(SVGA_TRACE_REGION_CREATE_BEGIN, rinfo->region_id, rinfo->size, 0);
 
 #ifdef GMR_SYSTEM
 		pa_vm = 0;
@@ -701,8 +463,10 @@ BOOL SVGA_region_create(SVGA_region_info_t *rinfo)
 	
 	if(cache_use(rinfo))
 	{
+		hda_perf->cache_hits++;
 		goto spare_region_used;
 	}
+	hda_perf->cache_misses++;
 	
 	//dbg_printf(dbg_pages, rinfo->size, nPages, P_SIZE);
 #ifdef GMR_CONTIG
@@ -755,6 +519,7 @@ BOOL SVGA_region_create(SVGA_region_info_t *rinfo)
 
 		if(!maddr)
 		{
+			SVGA_TRACE(SVGA_TRACE_REGION_CREATE_END, rinfo->region_id, FALSE, 0);
 			Signal_Semaphore(mem_sem);
 			return FALSE;
 		}
@@ -872,7 +637,7 @@ BOOL SVGA_region_create(SVGA_region_info_t *rinfo)
 	
 	if(!rinfo->mobonly)
 	{
-		if(rinfo->region_id < SVGA_ReadReg(SVGA_REG_GMR_MAX_IDS))
+		if(rinfo->region_id < SVGA_ReadRegCached(SVGA_REG_GMR_MAX_IDS))
 		{
 			/* register GMR */
 			SVGA_WriteReg(SVGA_REG_GMR_ID, rinfo->region_id);
@@ -921,6 +686,10 @@ BOOL SVGA_region_create(SVGA_region_info_t *rinfo)
 	
 	svga_db->stat_regions_usage += rinfo->size;
 	
+	SVGA_capture_region(SVGA_CAPTURE_REGION_CREATE, rinfo);
+	SVGA_TRACE(SVGA_TRACE_REGION_CREATE_END, rinfo->region_id, TRUE, 0);
+	HIST_END(SVGA_HIST_REGION_CREATE, hist_tsc);
+	
 	//dbg_printf("More memory usage: %ld (+%ld)\n", svga_db->stat_regions_usage, rinfo->size);
 	Signal_Semaphore(mem_sem);
 	
@@ -935,9 +704,14 @@ void SVGA_region_free(SVGA_region_info_t *rinfo)
 {
 	BOOL saved_in_cache;
 	BYTE *free_ptr = (BYTE*)rinfo->address;
+	DWORD hist_tsc[2] = {0, 0};
 
+	HIST_BEGIN(hist_tsc);
 	Wait_Semaphore(mem_sem, 0);
 
+	SVGA_capture_region(SVGA_CAPTURE_REGION_FREE, rinfo);
+	SVGA_TRACE(SVGA_TRACE_REGION_FREE_BEGIN, rinfo->region_id, rinfo->size, 0);
+
 	svga_db->stat_regions_usage -= rinfo->size;
 	//dbg_printf("Less memory usage: %ld (-%ld)\n", svga_db->stat_regions_usage, rinfo->size);
 
@@ -996,6 +770,8 @@ void SVGA_region_free(SVGA_region_info_t *rinfo)
 	}
 		
 	//dbg_printf(dbg_pagefree_end, rinfo->region_id, rinfo->size, saved_in_cache);
+	SVGA_TRACE(SVGA_TRACE_REGION_FREE_END, rinfo->region_id, 0, 0);
+	HIST_END(SVGA_HIST_REGION_FREE, hist_tsc);
 	Signal_Semaphore(mem_sem);
 	
 	rinfo->address        = NULL;
@@ -52,102 +52,208 @@ static BOOL hw_cursor_visible = FALSE;
 static DWORD mouse_last_x = 0;
 static DWORD mouse_last_y = 0;
 
-static DWORD conv_mask16to32(void *in, void *out, int w, int h)
+/* last cursor definitions, hit costs one command without conversion */
+#define HW_CURSOR_CACHE_SIZE 4
+
+typedef struct _hw_cursor_cache_t
 {
-	WORD *in16 = in;
-	DWORD *out32 = out;
+	DWORD hash;
+	DWORD hash2;
+	DWORD last_use;
+	DWORD mem_size;
+	DWORD cmd_size;
+	BOOL  valid;
+	void *cmd;
+} hw_cursor_cache_t;
+
+static hw_cursor_cache_t hw_cursor_cache[HW_CURSOR_CACHE_SIZE];
+static DWORD hw_cursor_cache_tick = 0;
+static int hw_cursor_defined = -1;
+
+#include "vxd_svga_mask.h"
+
+/**
+ * Build premultiplied ARGB image from AND mask and color (16/32 bpp)
+ * XOR mask. If XOR mask contains alpha channel it is used, otherwise
+ * alpha is taken from AND mask. Return FALSE if cursor contains inverted
+ * pixels (AND=1, XOR!=0), these cannot be expressed by alpha cursor.
+ **/
+static BOOL conv_alpha(CURSORSHAPE *cur, DWORD *out)
+{
+	BYTE *and_line = (BYTE*)(cur+1);
+	BYTE *xor_mask = and_line + cur->cbWidth * cur->cy;
+	BOOL has_alpha = FALSE;
+	DWORD px, a, and_bit;
 	int x, y;
 	
-	for(y = 0; y < h; y++)
+	if(cur->BitsPixel == 32)
 	{
-		for(x = 0; x < w; x++)
+		DWORD *ptr = (DWORD*)xor_mask;
+		DWORD s = cur->cx * cur->cy;
+		while(s--)
 		{
-			DWORD px16 = *in16;
-			DWORD px32 = ((px16 & 0xF800) << 8) | ((px16 & 0x07E0) << 5) | ((px16 & 0x001F) << 3);
-			*out32 = px32;
-			
-			in16++;
-			out32++;
+			if((*ptr) & 0xFF000000UL)
+			{
+				has_alpha = TRUE;
+				break;
+			}
+			ptr++;
 		}
 	}
 	
-	return w * h * sizeof(DWORD);
-}
-
-static DWORD conv_mask1to32(void *in, void *out, int w, int h, int pitch)
-{
-	BYTE *in1 = in;
-	DWORD *out32 = out;
-	int x, y;
-	
-	for(y = 0; y < h; y++)
+	for(y = 0; y < cur->cy; y++)
 	{
-		for(x = 0; x < w; x++)
+		for(x = 0; x < cur->cx; x++)
 		{
-			DWORD b = ((in1[x >> 3] << (x & 0x7)) >> 7) & 0x1;
-			out32[x] = b ? 0x00FFFFFF : 0;
+			and_bit = ((and_line[x >> 3] << (x & 0x7)) >> 7) & 0x1;
+			
+			if(cur->BitsPixel == 32)
+			{
+				px = ((DWORD*)xor_mask)[x];
+			}
+			else
+			{
+				DWORD px16 = ((WORD*)xor_mask)[x];
+				px = ((px16 & 0xF800) << 8) | ((px16 & 0x07E0) << 5) | ((px16 & 0x001F) << 3);
+			}
+			
+			if(has_alpha)
+			{
+				a = px >> 24;
+				if(and_bit && a == 0 && (px & 0x00FFFFFFUL) != 0)
+				{
+					return FALSE;
+				}
+				
+				out[x] = (a << 24) |
+					((((px >> 16) & 0xFF) * a / 255) << 16) |
+					((((px >>  8) & 0xFF) * a / 255) <<  8) |
+					 (((px        & 0xFF) * a / 255));
+			}
+			else if(and_bit)
+			{
+				if((px & 0x00FFFFFFUL) != 0)
+				{
+					return FALSE;
+				}
+				out[x] = 0;
+			}
+			else
+			{
+				out[x] = 0xFF000000UL | px;
+			}
 		}
 		
-		out32 += w;
-		in1 += pitch;
+		and_line += cur->cbWidth;
+		xor_mask += cur->cx * (cur->BitsPixel/8);
+		out += cur->cx;
 	}
 	
-	return w * h * sizeof(DWORD);
+	return TRUE;
 }
 
-static DWORD copy_mask1(void *in, void *out, int w, int h, int pitch)
+/**
+ * Build alpha cursor command for color cursor to cmdbuf, return size
+ * of command or 0, if cursor isn't suitable for alpha cursor.
+ **/
+static DWORD build_alpha_cursor(CURSORSHAPE *cur)
 {
-	BYTE *in8 = in;
-	BYTE *out8 = out;
-	DWORD bw = pitch;
-	DWORD pad = bw % 4;
-	int y;
+	SVGAFifoCmdDefineAlphaCursor *cursor;
+	DWORD cmdoff = 0;
+	
+	if((gSVGA.capabilities & SVGA_CAP_ALPHA_CURSOR) == 0)
+	{
+		return 0;
+	}
+	
+	if(cur->BitsPixel != 16 && cur->BitsPixel != 32)
+	{
+		return 0;
+	}
+	
+	cursor = SVGA_cmd_ptr(cmdbuf, &cmdoff, SVGA_CMD_DEFINE_ALPHA_CURSOR, sizeof(SVGAFifoCmdDefineAlphaCursor));
 	
-	for(y = 0; y < h; y++)
+	if(!conv_alpha(cur, (DWORD*)(((BYTE*)cmdbuf)+cmdoff)))
 	{
-		memcpy(out8, in8, bw);
-		in8 += bw;
-		out8 += bw + pad;
+		return 0;
 	}
+	cmdoff += cur->cx * cur->cy * sizeof(DWORD);
+	
+	cursor->id = 0;
+	cursor->hotspotX = cur->xHotSpot;
+	cursor->hotspotY = cur->yHotSpot;
+	cursor->width    = cur->cx;
+	cursor->height   = cur->cy;
+	
+	return cmdoff;
+}
+
+/**
+ * Build AND/XOR mask cursor command to cmdbuf, return size of command.
+ **/
+static DWORD build_mask_cursor(CURSORSHAPE *cur)
+{
+	SVGAFifoCmdDefineCursor *cursor;
+	DWORD cmdoff = 0;
+	DWORD mask_size;
+	
+  cursor = SVGA_cmd_ptr(cmdbuf, &cmdoff, SVGA_CMD_DEFINE_CURSOR, sizeof(SVGAFifoCmdDefineCursor));
+
+  mask_size = conv_mask(cur+1, 1, ((BYTE*)cmdbuf)+cmdoff, &(cursor->andMaskDepth),
+  	cur->cx, cur->cy, cur->cbWidth, FALSE);
+  cmdoff += mask_size;
+  mask_size = conv_mask(((BYTE*)(cur+1)) + cur->cbWidth * cur->cy, cur->BitsPixel, ((BYTE*)cmdbuf)+cmdoff, &(cursor->xorMaskDepth),
+  	cur->cx, cur->cy, cur->cbWidth, TRUE);
+
+  cmdoff += mask_size;
 	
-	return (bw + pad) * h;
+	cursor->id = 0;
+	cursor->hotspotX = cur->xHotSpot;
+	cursor->hotspotY = cur->yHotSpot;
+	cursor->width    = cur->cx;
+	cursor->height   = cur->cy;
+	
+	return cmdoff;
 }
 
-static DWORD conv_mask(void *in, DWORD in_bpp, void *out, DWORD *out_bpp, int w, int h, int pitch, BOOL force32bpp)
+/**
+ * Search cursor definition in cache, if not found, return least recently
+ * used entry (with valid = FALSE).
+ **/
+static int hw_cursor_cache_get(DWORD hash, DWORD hash2)
 {
-	switch(in_bpp)
+	int i;
+	int lru = 0;
+	
+	for(i = 0; i < HW_CURSOR_CACHE_SIZE; i++)
 	{
-		case 1:
-			if(force32bpp)
-			{
-				*out_bpp = 32;
-				return conv_mask1to32(in, out, w, h, pitch);
-			}
-			*out_bpp = 1;
-			return copy_mask1(in, out, w, h, pitch);
-		case 16:
-			*out_bpp = 32;
-			return conv_mask16to32(in, out, w, h);
-		case 32:
+		hw_cursor_cache_t *c = &hw_cursor_cache[i];
+		if(c->valid && c->hash == hash && c->hash2 == hash2)
 		{
-			DWORD s = w * h * sizeof(DWORD);
-			
-			*out_bpp = 32;
-			memcpy(out, in, s);
-			return s;
+			c->last_use = ++hw_cursor_cache_tick;
+			return i;
+		}
+		
+		if(c->last_use < hw_cursor_cache[lru].last_use)
+		{
+			lru = i;
 		}
 	}
 	
-	return 0;
+	hw_cursor_cache[lru].valid = FALSE;
+	hw_cursor_cache[lru].last_use = ++hw_cursor_cache_tick;
+	return lru;
 }
 
-BOOL SVGA_mouse_load()
+BOOL SVGA_mouse_load(DWORD hash, DWORD hash2)
 {
-	SVGAFifoCmdDefineCursor *cursor;
 	DWORD cmdoff = 0;
-	DWORD mask_size;
+	DWORD flags = 0;
 	void *mb;
 	CURSORSHAPE *cur;
+	int defined = hw_cursor_defined;
+	int ci;
+	hw_cursor_cache_t *c;
 	
 	SVGA_mouse_hide(TRUE);
 	
@@ -163,27 +269,57 @@ BOOL SVGA_mouse_load()
 	{
 		return FALSE;
 	}
+	
+	ci = hw_cursor_cache_get(hash, hash2);
+	c = &hw_cursor_cache[ci];
+	
+	if(c->valid)
+	{
+		if(ci == defined)
+		{
+			/* same cursor is already defined on host */
+			goto loaded;
+		}
 		
+		/* command is self contained, no need to wait for completion */
+		wait_for_cmdbuf();
+		memcpy(cmdbuf, c->cmd, c->cmd_size);
+		submit_cmdbuf(c->cmd_size, SVGA_CB_2D, 0);
+		goto loaded;
+	}
+	
 	wait_for_cmdbuf();
 	
-  cursor = SVGA_cmd_ptr(cmdbuf, &cmdoff, SVGA_CMD_DEFINE_CURSOR, sizeof(SVGAFifoCmdDefineCursor));
-
-  mask_size = conv_mask(cur+1, 1, ((BYTE*)cmdbuf)+cmdoff, &(cursor->andMaskDepth),
-  	cur->cx, cur->cy, cur->cbWidth, FALSE);
-  cmdoff += mask_size;
-  mask_size = conv_mask(((BYTE*)(cur+1)) + cur->cbWidth * cur->cy, cur->BitsPixel, ((BYTE*)cmdbuf)+cmdoff, &(cursor->xorMaskDepth),
-  	cur->cx, cur->cy, cur->cbWidth, TRUE);
-
-  cmdoff += mask_size;
+	cmdoff = build_alpha_cursor(cur);
+	if(cmdoff == 0)
+	{
+		cmdoff = build_mask_cursor(cur);
+		flags = SVGA_CB_SYNC;
+	}
 	
-	cursor->id = 0;
-	cursor->hotspotX = cur->xHotSpot;
-	cursor->hotspotY = cur->yHotSpot;
-	cursor->width    = cur->cx;
-	cursor->height   = cur->cx;
+	/* save command for next use */
+	if(cmdoff > c->mem_size)
+	{
+		if(c->cmd)
+			_PageFree(c->cmd, 0);
+		
+		c->cmd = (void*)_PageAllocate(RoundToPages(cmdoff), PG_SYS, 0, 0, 0x0, 0x100000, NULL, PAGEFIXED);
+		c->mem_size = (c->cmd != NULL) ? RoundToPages(cmdoff) * P_SIZE : 0;
+	}
+	
+	if(c->cmd != NULL)
+	{
+		memcpy(c->cmd, cmdbuf, cmdoff);
+		c->cmd_size  = cmdoff;
+		c->hash      = hash;
+		c->hash2     = hash2;
+		c->valid     = TRUE;
+	}
 	
-	submit_cmdbuf(cmdoff, SVGA_CB_SYNC, 0);
+	submit_cmdbuf(cmdoff, flags | SVGA_CB_2D, 0);
 	
+	loaded:
+	hw_cursor_defined = c->valid ? ci : -1;
 	hw_cursor_valid = TRUE;
 	hw_cursor_visible = TRUE;
 	SVGA_mouse_move(mouse_last_x, mouse_last_y);
@@ -252,6 +388,7 @@ void SVGA_mouse_hide(BOOL invalidate)
 	if(invalidate)
 	{
 		hw_cursor_valid = FALSE;
+		hw_cursor_defined = -1;
 	}
 	
 	hw_cursor_visible = FALSE;
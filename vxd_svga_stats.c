@@ -0,0 +1,304 @@
+/*****************************************************************************
+
+Copyright (c) 2024 Jaroslav Hensl <emulator@emulace.cz>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*****************************************************************************/
+
+
+/* 32 bit RING-0 code for SVGA-II command statistics */
+#define SVGA
+
+#include "winhack.h"
+#include "vmm.h"
+#include "vxd.h"
+#include "vxd_lib.h"
+
+#include "svga_all.h"
+#include "3d_accel.h"
+#include "code32.h"
+#include "vxd_svga.h"
+#include "vxd_strings.h"
+
+/*
+ * consts
+ */
+#define STATS_FENCES 32
+
+/*
+ * globals
+ */
+BOOL stats_active = FALSE;
+
+extern SVGA_DB_t *svga_db;
+
+/*
+ * locals
+ */
+static SVGA_stats_t *stats = NULL;
+
+/* last command before fence for recent submits */
+static DWORD stats_fences[STATS_FENCES];
+static DWORD stats_fences_op[STATS_FENCES];
+static DWORD stats_fences_pos = 0;
+static DWORD stats_last_op = 0;
+
+/* VWIN32 process handle of stats->procs[i] */
+static DWORD stats_procs_handle[SVGA_STATS_PROCS];
+
+/**
+ * Allocate statistics page, long_wait_ms is limit for long fence wait
+ **/
+void SVGA_stats_alloc(DWORD long_wait_ms)
+{
+	stats = (SVGA_stats_t*)_PageAllocate(RoundToPages(sizeof(SVGA_stats_t)), PG_VM, ThisVM, 0, 0x0, 0x100000, NULL, PAGEFIXED);
+	if(stats)
+	{
+		memset(stats, 0, sizeof(SVGA_stats_t));
+		stats->long_wait_limit = long_wait_ms;
+	}
+}
+
+SVGA_stats_t *SVGA_stats_setup()
+{
+	return stats;
+}
+
+/**
+ * Start (counters are cleared) or stop statistics.
+ * Return FALSE when page isn't allocated.
+ **/
+BOOL SVGA_stats_enable(BOOL enable)
+{
+	if(stats == NULL)
+	{
+		return FALSE;
+	}
+
+	stats_active = FALSE;
+
+	if(enable)
+	{
+		DWORD limit = stats->long_wait_limit;
+
+		memset(stats, 0, sizeof(SVGA_stats_t));
+		memset(stats_fences, 0, sizeof(stats_fences));
+		memset(stats_procs_handle, 0, sizeof(stats_procs_handle));
+		stats_last_op = 0;
+
+		stats->long_wait_limit = limit;
+		stats->start_time = Get_System_Time();
+		stats->enabled = 1;
+		stats_active = TRUE;
+	}
+	else
+	{
+		stats->enabled = 0;
+	}
+
+	return TRUE;
+}
+
+static DWORD stats_op_index(DWORD id)
+{
+	if(id < SVGA_STATS_2D_CNT)
+	{
+		return id;
+	}
+
+	if(id >= SVGA_STATS_3D_BASE && id < SVGA_STATS_3D_BASE + SVGA_STATS_3D_CNT)
+	{
+		return SVGA_STATS_2D_CNT + (id - SVGA_STATS_3D_BASE);
+	}
+
+	return 0;
+}
+
+/**
+ * Owner of buffer: VXD (process = 0) or submitting process. Process is
+ * identified by DX context owner from SVGA_DB, when process hasn't
+ * submitted any DX context buffer yet, by its VWIN32 process handle.
+ **/
+static SVGA_stats_proc_t *stats_proc(DWORD process, DWORD flags, DWORD dx)
+{
+	DWORD pid;
+	BOOL dx_pid = FALSE;
+	DWORD i;
+
+	if(process == 0)
+	{
+		pid = SVGA_STATS_PID_DRIVER;
+	}
+	else
+	{
+		pid = process;
+		if((flags & SVGA_CB_FLAG_DX_CONTEXT) && dx < svga_db->contexts_cnt)
+		{
+			pid = svga_db->contexts[dx].pid;
+			dx_pid = TRUE;
+		}
+		
+		for(i = 0; i < SVGA_STATS_PROCS && stats->procs[i].submits != 0; i++)
+		{
+			if(stats_procs_handle[i] == process)
+			{
+				if(dx_pid)
+				{
+					/* replace handle by Win32 PID */
+					stats->procs[i].pid = pid;
+				}
+				return &stats->procs[i];
+			}
+		}
+	}
+
+	for(i = 0; i < SVGA_STATS_PROCS; i++)
+	{
+		if(stats->procs[i].submits == 0)
+		{
+			stats->procs[i].pid = pid;
+			stats_procs_handle[i] = process;
+			return &stats->procs[i];
+		}
+
+		if(stats->procs[i].pid == pid)
+		{
+			return &stats->procs[i];
+		}
+	}
+
+	return NULL;
+}
+
+/**
+ * Count commands in buffer, called from SVGA_CMB_submit before fence is
+ * appended. Process is VWIN32 handle of submitting process, 0 for VXD
+ * buffers.
+ **/
+void SVGA_stats_cmb(DWORD *cmb, DWORD cmb_size, DWORD flags, DWORD dx, DWORD process)
+{
+	SVGA_stats_proc_t *proc;
+	DWORD pos = 0;
+	DWORD cmds = 0;
+
+	if(!stats_active)
+	{
+		return;
+	}
+
+	stats->submits++;
+	stats->bytes += cmb_size;
+	if(flags & SVGA_CB_FORCE_FIFO)
+	{
+		stats->submits_fifo++;
+	}
+
+	while(pos < cmb_size)
+	{
+		DWORD *cmd = cmb + pos/sizeof(DWORD);
+		DWORD size = CB_cmd_size(cmd, cmb_size - pos);
+		DWORD op;
+
+		if(size == 0 || size > cmb_size - pos)
+		{
+			/* unknown command, rest of buffer cannot be parsed */
+			stats->ops[0].cnt++;
+			stats->ops[0].bytes += cmb_size - pos;
+			stats_last_op = 0;
+			cmds++;
+			break;
+		}
+
+		op = stats_op_index(cmd[0]);
+		stats->ops[op].cnt++;
+		stats->ops[op].bytes += size;
+		stats_last_op = op;
+
+		cmds++;
+		pos += size;
+	}
+
+	proc = stats_proc(process, flags, dx);
+	if(proc)
+	{
+		proc->submits++;
+		proc->cmds += cmds;
+		proc->bytes += cmb_size;
+	}
+	else
+	{
+		stats->procs_lost++;
+	}
+}
+
+/**
+ * Remember last command of buffer with this fence
+ **/
+void SVGA_stats_fence(DWORD fence)
+{
+	if(!stats_active || fence == 0)
+	{
+		return;
+	}
+
+	stats_fences[stats_fences_pos]    = fence;
+	stats_fences_op[stats_fences_pos] = stats_last_op;
+	stats_fences_pos = (stats_fences_pos + 1) % STATS_FENCES;
+}
+
+/**
+ * Account fence wait, long wait is counted to command before the fence
+ * or before the nearest older known fence.
+ **/
+void SVGA_stats_wait(DWORD fence, DWORD ms)
+{
+	DWORD op = 0;
+	DWORD best = 0;
+	DWORD i;
+
+	if(!stats_active)
+	{
+		return;
+	}
+
+	stats->fence_waits++;
+	stats->fence_wait_ms += ms;
+
+	if(ms < stats->long_wait_limit)
+	{
+		return;
+	}
+
+	stats->long_waits++;
+	stats->long_wait_ms += ms;
+
+	for(i = 0; i < STATS_FENCES; i++)
+	{
+		DWORD f = stats_fences[i];
+		if(f != 0 && (long)(fence - f) >= 0 && (best == 0 || (long)(f - best) > 0))
+		{
+			best = f;
+			op = stats_fences_op[i];
+		}
+	}
+
+	stats->ops[op].long_waits++;
+	stats->ops[op].long_wait_ms += ms;
+}
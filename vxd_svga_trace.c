@@ -0,0 +1,200 @@
+/*****************************************************************************
+
+Copyright (c) 2024 Jaroslav Hensl <emulator@emulace.cz>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+
+*****************************************************************************/
+
+
+/* 32 bit RING-0 code for SVGA-II event trace */
+#define SVGA
+
+#include "winhack.h"
+#include "vmm.h"
+#include "vxd.h"
+#include "vxd_lib.h"
+
+#include "svga_all.h"
+#include "3d_accel.h"
+#include "code32.h"
+#include "vxd_svga.h"
+#include "vxd_strings.h"
+
+/*
+ * consts
+ */
+#define TRACE_MIN_KB 16
+
+/*
+ * globals
+ */
+BOOL trace_active = FALSE;
+
+/*
+ * locals
+ */
+static SVGA_trace_ev_t *trace_ring = NULL;
+static DWORD trace_cnt  = 0; /* power of 2 */
+static volatile DWORD trace_pos = 0;
+static DWORD trace_tsc0[2];
+static DWORD trace_time0 = 0;
+
+/* return old value of *ptr and increment it by one */
+DWORD trace_reserve(volatile DWORD *ptr);
+#pragma aux trace_reserve = \
+	".486"                  \
+	"mov eax, 1"            \
+	"lock xadd [ecx], eax"  \
+	parm [ecx] value [eax];
+
+/**
+ * Allocate trace ring, size_kb = 0 means trace is not available
+ **/
+void SVGA_trace_alloc(DWORD size_kb)
+{
+	DWORD cnt = 1;
+
+	if(size_kb == 0)
+	{
+		return;
+	}
+
+	if(size_kb < TRACE_MIN_KB)
+	{
+		size_kb = TRACE_MIN_KB;
+	}
+
+	while(cnt * 2 * sizeof(SVGA_trace_ev_t) <= size_kb * 1024)
+	{
+		cnt *= 2;
+	}
+
+	trace_ring = (SVGA_trace_ev_t*)_PageAllocate(RoundToPages(cnt * sizeof(SVGA_trace_ev_t)), PG_SYS, 0, 0, 0x0, 0x100000, NULL, PAGEFIXED);
+	if(trace_ring)
+	{
+		memset(trace_ring, 0, cnt * sizeof(SVGA_trace_ev_t));
+		trace_cnt = cnt;
+	}
+
+	dbg_printf("SVGA trace alloc: %ld events\n", trace_cnt);
+}
+
+/**
+ * Start (ring is cleared) or stop trace.
+ * Return FALSE when trace isn't configured.
+ **/
+BOOL SVGA_trace_enable(BOOL enable)
+{
+	if(trace_ring == NULL)
+	{
+		return FALSE;
+	}
+
+	trace_active = FALSE;
+
+	if(enable)
+	{
+		memset(trace_ring, 0, trace_cnt * sizeof(SVGA_trace_ev_t));
+		trace_pos = 0;
+		Get_TSC(trace_tsc0);
+		trace_time0 = Get_System_Time();
+		trace_active = TRUE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * Write event, use SVGA_TRACE macro to skip call when trace is off
+ **/
+void SVGA_trace(DWORD id, DWORD a0, DWORD a1, DWORD a2)
+{
+	DWORD seq = trace_reserve(&trace_pos);
+	SVGA_trace_ev_t *ev = &trace_ring[seq & (trace_cnt - 1)];
+
+	ev->seq    = 0;
+	ev->id     = id;
+	Get_TSC(&ev->tsc_lo);
+	ev->arg[0] = a0;
+	ev->arg[1] = a1;
+	ev->arg[2] = a2;
+	ev->arg[3] = 0;
+	ev->seq    = seq + 1;
+}
+
+/**
+ * Copy snapshot header and events to buf (from oldest event which fits),
+ * events which were overwritten during copy are skipped.
+ * Return number of bytes written.
+ **/
+DWORD SVGA_trace_snapshot(void *buf, DWORD size)
+{
+	SVGA_trace_snapshot_t *snap = (SVGA_trace_snapshot_t*)buf;
+	SVGA_trace_ev_t *out;
+	DWORD end, start, fit, i;
+
+	if(size < sizeof(SVGA_trace_snapshot_t) || snap == NULL)
+	{
+		return 0;
+	}
+
+	memset(snap, 0, sizeof(SVGA_trace_snapshot_t));
+	snap->magic   = SVGA_TRACE_MAGIC;
+	snap->version = SVGA_TRACE_VERSION;
+
+	if(trace_ring == NULL)
+	{
+		return sizeof(SVGA_trace_snapshot_t);
+	}
+
+	snap->tsc0_lo = trace_tsc0[0];
+	snap->tsc0_hi = trace_tsc0[1];
+	snap->time0   = trace_time0;
+	Get_TSC(&snap->tsc1_lo);
+	snap->time1   = Get_System_Time();
+
+	end   = trace_pos;
+	start = (end > trace_cnt) ? end - trace_cnt : 0;
+	fit   = (size - sizeof(SVGA_trace_snapshot_t)) / sizeof(SVGA_trace_ev_t);
+	if(end - start > fit)
+	{
+		start = end - fit;
+	}
+	snap->lost = start;
+
+	out = (SVGA_trace_ev_t*)(snap+1);
+	for(i = start; i != end; i++)
+	{
+		SVGA_trace_ev_t *ev = &trace_ring[i & (trace_cnt - 1)];
+
+		memcpy(out, ev, sizeof(SVGA_trace_ev_t));
+		if(out->seq == i + 1 && ev->seq == i + 1)
+		{
+			out++;
+			snap->count++;
+		}
+		else
+		{
+			snap->lost++;
+		}
+	}
+
+	return sizeof(SVGA_trace_snapshot_t) + snap->count * sizeof(SVGA_trace_ev_t);
+}
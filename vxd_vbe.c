@@ -40,6 +40,7 @@ THE SOFTWARE.
 #define IO_OUT16
 #define IO_IN8
 #define IO_OUT8
+#define IO_OUTS8
 #ifndef QEMU
 # define IO_IN32
 #endif
@@ -69,6 +70,13 @@ static char vbe_vxd_name[] = "boxvmini.vxd";
 
 #include "vxd_strings.h"
 
+/* shadow of DAC, palette is never read back from HW */
+static DWORD vbe_palette[256];
+static BOOL  vbe_palette_valid = FALSE;
+
+/* RGB triplets for rep outsb */
+static BYTE vbe_dac_buf[256*3];
+
 static inline void wridx(unsigned short idx_reg, unsigned char idx, unsigned char data)
 {
 	outpw(idx_reg, (unsigned short)idx | (((unsigned short)data) << 8));
@@ -150,6 +158,11 @@ BOOL VBE_init_hw()
  	
  	hda->vram_size = vram_size;
 	hda->vram_pm32 = (void*)_MapPhysToLinear(vram_phy, vram_size, 0);
+	
+	FBHDA_modes_update(
+		FBHDA_BPP_BIT(8) | FBHDA_BPP_BIT(16) | FBHDA_BPP_BIT(24) | FBHDA_BPP_BIT(32),
+		RES_MAX_X, RES_MAX_Y, 0
+	);
 	hda->flags    |= FB_SUPPORT_FLIPING;
 	
 	memcpy(hda->vxdname, vbe_vxd_name, sizeof(vbe_vxd_name));
@@ -178,35 +191,12 @@ static DWORD VBE_pitch(DWORD width, DWORD bpp)
 
 BOOL VBE_validmode(DWORD w, DWORD h, DWORD bpp)
 {
-	switch(bpp)
-	{
-		case 8:
-		case 16:
-		case 24:
-		case 32:
-			break;
-		default:
-			return FALSE;
-	}
-	
-	if(w <= RES_MAX_X)
-	{
-		if(h <= RES_MAX_Y)
-		{
-			DWORD size = VBE_pitch(w, bpp) * h;
-			if(size < hda->vram_size)
-			{
-				return TRUE;
-			}
-		}
-	}
-	
-	return FALSE;
+	return FBHDA_mode_valid(w, h, bpp);
 }
 
 void VBE_clear()
 {
-	memset(hda->vram_pm32, 0, hda->pitch*hda->height);
+	memset_vram(hda->vram_pm32, 0, hda->pitch*hda->height);
 }
 
 BOOL VBE_setmode(DWORD w, DWORD h, DWORD bpp)
@@ -268,6 +258,9 @@ BOOL VBE_setmode(DWORD w, DWORD h, DWORD bpp)
 	hda->stride = h * hda->pitch;
 	hda->surface = 0;
 	
+	/* mode set could reset DAC, read it again on next palette call */
+	vbe_palette_valid = FALSE;
+	
 	VBE_clear();
 
 	mouse_invalidate();
@@ -275,24 +268,74 @@ BOOL VBE_setmode(DWORD w, DWORD h, DWORD bpp)
 	return TRUE;
 }
 
+/* read whole DAC to shadow palette, only once */
+static void vbe_palette_load()
+{
+	DWORD i, r, g, b;
+	
+	outp(VGA_DAC_R_INDEX, 0);
+	for(i = 0; i < 256; i++)
+	{
+		r = inp(VGA_DAC_DATA);
+		g = inp(VGA_DAC_DATA);
+		b = inp(VGA_DAC_DATA);
+		vbe_palette[i] = (r << 16) | (g << 8) | b;
+	}
+	
+	vbe_palette_valid = TRUE;
+}
+
 void  FBHDA_palette_set(unsigned char index, DWORD rgb)
 {
-	outp(VGA_DAC_W_INDEX, index);    /* Set starting index. */
-	outp(VGA_DAC_DATA,   (rgb >> 16) & 0xFF);
-	outp(VGA_DAC_DATA,   (rgb >>  8) & 0xFF);
-	outp(VGA_DAC_DATA,    rgb        & 0xFF);
+	FBHDA_palette_set_range(index, 1, &rgb);
 }
 
-DWORD FBHDA_palette_get(unsigned char index)
+/**
+ * Program consecutive DAC entries by one index write and one string
+ * output of RGB triplets (DAC index increments after each triplet).
+ **/
+void FBHDA_palette_set_range(DWORD start, DWORD count, DWORD *rgb)
 {
-	DWORD r, g, b;
+	DWORD i;
+	BYTE *ptr = vbe_dac_buf;
 	
-	outp(VGA_DAC_W_INDEX, index);
-	r = inp(VGA_DAC_DATA);
-	g = inp(VGA_DAC_DATA);
-	b = inp(VGA_DAC_DATA);
+	if(start >= 256)
+	{
+		return;
+	}
 	
-	return (r << 16) | (g << 8) | b;
+	if(start + count > 256)
+	{
+		count = 256 - start;
+	}
+	
+	if(!vbe_palette_valid)
+	{
+		vbe_palette_load();
+	}
+	
+	for(i = 0; i < count; i++)
+	{
+		vbe_palette[start + i] = rgb[i] & 0x00FFFFFFUL;
+		*(ptr++) = (rgb[i] >> 16) & 0xFF;
+		*(ptr++) = (rgb[i] >>  8) & 0xFF;
+		*(ptr++) =  rgb[i]        & 0xFF;
+	}
+	
+	outp(VGA_DAC_W_INDEX, start);
+	outsb(VGA_DAC_DATA, vbe_dac_buf, count*3);
+	
+	hda->palette_update++;
+}
+
+DWORD FBHDA_palette_get(unsigned char index)
+{
+	if(!vbe_palette_valid)
+	{
+		vbe_palette_load();
+	}
+	
+	return vbe_palette[index];
 }
 
 BOOL FBHDA_swap(DWORD offset)
@@ -317,6 +360,12 @@ BOOL FBHDA_swap(DWORD offset)
 	return TRUE;
 }
 
+/* flip is done by changing of display offset, nothing is queued */
+DWORD FBHDA_flip_status(DWORD offset)
+{
+	return 0;
+}
+
 void FBHDA_access_begin(DWORD flags)
 {
 	//Wait_Semaphore(hda_sem, 0);
@@ -149,7 +149,7 @@ VDDPROC(REGISTER_DISPLAY_DRIVER, register_display_driver)
 	
 	if(hda_pm16 == 0)
 	{
-		hda_pm16 = map_pm16(state->Client_EBX, (DWORD)hda, sizeof(FBHDA_t));
+		hda_pm16 = map_pm16(state->Client_EBX, (DWORD)hda, FBHDA_SHARED_SIZE);
 	}
 	
 	if(mouse_pm16 == 0)